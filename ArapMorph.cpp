@@ -0,0 +1,464 @@
+#include "ArapMorph.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <unordered_map>
+#include <Eigen/Dense>
+#include <Eigen/SparseCholesky>
+
+#include "mesh.h"
+#include "Utils.h"
+
+// islands are packed into systems of at least this many vertices, small ones share a factor
+static const int BATCH_VERTICES = 1 << 15;
+// obtuse corners have negative cotangents, the weights are kept above this
+static const float MIN_WEIGHT = 1e-3f;
+// pull towards the linear morph, relative to the mean edge weight; it fixes each island's
+// translation and is otherwise too weak to show
+static const double PULL = 1e-4;
+
+struct ArapMorph::Batch
+{
+    std::vector<int> welded;    // global welded ids in local order
+    std::vector<int> faces;
+    std::vector<int> cornerOffsets, corners; // face corners of each local vertex
+    std::vector<glm::vec3> start, end;       // local vertices at t = 0 and t = 1
+    std::vector<int> vertices, local;        // mesh vertices and their local vertex
+    Eigen::SimplicialLDLT<Eigen::SparseMatrix<double>> solver;
+    std::vector<double> values; // x, y, z of each permuted vertex, right hand side and solution
+    double pull = 0.0;
+    glm::vec3 boxMin, boxMax; // of the last solution
+};
+
+struct WeldKey
+{
+    uint32_t bits[5];
+
+    bool operator==(const WeldKey& other) const { return memcmp(bits, other.bits, sizeof(bits)) == 0; }
+};
+
+struct WeldHash
+{
+    size_t operator()(const WeldKey& key) const
+    {
+        uint64_t h = 0;
+        for (int k = 0; k < 5; k++)
+            h = (h ^ key.bits[k]) * 0x9E3779B97F4A7C15ull;
+        return std::hash<uint64_t>()(h ^ h >> 32);
+    }
+};
+
+static WeldKey weldKey(const Mesh& mesh, int vertex)
+{
+    float values[5] = { mesh.pos[vertex].x, mesh.pos[vertex].y, mesh.pos[vertex].z, mesh.uv[vertex].x, mesh.uv[vertex].y };
+    WeldKey key;
+    for (int k = 0; k < 5; k++)
+    {
+        float v = values[k] + 0.0f; // -0 and 0 weld
+        memcpy(&key.bits[k], &v, sizeof(v));
+    }
+    return key;
+}
+
+static int findRoot(std::vector<int>& parent, int i)
+{
+    while (parent[i] != i)
+    {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+static Eigen::Vector3f toEigen(const glm::vec3& v) { return Eigen::Vector3f(v.x, v.y, v.z); }
+static glm::vec3 toGlm(const Eigen::Vector3f& v) { return glm::vec3(v.x(), v.y(), v.z()); }
+
+// L D L^T x = b in place on x, y, z interleaved and already permuted. Eigen's solve() walks
+// the factor once per column, this walks it once for all three, which is the bulk of a frame
+static void solveFactored(const Eigen::SimplicialLDLT<Eigen::SparseMatrix<double>>& solver, double* values)
+{
+    const Eigen::SparseMatrix<double>& factor = solver.matrixL().nestedExpression();
+    const Eigen::VectorXd& diagonal = solver.vectorD();
+    const int* outer = factor.outerIndexPtr();
+    const int* inner = factor.innerIndexPtr();
+    const double* entries = factor.valuePtr();
+    int n = (int)factor.cols();
+    for (int j = 0; j < n; j++)
+    {
+        double x = values[j * 3], y = values[j * 3 + 1], z = values[j * 3 + 2];
+        for (int k = outer[j]; k < outer[j + 1]; k++)
+        {
+            if (inner[k] <= j)
+                continue; // unit diagonal
+            double* value = &values[inner[k] * 3];
+            value[0] -= entries[k] * x;
+            value[1] -= entries[k] * y;
+            value[2] -= entries[k] * z;
+        }
+    }
+    for (int j = 0; j < n; j++)
+    {
+        double d = 1.0 / diagonal[j];
+        values[j * 3] *= d;
+        values[j * 3 + 1] *= d;
+        values[j * 3 + 2] *= d;
+    }
+    for (int j = n - 1; j >= 0; j--)
+    {
+        double x = values[j * 3], y = values[j * 3 + 1], z = values[j * 3 + 2];
+        for (int k = outer[j]; k < outer[j + 1]; k++)
+        {
+            if (inner[k] <= j)
+                continue;
+            const double* value = &values[inner[k] * 3];
+            x -= entries[k] * value[0];
+            y -= entries[k] * value[1];
+            z -= entries[k] * value[2];
+        }
+        values[j * 3] = x;
+        values[j * 3 + 1] = y;
+        values[j * 3 + 2] = z;
+    }
+}
+
+ArapMorph::ArapMorph(const Mesh& mesh)
+    : m_Mesh(mesh), m_BuildMs(0.0), m_SolveMs(0.0)
+{
+    m_Bounds.center = glm::vec3(0.0f);
+    m_Bounds.radius = -1.0f;
+}
+
+ArapMorph::~ArapMorph()
+{
+}
+
+size_t ArapMorph::getWeldedCount() const
+{
+    size_t count = 0;
+    for (const std::unique_ptr<Batch>& batch : m_Batches)
+        count += batch->welded.size();
+    return count;
+}
+
+void ArapMorph::build()
+{
+    auto start = std::chrono::steady_clock::now();
+    const Mesh& mesh = m_Mesh;
+    int vertexCount = (int)mesh.pos.size();
+    int faceCount = (int)mesh.f.size();
+    m_Batches.clear();
+
+    // weld the vertices used by faces, a vertex on a seam stays split
+    m_Weld.assign(vertexCount, -1);
+    m_VertexFace.assign(vertexCount, -1);
+    std::unordered_map<WeldKey, int, WeldHash> welds;
+    welds.reserve(vertexCount);
+    std::vector<int> weldVertex; // a mesh vertex of each welded one
+    for (int i = 0; i < faceCount; i++)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            int v = mesh.f[i].vi[k];
+            if (m_VertexFace[v] >= 0)
+                continue;
+            m_VertexFace[v] = i;
+            auto inserted = welds.emplace(weldKey(mesh, v), (int)weldVertex.size());
+            if (inserted.second)
+                weldVertex.push_back(v);
+            m_Weld[v] = inserted.first->second;
+        }
+    }
+    std::unordered_map<WeldKey, int, WeldHash>().swap(welds);
+    m_Normals.clear();
+    if (mesh.normal.size() == mesh.pos.size())
+    {
+        m_Normals.resize(vertexCount);
+        for (int v = 0; v < vertexCount; v++)
+        {
+            glm::vec3 n = mesh.normal[v] * mesh.bestRotation;
+            float length = glm::length(n);
+            m_Normals[v] = length > 1e-6f ? n / length : glm::vec3(0.0f, 0.0f, 1.0f);
+        }
+    }
+    int weldedCount = (int)weldVertex.size();
+
+    // per face: rotation and stretch from the polar decomposition of the map between the
+    // end triangles, and the cotangent weighted start edges at each corner
+    m_Rotations.assign((size_t)faceCount * 4, 0.0f);
+    m_Stretches.assign((size_t)faceCount * 6, 0.0f);
+    m_Corners.assign((size_t)faceCount * 3, glm::vec3(0.0f));
+    std::vector<float> weights((size_t)faceCount * 3, 0.0f); // of the edge across each corner
+    const int CHUNK = 1 << 14;
+    Utils::ParallelFor((faceCount + CHUNK - 1) / CHUNK, [&](int chunk)
+    {
+        int end = std::min(faceCount, (chunk + 1) * CHUNK);
+        for (int i = chunk * CHUNK; i < end; i++)
+        {
+            const Face& face = mesh.f[i];
+            glm::vec3 p[3], q[3];
+            for (int k = 0; k < 3; k++)
+            {
+                p[k] = mesh.morphStart(face.vi[k]);
+                q[k] = mesh.morphEnd(face.vi[k]);
+            }
+            float* rotation = &m_Rotations[(size_t)i * 4];
+            float* stretch = &m_Stretches[(size_t)i * 6];
+            rotation[0] = 1.0f;
+            stretch[0] = stretch[1] = stretch[2] = 1.0f;
+            glm::vec3 normal = glm::cross(p[1] - p[0], p[2] - p[0]);
+            float area = glm::length(normal);
+            if (!(area > 1e-20f) || !std::isfinite(area))
+                continue; // no shape to keep, the vertices follow their neighbors
+
+            // the normal goes to the end normal, scaled so that areas match
+            glm::vec3 endNormal = glm::cross(q[1] - q[0], q[2] - q[0]);
+            float endArea = glm::length(endNormal);
+            Eigen::Matrix3d from, to;
+            from.col(0) = toEigen(p[1] - p[0]).cast<double>();
+            from.col(1) = toEigen(p[2] - p[0]).cast<double>();
+            from.col(2) = toEigen(normal / area).cast<double>();
+            to.col(0) = toEigen(q[1] - q[0]).cast<double>();
+            to.col(1) = toEigen(q[2] - q[0]).cast<double>();
+            to.col(2) = Eigen::Vector3d::Zero();
+            if (endArea > 0.0f)
+                to.col(2) = toEigen(endNormal / std::sqrt(endArea * area)).cast<double>();
+            Eigen::Matrix3d map = to * from.inverse();
+            Eigen::JacobiSVD<Eigen::Matrix3d> svd(map, Eigen::ComputeFullU | Eigen::ComputeFullV);
+            Eigen::Matrix3d u = svd.matrixU(), v = svd.matrixV();
+            Eigen::Vector3d sigma = svd.singularValues();
+            if ((u * v.transpose()).determinant() < 0.0)
+            {
+                // a flipped uv face: the reflection stays in the stretch
+                u.col(2) = -u.col(2);
+                sigma(2) = -sigma(2);
+            }
+            Eigen::AngleAxisd turn((u * v.transpose()).eval());
+            Eigen::Matrix3d s = v * sigma.asDiagonal() * v.transpose();
+            rotation[0] = (float)turn.axis().x();
+            rotation[1] = (float)turn.axis().y();
+            rotation[2] = (float)turn.axis().z();
+            rotation[3] = (float)turn.angle();
+            float values[6] = { (float)s(0, 0), (float)s(1, 1), (float)s(2, 2), (float)s(0, 1), (float)s(0, 2), (float)s(1, 2) };
+            std::copy(values, values + 6, stretch);
+
+            for (int k = 0; k < 3; k++)
+            {
+                glm::vec3 a = p[(k + 1) % 3] - p[k], b = p[(k + 2) % 3] - p[k];
+                weights[(size_t)i * 3 + k] = std::max(0.5f * glm::dot(a, b) / area, MIN_WEIGHT);
+            }
+            for (int k = 0; k < 3; k++)
+            {
+                int j = (k + 1) % 3, l = (k + 2) % 3;
+                // edge k-j is across corner l, edge k-l across corner j
+                m_Corners[(size_t)i * 3 + k] = weights[(size_t)i * 3 + l] * (p[k] - p[j]) + weights[(size_t)i * 3 + j] * (p[k] - p[l]);
+            }
+        }
+    });
+    double weightSum = 0.0;
+    size_t weightCount = 0;
+    for (float w : weights)
+    {
+        weightSum += w;
+        weightCount += w > 0.0f;
+    }
+    double pull = PULL * (weightCount ? weightSum / weightCount : 1.0);
+
+    // islands of welded vertices, packed into batches in order of first appearance
+    std::vector<int> parent(weldedCount);
+    for (int i = 0; i < weldedCount; i++)
+        parent[i] = i;
+    for (const Face& face : mesh.f)
+    {
+        for (int k = 1; k < 3; k++)
+        {
+            int a = findRoot(parent, m_Weld[face.vi[0]]), b = findRoot(parent, m_Weld[face.vi[k]]);
+            if (a != b)
+                parent[std::max(a, b)] = std::min(a, b);
+        }
+    }
+    std::vector<int> islandSize(weldedCount, 0);
+    for (int i = 0; i < weldedCount; i++)
+        islandSize[findRoot(parent, i)]++;
+    std::vector<int> rootBatch(weldedCount, -1), weldBatch(weldedCount), local(weldedCount);
+    int open = -1;
+    for (int i = 0; i < weldedCount; i++)
+    {
+        int root = findRoot(parent, i);
+        if (rootBatch[root] < 0)
+        {
+            if (open < 0 || (int)m_Batches[open]->welded.size() >= BATCH_VERTICES)
+            {
+                open = (int)m_Batches.size();
+                m_Batches.emplace_back(new Batch());
+            }
+            rootBatch[root] = open;
+            m_Batches[open]->welded.reserve(m_Batches[open]->welded.size() + islandSize[root]);
+        }
+        Batch& batch = *m_Batches[rootBatch[root]];
+        weldBatch[i] = rootBatch[root];
+        local[i] = (int)batch.welded.size();
+        batch.welded.push_back(i);
+    }
+    for (int i = 0; i < faceCount; i++)
+        m_Batches[weldBatch[m_Weld[mesh.f[i].vi[0]]]]->faces.push_back(i);
+    for (int v = 0; v < vertexCount; v++)
+    {
+        if (m_Weld[v] < 0)
+            continue;
+        Batch& batch = *m_Batches[weldBatch[m_Weld[v]]];
+        batch.vertices.push_back(v);
+        batch.local.push_back(local[m_Weld[v]]);
+    }
+
+    // Laplacians, one factor per batch
+    std::atomic<bool> failed(false);
+    Utils::ParallelFor((int)m_Batches.size(), [&](int b)
+    {
+        Batch& batch = *m_Batches[b];
+        int n = (int)batch.welded.size();
+        batch.pull = pull;
+        batch.start.resize(n);
+        batch.end.resize(n);
+        for (int l = 0; l < n; l++)
+        {
+            batch.start[l] = mesh.morphStart(weldVertex[batch.welded[l]]);
+            batch.end[l] = mesh.morphEnd(weldVertex[batch.welded[l]]);
+        }
+        std::vector<Eigen::Triplet<double>> triplets;
+        triplets.reserve(batch.faces.size() * 12 + n);
+        batch.cornerOffsets.assign(n + 1, 0);
+        for (int i : batch.faces)
+        {
+            const Face& face = mesh.f[i];
+            for (int k = 0; k < 3; k++)
+            {
+                batch.cornerOffsets[local[m_Weld[face.vi[k]]] + 1]++;
+                double w = weights[(size_t)i * 3 + k];
+                if (w <= 0.0)
+                    continue;
+                int a = local[m_Weld[face.vi[(k + 1) % 3]]], c = local[m_Weld[face.vi[(k + 2) % 3]]];
+                triplets.emplace_back(a, a, w);
+                triplets.emplace_back(c, c, w);
+                triplets.emplace_back(a, c, -w);
+                triplets.emplace_back(c, a, -w);
+            }
+        }
+        for (int l = 0; l < n; l++)
+        {
+            triplets.emplace_back(l, l, pull);
+            batch.cornerOffsets[l + 1] += batch.cornerOffsets[l];
+        }
+        batch.corners.resize(batch.cornerOffsets[n]);
+        std::vector<int> next(batch.cornerOffsets.begin(), batch.cornerOffsets.end() - 1);
+        for (int i : batch.faces)
+        {
+            for (int k = 0; k < 3; k++)
+                batch.corners[next[local[m_Weld[mesh.f[i].vi[k]]]]++] = i * 3 + k;
+        }
+
+        Eigen::SparseMatrix<double> laplacian(n, n);
+        laplacian.setFromTriplets(triplets.begin(), triplets.end());
+        batch.solver.compute(laplacian);
+        if (batch.solver.info() != Eigen::Success)
+            failed = true;
+        batch.values.resize((size_t)n * 3);
+    });
+    m_CornerTargets.resize((size_t)faceCount * 3);
+    if (failed)
+    {
+        std::cout << "ArapMorph: factorization failed" << std::endl;
+        m_Batches.clear();
+    }
+
+    m_BuildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void ArapMorph::interpolate(float t, glm::vec3* positions, glm::vec3* normals)
+{
+    auto start = std::chrono::steady_clock::now();
+    const Mesh& mesh = m_Mesh;
+    int faceCount = (int)mesh.f.size();
+
+    // each face's wish at t: the slerped rotation, a share of the angle about the same axis,
+    // times the mixed stretch
+    const int CHUNK = 1 << 14;
+    bool haveNormals = normals && !m_Normals.empty();
+    Utils::ParallelFor((faceCount + CHUNK - 1) / CHUNK, [&](int chunk)
+    {
+        int end = std::min(faceCount, (chunk + 1) * CHUNK);
+        for (int i = chunk * CHUNK; i < end; i++)
+        {
+            const float* r = &m_Rotations[(size_t)i * 4];
+            const float* s = &m_Stretches[(size_t)i * 6];
+            Eigen::Matrix3f rotation = Eigen::AngleAxisf(t * r[3], Eigen::Vector3f(r[0], r[1], r[2])).toRotationMatrix();
+            Eigen::Matrix3f stretch;
+            stretch << s[0], s[3], s[4],
+                       s[3], s[1], s[5],
+                       s[4], s[5], s[2];
+            Eigen::Matrix3f map = rotation * ((1.0f - t) * Eigen::Matrix3f::Identity() + t * stretch);
+            for (int k = 0; k < 3; k++)
+            {
+                m_CornerTargets[(size_t)i * 3 + k] = toGlm(map * toEigen(m_Corners[(size_t)i * 3 + k]));
+                int v = mesh.f[i].vi[k];
+                if (haveNormals && m_VertexFace[v] == i)
+                {
+                    normals[v] = toGlm(rotation * toEigen(m_Normals[v]));
+                }
+            }
+        }
+    });
+
+    // the vertices that fit them best, batch by batch
+    Utils::ParallelFor((int)m_Batches.size(), [&](int b)
+    {
+        Batch& batch = *m_Batches[b];
+        int n = (int)batch.welded.size();
+        const int* permutation = batch.solver.permutationP().indices().data();
+        for (int l = 0; l < n; l++)
+        {
+            Eigen::Vector3d sum = toEigen(glm::mix(batch.start[l], batch.end[l], t)).cast<double>() * batch.pull;
+            for (int c = batch.cornerOffsets[l]; c < batch.cornerOffsets[l + 1]; c++)
+                sum += toEigen(m_CornerTargets[batch.corners[c]]).cast<double>();
+            double* value = &batch.values[(size_t)permutation[l] * 3];
+            value[0] = sum.x();
+            value[1] = sum.y();
+            value[2] = sum.z();
+        }
+        solveFactored(batch.solver, batch.values.data());
+        batch.boxMin = glm::vec3(INFINITY);
+        batch.boxMax = glm::vec3(-INFINITY);
+        for (size_t i = 0; i < batch.vertices.size(); i++)
+        {
+            const double* value = &batch.values[(size_t)permutation[batch.local[i]] * 3];
+            glm::vec3 p((float)value[0], (float)value[1], (float)value[2]);
+            positions[batch.vertices[i]] = p;
+            batch.boxMin = glm::min(batch.boxMin, p);
+            batch.boxMax = glm::max(batch.boxMax, p);
+        }
+    });
+
+    if (normals && !haveNormals)
+        mesh.interpolateNormals(t, normals);
+    // vertices without faces take the linear path
+    glm::vec3 boxMin(INFINITY), boxMax(-INFINITY);
+    for (int v = 0; v < (int)mesh.pos.size(); v++)
+    {
+        if (m_Weld[v] >= 0)
+            continue;
+        positions[v] = glm::mix(mesh.morphStart(v), mesh.morphEnd(v), t);
+    }
+    for (const std::unique_ptr<Batch>& batch : m_Batches)
+    {
+        boxMin = glm::min(boxMin, batch->boxMin);
+        boxMax = glm::max(boxMax, batch->boxMax);
+    }
+    m_Bounds.center = (boxMin + boxMax) * 0.5f;
+    m_Bounds.radius = glm::length(boxMax - boxMin) * 0.5f;
+    m_SolveMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
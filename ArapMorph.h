@@ -0,0 +1,53 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "BoundingVolume.h"
+
+struct Mesh;
+
+// As rigid as possible interpolation between the morph end points (Alexa et al., As-Rigid-
+// As-Possible Shape Interpolation). Each face's map from its start to its end triangle is
+// split by polar decomposition into a rotation and a stretch; at t the face wants the
+// rotation slerped and the stretch mixed, and the vertices follow in the least squares sense
+// with cotangent weights. The Laplacian doesn't depend on t, so it is factored once at build
+// (Eigen's SimplicialLDLT) and every t is two triangle solves.
+// Vertices are welded by position and uv, so the layout comes apart at the seams and every
+// island keeps its centroid on the linear path. Islands are batched into separate systems,
+// which are solved in parallel. Both end points come out exactly like Mesh::interpolate.
+class ArapMorph
+{
+private:
+	struct Batch;
+
+	const Mesh& m_Mesh;
+	std::vector<int> m_Weld;         // welded vertex of each mesh vertex
+	std::vector<int> m_VertexFace;   // face whose rotation turns the vertex's normal, -1 if unused
+	std::vector<glm::vec3> m_Normals; // unit normals at t = 0, empty if the mesh has none
+	std::vector<float> m_Rotations;  // per face axis x, y, z and angle from start to end, 0..pi
+	std::vector<float> m_Stretches;  // per face symmetric stretch, xx, yy, zz, xy, xz, yz
+	std::vector<glm::vec3> m_Corners; // per face corner, weighted start edges to the two other corners
+	std::vector<std::unique_ptr<Batch>> m_Batches;
+	std::vector<glm::vec3> m_CornerTargets; // scratch, per face corner right hand side
+	BoundingSphere m_Bounds;
+	double m_BuildMs, m_SolveMs;
+
+public:
+	ArapMorph(const Mesh& mesh);
+	~ArapMorph();
+
+	// welds, decomposes and factors, call again after the mesh changes
+	void build();
+	// positions and normals (may be null) of all mesh vertices at t
+	void interpolate(float t, glm::vec3* positions, glm::vec3* normals);
+
+	bool isBuilt() const { return !m_Batches.empty(); }
+	size_t getBatchCount() const { return m_Batches.size(); }
+	size_t getWeldedCount() const;
+	// around the last interpolate()
+	const BoundingSphere& getBounds() const { return m_Bounds; }
+	double getBuildMs() const { return m_BuildMs; }
+	double getSolveMs() const { return m_SolveMs; }
+};
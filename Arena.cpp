@@ -0,0 +1,171 @@
+#include "Arena.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+static std::atomic<size_t> s_HeapCount(0);
+static std::atomic<size_t> s_HeapBytes(0);
+
+void* operator new(size_t size)
+{
+    s_HeapCount.fetch_add(1, std::memory_order_relaxed);
+    s_HeapBytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    std::free(p);
+}
+
+Arena::Arena(size_t blockSize)
+    : m_Current(0), m_Offset(0), m_BlockSize(blockSize)
+{
+}
+
+Arena::~Arena()
+{
+    for (Block& block : m_Blocks)
+        std::free(block.data);
+}
+
+void* Arena::Allocate(size_t bytes, size_t alignment)
+{
+    m_Stats.count++;
+    m_Stats.bytes += bytes;
+
+    while (m_Current < m_Blocks.size())
+    {
+        Block& block = m_Blocks[m_Current];
+        size_t start = (m_Offset + alignment - 1) & ~(alignment - 1);
+        if (start + bytes <= block.size)
+        {
+            m_Offset = start + bytes;
+            return block.data + start;
+        }
+        m_Current++;
+        m_Offset = 0;
+    }
+
+    // malloc is aligned for max_align_t, bigger alignments get padded inside the block
+    size_t size = std::max(m_BlockSize, bytes + alignment);
+    Block block = { static_cast<char*>(std::malloc(size)), size };
+    if (!block.data)
+        throw std::bad_alloc();
+    m_Blocks.push_back(block);
+    m_Current = m_Blocks.size() - 1;
+    size_t start = (reinterpret_cast<size_t>(block.data) + alignment - 1) & ~(alignment - 1);
+    start -= reinterpret_cast<size_t>(block.data);
+    m_Offset = start + bytes;
+    return block.data + start;
+}
+
+void Arena::Reset()
+{
+    if (m_Blocks.size() > 1)
+    {
+        size_t total = GetCapacity();
+        for (Block& block : m_Blocks)
+            std::free(block.data);
+        m_Blocks.clear();
+        Block block = { static_cast<char*>(std::malloc(total)), total };
+        if (block.data)
+            m_Blocks.push_back(block);
+    }
+    m_Current = 0;
+    m_Offset = 0;
+    m_Stats = AllocationStats();
+}
+
+size_t Arena::GetCapacity() const
+{
+    size_t total = 0;
+    for (const Block& block : m_Blocks)
+        total += block.size;
+    return total;
+}
+
+Arena& Arena::Frame()
+{
+    static Arena arena;
+    return arena;
+}
+
+Arena& Arena::Import()
+{
+    static Arena arena(16 << 20);
+    return arena;
+}
+
+static AllocationStats s_FrameStart;
+static AllocationStats s_LastFrameHeap;
+static AllocationStats s_LastFrameArena;
+static AllocationStats s_ImportStart;
+static AllocationStats s_LastImportHeap;
+static AllocationStats s_LastImportArena;
+
+static AllocationStats Delta(const AllocationStats& from, const AllocationStats& to)
+{
+    AllocationStats result;
+    result.count = to.count - from.count;
+    result.bytes = to.bytes - from.bytes;
+    return result;
+}
+
+AllocationStats MemoryStats::Heap()
+{
+    AllocationStats result;
+    result.count = s_HeapCount.load(std::memory_order_relaxed);
+    result.bytes = s_HeapBytes.load(std::memory_order_relaxed);
+    return result;
+}
+
+void MemoryStats::BeginFrame()
+{
+    AllocationStats now = Heap();
+    s_LastFrameHeap = Delta(s_FrameStart, now);
+    s_LastFrameArena = Arena::Frame().GetStats();
+    s_FrameStart = now;
+    Arena::Frame().Reset();
+}
+
+const AllocationStats& MemoryStats::LastFrameHeap()
+{
+    return s_LastFrameHeap;
+}
+
+const AllocationStats& MemoryStats::LastFrameArena()
+{
+    return s_LastFrameArena;
+}
+
+void MemoryStats::BeginImport()
+{
+    Arena::Import().Reset();
+    s_ImportStart = Heap();
+}
+
+void MemoryStats::EndImport()
+{
+    s_LastImportHeap = Delta(s_ImportStart, Heap());
+    s_LastImportArena = Arena::Import().GetStats();
+}
+
+const AllocationStats& MemoryStats::LastImportHeap()
+{
+    return s_LastImportHeap;
+}
+
+const AllocationStats& MemoryStats::LastImportArena()
+{
+    return s_LastImportArena;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <string>
+
+struct AllocationStats
+{
+	size_t count = 0;
+	size_t bytes = 0;
+};
+
+// Linear allocator: allocations bump a pointer, nothing is freed until Reset().
+// Not thread safe, every thread that needs scratch memory owns its own arena.
+class Arena
+{
+private:
+	struct Block
+	{
+		char* data;
+		size_t size;
+	};
+	std::vector<Block> m_Blocks;
+	size_t m_Current;
+	size_t m_Offset;
+	size_t m_BlockSize;
+	AllocationStats m_Stats; // since the last Reset()
+
+public:
+	Arena(size_t blockSize = 1 << 20);
+	~Arena();
+	Arena(const Arena&) = delete;
+	void operator=(const Arena&) = delete;
+
+	void* Allocate(size_t bytes, size_t alignment = alignof(std::max_align_t));
+	// keeps a single block as big as everything used so far, so a steady workload stops hitting the heap
+	void Reset();
+
+	const AllocationStats& GetStats() const { return m_Stats; }
+	size_t GetCapacity() const;
+
+	static Arena& Frame();  // reset by BeginFrame()
+	static Arena& Import(); // reset by BeginImport()
+};
+
+// std allocator over an Arena, deallocate is a no-op
+template <typename T>
+class ArenaAllocator
+{
+public:
+	using value_type = T;
+
+	Arena* arena;
+
+	ArenaAllocator(Arena& a) : arena(&a) {}
+	template <typename U>
+	ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+	T* allocate(size_t n) { return static_cast<T*>(arena->Allocate(n * sizeof(T), alignof(T))); }
+	void deallocate(T*, size_t) {}
+
+	template <typename U>
+	bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+	template <typename U>
+	bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+};
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+using ArenaString = std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>>;
+
+// Global heap counters (every operator new) split per frame and per import, plus the matching arena usage.
+class MemoryStats
+{
+public:
+	static AllocationStats Heap(); // totals since startup
+
+	static void BeginFrame();
+	static const AllocationStats& LastFrameHeap();
+	static const AllocationStats& LastFrameArena();
+
+	static void BeginImport();
+	static void EndImport();
+	static const AllocationStats& LastImportHeap();
+	static const AllocationStats& LastImportArena();
+};
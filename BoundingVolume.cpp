@@ -0,0 +1,257 @@
+#include "BoundingVolume.h"
+
+#include <Eigen/Dense>
+#include <algorithm>
+#include <limits>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define BV_SSE 1
+#endif
+
+static_assert(sizeof(glm::vec3) == 3 * sizeof(float), "points are read as packed floats");
+
+AABB computeAABB(const glm::vec3* points, size_t count)
+{
+    AABB result;
+    result.min = glm::vec3(std::numeric_limits<float>::max());
+    result.max = glm::vec3(-std::numeric_limits<float>::max());
+    size_t i = 0;
+
+#ifdef BV_SSE
+    // four points are 12 floats, three loads: x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3.
+    // Every lane keeps the same axis from block to block, so the lanes are only sorted out at the end.
+    if (count >= 4)
+    {
+        const float* data = &points[0].x;
+        __m128 min0 = _mm_loadu_ps(data), min1 = _mm_loadu_ps(data + 4), min2 = _mm_loadu_ps(data + 8);
+        __m128 max0 = min0, max1 = min1, max2 = min2;
+        for (i = 4; i + 4 <= count; i += 4)
+        {
+            const float* p = data + i * 3;
+            __m128 a = _mm_loadu_ps(p), b = _mm_loadu_ps(p + 4), c = _mm_loadu_ps(p + 8);
+            min0 = _mm_min_ps(min0, a); max0 = _mm_max_ps(max0, a);
+            min1 = _mm_min_ps(min1, b); max1 = _mm_max_ps(max1, b);
+            min2 = _mm_min_ps(min2, c); max2 = _mm_max_ps(max2, c);
+        }
+
+        float lo[12], hi[12];
+        _mm_storeu_ps(lo, min0); _mm_storeu_ps(lo + 4, min1); _mm_storeu_ps(lo + 8, min2);
+        _mm_storeu_ps(hi, max0); _mm_storeu_ps(hi + 4, max1); _mm_storeu_ps(hi + 8, max2);
+        for (int j = 0; j < 12; j++)
+        {
+            result.min[j % 3] = std::min(result.min[j % 3], lo[j]);
+            result.max[j % 3] = std::max(result.max[j % 3], hi[j]);
+        }
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        result.min = glm::min(result.min, points[i]);
+        result.max = glm::max(result.max, points[i]);
+    }
+    return result;
+}
+
+// Identity for plain arrays, an index lookup for subsets. Lets both versions share one implementation.
+struct DirectPoints
+{
+    const glm::vec3* points;
+    const glm::vec3& operator[](size_t i) const { return points[i]; }
+};
+
+struct IndexedPoints
+{
+    const glm::vec3* points;
+    const int* indices;
+    const glm::vec3& operator[](size_t i) const { return points[indices[i]]; }
+};
+
+static void grow(BoundingSphere& sphere, const glm::vec3& p)
+{
+    glm::vec3 d = p - sphere.center;
+    float distanceSquared = glm::dot(d, d);
+    if (distanceSquared <= sphere.radius * sphere.radius)
+        return;
+
+    // move the center towards p just enough that the old sphere stays inside
+    float distance = sqrt(distanceSquared);
+    float radius = (sphere.radius + distance) * 0.5f;
+    sphere.center += d * ((radius - sphere.radius) / distance);
+    sphere.radius = radius;
+}
+
+template <typename Points>
+// boxCenter: of the axis extremes it scans anyway
+static BoundingSphere ritterSphere(const Points& points, size_t count, glm::vec3& boxCenter)
+{
+    // the most separated pair of the six axis extremes seeds the sphere
+    size_t minIndex[3] = { 0, 0, 0 }, maxIndex[3] = { 0, 0, 0 };
+    for (size_t i = 1; i < count; i++)
+    {
+        const glm::vec3& p = points[i];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (p[axis] < points[minIndex[axis]][axis])
+                minIndex[axis] = i;
+            if (p[axis] > points[maxIndex[axis]][axis])
+                maxIndex[axis] = i;
+        }
+    }
+
+    int seedAxis = 0;
+    float seedDistance = -1.0f;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        glm::vec3 d = points[maxIndex[axis]] - points[minIndex[axis]];
+        if (glm::dot(d, d) > seedDistance)
+        {
+            seedDistance = glm::dot(d, d);
+            seedAxis = axis;
+        }
+    }
+
+    for (int axis = 0; axis < 3; axis++)
+        boxCenter[axis] = (points[minIndex[axis]][axis] + points[maxIndex[axis]][axis]) * 0.5f;
+
+    BoundingSphere sphere;
+    sphere.center = (points[minIndex[seedAxis]] + points[maxIndex[seedAxis]]) * 0.5f;
+    sphere.radius = sqrt(seedDistance) * 0.5f;
+    for (size_t i = 0; i < count; i++)
+        grow(sphere, points[i]);
+    return sphere;
+}
+
+template <typename Points>
+static BoundingSphere tightSphere(const Points& points, size_t count)
+{
+    BoundingSphere best;
+    best.center = glm::vec3(0.0f);
+    best.radius = 0.0f;
+    if (count == 0)
+        return best;
+
+    glm::vec3 boxCenter;
+    best = ritterSphere(points, count, boxCenter);
+
+    // Shrink and regrow, starting each pass at a different point so the growth order changes.
+    // Every pass visits all points, so whatever comes out still contains the whole set.
+    const int ITERATIONS = 4;
+    BoundingSphere sphere = best;
+    for (int k = 0; k < ITERATIONS; k++)
+    {
+        sphere.radius *= 0.95f;
+        size_t start = (count * (k * 2 + 1)) / (ITERATIONS * 2);
+        for (size_t i = start; i < count; i++)
+            grow(sphere, points[i]);
+        for (size_t i = 0; i < start; i++)
+            grow(sphere, points[i]);
+        if (sphere.radius < best.radius)
+            best = sphere;
+    }
+
+    // Float rounding in grow() can leave the farthest point a hair outside, the radius is measured
+    // again. Ritter can also end up a fifth too big on flat square sets, where the sphere around the
+    // box center is close to minimal, so that one is measured in the same pass and competes.
+    float maxDistanceSquared = 0.0f, boxDistanceSquared = 0.0f;
+    for (size_t i = 0; i < count; i++)
+    {
+        glm::vec3 d = points[i] - best.center;
+        maxDistanceSquared = std::max(maxDistanceSquared, glm::dot(d, d));
+        glm::vec3 b = points[i] - boxCenter;
+        boxDistanceSquared = std::max(boxDistanceSquared, glm::dot(b, b));
+    }
+    best.radius = sqrt(maxDistanceSquared);
+    if (boxDistanceSquared < maxDistanceSquared)
+    {
+        best.center = boxCenter;
+        best.radius = sqrt(boxDistanceSquared);
+    }
+    return best;
+}
+
+BoundingSphere computeBoundingSphere(const glm::vec3* points, size_t count)
+{
+    return tightSphere(DirectPoints{ points }, count);
+}
+
+BoundingSphere computeBoundingSphere(const glm::vec3* points, const int* indices, size_t indexCount)
+{
+    return tightSphere(IndexedPoints{ points, indices }, indexCount);
+}
+
+OBB computeOBB(const glm::vec3* points, size_t count)
+{
+    OBB result;
+    result.center = glm::vec3(0.0f);
+    result.axes = glm::mat3(1.0f);
+    result.halfExtents = glm::vec3(0.0f);
+    if (count == 0)
+        return result;
+
+    // doubles: the covariance of a few million float points loses too much otherwise
+    Eigen::Vector3d mean = Eigen::Vector3d::Zero();
+    for (size_t i = 0; i < count; i++)
+        mean += Eigen::Vector3d(points[i].x, points[i].y, points[i].z);
+    mean /= (double)count;
+
+    Eigen::Matrix3d covariance = Eigen::Matrix3d::Zero();
+    for (size_t i = 0; i < count; i++)
+    {
+        Eigen::Vector3d d = Eigen::Vector3d(points[i].x, points[i].y, points[i].z) - mean;
+        covariance += d * d.transpose();
+    }
+    covariance /= (double)count;
+
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver(covariance);
+    Eigen::Matrix3d axes = solver.eigenvectors();
+    for (int i = 0; i < 3; i++)
+        result.axes[i] = glm::vec3(axes(0, i), axes(1, i), axes(2, i));
+
+    glm::vec3 lo(std::numeric_limits<float>::max());
+    glm::vec3 hi(-std::numeric_limits<float>::max());
+    glm::mat3 toLocal = glm::transpose(result.axes);
+    for (size_t i = 0; i < count; i++)
+    {
+        glm::vec3 local = toLocal * points[i];
+        lo = glm::min(lo, local);
+        hi = glm::max(hi, local);
+    }
+    result.center = result.axes * ((lo + hi) * 0.5f);
+    result.halfExtents = (hi - lo) * 0.5f;
+
+    // The eigenvectors of a covariance with two equal eigenvalues (a square, a cube) can point
+    // anywhere in their plane, the box then comes out turned and bigger than the AABB. Compared
+    // by surface area so flat meshes, whose volume is zero either way, still get the better one.
+    AABB box = computeAABB(points, count);
+    glm::vec3 boxHalf = (box.max - box.min) * 0.5f;
+    auto area = [](const glm::vec3& h) { return h.x * h.y + h.y * h.z + h.z * h.x; };
+    if (area(boxHalf) < area(result.halfExtents))
+    {
+        result.center = (box.min + box.max) * 0.5f;
+        result.axes = glm::mat3(1.0f);
+        result.halfExtents = boxHalf;
+    }
+    return result;
+}
+
+void growToContain(AABB& box, const glm::vec3& p)
+{
+    box.min = glm::min(box.min, p);
+    box.max = glm::max(box.max, p);
+}
+
+void growToContain(BoundingSphere& sphere, const glm::vec3& p)
+{
+    grow(sphere, p);
+}
+
+void growToContain(OBB& box, const glm::vec3& p)
+{
+    glm::vec3 local = glm::transpose(box.axes) * (p - box.center);
+    glm::vec3 lo = glm::min(-box.halfExtents, local);
+    glm::vec3 hi = glm::max(box.halfExtents, local);
+    box.center += box.axes * ((lo + hi) * 0.5f);
+    box.halfExtents = (hi - lo) * 0.5f;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <cstddef>
+
+struct BoundingSphere
+{
+	glm::vec3 center;
+	float radius;
+};
+
+struct AABB
+{
+	glm::vec3 min;
+	glm::vec3 max;
+};
+
+// box along the principal axes of the points, axes are the columns
+struct OBB
+{
+	glm::vec3 center;
+	glm::mat3 axes;
+	glm::vec3 halfExtents;
+};
+
+// All of these take the unique vertex array, not face corners: shared vertices are
+// visited once. The indexed versions are for subsets (clusters) and visit every index.
+AABB computeAABB(const glm::vec3* points, size_t count);
+
+// Ritter's sphere refined by a few shrink and regrow passes (Ericson, Real-Time Collision
+// Detection 4.3.5), usually within a few percent of the minimal sphere, or the sphere around the
+// box center when that one is smaller. Always contains every point.
+BoundingSphere computeBoundingSphere(const glm::vec3* points, size_t count);
+BoundingSphere computeBoundingSphere(const glm::vec3* points, const int* indices, size_t indexCount);
+
+// PCA box: eigenvectors of the covariance matrix, then the extents along them; the AABB instead
+// when that one has the smaller surface
+OBB computeOBB(const glm::vec3* points, size_t count);
+
+// Enlarge a volume just enough to take in p, for edits of a few points. They never shrink,
+// the compute functions give the tight fit again.
+void growToContain(AABB& box, const glm::vec3& p);
+void growToContain(BoundingSphere& sphere, const glm::vec3& p);
+void growToContain(OBB& box, const glm::vec3& p); // keeps the axes
@@ -0,0 +1,243 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <vector>
+
+#include "Utils.h"
+
+// Top down binned SAH build shared by the hierarchies. Box needs a default constructor that
+// makes it empty, grow(const Box&), area(), the SAH weight of the box, and key(k), KEYS
+// coordinates to bin along (centroids) in groups of GROUP; per node only the widest key of
+// each group is binned and the cheapest split over those wins. Items are partitioned as
+// copies of their boxes, so every pass streams through memory instead of gathering by index.
+// The top levels are split on the calling thread until there are enough subtrees for every
+// core, the subtrees are then built in parallel. Children are allocated as a pair after their
+// parent, so a parent's index is always lower than its children's.
+template <typename Box, int KEYS, int GROUP = KEYS>
+class BvhBuilder
+{
+public:
+	static const int BINS = 16;
+	static const int MAX_LEAF = 16; // leaves only get bigger when the keys can't be split
+	// past this depth nodes are halved by count, whatever SAH thinks, so traversals can keep a
+	// fixed stack: 64 levels + log2 of any item count
+	static const int MAX_SAH_DEPTH = 64;
+
+	struct Node
+	{
+		Box box;
+		int first; // count == 0: children at first and first + 1, otherwise the leaf's slots
+		int count;
+	};
+
+	std::vector<Node> nodes; // root at 0
+	std::vector<int> items;  // item of each leaf slot
+
+private:
+	struct Task
+	{
+		int node, begin, end, depth;
+	};
+
+	struct Record
+	{
+		Box box;
+		int item;
+	};
+
+	std::vector<Record> m_Records;
+	int m_LeafSize;
+	std::atomic<int> m_NodeCount;
+	std::vector<Task>* m_Deferred; // subtrees up to m_Grain items go here while it is set
+	int m_Grain;
+
+	void child(int node, int begin, int end, int depth)
+	{
+		if (m_Deferred && end - begin <= m_Grain)
+			m_Deferred->push_back({ node, begin, end, depth });
+		else
+			split(node, begin, end, depth);
+	}
+
+	void split(int nodeIndex, int begin, int end, int depth)
+	{
+		Record* records = m_Records.data();
+		Box box;
+		float kmin[KEYS], kmax[KEYS];
+		for (int k = 0; k < KEYS; k++)
+		{
+			kmin[k] = INFINITY;
+			kmax[k] = -INFINITY;
+		}
+		for (int i = begin; i < end; i++)
+		{
+			box.grow(records[i].box);
+			for (int k = 0; k < KEYS; k++)
+			{
+				float key = records[i].box.key(k);
+				kmin[k] = std::min(kmin[k], key);
+				kmax[k] = std::max(kmax[k], key);
+			}
+		}
+		Node& node = nodes[nodeIndex];
+		node.box = box;
+		node.first = begin;
+		node.count = end - begin;
+		int count = end - begin;
+		if (count <= m_LeafSize)
+			return;
+
+		// split after bin bestBin of key bestKey; a leaf costs one test per item
+		int bestKey = -1, bestBin = 0;
+		float bestCost = (float)count;
+		float area = std::max(box.area(), 1e-30f);
+		for (int k = 0; k < KEYS && depth < MAX_SAH_DEPTH; k++)
+		{
+			float extent = kmax[k] - kmin[k];
+			if (!(extent > 0.0f))
+				continue;
+			int group = k - k % GROUP;
+			bool widest = true;
+			for (int j = group; j < group + GROUP; j++)
+				widest &= kmax[j] - kmin[j] < extent || (kmax[j] - kmin[j] == extent && j >= k);
+			if (!widest)
+				continue;
+			int binCount[BINS] = {};
+			Box binBox[BINS];
+			float scale = BINS / extent;
+			for (int i = begin; i < end; i++)
+			{
+				int b = std::min((int)((records[i].box.key(k) - kmin[k]) * scale), BINS - 1);
+				binCount[b]++;
+				binBox[b].grow(records[i].box);
+			}
+
+			// areas and counts left of each plane from a sweep, right of it from a second one
+			float leftArea[BINS - 1];
+			int leftCount[BINS - 1];
+			Box side;
+			int n = 0;
+			for (int b = 0; b < BINS - 1; b++)
+			{
+				n += binCount[b];
+				if (binCount[b])
+					side.grow(binBox[b]);
+				leftCount[b] = n;
+				leftArea[b] = n ? side.area() : 0.0f;
+			}
+			side = Box();
+			n = 0;
+			for (int b = BINS - 1; b > 0; b--)
+			{
+				n += binCount[b];
+				if (binCount[b])
+					side.grow(binBox[b]);
+				if (n == 0 || leftCount[b - 1] == 0)
+					continue;
+				float cost = 1.0f + (leftArea[b - 1] * leftCount[b - 1] + side.area() * n) / area;
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestKey = k;
+					bestBin = b - 1;
+				}
+			}
+		}
+
+		int mid;
+		if (bestKey >= 0)
+		{
+			float scale = BINS / (kmax[bestKey] - kmin[bestKey]);
+			float origin = kmin[bestKey];
+			mid = (int)(std::partition(records + begin, records + end, [&](const Record& record)
+			{
+				return std::min((int)((record.box.key(bestKey) - origin) * scale), BINS - 1) <= bestBin;
+			}) - records);
+		}
+		else if (count <= MAX_LEAF && depth < MAX_SAH_DEPTH)
+		{
+			return; // cheaper as a leaf
+		}
+		else
+		{
+			// stacked keys or too deep: halve by count along the widest key
+			int k = 0;
+			for (int j = 1; j < KEYS; j++)
+			{
+				if (kmax[j] - kmin[j] > kmax[k] - kmin[k])
+					k = j;
+			}
+			mid = begin + count / 2;
+			std::nth_element(records + begin, records + mid, records + end,
+				[&](const Record& a, const Record& b) { return a.box.key(k) < b.box.key(k); });
+		}
+		if (mid == begin || mid == end)
+			mid = begin + count / 2;
+
+		int left = m_NodeCount.fetch_add(2);
+		node.first = left;
+		node.count = 0;
+		child(left, begin, mid, depth + 1);
+		child(left + 1, mid, end, depth + 1);
+	}
+
+public:
+	BvhBuilder() : m_LeafSize(4), m_NodeCount(0), m_Deferred(nullptr), m_Grain(0) {}
+
+	// boxOf(item, box) fills in the box of item 0 .. itemCount - 1, false leaves the item out
+	template <typename BoxOf>
+	void build(int itemCount, BoxOf boxOf, int leafSize = 4)
+	{
+		m_LeafSize = std::max(leafSize, 1);
+		m_Records.resize(itemCount);
+		std::vector<char> keep(itemCount);
+		const int CHUNK = 1 << 16;
+		Utils::ParallelFor((itemCount + CHUNK - 1) / CHUNK, [&](int chunk)
+		{
+			int end = std::min(itemCount, (chunk + 1) * CHUNK);
+			for (int i = chunk * CHUNK; i < end; i++)
+			{
+				m_Records[i].item = i;
+				m_Records[i].box = Box();
+				keep[i] = boxOf(i, m_Records[i].box);
+			}
+		});
+		int count = 0;
+		for (int i = 0; i < itemCount; i++)
+		{
+			if (keep[i])
+				m_Records[count++] = m_Records[i];
+		}
+		m_Records.resize(count);
+
+		nodes.assign(count > 0 ? 2 * count - 1 : 0, Node());
+		m_NodeCount = 1;
+		items.resize(count);
+		if (count == 0)
+			return;
+
+		int threads = Utils::ThreadCount();
+		if (threads > 1)
+		{
+			std::vector<Task> tasks;
+			m_Deferred = &tasks;
+			m_Grain = std::max(1024, count / (threads * 8));
+			split(0, 0, count, 0);
+			m_Deferred = nullptr;
+			Utils::ParallelFor((int)tasks.size(), [&](int i)
+			{
+				split(tasks[i].node, tasks[i].begin, tasks[i].end, tasks[i].depth);
+			}, threads);
+		}
+		else
+		{
+			split(0, 0, count, 0);
+		}
+		nodes.resize(m_NodeCount);
+		for (int i = 0; i < count; i++)
+			items[i] = m_Records[i].item;
+		std::vector<Record>().swap(m_Records);
+	}
+};
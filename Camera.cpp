@@ -1,5 +1,7 @@
 #include "Camera.h"
 
+#include <algorithm>
+
 Camera::Camera() :
 	m_CameraPos(glm::vec3(0.0f, 0.0f, 10.0f)),
 	m_CameraTarget(glm::vec3(0.0f, 0.0f, 0.0f)),
@@ -73,6 +75,16 @@ glm::vec3 Camera::GetFront() const
 	return m_CameraFront;
 }
 
+glm::mat4 Camera::Orbit(const BoundingSphere& target, float yawDegrees, float pitchDegrees, float fovy, glm::vec3& eye)
+{
+	float radius = std::max(target.radius, 1e-3f);
+	float distance = radius / sin(fovy * 0.5f) * 1.05f;
+	float yaw = glm::radians(yawDegrees), pitch = glm::radians(pitchDegrees);
+	glm::vec3 direction(cos(pitch) * sin(yaw), sin(pitch), cos(pitch) * cos(yaw));
+	eye = target.center + direction * distance;
+	return glm::lookAt(eye, target.center, WorldUp);
+}
+
 void Camera::updateCameraVectors()
 {
 	// calculate the new Front vector
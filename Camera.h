@@ -4,6 +4,7 @@
 #include "GLFW/glfw3.h"
 #include "glm/glm.hpp"
 #include <glm/ext/matrix_transform.hpp>
+#include "BoundingVolume.h"
 
 const glm::vec3 WorldUp(0, 1, 0);
 
@@ -33,6 +34,9 @@ public:
 	glm::vec3 GetPos() const;
 	glm::vec3 GetFront() const;
 
+	// view of a camera circling the sphere, far enough back that it fits the vertical fov
+	static glm::mat4 Orbit(const BoundingSphere& target, float yawDegrees, float pitchDegrees, float fovy, glm::vec3& eye);
+
 private:
 	void updateCameraVectors();
 };
@@ -0,0 +1,372 @@
+#include "EditableMesh.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+
+#include "mesh.h"
+#include "meshGL.h"
+#include "MorphFeedback.h"
+
+// dirty vertices closer than this are uploaded as one range, the few clean ones in between are
+// cheaper to rewrite than another glBufferSubData call
+static const int RUN_GAP = 32;
+
+EditableMesh::EditableMesh(Mesh& mesh)
+    : m_Mesh(mesh), m_UVSphere(), m_Begun(false), m_LastVertices(0), m_LastFaces(0), m_LastRuns(0), m_LastMs(0.0), m_BeginMs(0.0)
+{
+}
+
+// the morph maps a uv point to (u or 1 - u, v, 0) * averageScaling
+static BoundingSphere uvSphereAtEnd(const Mesh& mesh, const BoundingSphere& sphere)
+{
+    BoundingSphere result;
+    float u = mesh.toFlip ? 1.0f - sphere.center.x : sphere.center.x;
+    result.center = glm::vec3(u, sphere.center.y, 0.0f) * mesh.averageScaling;
+    result.radius = sphere.radius * mesh.averageScaling;
+    return result;
+}
+
+// exact bits like UVSeams and ArapMorph weld by, -0 and 0 alike
+struct PositionKey
+{
+    uint32_t bits[3];
+
+    bool operator==(const PositionKey& other) const { return memcmp(bits, other.bits, sizeof(bits)) == 0; }
+};
+
+struct PositionHash
+{
+    size_t operator()(const PositionKey& key) const
+    {
+        uint64_t h = 0;
+        for (int k = 0; k < 3; k++)
+            h = (h ^ key.bits[k]) * 0x9E3779B97F4A7C15ull;
+        return (size_t)(h ^ (h >> 32));
+    }
+};
+
+static PositionKey positionKey(const glm::vec3& p)
+{
+    PositionKey key;
+    for (int k = 0; k < 3; k++)
+    {
+        float v = p[k] + 0.0f;
+        memcpy(&key.bits[k], &v, sizeof(v));
+    }
+    return key;
+}
+
+static bool sameUV(const glm::vec2& a, const glm::vec2& b)
+{
+    return a.x + 0.0f == b.x + 0.0f && a.y + 0.0f == b.y + 0.0f;
+}
+
+static int clusterOf(const std::vector<MeshCluster>& clusters, int face)
+{
+    auto it = std::upper_bound(clusters.begin(), clusters.end(), face,
+        [](int f, const MeshCluster& cluster) { return f < cluster.firstFace; });
+    return (int)(it - clusters.begin()) - 1;
+}
+
+void EditableMesh::begin()
+{
+    auto start = std::chrono::steady_clock::now();
+    Mesh& mesh = m_Mesh;
+    int vertexCount = (int)mesh.vertexCount();
+    int faceCount = (int)mesh.f.size();
+
+    // vertex to face adjacency, counted then filled
+    m_FaceStart.assign(vertexCount + 1, 0);
+    for (const Face& face : mesh.f)
+        for (int k = 0; k < 3; k++)
+            m_FaceStart[face.vi[k] + 1]++;
+    for (int v = 0; v < vertexCount; v++)
+        m_FaceStart[v + 1] += m_FaceStart[v];
+    m_VertexFaces.resize(m_FaceStart[vertexCount]);
+    std::vector<int> fill(m_FaceStart.begin(), m_FaceStart.end() - 1);
+    for (int i = 0; i < faceCount; i++)
+        for (int k = 0; k < 3; k++)
+            m_VertexFaces[fill[mesh.f[i].vi[k]]++] = i;
+
+    // vertices grouped by position, counted then filled like the faces
+    m_VertexPosition.resize(vertexCount);
+    std::unordered_map<PositionKey, int, PositionHash> positions;
+    positions.reserve(vertexCount);
+    for (int v = 0; v < vertexCount; v++)
+        m_VertexPosition[v] = positions.emplace(positionKey(mesh.pos[v]), (int)positions.size()).first->second;
+    int positionCount = (int)positions.size();
+    std::unordered_map<PositionKey, int, PositionHash>().swap(positions);
+    m_PositionStart.assign(positionCount + 1, 0);
+    for (int v = 0; v < vertexCount; v++)
+        m_PositionStart[m_VertexPosition[v] + 1]++;
+    for (int p = 0; p < positionCount; p++)
+        m_PositionStart[p + 1] += m_PositionStart[p];
+    m_PositionVertices.resize(vertexCount);
+    fill.assign(m_PositionStart.begin(), m_PositionStart.end() - 1);
+    for (int v = 0; v < vertexCount; v++)
+        m_PositionVertices[fill[m_VertexPosition[v]]++] = v;
+
+    m_VertexFlags.assign(vertexCount, 0);
+    m_FaceDirty.assign(faceCount, 0);
+    m_DirtyVertices.clear();
+    m_DirtyFaces.clear();
+
+    // the sums, corners are counted once per face using them like computeInitRotation does
+    m_Sums = Sums();
+    for (int v = 0; v < vertexCount; v++)
+    {
+        double corners = m_FaceStart[v + 1] - m_FaceStart[v];
+        for (int a = 0; a < 3; a++)
+        {
+            m_Sums.corners3D[a] += corners * mesh.pos[v][a];
+            for (int b = 0; b < 2; b++)
+                m_Sums.cross[a][b] += corners * mesh.pos[v][a] * mesh.uv[v][b];
+        }
+        for (int b = 0; b < 2; b++)
+            m_Sums.cornersUV[b] += corners * mesh.uv[v][b];
+    }
+    for (int i = 0; i < faceCount; i++)
+        addFace(i, 1.0);
+    updateDerived();
+
+    // tight bounds, in the mesh's own space and in uv space
+    mesh.aabb = computeAABB(mesh.pos.data(), mesh.pos.size());
+    mesh.boundingSphere = computeBoundingSphere(mesh.pos.data(), mesh.pos.size());
+    mesh.obb = computeOBB(mesh.pos.data(), mesh.pos.size());
+    std::vector<glm::vec3> uvPoints(vertexCount);
+    for (int v = 0; v < vertexCount; v++)
+        uvPoints[v] = glm::vec3(mesh.uv[v], 0.0f);
+    m_UVSphere = computeBoundingSphere(uvPoints.data(), uvPoints.size());
+    m_ClusterPosSpheres.resize(mesh.clusters.size());
+    m_ClusterUVSpheres.resize(mesh.clusters.size());
+    for (size_t c = 0; c < mesh.clusters.size(); c++)
+    {
+        const MeshCluster& cluster = mesh.clusters[c];
+        size_t indexCount = (size_t)cluster.faceCount * 3;
+        m_ClusterPosSpheres[c] = computeBoundingSphere(mesh.pos.data(), mesh.f[cluster.firstFace].vi, indexCount);
+        m_ClusterUVSpheres[c] = computeBoundingSphere(uvPoints.data(), mesh.f[cluster.firstFace].vi, indexCount);
+    }
+    updateMorphBounds();
+
+    m_Begun = true;
+    m_BeginMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void EditableMesh::addFace(int face, double sign)
+{
+    const Mesh& mesh = m_Mesh;
+    const Face& f = mesh.f[face];
+    glm::vec3 a = mesh.pos[f.vi[0]], b = mesh.pos[f.vi[1]], c = mesh.pos[f.vi[2]];
+    glm::vec2 ua = mesh.uv[f.vi[0]], ub = mesh.uv[f.vi[1]], uc = mesh.uv[f.vi[2]];
+
+    double area3D = 0.5 * glm::length(glm::cross(b - a, c - a));
+    glm::vec2 e1 = ub - ua, e2 = uc - ua;
+    double winding = (double)e1.x * e2.y - (double)e1.y * e2.x;
+    double areaUV = 0.5 * std::abs(winding);
+    glm::vec3 center = (a + b + c) / 3.0f;
+    glm::vec2 centerUV = (ua + ub + uc) / 3.0f;
+
+    m_Sums.area3D += sign * area3D;
+    m_Sums.areaUV += sign * areaUV;
+    for (int k = 0; k < 3; k++)
+        m_Sums.centroid3D[k] += sign * area3D * center[k];
+    for (int k = 0; k < 2; k++)
+        m_Sums.centroid2D[k] += sign * areaUV * centerUV[k];
+    m_Sums.winding += sign * winding;
+    double ratio = areaUV > 0.0 ? std::sqrt(area3D / areaUV) : 0.0;
+    m_Sums.scaling += sign * ratio;
+
+    // faces coming back in carry their new ratio
+    if (sign > 0.0)
+        m_Mesh.faceAttribute("uvScaling")[face] = (float)ratio;
+}
+
+void EditableMesh::touchVertex(int v, unsigned char flag)
+{
+    if (!m_Begun)
+        begin();
+    const Mesh& mesh = m_Mesh;
+    if (!m_VertexFlags[v])
+    {
+        // its corners and its faces leave the sums with their old values
+        m_DirtyVertices.push_back(v);
+        double corners = m_FaceStart[v + 1] - m_FaceStart[v];
+        for (int a = 0; a < 3; a++)
+        {
+            m_Sums.corners3D[a] -= corners * mesh.pos[v][a];
+            for (int b = 0; b < 2; b++)
+                m_Sums.cross[a][b] -= corners * mesh.pos[v][a] * mesh.uv[v][b];
+        }
+        for (int b = 0; b < 2; b++)
+            m_Sums.cornersUV[b] -= corners * mesh.uv[v][b];
+        for (int i = m_FaceStart[v]; i < m_FaceStart[v + 1]; i++)
+        {
+            int face = m_VertexFaces[i];
+            if (m_FaceDirty[face])
+                continue;
+            m_FaceDirty[face] = 1;
+            m_DirtyFaces.push_back(face);
+            addFace(face, -1.0);
+        }
+    }
+    m_VertexFlags[v] |= flag;
+}
+
+void EditableMesh::setPosition(int v, const glm::vec3& p)
+{
+    if (!m_Begun)
+        begin();
+    int position = m_VertexPosition[v];
+    for (int i = m_PositionStart[position]; i < m_PositionStart[position + 1]; i++)
+    {
+        int u = m_PositionVertices[i];
+        touchVertex(u, POSITION_EDITED);
+        m_Mesh.pos[u] = p;
+    }
+}
+
+void EditableMesh::setUV(int v, const glm::vec2& uv)
+{
+    if (!m_Begun)
+        begin();
+    int position = m_VertexPosition[v];
+    glm::vec2 old = m_Mesh.uv[v];
+    for (int i = m_PositionStart[position]; i < m_PositionStart[position + 1]; i++)
+    {
+        int u = m_PositionVertices[i];
+        if (!sameUV(m_Mesh.uv[u], old))
+            continue;
+        touchVertex(u, UV_EDITED);
+        m_Mesh.uv[u] = uv;
+    }
+}
+
+// what setupCentroids, computeUVScaling, computeInitRotation and updateToFlipBool find, from the sums
+void EditableMesh::updateDerived()
+{
+    Mesh& mesh = m_Mesh;
+    const Sums& s = m_Sums;
+    double faceCount = (double)mesh.f.size();
+    if (faceCount == 0.0)
+        return;
+
+    double c3[3], c2[2] = { 0.0, 0.0 };
+    for (int k = 0; k < 3; k++)
+        c3[k] = s.area3D > 0.0 ? s.centroid3D[k] / s.area3D : 0.0;
+    if (s.areaUV > 0.0)
+        for (int k = 0; k < 2; k++)
+            c2[k] = s.centroid2D[k] / s.areaUV;
+    mesh.centroid3D = glm::vec3((float)c3[0], (float)c3[1], (float)c3[2]);
+    mesh.centroid2D = glm::vec3((float)c2[0], (float)c2[1], 0.0f);
+    mesh.averageScaling = s.scaling != 0.0 ? (float)(s.scaling / faceCount) : 1.0f;
+
+    // sum of (p - c3)(w - c2) expanded, so moving the centroids doesn't need the corners again;
+    // column i is uv axis i, row j pos axis j, like outerProduct(p, w). The uv z axis stays 0.
+    double n = 3.0 * faceCount;
+    glm::mat3 covariance(0.0f);
+    for (int i = 0; i < 2; i++)
+        for (int j = 0; j < 3; j++)
+            covariance[i][j] = (float)((s.cross[j][i] - c3[j] * s.cornersUV[i] - s.corners3D[j] * c2[i] + n * c3[j] * c2[i]) / n);
+    mesh.bestRotation = Mesh::rotationFromCovariance(covariance);
+    mesh.toFlip = s.winding < 0.0;
+}
+
+void EditableMesh::updateMorphBounds()
+{
+    Mesh& mesh = m_Mesh;
+    // the rotation keeps distances, so the sphere of the rest pose just turns with it
+    mesh.morphBounds.start.center = mesh.boundingSphere.center * mesh.bestRotation;
+    mesh.morphBounds.start.radius = mesh.boundingSphere.radius;
+    mesh.morphBounds.end = uvSphereAtEnd(mesh, m_UVSphere);
+    mesh.hasMorphBounds = !mesh.f.empty();
+    for (size_t c = 0; c < mesh.clusters.size() && c < m_ClusterPosSpheres.size(); c++)
+    {
+        MorphBounds& bounds = mesh.clusters[c].bounds;
+        bounds.start.center = m_ClusterPosSpheres[c].center * mesh.bestRotation;
+        bounds.start.radius = m_ClusterPosSpheres[c].radius;
+        bounds.end = uvSphereAtEnd(mesh, m_ClusterUVSpheres[c]);
+    }
+}
+
+void EditableMesh::commit(MeshGl* target, MorphFeedback* feedback)
+{
+    if (!m_Begun || m_DirtyVertices.empty())
+        return;
+    auto start = std::chrono::steady_clock::now();
+    Mesh& mesh = m_Mesh;
+
+    // the new terms back in, the bounds grown to the new places
+    for (int v : m_DirtyVertices)
+    {
+        double corners = m_FaceStart[v + 1] - m_FaceStart[v];
+        for (int a = 0; a < 3; a++)
+        {
+            m_Sums.corners3D[a] += corners * mesh.pos[v][a];
+            for (int b = 0; b < 2; b++)
+                m_Sums.cross[a][b] += corners * mesh.pos[v][a] * mesh.uv[v][b];
+        }
+        for (int b = 0; b < 2; b++)
+            m_Sums.cornersUV[b] += corners * mesh.uv[v][b];
+
+        glm::vec3 uvPoint(mesh.uv[v], 0.0f);
+        if (m_VertexFlags[v] & POSITION_EDITED)
+        {
+            growToContain(mesh.aabb, mesh.pos[v]);
+            growToContain(mesh.boundingSphere, mesh.pos[v]);
+            growToContain(mesh.obb, mesh.pos[v]);
+        }
+        if (m_VertexFlags[v] & UV_EDITED)
+            growToContain(m_UVSphere, uvPoint);
+        for (int i = m_FaceStart[v]; i < m_FaceStart[v + 1]; i++)
+        {
+            int c = clusterOf(mesh.clusters, m_VertexFaces[i]);
+            if (c < 0 || c >= (int)m_ClusterPosSpheres.size())
+                continue;
+            growToContain(m_ClusterPosSpheres[c], mesh.pos[v]);
+            growToContain(m_ClusterUVSpheres[c], uvPoint);
+        }
+    }
+    for (int face : m_DirtyFaces)
+    {
+        addFace(face, 1.0);
+        m_FaceDirty[face] = 0;
+    }
+    updateDerived();
+    updateMorphBounds();
+
+    // nearby edits share one range of the buffers
+    std::sort(m_DirtyVertices.begin(), m_DirtyVertices.end());
+    size_t runs = 0;
+    for (size_t i = 0; i < m_DirtyVertices.size();)
+    {
+        int first = m_DirtyVertices[i], last = first;
+        unsigned char flags = 0;
+        for (; i < m_DirtyVertices.size() && m_DirtyVertices[i] - last <= RUN_GAP; i++)
+        {
+            last = m_DirtyVertices[i];
+            flags |= m_VertexFlags[last];
+            m_VertexFlags[last] = 0;
+        }
+        size_t count = (size_t)(last - first + 1);
+        if (target && (flags & UV_EDITED))
+            target->updateUVs(&mesh.uv[first], first, count);
+        if (feedback)
+            feedback->updateVertices(mesh, first, count);
+        runs++;
+    }
+    if (feedback)
+        feedback->updateParams(mesh);
+    if (target)
+        target->updateBounds(mesh);
+
+    m_LastVertices = m_DirtyVertices.size();
+    m_LastFaces = m_DirtyFaces.size();
+    m_LastRuns = runs;
+    m_DirtyVertices.clear();
+    m_DirtyFaces.clear();
+    m_LastMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
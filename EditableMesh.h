@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+#include "BoundingVolume.h"
+
+struct Mesh;
+struct MeshGl;
+class MorphFeedback;
+
+// Keeps the import time analysis of a mesh (centroids, uv scaling, best rotation, flip, bounds)
+// current while vertices are edited, without the full passes. begin() takes running sums over
+// every face once: area weighted centers, the raw cross-covariance of the corners, the scaling
+// and winding sums. An edit of a vertex takes its corners and its faces' terms out of the sums
+// when it is first touched, commit() puts the new terms back, so a commit costs O(edited
+// vertices * valence) plus one 3x3 SVD. Bounds only grow until the next begin(), normals are
+// left as they were, and only the edited ranges of the GPU buffers are rewritten.
+class EditableMesh
+{
+private:
+	// doubles, the same terms come in and go out many times
+	struct Sums
+	{
+		double area3D = 0.0, areaUV = 0.0;
+		double centroid3D[3] = {}, centroid2D[2] = {}; // area weighted face centers
+		double corners3D[3] = {}, cornersUV[2] = {};    // plain corner sums, for the covariance
+		double cross[3][2] = {};                        // sum of pos[a] * uv[b] over the corners
+		double scaling = 0.0;                           // sum of per face sqrt(area3D / areaUV)
+		double winding = 0.0;                           // sum of the uv triangles' signed doubled areas
+	};
+
+	static const unsigned char POSITION_EDITED = 1;
+	static const unsigned char UV_EDITED = 2;
+
+	Mesh& m_Mesh;
+	Sums m_Sums;
+	// faces of each vertex, one entry per corner
+	std::vector<int> m_FaceStart, m_VertexFaces;
+	// the vertices at each position: the importer splits one per face corner, an edit moves them all
+	std::vector<int> m_VertexPosition, m_PositionStart, m_PositionVertices;
+	std::vector<unsigned char> m_VertexFlags, m_FaceDirty;
+	std::vector<int> m_DirtyVertices, m_DirtyFaces;
+	// spheres before the morph transform, so a new rotation or scale doesn't invalidate them
+	BoundingSphere m_UVSphere;
+	std::vector<BoundingSphere> m_ClusterPosSpheres, m_ClusterUVSpheres;
+	bool m_Begun;
+
+	size_t m_LastVertices, m_LastFaces, m_LastRuns;
+	double m_LastMs, m_BeginMs;
+
+	void touchVertex(int v, unsigned char flag);
+	void addFace(int face, double sign);
+	void updateDerived();
+	void updateMorphBounds();
+
+public:
+	EditableMesh(Mesh& mesh);
+
+	// full sums, adjacency and tight bounds; again after the mesh changes other than through this
+	void begin();
+	bool isBegun() const { return m_Begun; }
+	// moves v and every vertex at its position, so its faces stay joined to their neighbours
+	void setPosition(int v, const glm::vec3& p);
+	// v and the vertices at its position with its uvs; across a seam the other side keeps its own
+	void setUV(int v, const glm::vec2& uv);
+	bool hasEdits() const { return !m_DirtyVertices.empty(); }
+	// folds the edits into the mesh's analysis and uploads the edited ranges to target and feedback,
+	// either can be null
+	void commit(MeshGl* target, MorphFeedback* feedback);
+
+	size_t getLastVertexCount() const { return m_LastVertices; }
+	size_t getLastFaceCount() const { return m_LastFaces; }
+	size_t getLastRunCount() const { return m_LastRuns; } // buffer ranges written
+	double getLastMs() const { return m_LastMs; }
+	double getBeginMs() const { return m_BeginMs; }
+};
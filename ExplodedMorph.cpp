@@ -0,0 +1,264 @@
+#include "ExplodedMorph.h"
+
+#include <GL/glew.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+
+#include "mesh.h"
+#include "Renderer.h"
+#include "GLState.h"
+#include "Utils.h"
+
+// quaternions as x, y, z, w
+static glm::vec3 rotate(const glm::vec4& q, const glm::vec3& v)
+{
+    glm::vec3 axis(q.x, q.y, q.z);
+    glm::vec3 t = 2.0f * glm::cross(axis, v);
+    return v + q.w * t + glm::cross(axis, t);
+}
+
+static glm::vec4 multiply(const glm::vec4& a, const glm::vec4& b)
+{
+    glm::vec3 va(a.x, a.y, a.z), vb(b.x, b.y, b.z);
+    glm::vec3 v = a.w * vb + b.w * va + glm::cross(va, vb);
+    return glm::vec4(v.x, v.y, v.z, a.w * b.w - glm::dot(va, vb));
+}
+
+// from identity to q, the same axis and a share of the angle
+static glm::vec4 slerpFromIdentity(const glm::vec4& q, float t)
+{
+    float halfAngle = std::acos(std::min(std::max(q.w, -1.0f), 1.0f));
+    float s = std::sin(halfAngle);
+    if (s < 1e-6f)
+        return glm::normalize(glm::vec4(q.x * t, q.y * t, q.z * t, 1.0f));
+    float k = std::sin(t * halfAngle) / s;
+    return glm::vec4(q.x * k, q.y * k, q.z * k, std::cos(t * halfAngle));
+}
+
+// rotation, centroids and size ratio of one face; returns how far its corners get from the centroid
+static float faceFrame(const glm::vec3* start, const glm::vec3* end, float* frame)
+{
+    glm::vec3 c0 = (start[0] + start[1] + start[2]) / 3.0f;
+    glm::vec3 c1 = (end[0] + end[1] + end[2]) / 3.0f;
+    glm::vec3 normal = glm::cross(start[1] - start[0], start[2] - start[0]);
+    float area = glm::length(normal);
+    float endArea = glm::length(glm::cross(end[1] - end[0], end[2] - end[0]));
+    glm::vec4 q(0.0f, 0.0f, 0.0f, 1.0f);
+    float scale = 1.0f;
+    if (area > 1e-20f)
+    {
+        // shortest arc from the normal to +z, half way around x when it points the other way
+        glm::vec3 n = normal / area;
+        if (n.z < -0.9999f)
+            q = glm::vec4(1.0f, 0.0f, 0.0f, 0.0f);
+        else
+            q = glm::normalize(glm::vec4(-n.y, n.x, 0.0f, 1.0f + n.z));
+        // then about z by the angle that fits the uv corners best in the least squares sense
+        float cosSum = 0.0f, sinSum = 0.0f;
+        for (int k = 0; k < 3; k++)
+        {
+            glm::vec3 a = rotate(q, start[k] - c0), b = end[k] - c1;
+            cosSum += a.x * b.x + a.y * b.y;
+            sinSum += a.x * b.y - a.y * b.x;
+        }
+        float halfAngle = 0.5f * std::atan2(sinSum, cosSum);
+        q = multiply(glm::vec4(0.0f, 0.0f, std::sin(halfAngle), std::cos(halfAngle)), q);
+        if (q.w < 0.0f)
+            q = -q;
+        if (endArea > 1e-20f)
+            scale = std::sqrt(endArea / area);
+    }
+    float values[12] = { q.x, q.y, q.z, q.w, c0.x, c0.y, c0.z, scale, c1.x, c1.y, c1.z, 0.0f };
+    std::copy(values, values + 12, frame);
+
+    // |shape(t)| <= mix(1, scale, t) * max(|start - c0|, |end - c1| / scale)
+    float reach = 0.0f;
+    for (int k = 0; k < 3; k++)
+        reach = std::max(reach, std::max(glm::length(start[k] - c0), glm::length(end[k] - c1) / scale));
+    return reach * std::max(scale, 1.0f);
+}
+
+ExplodedMorph::ExplodedMorph()
+    : m_Shader("res/shaders/exploded.hlsl", { "v_Position", "v_Normal" }),
+    m_VAO(0), m_SourceVBO(0), m_Frames(FRAME_VALUES), m_VertexCount(0), m_LastInterpolation(-1.0f), m_BuildMs(0.0)
+{
+    glGenVertexArrays(1, &m_VAO);
+    glGenBuffers(1, &m_SourceVBO);
+}
+
+ExplodedMorph::~ExplodedMorph()
+{
+    m_Target.deleteBuffers();
+    GLState::ForgetVertexArray(m_VAO);
+    GLState::ForgetBuffer(m_SourceVBO);
+    glDeleteVertexArrays(1, &m_VAO);
+    glDeleteBuffers(1, &m_SourceVBO);
+}
+
+void ExplodedMorph::setup(const Mesh& mesh)
+{
+    auto startTime = std::chrono::steady_clock::now();
+    int faceCount = (int)mesh.f.size();
+    size_t n = (size_t)faceCount * 3;
+    bool hasNormals = mesh.normal.size() == mesh.pos.size();
+
+    // corners at both ends and the frames, in one pass over the faces
+    m_Start.resize(n);
+    m_End.resize(n);
+    m_Normals.resize(n);
+    m_FrameValues.resize((size_t)faceCount * FRAME_VALUES);
+    std::vector<float> reach(faceCount);
+    const int CHUNK = 1 << 14;
+    Utils::ParallelFor((faceCount + CHUNK - 1) / CHUNK, [&](int chunk)
+    {
+        int last = std::min(faceCount, (chunk + 1) * CHUNK);
+        for (int i = chunk * CHUNK; i < last; i++)
+        {
+            const Face& face = mesh.f[i];
+            glm::vec3* start = &m_Start[(size_t)i * 3];
+            glm::vec3* end = &m_End[(size_t)i * 3];
+            for (int k = 0; k < 3; k++)
+            {
+                start[k] = mesh.morphStart(face.vi[k]);
+                end[k] = mesh.morphEnd(face.vi[k]);
+            }
+            reach[i] = faceFrame(start, end, &m_FrameValues[(size_t)i * FRAME_VALUES]);
+            glm::vec3 faceNormal = glm::cross(start[1] - start[0], start[2] - start[0]);
+            for (int k = 0; k < 3; k++)
+            {
+                glm::vec3 normal = hasNormals ? mesh.normal[face.vi[k]] * mesh.bestRotation : faceNormal;
+                float length = glm::length(normal);
+                m_Normals[(size_t)i * 3 + k] = length > 1e-6f ? normal / length : glm::vec3(0.0f, 0.0f, 1.0f);
+            }
+        }
+    });
+    m_Frames.upload(m_FrameValues.data(), faceCount);
+
+    // the target: a vertex per corner, faces in their original order so face attributes still line up
+    Mesh split;
+    split.pos = m_Start;
+    split.normal = m_Normals;
+    split.uv.resize(n);
+    split.f.resize(faceCount);
+    bool hasMaterials = mesh.material.size() == mesh.pos.size();
+    if (hasMaterials)
+        split.material.resize(n);
+    for (int i = 0; i < faceCount; i++)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            split.uv[(size_t)i * 3 + k] = mesh.uv[mesh.f[i].vi[k]];
+            if (hasMaterials)
+                split.material[(size_t)i * 3 + k] = mesh.material[mesh.f[i].vi[k]];
+            split.f[i].vi[k] = i * 3 + k;
+        }
+    }
+    if (faceCount > 0)
+    {
+        std::vector<glm::vec3> centroids(faceCount);
+        float maxReach = *std::max_element(reach.begin(), reach.end());
+        for (int end = 0; end < 2; end++)
+        {
+            for (int i = 0; i < faceCount; i++)
+                centroids[i] = glm::vec3(m_FrameValues[(size_t)i * FRAME_VALUES + 4 + end * 4], m_FrameValues[(size_t)i * FRAME_VALUES + 5 + end * 4],
+                    m_FrameValues[(size_t)i * FRAME_VALUES + 6 + end * 4]);
+            BoundingSphere& sphere = end ? split.morphBounds.end : split.morphBounds.start;
+            sphere = computeBoundingSphere(centroids.data(), centroids.size());
+            sphere.radius += maxReach;
+        }
+        split.hasMorphBounds = true;
+    }
+    m_Target.deleteBuffers();
+    m_Target = split.bake();
+    m_VertexCount = (unsigned int)n;
+
+    // feedback inputs: [start | end | normal]
+    GLState::BindVertexArray(m_VAO);
+    GLState::BindBuffer(GL_ARRAY_BUFFER, m_SourceVBO);
+    GLCall(glBufferData(GL_ARRAY_BUFFER, 3 * n * sizeof(glm::vec3), nullptr, GL_STATIC_DRAW));
+    GLCall(glBufferSubData(GL_ARRAY_BUFFER, 0, n * sizeof(glm::vec3), m_Start.data()));
+    GLCall(glBufferSubData(GL_ARRAY_BUFFER, n * sizeof(glm::vec3), n * sizeof(glm::vec3), m_End.data()));
+    GLCall(glBufferSubData(GL_ARRAY_BUFFER, 2 * n * sizeof(glm::vec3), n * sizeof(glm::vec3), m_Normals.data()));
+    for (int attribute = 0; attribute < 3; attribute++)
+    {
+        glEnableVertexAttribArray(attribute);
+        glVertexAttribPointer(attribute, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)(attribute * n * sizeof(glm::vec3)));
+    }
+    GLState::BindVertexArray(0);
+    invalidate();
+
+    m_BuildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+bool ExplodedMorph::run(float interpolation)
+{
+    if (interpolation == m_LastInterpolation || m_VertexCount == 0)
+        return false;
+    m_LastInterpolation = interpolation;
+
+    m_Shader.Bind();
+    m_Shader.SetUniform1f("u_Interpolation", interpolation);
+    GLState::BindTexture(Shader::FACE_ATTRIBUTE_UNIT, GL_TEXTURE_BUFFER, m_Frames.getTexture());
+
+    GLState::BindVertexArray(m_VAO);
+    m_Target.bindMorphOutputs();
+    GLState::SetEnabled(GL_RASTERIZER_DISCARD, true);
+    GLCall(glBeginTransformFeedback(GL_POINTS));
+    GLCall(glDrawArrays(GL_POINTS, 0, m_VertexCount));
+    GLCall(glEndTransformFeedback());
+    GLState::SetEnabled(GL_RASTERIZER_DISCARD, false);
+    return true;
+}
+
+void ExplodedMorph::interpolate(float t, glm::vec3* positions, glm::vec3* normals) const
+{
+    int faceCount = (int)(m_VertexCount / 3);
+    for (int i = 0; i < faceCount; i++)
+    {
+        const float* frame = &m_FrameValues[(size_t)i * FRAME_VALUES];
+        glm::vec4 rotation(frame[0], frame[1], frame[2], frame[3]);
+        glm::vec4 inverse(-frame[0], -frame[1], -frame[2], frame[3]);
+        glm::vec3 c0(frame[4], frame[5], frame[6]), c1(frame[8], frame[9], frame[10]);
+        float scale = frame[7];
+        glm::vec4 q = slerpFromIdentity(rotation, t);
+        for (int k = 0; k < 3; k++)
+        {
+            size_t c = (size_t)i * 3 + k;
+            // the uv shape turned back into the face's 3D frame and size
+            glm::vec3 endShape = rotate(inverse, m_End[c] - c1) / scale;
+            glm::vec3 shape = glm::mix(m_Start[c] - c0, endShape, t) * glm::mix(1.0f, scale, t);
+            positions[c] = glm::mix(c0, c1, t) + rotate(q, shape);
+            if (normals)
+                normals[c] = rotate(q, m_Normals[c]);
+        }
+    }
+}
+
+float ExplodedMorph::validate(float interpolation)
+{
+    size_t n = m_VertexCount;
+    if (n == 0)
+        return -1.0f;
+
+    invalidate();
+    run(interpolation);
+
+    std::vector<glm::vec3> gpuPositions(n), gpuNormals(n), cpuPositions(n), cpuNormals(n);
+    GLState::BindBuffer(GL_ARRAY_BUFFER, m_Target.getVBO());
+    GLCall(glGetBufferSubData(GL_ARRAY_BUFFER, 0, n * sizeof(glm::vec3), gpuPositions.data()));
+    GLCall(glGetBufferSubData(GL_ARRAY_BUFFER, m_Target.normalOffset(), n * sizeof(glm::vec3), gpuNormals.data()));
+    interpolate(interpolation, cpuPositions.data(), cpuNormals.data());
+
+    float positionError = 0.0f, normalError = 0.0f;
+    for (size_t i = 0; i < n; i++)
+    {
+        positionError = std::max(positionError, glm::length(gpuPositions[i] - cpuPositions[i]));
+        normalError = std::max(normalError, glm::length(gpuNormals[i] - cpuNormals[i]));
+    }
+
+    std::cout << "Exploded morph validation at t = " << interpolation << ": max position error " << positionError
+        << ", max normal error " << normalError << " over " << n << " corners" << std::endl;
+    return positionError;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "Shader.h"
+#include "meshGL.h"
+#include "FaceAttributeBuffer.h"
+
+struct Mesh;
+
+// Every face turns rigidly about its own centroid from its 3D pose to its uv pose, no global
+// solve. A parallel pass finds each face's rotation (its normal onto +z, then the in-plane angle
+// that best matches the uv triangle), its centroids at both ends and its uv to 3D size ratio, and
+// uploads them once as a per-face buffer. What the rotation and the scale leave of the uv shape is
+// mixed in linearly, so both end points are exact. Faces come apart, so the vertices are split
+// per face corner into a mesh of their own, built on first use; a transform feedback pass writes
+// it for each t like MorphFeedback does, and the passes draw it as a plain mesh.
+class ExplodedMorph
+{
+public:
+	// per face: rotation x, y, z, w; centroid at t = 0 and size ratio; centroid at t = 1 and 0
+	static const unsigned int FRAME_VALUES = 12;
+
+private:
+	Shader m_Shader;
+	unsigned int m_VAO, m_SourceVBO;
+	FaceAttributeBuffer m_Frames;
+	std::vector<float> m_FrameValues;
+	std::vector<glm::vec3> m_Start, m_End, m_Normals; // per corner 3 * face + k, the feedback's inputs
+	MeshGl m_Target;
+	unsigned int m_VertexCount;
+	float m_LastInterpolation;
+	double m_BuildMs;
+
+public:
+	ExplodedMorph();
+	~ExplodedMorph();
+
+	// frames, split vertices and the target mesh; call again after the mesh changes
+	void setup(const Mesh& mesh);
+	bool isSetUp() const { return m_VertexCount > 0; }
+	// writes the target when t changed since the last run, returns whether it did
+	bool run(float interpolation);
+	void invalidate() { m_LastInterpolation = -1.0f; }
+
+	// what the shader computes, for the corners of the target
+	void interpolate(float t, glm::vec3* positions, glm::vec3* normals) const;
+	// reads the target back and compares it with interpolate(), returns the largest position
+	// error or -1 before setup(). Stalls, debugging only.
+	float validate(float interpolation);
+
+	// its morph bounds hold: the centroids move on straight lines and the corners stay within
+	// a fixed distance of them
+	const MeshGl& getTarget() const { return m_Target; }
+	size_t getFaceCount() const { return m_VertexCount / 3; }
+	double getBuildMs() const { return m_BuildMs; }
+};
@@ -0,0 +1,38 @@
+#include "FaceAttributeBuffer.h"
+
+#include <GL/glew.h>
+
+#include "Renderer.h"
+#include "GLState.h"
+
+FaceAttributeBuffer::FaceAttributeBuffer(unsigned int valuesPerFace)
+	: m_BufferID(0), m_TextureID(0), m_ValuesPerFace(valuesPerFace), m_Count(0)
+{
+	glGenBuffers(1, &m_BufferID);
+	glGenTextures(1, &m_TextureID);
+}
+
+FaceAttributeBuffer::~FaceAttributeBuffer()
+{
+	GLState::ForgetBuffer(m_BufferID);
+	GLState::ForgetTexture(m_TextureID);
+	glDeleteTextures(1, &m_TextureID);
+	glDeleteBuffers(1, &m_BufferID);
+}
+
+void FaceAttributeBuffer::upload(const float* values, size_t count)
+{
+	GLState::BindBuffer(GL_TEXTURE_BUFFER, m_BufferID);
+	if (count != m_Count)
+	{
+		// a buffer texture can't be empty, keep one face around
+		GLCall(glBufferData(GL_TEXTURE_BUFFER, (count ? count : 1) * m_ValuesPerFace * sizeof(float), NULL, GL_STATIC_DRAW));
+		m_Count = count;
+		GLState::BindTexture(0, GL_TEXTURE_BUFFER, m_TextureID);
+		GLCall(glTexBuffer(GL_TEXTURE_BUFFER, m_ValuesPerFace == 1 ? GL_R32F : GL_RGBA32F, m_BufferID));
+	}
+	if (count)
+	{
+		GLCall(glBufferSubData(GL_TEXTURE_BUFFER, 0, count * m_ValuesPerFace * sizeof(float), values));
+	}
+}
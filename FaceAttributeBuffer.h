@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+
+// One float per face in a buffer texture (R32F), read in shaders with
+// texelFetch(samplerBuffer, gl_PrimitiveID). The draw has to cover the faces in their
+// original order, see DrawItem::faceOrder.
+// With more values per face (a multiple of 4) the texture is RGBA32F and face i starts at
+// texel i * valuesPerFace / 4.
+class FaceAttributeBuffer
+{
+private:
+	unsigned int m_BufferID;
+	unsigned int m_TextureID;
+	unsigned int m_ValuesPerFace;
+	size_t m_Count;
+
+public:
+	FaceAttributeBuffer(unsigned int valuesPerFace = 1);
+	~FaceAttributeBuffer();
+
+	// count faces; reallocates when count changes, otherwise overwrites the values in place
+	void upload(const float* values, size_t count);
+
+	unsigned int getTexture() const { return m_TextureID; }
+	size_t getCount() const { return m_Count; }
+};
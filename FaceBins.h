@@ -0,0 +1,62 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+// Faces sorted into fixed size buckets along one axis, in compressed rows: bucket b owns
+// faces[start[b] .. start[b + 1]). Faces are stored in increasing order within a bucket, so
+// anything that depends on draw order stays deterministic.
+struct FaceBins
+{
+	std::vector<int> start;
+	std::vector<int> faces;
+
+	// faces == nullptr bins 0 .. faceCount - 1; range(face, lo, hi) gives the face's extent,
+	// in the same units as bucketSize
+	template <typename Range>
+	void build(int bucketCount, float bucketSize, const int* faceList, size_t faceCount, Range range)
+	{
+		// both ends clamped as floats, coordinates far outside would overflow an int; faces with
+		// non-finite coordinates go nowhere
+		auto buckets = [&](int face, int& first, int& last)
+		{
+			float lo, hi;
+			range(face, lo, hi);
+			first = 0;
+			last = -1;
+			if (std::isfinite(lo) && std::isfinite(hi) && hi >= lo)
+			{
+				float top = (float)bucketCount - 1.0f;
+				first = (int)std::min(std::max(std::floor(lo / bucketSize), 0.0f), top);
+				last = (int)std::min(std::max(std::floor(hi / bucketSize), 0.0f), top);
+			}
+		};
+
+		start.assign(bucketCount + 1, 0);
+		for (size_t i = 0; i < faceCount; i++)
+		{
+			int first, last;
+			buckets(faceList ? faceList[i] : (int)i, first, last);
+			for (int b = first; b <= last; b++)
+				start[b + 1]++;
+		}
+		for (int b = 0; b < bucketCount; b++)
+			start[b + 1] += start[b];
+
+		faces.resize(start[bucketCount]);
+		std::vector<int> cursor(start.begin(), start.end() - 1);
+		for (size_t i = 0; i < faceCount; i++)
+		{
+			int face = faceList ? faceList[i] : (int)i;
+			int first, last;
+			buckets(face, first, last);
+			for (int b = first; b <= last; b++)
+				faces[cursor[b]++] = face;
+		}
+	}
+
+	size_t count(int bucket) const { return start[bucket + 1] - start[bucket]; }
+	const int* begin(int bucket) const { return faces.data() + start[bucket]; }
+};
@@ -0,0 +1,64 @@
+#include "Frustum.h"
+
+// Gribb/Hartmann: every plane is the last row of the matrix plus or minus one of the others
+Frustum::Frustum(const glm::mat4& m)
+{
+	glm::vec4 row[4];
+	for (int i = 0; i < 4; i++)
+		row[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+
+	m_Planes[0] = row[3] + row[0]; // left
+	m_Planes[1] = row[3] - row[0]; // right
+	m_Planes[2] = row[3] + row[1]; // bottom
+	m_Planes[3] = row[3] - row[1]; // top
+	m_Planes[4] = row[3] + row[2]; // near
+	m_Planes[5] = row[3] - row[2]; // far
+
+	for (int i = 0; i < 6; i++)
+		m_Planes[i] = m_Planes[i] / glm::length(glm::vec3(m_Planes[i]));
+}
+
+Frustum::Result Frustum::test(const BoundingSphere& sphere) const
+{
+	Result result = Result::Inside;
+	for (int i = 0; i < 6; i++)
+	{
+		float distance = glm::dot(glm::vec3(m_Planes[i]), sphere.center) + m_Planes[i].w;
+		if (distance < -sphere.radius)
+			return Result::Outside;
+		if (distance < sphere.radius)
+			result = Result::Intersects;
+	}
+	return result;
+}
+
+BoundingSphere transformSphere(const BoundingSphere& sphere, const glm::mat4& model)
+{
+	float scale2 = std::max(glm::dot(glm::vec3(model[0]), glm::vec3(model[0])),
+		std::max(glm::dot(glm::vec3(model[1]), glm::vec3(model[1])), glm::dot(glm::vec3(model[2]), glm::vec3(model[2]))));
+
+	BoundingSphere result;
+	result.center = glm::vec3(model * glm::vec4(sphere.center, 1.0f));
+	result.radius = sphere.radius * sqrt(scale2);
+	return result;
+}
+
+BoundingSphere mergeSpheres(const BoundingSphere& a, const BoundingSphere& b)
+{
+	if (a.radius < 0.0f)
+		return b;
+	if (b.radius < 0.0f)
+		return a;
+
+	glm::vec3 offset = b.center - a.center;
+	float distance = glm::length(offset);
+	if (distance + b.radius <= a.radius)
+		return a;
+	if (distance + a.radius <= b.radius)
+		return b;
+
+	BoundingSphere result;
+	result.radius = (distance + a.radius + b.radius) * 0.5f;
+	result.center = a.center + offset * ((result.radius - a.radius) / distance);
+	return result;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include "mesh.h"
+
+class Frustum
+{
+public:
+	enum class Result { Outside, Intersects, Inside };
+
+private:
+	glm::vec4 m_Planes[6]; // normalized, pointing inwards
+
+public:
+	// planes of a projection * view (* model) matrix, in the space the matrix maps from
+	Frustum(const glm::mat4& matrix);
+
+	Result test(const BoundingSphere& sphere) const;
+};
+
+// sphere through an affine transform, the radius grows with the largest axis scale
+BoundingSphere transformSphere(const BoundingSphere& sphere, const glm::mat4& model);
+
+// smallest sphere holding both, a negative radius counts as empty
+BoundingSphere mergeSpheres(const BoundingSphere& a, const BoundingSphere& b);
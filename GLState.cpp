@@ -0,0 +1,276 @@
+#include "GLState.h"
+#include "Renderer.h"
+
+static const unsigned int UNKNOWN = 0xFFFFFFFF;
+
+struct CachedState
+{
+	unsigned int program;
+	unsigned int vao;
+	unsigned int elementBuffer; // part of the VAO, forgotten whenever the VAO changes
+	unsigned int arrayBuffer;
+	unsigned int uniformBuffer;
+	unsigned int pixelPackBuffer;
+	unsigned int pixelUnpackBuffer;
+	unsigned int textureBuffer;
+	unsigned int transformFeedbackBuffer;
+	unsigned int activeUnit;
+	GLenum textureTargets[GLState::MAX_TEXTURE_UNITS];
+	unsigned int textures[GLState::MAX_TEXTURE_UNITS];
+	unsigned int framebuffer;
+	int viewport[4];
+	unsigned int blend, depthTest, cullFace;
+	GLenum blendSrc, blendDst;
+	GLenum depthFunc;
+	unsigned int depthMask;
+};
+
+static CachedState s_State;
+static GLState::Stats s_FrameStats;
+static GLState::Stats s_LastFrameStats;
+
+static bool Changed(unsigned int& cached, unsigned int value)
+{
+	if (cached == value)
+	{
+		s_FrameStats.filtered++;
+		return false;
+	}
+	cached = value;
+	s_FrameStats.issued++;
+	return true;
+}
+
+static unsigned int* BufferSlot(GLenum target)
+{
+	switch (target)
+	{
+	case GL_ELEMENT_ARRAY_BUFFER: return &s_State.elementBuffer;
+	case GL_ARRAY_BUFFER: return &s_State.arrayBuffer;
+	case GL_UNIFORM_BUFFER: return &s_State.uniformBuffer;
+	case GL_PIXEL_PACK_BUFFER: return &s_State.pixelPackBuffer;
+	case GL_PIXEL_UNPACK_BUFFER: return &s_State.pixelUnpackBuffer;
+	case GL_TEXTURE_BUFFER: return &s_State.textureBuffer;
+	case GL_TRANSFORM_FEEDBACK_BUFFER: return &s_State.transformFeedbackBuffer;
+	default: return nullptr;
+	}
+}
+
+static unsigned int* CapSlot(GLenum cap)
+{
+	switch (cap)
+	{
+	case GL_BLEND: return &s_State.blend;
+	case GL_DEPTH_TEST: return &s_State.depthTest;
+	case GL_CULL_FACE: return &s_State.cullFace;
+	default: return nullptr;
+	}
+}
+
+void GLState::UseProgram(unsigned int program)
+{
+	if (Changed(s_State.program, program))
+	{
+		GLCall(glUseProgram(program));
+	}
+}
+
+void GLState::BindVertexArray(unsigned int vao)
+{
+	if (Changed(s_State.vao, vao))
+	{
+		GLCall(glBindVertexArray(vao));
+		s_State.elementBuffer = UNKNOWN;
+	}
+}
+
+void GLState::BindBuffer(GLenum target, unsigned int buffer)
+{
+	unsigned int* slot = BufferSlot(target);
+	if (!slot)
+	{
+		s_FrameStats.issued++;
+		GLCall(glBindBuffer(target, buffer));
+		return;
+	}
+	if (Changed(*slot, buffer))
+	{
+		GLCall(glBindBuffer(target, buffer));
+	}
+}
+
+void GLState::BindTexture(unsigned int unit, GLenum target, unsigned int texture)
+{
+	if (unit >= MAX_TEXTURE_UNITS)
+	{
+		s_FrameStats.issued += 2;
+		GLCall(glActiveTexture(GL_TEXTURE0 + unit));
+		GLCall(glBindTexture(target, texture));
+		s_State.activeUnit = UNKNOWN;
+		return;
+	}
+	if (s_State.textures[unit] == texture && s_State.textureTargets[unit] == target)
+	{
+		s_FrameStats.filtered++;
+		return;
+	}
+	if (Changed(s_State.activeUnit, unit))
+	{
+		GLCall(glActiveTexture(GL_TEXTURE0 + unit));
+	}
+	s_State.textures[unit] = texture;
+	s_State.textureTargets[unit] = target;
+	s_FrameStats.issued++;
+	GLCall(glBindTexture(target, texture));
+}
+
+void GLState::BindFramebuffer(unsigned int framebuffer)
+{
+	if (Changed(s_State.framebuffer, framebuffer))
+	{
+		GLCall(glBindFramebuffer(GL_FRAMEBUFFER, framebuffer));
+	}
+}
+
+void GLState::Viewport(int x, int y, int width, int height)
+{
+	int* v = s_State.viewport;
+	if (v[0] == x && v[1] == y && v[2] == width && v[3] == height)
+	{
+		s_FrameStats.filtered++;
+		return;
+	}
+	v[0] = x; v[1] = y; v[2] = width; v[3] = height;
+	s_FrameStats.issued++;
+	GLCall(glViewport(x, y, width, height));
+}
+
+void GLState::SetEnabled(GLenum cap, bool enabled)
+{
+	unsigned int* slot = CapSlot(cap);
+	if (slot && !Changed(*slot, enabled ? 1 : 0))
+		return;
+	if (!slot)
+		s_FrameStats.issued++;
+	if (enabled)
+	{
+		GLCall(glEnable(cap));
+	}
+	else
+	{
+		GLCall(glDisable(cap));
+	}
+}
+
+void GLState::BlendFunc(GLenum src, GLenum dst)
+{
+	if (s_State.blendSrc == src && s_State.blendDst == dst)
+	{
+		s_FrameStats.filtered++;
+		return;
+	}
+	s_State.blendSrc = src;
+	s_State.blendDst = dst;
+	s_FrameStats.issued++;
+	GLCall(glBlendFunc(src, dst));
+}
+
+void GLState::DepthFunc(GLenum func)
+{
+	if (Changed(s_State.depthFunc, func))
+	{
+		GLCall(glDepthFunc(func));
+	}
+}
+
+void GLState::DepthMask(bool write)
+{
+	if (Changed(s_State.depthMask, write ? 1 : 0))
+	{
+		GLCall(glDepthMask(write ? GL_TRUE : GL_FALSE));
+	}
+}
+
+void GLState::ForgetProgram(unsigned int program)
+{
+	if (s_State.program == program)
+		s_State.program = UNKNOWN;
+}
+
+void GLState::ForgetVertexArray(unsigned int vao)
+{
+	if (s_State.vao == vao)
+	{
+		s_State.vao = UNKNOWN;
+		s_State.elementBuffer = UNKNOWN;
+	}
+}
+
+void GLState::ForgetBuffer(unsigned int buffer)
+{
+	const GLenum targets[] = { GL_ELEMENT_ARRAY_BUFFER, GL_ARRAY_BUFFER, GL_UNIFORM_BUFFER, GL_PIXEL_PACK_BUFFER,
+		GL_PIXEL_UNPACK_BUFFER, GL_TEXTURE_BUFFER, GL_TRANSFORM_FEEDBACK_BUFFER };
+	for (GLenum target : targets)
+	{
+		unsigned int* slot = BufferSlot(target);
+		if (*slot == buffer)
+			*slot = UNKNOWN;
+	}
+}
+
+void GLState::ForgetTexture(unsigned int texture)
+{
+	for (unsigned int i = 0; i < MAX_TEXTURE_UNITS; i++)
+	{
+		if (s_State.textures[i] == texture)
+			s_State.textures[i] = UNKNOWN;
+	}
+}
+
+void GLState::ForgetFramebuffer(unsigned int framebuffer)
+{
+	if (s_State.framebuffer == framebuffer)
+		s_State.framebuffer = UNKNOWN;
+}
+
+void GLState::Invalidate()
+{
+	s_State.program = UNKNOWN;
+	s_State.vao = UNKNOWN;
+	s_State.elementBuffer = UNKNOWN;
+	s_State.arrayBuffer = UNKNOWN;
+	s_State.uniformBuffer = UNKNOWN;
+	s_State.pixelPackBuffer = UNKNOWN;
+	s_State.pixelUnpackBuffer = UNKNOWN;
+	s_State.textureBuffer = UNKNOWN;
+	s_State.transformFeedbackBuffer = UNKNOWN;
+	s_State.activeUnit = UNKNOWN;
+	for (unsigned int i = 0; i < MAX_TEXTURE_UNITS; i++)
+	{
+		s_State.textures[i] = UNKNOWN;
+		s_State.textureTargets[i] = GL_NONE;
+	}
+	s_State.framebuffer = UNKNOWN;
+	s_State.viewport[0] = s_State.viewport[1] = s_State.viewport[2] = s_State.viewport[3] = -1;
+	s_State.blend = s_State.depthTest = s_State.cullFace = UNKNOWN;
+	s_State.blendSrc = s_State.blendDst = GL_NONE;
+	s_State.depthFunc = UNKNOWN;
+	s_State.depthMask = UNKNOWN;
+}
+
+void GLState::EndFrame()
+{
+	s_LastFrameStats = s_FrameStats;
+	s_FrameStats = Stats();
+}
+
+const GLState::Stats& GLState::GetLastFrameStats()
+{
+	return s_LastFrameStats;
+}
+
+// start from "unknown" so the first bind of everything reaches the driver
+static struct GLStateInit
+{
+	GLStateInit() { GLState::Invalidate(); }
+} s_Init;
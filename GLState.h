@@ -0,0 +1,39 @@
+#pragma once
+
+#include <GL/glew.h>
+
+// Shadow copy of the GL bindings the app touches. Binds that match the cached
+// state are dropped before reaching the driver. Anything that changes state
+// behind its back (ImGui, deleting objects) must call Invalidate() or Forget*().
+class GLState
+{
+public:
+	static const unsigned int MAX_TEXTURE_UNITS = 16;
+
+	struct Stats
+	{
+		unsigned int issued = 0;
+		unsigned int filtered = 0;
+	};
+
+	static void UseProgram(unsigned int program);
+	static void BindVertexArray(unsigned int vao);
+	static void BindBuffer(GLenum target, unsigned int buffer);
+	static void BindTexture(unsigned int unit, GLenum target, unsigned int texture);
+	static void BindFramebuffer(unsigned int framebuffer);
+	static void Viewport(int x, int y, int width, int height);
+	static void SetEnabled(GLenum cap, bool enabled); // GL_BLEND, GL_DEPTH_TEST, GL_CULL_FACE
+	static void BlendFunc(GLenum src, GLenum dst);
+	static void DepthFunc(GLenum func);
+	static void DepthMask(bool write);
+
+	static void ForgetProgram(unsigned int program);
+	static void ForgetVertexArray(unsigned int vao);
+	static void ForgetBuffer(unsigned int buffer);
+	static void ForgetTexture(unsigned int texture);
+	static void ForgetFramebuffer(unsigned int framebuffer);
+	static void Invalidate();
+
+	static void EndFrame();
+	static const Stats& GetLastFrameStats();
+};
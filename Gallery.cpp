@@ -0,0 +1,159 @@
+#include "Gallery.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include "Frustum.h"
+
+Gallery::Gallery()
+	: m_Dirty(true), m_LastInterpolation(-1.0f), mode(Mode::Models), stateCount(9), stateEntry(0), spacing(5.0f)
+{
+}
+
+Gallery::~Gallery()
+{
+	clear();
+}
+
+bool Gallery::addModel(const std::string& path)
+{
+	for (auto& entry : m_Entries)
+	{
+		if (entry->path == path)
+		{
+			entry->copies++;
+			m_Dirty = true;
+			return true;
+		}
+	}
+
+	std::unique_ptr<Entry> entry(new Entry());
+	entry->path = path;
+	if (!entry->mesh.importOBJ(path.c_str()))
+		return false;
+	entry->meshGl = entry->mesh.bake();
+	entry->simplifier.start(entry->mesh);
+	entry->copies = 1;
+	entry->bounds.center = glm::vec3(0.0f);
+	entry->bounds.radius = -1.0f;
+	entry->instanceRadius = 0.0f;
+
+	// what the vertex shader needs to morph on its own, see gallery.hlsl
+	MorphParams params;
+	params.bestRotation = entry->mesh.bestRotation;
+	params.averageScaling = entry->mesh.averageScaling;
+	params.toFlip = entry->mesh.toFlip;
+	entry->drawParams = params.pack();
+
+	m_Entries.push_back(std::move(entry));
+	m_Dirty = true;
+	return true;
+}
+
+void Gallery::clear()
+{
+	for (auto& entry : m_Entries)
+		entry->meshGl.deleteBuffers();
+	m_Entries.clear();
+	m_Dirty = true;
+}
+
+size_t Gallery::getInstanceCount() const
+{
+	size_t count = 0;
+	for (auto& entry : m_Entries)
+		count += entry->instances.size();
+	return count;
+}
+
+BoundingSphere Gallery::getBounds() const
+{
+	BoundingSphere result;
+	result.center = glm::vec3(0.0f);
+	result.radius = -1.0f;
+	for (auto& entry : m_Entries)
+		result = mergeSpheres(result, entry->bounds);
+	return result;
+}
+
+void Gallery::update(float interpolation)
+{
+	for (auto& entry : m_Entries)
+		entry->simplifier.apply(entry->mesh, entry->meshGl);
+
+	if (!m_Dirty && (mode == Mode::States || interpolation == m_LastInterpolation))
+		return;
+	m_Dirty = false;
+	m_LastInterpolation = interpolation;
+
+	for (auto& entry : m_Entries)
+	{
+		entry->instances.clear();
+		entry->bounds.radius = -1.0f;
+		entry->instanceRadius = 0.0f;
+	}
+	if (m_Entries.empty())
+		return;
+
+	// cells in row major order, every entry keeps its cells contiguous
+	std::vector<std::pair<Entry*, float>> cells;
+	if (mode == Mode::States)
+	{
+		Entry* entry = m_Entries[std::min<size_t>(stateEntry, m_Entries.size() - 1)].get();
+		for (int i = 0; i < stateCount; i++)
+			cells.push_back({ entry, stateCount > 1 ? (float)i / (stateCount - 1) : interpolation });
+	}
+	else
+	{
+		for (auto& entry : m_Entries)
+		{
+			for (unsigned int i = 0; i < entry->copies; i++)
+				cells.push_back({ entry.get(), interpolation });
+		}
+	}
+
+	int columns = (int)std::ceil(std::sqrt((float)cells.size()));
+	int rows = ((int)cells.size() + columns - 1) / columns;
+	for (size_t i = 0; i < cells.size(); i++)
+	{
+		Entry* entry = cells[i].first;
+		float x = ((int)i % columns - (columns - 1) * 0.5f) * spacing;
+		float z = ((int)i / columns - (rows - 1) * 0.5f) * spacing;
+		float scalingFactor = 1.0 / entry->mesh.boundingSphere.radius * 2.0f;
+
+		InstanceData instance;
+		instance.model = glm::translate(glm::mat4(1.0f), glm::vec3(x, 0.0f, z));
+		instance.model = glm::scale(instance.model, glm::vec3(scalingFactor));
+		instance.interpolation = cells[i].second;
+		entry->instances.push_back(instance);
+		if (entry->mesh.hasMorphBounds)
+		{
+			BoundingSphere bounds = transformSphere(entry->mesh.morphBounds.at(instance.interpolation), instance.model);
+			entry->bounds = mergeSpheres(entry->bounds, bounds);
+			entry->instanceRadius = std::max(entry->instanceRadius, bounds.radius);
+		}
+	}
+
+	for (auto& entry : m_Entries)
+	{
+		if (!entry->instances.empty())
+			entry->meshGl.updateInstances(entry->instances.data(), entry->instances.size());
+	}
+}
+
+void Gallery::record(CommandList& list, const Shader& shader) const
+{
+	for (auto& entry : m_Entries)
+	{
+		if (entry->instances.empty())
+			continue;
+		DrawItem& item = list.Draw(shader, entry->meshGl, glm::mat4(1.0f));
+		item.params = entry->drawParams;
+		item.instanceCount = (unsigned int)entry->instances.size();
+		item.worldBounds = entry->bounds;
+		item.instanceRadius = entry->instanceRadius;
+		// the per-instance transforms are not in the model matrix, the mesh bounds alone would be wrong
+		item.cull = entry->bounds.radius >= 0.0f;
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "mesh.h"
+#include "meshGL.h"
+#include "Renderer.h"
+#include "MeshSimplifier.h"
+
+// Side by side comparison of several models, or of several interpolation states
+// of one model, laid out on a grid. The morph runs in the vertex shader with a
+// per-instance t, so every distinct mesh is a single instanced draw.
+class Gallery
+{
+public:
+	enum class Mode
+	{
+		Models, // one cell per added model, all at the global interpolation
+		States  // stateCount cells of one model, t from 0 to 1
+	};
+
+private:
+	struct Entry
+	{
+		std::string path;
+		Mesh mesh;
+		MeshGl meshGl; // rest positions, only the levels of detail are added once simplifier is done
+		MeshSimplifier simplifier;
+		glm::mat4 drawParams; // MorphParams packed
+		unsigned int copies;
+		std::vector<InstanceData> instances;
+		BoundingSphere bounds; // world space, all instances
+		float instanceRadius;  // world space, the largest single instance
+	};
+	std::vector<std::unique_ptr<Entry>> m_Entries;
+	bool m_Dirty;
+	float m_LastInterpolation;
+
+public:
+	Mode mode;
+	int stateCount;
+	int stateEntry;
+	float spacing;
+
+	Gallery();
+	~Gallery();
+
+	// the same path twice adds a cell, not a second copy of the mesh
+	bool addModel(const std::string& path);
+	void clear();
+	void setDirty() { m_Dirty = true; }
+
+	// takes the levels of detail of entries whose simplifier finished, and rebuilds and uploads the
+	// instance buffers when the layout or t changed; call it every frame
+	void update(float interpolation);
+	void record(CommandList& list, const Shader& shader) const;
+
+	size_t getEntryCount() const { return m_Entries.size(); }
+	const std::string& getPath(size_t i) const { return m_Entries[i]->path; }
+	size_t getInstanceCount() const;
+	BoundingSphere getBounds() const; // world space, radius < 0 when empty
+};
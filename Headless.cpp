@@ -0,0 +1,913 @@
+#include "Headless.h"
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+
+#if defined(__linux__) && defined(UVMAP_EGL)
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include "mesh.h"
+#include "meshGL.h"
+#include "Arena.h"
+#include "Shader.h"
+#include "Renderer.h"
+#include "GLState.h"
+#include "MorphFeedback.h"
+#include "MeshSimplifier.h"
+#include "ExplodedMorph.h"
+#include "Utils.h"
+#include "UVIslands.h"
+#include "UVCoverage.h"
+#include "UVOverlaps.h"
+#include "OffscreenTarget.h"
+#include "PngWriter.h"
+#include "directionalLight.h"
+#include "Camera.h"
+#include "vendor/stb_image/stb_image.h"
+
+// models under res/ that the regression run renders
+static const char* REGRESSION_MODELS[] = {
+    "res/models/_Wheel_195_50R13x10_OBJ/wheel.obj",
+    "res/models/Die-OBJ/Die-OBJ.obj",
+    "res/models/cylinder/cylinder.obj",
+    "res/models/plane/plane.obj",
+};
+
+static std::vector<float> parseFloats(const char* text)
+{
+    std::vector<float> result;
+    const char* p = text;
+    while (*p)
+    {
+        char* end;
+        float value = strtof(p, &end);
+        if (end == p)
+            break;
+        result.push_back(value);
+        p = *end == ',' ? end + 1 : end;
+    }
+    return result;
+}
+
+bool ParseHeadlessArgs(int argc, char** argv, HeadlessOptions& options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char* arg = argv[i];
+        bool hasValue = i + 1 < argc && argv[i + 1][0] != '-';
+        if (strcmp(arg, "--thumbnails") == 0)
+        {
+            options.mode = HeadlessOptions::Mode::Thumbnails;
+            for (; i + 1 < argc && argv[i + 1][0] != '-'; i++)
+            {
+                const char* model = argv[i + 1];
+                if (model[0] != '@')
+                {
+                    options.models.push_back(model);
+                    continue;
+                }
+                // @file: one path per line, for batches too long for a command line
+                std::ifstream list(model + 1);
+                std::string line;
+                while (std::getline(list, line))
+                {
+                    if (!line.empty() && line.back() == '\r')
+                        line.pop_back();
+                    if (!line.empty())
+                        options.models.push_back(line);
+                }
+            }
+        }
+        else if (strcmp(arg, "--regress") == 0)
+        {
+            options.mode = HeadlessOptions::Mode::Regress;
+            if (hasValue)
+                options.referenceDir = argv[++i];
+        }
+        else if (strcmp(arg, "--record") == 0 && hasValue)
+        {
+            options.mode = HeadlessOptions::Mode::Record;
+            options.models.push_back(argv[++i]);
+        }
+        else if (strcmp(arg, "--uvlayout") == 0)
+        {
+            options.mode = HeadlessOptions::Mode::UVLayout;
+            for (; i + 1 < argc && argv[i + 1][0] != '-'; i++)
+                options.models.push_back(argv[i + 1]);
+        }
+        else if (strcmp(arg, "--coverage") == 0)
+        {
+            options.mode = HeadlessOptions::Mode::Coverage;
+            for (; i + 1 < argc && argv[i + 1][0] != '-'; i++)
+                options.models.push_back(argv[i + 1]);
+        }
+        else if (strcmp(arg, "--overlaps") == 0)
+        {
+            options.mode = HeadlessOptions::Mode::Overlaps;
+            for (; i + 1 < argc && argv[i + 1][0] != '-'; i++)
+                options.models.push_back(argv[i + 1]);
+        }
+        else if (strcmp(arg, "--validate-morph") == 0)
+        {
+            options.mode = HeadlessOptions::Mode::ValidateMorph;
+            for (; i + 1 < argc && argv[i + 1][0] != '-'; i++)
+                options.models.push_back(argv[i + 1]);
+        }
+        else if (strcmp(arg, "--bench") == 0)
+        {
+            options.mode = HeadlessOptions::Mode::Benchmark;
+            if (hasValue)
+                options.benchTriangles = std::max(2ull, strtoull(argv[++i], nullptr, 10));
+        }
+        else if (strcmp(arg, "--tolerance") == 0 && hasValue)
+            options.maxMorphError = (float)atof(argv[++i]);
+        else if (strcmp(arg, "--uvmode") == 0 && hasValue)
+        {
+            const char* mode = argv[++i];
+            if (strcmp(mode, "islands") == 0)
+                options.uvLayout.mode = UVRasterSettings::Mode::Islands;
+            else if (strcmp(mode, "stretch") == 0)
+                options.uvLayout.mode = UVRasterSettings::Mode::FaceAttribute;
+            else if (strcmp(mode, "id") == 0)
+                options.uvLayout.mode = UVRasterSettings::Mode::IslandId;
+            else
+                options.uvLayout.mode = UVRasterSettings::Mode::Wireframe;
+        }
+        else if (strcmp(arg, "--frames") == 0 && hasValue)
+            options.record.frameCount = std::max(1, atoi(argv[++i]));
+        else if (strcmp(arg, "--fps") == 0 && hasValue)
+            options.record.fps = std::max(1, atoi(argv[++i]));
+        else if (strcmp(arg, "--orbit") == 0 && i + 1 < argc)
+            options.record.orbitDegrees = (float)atof(argv[++i]);
+        else if (strcmp(arg, "--y4m") == 0)
+            options.record.format = RecordSettings::Format::Y4m;
+        else if (strcmp(arg, "--update") == 0)
+            options.updateReferences = true;
+        else if (strcmp(arg, "--out") == 0 && hasValue)
+            options.outDir = argv[++i];
+        else if (strcmp(arg, "--size") == 0 && hasValue)
+            options.size = std::max(16, atoi(argv[++i]));
+        else if (strcmp(arg, "--t") == 0 && hasValue)
+            options.interpolations = parseFloats(argv[++i]);
+        else if (strcmp(arg, "--view") == 0 && i + 1 < argc)
+        {
+            std::vector<float> view = parseFloats(argv[++i]);
+            if (view.size() == 2)
+                options.views.push_back(glm::vec2(view[0], view[1]));
+        }
+        else
+            std::cout << "Ignoring argument " << arg << std::endl;
+    }
+    if (options.interpolations.empty())
+        options.interpolations = { 0.0f, 0.5f, 1.0f };
+    if (options.views.empty())
+        options.views.push_back(glm::vec2(30.0f, 20.0f));
+    return options.mode != HeadlessOptions::Mode::None;
+}
+
+// ********************* Context ********************* //
+
+#if defined(__linux__) && defined(UVMAP_EGL)
+static EGLDisplay s_Display = EGL_NO_DISPLAY;
+static EGLContext s_Context = EGL_NO_CONTEXT;
+
+// Mesa's surfaceless platform: no X, no Wayland, no window, works on llvmpipe
+static bool createEglContext()
+{
+    auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (!getPlatformDisplay)
+        return false;
+    s_Display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    if (s_Display == EGL_NO_DISPLAY || !eglInitialize(s_Display, nullptr, nullptr))
+        return false;
+
+    if (!eglBindAPI(EGL_OPENGL_API))
+        return false;
+    // surfaceless displays may list no configs at all, a context without one is fine for FBOs (EGL_KHR_no_config_context)
+    const EGLint configAttribs[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+    EGLConfig config = EGL_NO_CONFIG_KHR;
+    EGLint configCount = 0;
+    if (!eglChooseConfig(s_Display, configAttribs, &config, 1, &configCount) || configCount == 0)
+        config = EGL_NO_CONFIG_KHR;
+
+    const EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3, EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE
+    };
+    s_Context = eglCreateContext(s_Display, config, EGL_NO_CONTEXT, contextAttribs);
+    if (s_Context == EGL_NO_CONTEXT)
+        return false;
+    // needs EGL_KHR_surfaceless_context, everything is drawn into FBOs
+    return eglMakeCurrent(s_Display, EGL_NO_SURFACE, EGL_NO_SURFACE, s_Context);
+}
+#endif
+
+static GLFWwindow* s_Window = nullptr;
+
+// Built with UVMAP_EGL on Linux (link libEGL), a surfaceless EGL context comes first and needs
+// no display server. Otherwise, or when that fails, a hidden GLFW window, which does need one.
+static bool createContext()
+{
+#if defined(__linux__) && defined(UVMAP_EGL)
+    if (createEglContext())
+    {
+        // glewInit would also look for GLX, which isn't there
+        glewExperimental = GL_TRUE;
+        if (glewContextInit() != GLEW_OK)
+            return false;
+        std::cout << "Headless: EGL surfaceless, " << glGetString(GL_RENDERER) << std::endl;
+        return true;
+    }
+    std::cout << "Headless: no EGL surfaceless display, falling back to a hidden window" << std::endl;
+#endif
+    if (!glfwInit())
+        return false;
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    s_Window = glfwCreateWindow(64, 64, "UVMap_Visualizer headless", NULL, NULL);
+    if (!s_Window)
+    {
+        glfwTerminate();
+        return false;
+    }
+    glfwMakeContextCurrent(s_Window);
+    if (glewInit() != GLEW_OK)
+        return false;
+    std::cout << "Headless: hidden window, " << glGetString(GL_RENDERER) << std::endl;
+    return true;
+}
+
+static void destroyContext()
+{
+#if defined(__linux__) && defined(UVMAP_EGL)
+    if (s_Context != EGL_NO_CONTEXT)
+    {
+        eglMakeCurrent(s_Display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(s_Display, s_Context);
+        eglTerminate(s_Display);
+        s_Context = EGL_NO_CONTEXT;
+    }
+#endif
+    if (s_Window)
+    {
+        glfwDestroyWindow(s_Window);
+        glfwTerminate();
+        s_Window = nullptr;
+    }
+}
+
+// ********************* Scene ********************* //
+
+// Everything that survives from one asset to the next: programs, the pass UBO, the morph
+// source buffer and the framebuffer. Only the mesh buffers are recreated per model.
+class HeadlessScene
+{
+private:
+    Shader m_Shader;
+    Renderer m_Renderer;
+    MorphFeedback m_Morph;
+    OffscreenTarget m_Target;
+    CommandList m_List;
+    Mesh m_Mesh;
+    MeshGl m_MeshGl;
+    MeshSimplifier m_Simplifier;
+    bool m_Loaded;
+
+public:
+    HeadlessScene(int size)
+        : m_Shader("res/shaders/basic.hlsl"), m_Target(size, size), m_Loaded(false)
+    {
+        DirectionalLight light(
+            glm::vec3(-0.2f, -1.0f, -0.3f),
+            glm::vec3(0.15f, 0.15f, 0.15f),
+            glm::vec3(0.5f, 0.5f, 0.5f),
+            glm::vec3(0.5f, 0.5f, 0.5f)
+        );
+        m_Shader.Bind();
+        light.setUniform(m_Shader);
+        m_Shader.SetUniform1f("material.shininess", 32.0f);
+        // plain white with the uv grid on top, the grid is what shows the unwrap
+        m_Shader.SetUniform1i("u_Texture", 0);
+        m_Shader.SetUniform1f("u_TextureColorMode", 0.0f);
+        m_Shader.SetUniform1f("u_TextureGridMode", 1.0f);
+        m_Shader.SetUniform1f("u_ShadowStrength", 0.0f);
+        m_Shader.SetUniform1f("u_ShadowBias", 0.0f);
+        m_Shader.SetUniform1i("u_PcfRadius", 0);
+    }
+
+    ~HeadlessScene()
+    {
+        if (m_Loaded)
+            m_MeshGl.deleteBuffers();
+    }
+
+    bool load(const std::string& path)
+    {
+        if (m_Loaded)
+            m_MeshGl.deleteBuffers();
+        m_Loaded = false;
+        m_Mesh = Mesh();
+        if (!m_Mesh.importOBJ(path.c_str()) || m_Mesh.f.empty())
+            return false;
+        m_MeshGl = m_Mesh.bake();
+        // the images are drawn right away, with the levels of detail the window would have once they are done
+        m_Simplifier.start(m_Mesh);
+        m_Simplifier.wait();
+        m_Simplifier.apply(m_Mesh, m_MeshGl);
+        m_Morph.setup(m_Mesh);
+        m_Loaded = true;
+        return true;
+    }
+
+    // leaves the image in the framebuffer
+    void draw(float interpolation, const glm::vec2& view)
+    {
+        // the EGL context has no default framebuffer and the hidden window's is 64x64, the morph's
+        // rasterizer-discard draw still needs a complete one bound
+        GLState::BindFramebuffer(m_Target.getID());
+        m_Morph.run(interpolation, m_MeshGl);
+
+        BoundingSphere bounds = m_Mesh.morphBounds.at(interpolation);
+        float radius = std::max(bounds.radius, 1e-3f);
+        float fov = glm::radians(35.0f);
+        glm::vec3 eye;
+        glm::mat4 viewMatrix = Camera::Orbit(bounds, view.x, view.y, fov, eye);
+        float distance = glm::length(eye - bounds.center);
+
+        RenderPass pass = {
+            "offscreen", m_Target.getID(), { 0, 0, m_Target.getWidth(), m_Target.getHeight() },
+            GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT, glm::vec4(0.18f, 0.18f, 0.18f, 1.0f),
+            {
+                viewMatrix,
+                glm::perspective(fov, (float)m_Target.getWidth() / m_Target.getHeight(), std::max(distance - radius * 1.1f, radius * 0.01f), distance + radius * 1.1f),
+                glm::mat4(1.0f), glm::vec4(eye, 1.0f)
+            }
+        };
+        m_List.Clear();
+        DrawItem& item = m_List.Draw(m_Shader, m_MeshGl, glm::mat4(1.0f));
+        item.interpolation = interpolation;
+        m_Renderer.BeginFrame();
+        m_Renderer.Submit(pass, m_List);
+    }
+
+    // the transform feedback morph's largest position error against the CPU at t
+    float validateMorph(float interpolation)
+    {
+        GLState::BindFramebuffer(m_Target.getID());
+        m_Morph.invalidate();
+        m_Morph.run(interpolation, m_MeshGl);
+        return m_Morph.validate(m_Mesh, interpolation, m_MeshGl);
+    }
+
+    // width * height * 4 bytes, top row first
+    void render(float interpolation, const glm::vec2& view, unsigned char* rgba)
+    {
+        draw(interpolation, view);
+        m_Target.readPixels(rgba);
+    }
+
+    const Mesh& getMesh() const { return m_Mesh; }
+    int getSize() const { return m_Target.getWidth(); }
+    unsigned int getFramebuffer() const { return m_Target.getID(); }
+};
+
+// ********************* Files ********************* //
+
+// "res/models/cylinder/cylinder.obj" -> "cylinder_cylinder", the folder keeps same-named files apart
+static std::string assetName(const std::string& path)
+{
+    size_t slash = path.find_last_of("/\\");
+    std::string file = slash == std::string::npos ? path : path.substr(slash + 1);
+    std::string stem = file.substr(0, file.find_last_of('.'));
+    if (slash == std::string::npos || slash == 0)
+        return stem;
+    size_t parentSlash = path.find_last_of("/\\", slash - 1);
+    std::string parent = path.substr(parentSlash == std::string::npos ? 0 : parentSlash + 1, slash - (parentSlash == std::string::npos ? 0 : parentSlash + 1));
+    return parent + "_" + stem;
+}
+
+static std::string imageName(const std::string& model, size_t t, size_t view)
+{
+    return assetName(model) + "_t" + std::to_string(t) + "_v" + std::to_string(view) + ".png";
+}
+
+// ********************* Perceptual diff ********************* //
+
+static glm::vec3 srgbToLab(const unsigned char* rgb)
+{
+    float c[3];
+    for (int i = 0; i < 3; i++)
+    {
+        float v = rgb[i] / 255.0f;
+        c[i] = v <= 0.04045f ? v / 12.92f : std::pow((v + 0.055f) / 1.055f, 2.4f);
+    }
+    // linear sRGB to XYZ, D65 white, then relative to the white point
+    float x = (0.4124f * c[0] + 0.3576f * c[1] + 0.1805f * c[2]) / 0.95047f;
+    float y = 0.2126f * c[0] + 0.7152f * c[1] + 0.0722f * c[2];
+    float z = (0.0193f * c[0] + 0.1192f * c[1] + 0.9505f * c[2]) / 1.08883f;
+    auto f = [](float t) { return t > 0.008856f ? std::cbrt(t) : 7.787f * t + 16.0f / 116.0f; };
+    float fx = f(x), fy = f(y), fz = f(z);
+    return glm::vec3(116.0f * fy - 16.0f, 500.0f * (fx - fy), 200.0f * (fy - fz));
+}
+
+// Pixels further apart than maxDeltaE in CIELAB count as different. Returns the count and
+// fills a diff image: the reference in gray, differing pixels in red.
+static size_t perceptualDiff(const unsigned char* a, const unsigned char* b, int width, int height, float maxDeltaE, unsigned char* diff)
+{
+    size_t failed = 0;
+    for (size_t i = 0; i < (size_t)width * height; i++)
+    {
+        const unsigned char* pa = a + i * 4;
+        const unsigned char* pb = b + i * 4;
+        float deltaE = glm::length(srgbToLab(pa) - srgbToLab(pb));
+        unsigned char gray = (unsigned char)((pb[0] + pb[1] + pb[2]) / 6);
+        unsigned char* d = diff + i * 4;
+        if (deltaE > maxDeltaE)
+        {
+            failed++;
+            d[0] = 255; d[1] = 0; d[2] = 0;
+        }
+        else
+        {
+            d[0] = gray; d[1] = gray; d[2] = gray;
+        }
+        d[3] = 255;
+    }
+    return failed;
+}
+
+// ********************* Modes ********************* //
+
+static int runThumbnails(HeadlessScene& scene, const HeadlessOptions& options)
+{
+    Utils::MakeDirectory(options.outDir);
+    int size = scene.getSize();
+    std::vector<unsigned char> pixels((size_t)size * size * 4);
+    size_t written = 0, failed = 0;
+    for (size_t m = 0; m < options.models.size(); m++)
+    {
+        const std::string& model = options.models[m];
+        if (!scene.load(model))
+        {
+            std::cout << "Thumbnails: can't load " << model << std::endl;
+            failed++;
+            continue;
+        }
+        for (size_t t = 0; t < options.interpolations.size(); t++)
+        {
+            for (size_t v = 0; v < options.views.size(); v++)
+            {
+                scene.render(options.interpolations[t], options.views[v], pixels.data());
+                std::string path = options.outDir + "/" + imageName(model, t, v);
+                if (PngWriter::Write(path.c_str(), size, size, 4, pixels.data()))
+                    written++;
+                else
+                    failed++;
+            }
+        }
+        std::cout << "[" << m + 1 << "/" << options.models.size() << "] " << model << std::endl;
+    }
+    std::cout << "Thumbnails: " << written << " written, " << failed << " failed" << std::endl;
+    return failed ? 1 : 0;
+}
+
+static int runRecord(HeadlessScene& scene, const HeadlessOptions& options)
+{
+    const std::string& model = options.models.front();
+    if (!scene.load(model))
+    {
+        std::cout << "Record: can't load " << model << std::endl;
+        return 1;
+    }
+
+    RecordSettings settings = options.record;
+    settings.pitch = options.views.front().y;
+    if (settings.format == RecordSettings::Format::Y4m)
+    {
+        Utils::MakeDirectory(options.outDir);
+        settings.path = options.outDir + "/" + assetName(model) + ".y4m";
+    }
+    else
+    {
+        settings.path = options.outDir;
+    }
+
+    Recorder recorder;
+    int size = scene.getSize();
+    if (!recorder.start(settings, size, size))
+        return 1;
+    while (recorder.isRecording())
+    {
+        int frame = recorder.getFrame();
+        glm::vec2 view(options.views.front().x + recorder.yawAt(frame), settings.pitch);
+        scene.draw(recorder.interpolationAt(frame), view);
+        recorder.capture(scene.getFramebuffer());
+    }
+    Recorder::Stats stats = recorder.getStats();
+    return stats.written == settings.frameCount && !recorder.hasFailed() ? 0 : 1;
+}
+
+static int runUVLayout(const HeadlessOptions& options)
+{
+    static const char* modeNames[] = { "wire", "islands", "stretch", "id" };
+    Utils::MakeDirectory(options.outDir);
+    UVRasterSettings settings = options.uvLayout;
+    settings.width = std::min(options.size, (int)UVRasterizer::MAX_SIZE);
+    settings.height = settings.width;
+
+    size_t failed = 0;
+    for (const std::string& model : options.models)
+    {
+        Mesh mesh;
+        UVIslands islands;
+        if (!mesh.importOBJ(model.c_str()))
+        {
+            failed++;
+            continue;
+        }
+        islands.build(mesh);
+        UVRasterizer rasterizer(mesh, islands);
+        std::string path = options.outDir + "/" + assetName(model) + "_uv_" + modeNames[(int)settings.mode] + ".png";
+        if (!rasterizer.exportPng(settings, path.c_str()))
+            failed++;
+    }
+    return failed ? 1 : 0;
+}
+
+static int runCoverage(const HeadlessOptions& options)
+{
+    Utils::MakeDirectory(options.outDir);
+    size_t failed = 0;
+    for (const std::string& model : options.models)
+    {
+        Mesh mesh;
+        UVIslands islands;
+        if (!mesh.importOBJ(model.c_str()))
+        {
+            failed++;
+            continue;
+        }
+        islands.build(mesh);
+        UVCoverage coverage(mesh, islands);
+        const UVCoverageReport& report = coverage.analyze(options.size, options.size);
+        std::string path = options.outDir + "/" + assetName(model) + "_coverage.json";
+        if (!report.writeJson(path.c_str(), model))
+            failed++;
+    }
+    return failed ? 1 : 0;
+}
+
+static int runOverlaps(const HeadlessOptions& options)
+{
+    Utils::MakeDirectory(options.outDir);
+    size_t failed = 0;
+    for (const std::string& model : options.models)
+    {
+        Mesh mesh;
+        UVIslands islands;
+        if (!mesh.importOBJ(model.c_str()))
+        {
+            failed++;
+            continue;
+        }
+        islands.build(mesh);
+        UVOverlaps overlaps(mesh, islands);
+        const UVOverlapReport& report = overlaps.detect();
+        std::string path = options.outDir + "/" + assetName(model) + "_overlaps.json";
+        if (!report.writeJson(path.c_str(), model))
+            failed++;
+    }
+    return failed ? 1 : 0;
+}
+
+// both GPU morphs against their CPU versions at every t; errors are relative to the mesh's size
+static int runValidateMorph(HeadlessScene& scene, const HeadlessOptions& options)
+{
+    std::vector<std::string> models = options.models;
+    if (models.empty())
+        models.assign(std::begin(REGRESSION_MODELS), std::end(REGRESSION_MODELS));
+
+    int failures = 0, checked = 0;
+    ExplodedMorph exploded;
+    for (const std::string& model : models)
+    {
+        if (!scene.load(model))
+        {
+            std::cout << "FAIL " << model << ": can't load" << std::endl;
+            failures++;
+            continue;
+        }
+        exploded.setup(scene.getMesh());
+        for (float t : options.interpolations)
+        {
+            float size = std::max(scene.getMesh().morphBounds.at(t).radius, 1e-6f);
+            GLState::BindFramebuffer(scene.getFramebuffer());
+            exploded.invalidate();
+            exploded.run(t);
+            float errors[2] = { scene.validateMorph(t), exploded.validate(t) };
+            const char* names[2] = { "feedback", "exploded" };
+            for (int k = 0; k < 2; k++)
+            {
+                checked++;
+                float relative = errors[k] / size;
+                if (errors[k] < 0.0f || !(relative <= options.maxMorphError))
+                {
+                    std::cout << "FAIL " << model << " " << names[k] << " at t = " << t << ": error " << relative << " of the mesh size" << std::endl;
+                    failures++;
+                }
+            }
+        }
+    }
+    std::cout << "Morph validation: " << checked - failures << "/" << checked << " within " << options.maxMorphError << std::endl;
+    return failures ? 1 : 0;
+}
+
+static int runRegression(HeadlessScene& scene, const HeadlessOptions& options)
+{
+    Utils::MakeDirectory(options.outDir);
+    if (options.updateReferences)
+        Utils::MakeDirectory(options.referenceDir);
+
+    int size = scene.getSize();
+    size_t pixelCount = (size_t)size * size;
+    std::vector<unsigned char> pixels(pixelCount * 4), diff(pixelCount * 4);
+    int failures = 0, compared = 0;
+    stbi_set_flip_vertically_on_load_thread(0); // PngWriter writes top row first, so do the references
+    for (const char* model : REGRESSION_MODELS)
+    {
+        if (!scene.load(model))
+        {
+            std::cout << "FAIL " << model << ": can't load" << std::endl;
+            failures++;
+            continue;
+        }
+        for (size_t t = 0; t < options.interpolations.size(); t++)
+        {
+            for (size_t v = 0; v < options.views.size(); v++)
+            {
+                std::string name = imageName(model, t, v);
+                std::string referencePath = options.referenceDir + "/" + name;
+                scene.render(options.interpolations[t], options.views[v], pixels.data());
+                if (options.updateReferences)
+                {
+                    PngWriter::Write(referencePath.c_str(), size, size, 4, pixels.data());
+                    continue;
+                }
+
+                compared++;
+                int width, height, channels;
+                unsigned char* reference = stbi_load(referencePath.c_str(), &width, &height, &channels, 4);
+                if (!reference)
+                {
+                    std::cout << "FAIL " << name << ": no reference at " << referencePath << " (run with --update)" << std::endl;
+                    failures++;
+                    continue;
+                }
+                if (width != size || height != size)
+                {
+                    std::cout << "FAIL " << name << ": the reference isn't " << size << "x" << size << " (run with --update)" << std::endl;
+                    failures++;
+                    stbi_image_free(reference);
+                    continue;
+                }
+                size_t different = perceptualDiff(pixels.data(), reference, size, size, options.maxDeltaE, diff.data());
+                stbi_image_free(reference);
+                if (different > pixelCount * options.maxFailFraction)
+                {
+                    std::cout << "FAIL " << name << ": " << different << " pixels differ" << std::endl;
+                    std::string stem = options.outDir + "/" + name.substr(0, name.size() - 4);
+                    PngWriter::Write((stem + "_actual.png").c_str(), size, size, 4, pixels.data());
+                    PngWriter::Write((stem + "_diff.png").c_str(), size, size, 4, diff.data());
+                    failures++;
+                }
+                else
+                {
+                    std::cout << "ok   " << name << " (" << different << " pixels differ)" << std::endl;
+                }
+            }
+        }
+    }
+
+    if (options.updateReferences)
+        std::cout << "Regression: references written to " << options.referenceDir << std::endl;
+    else
+        std::cout << "Regression: " << compared - failures << "/" << compared << " passed" << std::endl;
+    return failures ? 1 : 0;
+}
+
+static double elapsedMs(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// best of a few runs, the first one also pays for page faults
+template <typename F>
+static double bestMs(F pass, int runs = 3)
+{
+    double best = 1e30;
+    for (int i = 0; i < runs; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        pass();
+        best = std::min(best, elapsedMs(start));
+    }
+    return best;
+}
+
+// a wavy square grid of about the given number of triangles, uvs spanning [0, 1]
+static void buildBenchmarkGrid(Mesh& mesh, size_t triangles)
+{
+    int n = std::max(1, (int)std::ceil(std::sqrt(triangles / 2.0)));
+    size_t side = (size_t)n + 1;
+    mesh.pos.resize(side * side);
+    mesh.uv.resize(side * side);
+    mesh.normal.assign(side * side, glm::vec3(0.0f, 0.0f, 1.0f));
+    for (size_t y = 0; y < side; y++)
+    {
+        for (size_t x = 0; x < side; x++)
+        {
+            glm::vec2 uv((float)x / n, (float)y / n);
+            size_t i = y * side + x;
+            mesh.uv[i] = uv;
+            mesh.pos[i] = glm::vec3(uv.x * 2.0f - 1.0f, uv.y * 2.0f - 1.0f, 0.1f * std::sin(uv.x * 20.0f) * std::cos(uv.y * 12.0f));
+        }
+    }
+    mesh.f.resize((size_t)n * n * 2);
+    for (int y = 0; y < n; y++)
+    {
+        for (int x = 0; x < n; x++)
+        {
+            int i = y * (int)side + x;
+            Face* quad = &mesh.f[((size_t)y * n + x) * 2];
+            quad[0] = { { i, i + 1, i + (int)side + 1 } };
+            quad[1] = { { i, i + (int)side + 1, i + (int)side } };
+        }
+    }
+    mesh.generation = Mesh::nextGeneration();
+    mesh.centroid3D = glm::vec3(0.0f);
+    mesh.centroid2D = glm::vec3(0.5f, 0.5f, 0.0f);
+    mesh.averageScaling = 1.0f;
+    mesh.bestRotation = glm::mat3(1.0f);
+}
+
+static double megabytes(size_t bytes)
+{
+    return bytes / (1024.0 * 1024.0);
+}
+
+// The layout, morph and bounding volume passes on a generated grid, each against the interleaved
+// layout with 40 byte faces (three indices, a uv scaling and two centroids) the mesh used before
+// its streams were split. Nothing is drawn, the numbers are CPU time and bytes touched.
+static int runBenchmark(const HeadlessOptions& options)
+{
+    Mesh mesh;
+    MemoryStats::BeginImport();
+    buildBenchmarkGrid(mesh, options.benchTriangles);
+    MemoryStats::EndImport();
+    size_t vertices = mesh.vertexCount(), faces = mesh.f.size();
+    std::cout << "Bench: " << faces << " triangles, " << vertices << " vertices" << std::endl;
+    std::cout << "Bench: build allocations heap " << MemoryStats::LastImportHeap().count << " (" << megabytes(MemoryStats::LastImportHeap().bytes) << " MB)" << std::endl;
+
+    const size_t oldFaceBytes = 40;
+    size_t streams = vertices * (sizeof(glm::vec3) * 2 + sizeof(glm::vec2));
+    std::cout << "Bench: faces " << megabytes(faces * sizeof(Face)) << " MB, were " << megabytes(faces * oldFaceBytes) << " MB; vertex streams "
+        << megabytes(streams) << " MB, same as interleaved" << std::endl;
+
+    // a pass that reads one attribute, over its stream and over interleaved vertices
+    std::vector<Vertex> interleaved(vertices);
+    for (size_t i = 0; i < vertices; i++)
+        interleaved[i] = mesh.vertex((int)i);
+    // both read every value they time, the results are compared so neither pass can be skipped
+    glm::vec3 low(0.0f), high(0.0f), interleavedLow(0.0f), interleavedHigh(0.0f);
+    double posStream = bestMs([&] {
+        low = high = mesh.pos[0];
+        for (const glm::vec3& p : mesh.pos)
+        {
+            low = glm::min(low, p);
+            high = glm::max(high, p);
+        }
+    });
+    double posInterleaved = bestMs([&] {
+        interleavedLow = interleavedHigh = interleaved[0].pos;
+        for (const Vertex& v : interleaved)
+        {
+            interleavedLow = glm::min(interleavedLow, v.pos);
+            interleavedHigh = glm::max(interleavedHigh, v.pos);
+        }
+    });
+    bool agree = low == interleavedLow && high == interleavedHigh;
+    glm::vec2 uvLow(0.0f), uvHigh(0.0f), interleavedUVLow(0.0f), interleavedUVHigh(0.0f);
+    double uvStream = bestMs([&] {
+        uvLow = uvHigh = mesh.uv[0];
+        for (const glm::vec2& uv : mesh.uv)
+        {
+            uvLow = glm::min(uvLow, uv);
+            uvHigh = glm::max(uvHigh, uv);
+        }
+    });
+    double uvInterleaved = bestMs([&] {
+        interleavedUVLow = interleavedUVHigh = interleaved[0].uv;
+        for (const Vertex& v : interleaved)
+        {
+            interleavedUVLow = glm::min(interleavedUVLow, v.uv);
+            interleavedUVHigh = glm::max(interleavedUVHigh, v.uv);
+        }
+    });
+    agree = agree && uvLow == interleavedUVLow && uvHigh == interleavedUVHigh;
+    interleaved = std::vector<Vertex>();
+    std::cout << "Bench: position pass " << posStream << " ms, interleaved " << posInterleaved << " ms" << std::endl;
+    std::cout << "Bench: uv pass " << uvStream << " ms, interleaved " << uvInterleaved << " ms" << std::endl;
+    if (!agree)
+    {
+        std::cout << "Bench: the stream and interleaved passes disagree" << std::endl;
+        return 1;
+    }
+
+    // a morph step the way the frame does it, against the copy of the whole mesh it used to make
+    std::vector<glm::vec3> morphed(vertices);
+    double morphInPlace = bestMs([&] { mesh.interpolate(0.5f, morphed.data()); });
+    double morphCopy = bestMs([&] { Mesh copy = mesh.interpolate(0.5f); });
+    morphed = std::vector<glm::vec3>();
+    std::cout << "Bench: morph step " << morphInPlace << " ms writing " << megabytes(vertices * sizeof(glm::vec3)) << " MB, whole mesh copy "
+        << morphCopy << " ms" << std::endl;
+
+    // the second frame is the steady state, the first one grows the arena
+    for (int frame = 0; frame < 2; frame++)
+    {
+        MemoryStats::BeginFrame();
+        ArenaVector<glm::vec3> positions(vertices, glm::vec3(0.0f), ArenaAllocator<glm::vec3>(Arena::Frame()));
+        mesh.interpolate(0.5f, positions.data());
+    }
+    MemoryStats::BeginFrame();
+    std::cout << "Bench: morph frame allocations heap " << MemoryStats::LastFrameHeap().count << " (" << megabytes(MemoryStats::LastFrameHeap().bytes)
+        << " MB), arena " << MemoryStats::LastFrameArena().count << " (" << megabytes(MemoryStats::LastFrameArena().bytes) << " MB)" << std::endl;
+
+    AABB box;
+    BoundingSphere sphere;
+    OBB obb;
+    double aabbMs = bestMs([&] { box = computeAABB(mesh.pos.data(), vertices); });
+    double sphereMs = bestMs([&] { sphere = computeBoundingSphere(mesh.pos.data(), vertices); });
+    double obbMs = bestMs([&] { obb = computeOBB(mesh.pos.data(), vertices); });
+    double boxSphere = glm::length(box.max - box.min) * 0.5f;
+    std::cout << "Bench: AABB " << aabbMs << " ms, sphere " << sphereMs << " ms, OBB " << obbMs << " ms" << std::endl;
+    std::cout << "Bench: sphere radius " << sphere.radius << ", around the AABB " << boxSphere << "; OBB volume "
+        << 8.0f * obb.halfExtents.x * obb.halfExtents.y * obb.halfExtents.z << ", AABB " << (box.max.x - box.min.x) * (box.max.y - box.min.y) * (box.max.z - box.min.z) << std::endl;
+
+    MemoryStats::BeginImport();
+    double clustersMs = bestMs([&] { mesh.buildClusters(); }, 1);
+    MemoryStats::EndImport();
+    std::cout << "Bench: clusters " << clustersMs << " ms for " << mesh.clusters.size() << ", allocations heap " << MemoryStats::LastImportHeap().count
+        << " (" << megabytes(MemoryStats::LastImportHeap().bytes) << " MB), arena " << MemoryStats::LastImportArena().count
+        << " (" << megabytes(MemoryStats::LastImportArena().bytes) << " MB)" << std::endl;
+    return 0;
+}
+
+int RunHeadless(const HeadlessOptions& options)
+{
+    if (options.mode == HeadlessOptions::Mode::UVLayout)
+        return runUVLayout(options);
+    if (options.mode == HeadlessOptions::Mode::Coverage)
+        return runCoverage(options);
+    if (options.mode == HeadlessOptions::Mode::Overlaps)
+        return runOverlaps(options);
+    if (options.mode == HeadlessOptions::Mode::Benchmark)
+        return runBenchmark(options);
+
+    if (!createContext())
+    {
+        std::cout << "Headless: no OpenGL 3.3 context" << std::endl;
+        return 2;
+    }
+    GLDebug::Init(GLErrorMode::Callback);
+    GLState::SetEnabled(GL_DEPTH_TEST, true);
+
+    int result;
+    {
+        // the scene owns GL objects, they have to go before the context
+        HeadlessScene scene(options.size);
+        if (options.mode == HeadlessOptions::Mode::Thumbnails)
+            result = runThumbnails(scene, options);
+        else if (options.mode == HeadlessOptions::Mode::Record)
+            result = runRecord(scene, options);
+        else if (options.mode == HeadlessOptions::Mode::ValidateMorph)
+            result = runValidateMorph(scene, options);
+        else
+            result = runRegression(scene, options);
+    }
+    destroyContext();
+    return result;
+}
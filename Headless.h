@@ -0,0 +1,51 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+#include "Recorder.h"
+#include "UVRasterizer.h"
+
+// Command line modes that render without a window. On Linux, built with UVMAP_EGL, they get a
+// surfaceless EGL context that needs no display (llvmpipe works); otherwise a hidden GLFW window,
+// which needs an X or Wayland display.
+//   --thumbnails <model.obj | @list.txt>...   one PNG per model, t value and view
+//   --regress [reference dir]                 renders the bundled models, compares with the references in
+//                                             res/regression; a missing reference fails, --update writes them
+//   --record <model.obj>                      an interpolation sweep through the recorder, PNG frames or
+//                                             --y4m, with --frames <n>, --fps <n>, --orbit <degrees>
+//   --uvlayout <model.obj>...                 the uv layout as an image, --uvmode wire|islands|stretch|id,
+//                                             --size up to 16384; needs no OpenGL
+//   --coverage <model.obj>...                 texel coverage, overlap and island waste at --size as JSON
+//   --overlaps <model.obj>...                 overlapping face pairs and flipped faces as JSON
+//   --validate-morph [model.obj]...           both GPU morphs against the CPU at every --t, fails above
+//                                             --tolerance of the mesh size; the bundled models by default
+//   --bench [triangles]                       memory and pass times of a generated grid, 10M triangles by
+//                                             default; needs no OpenGL
+// common options: --out <dir>, --size <pixels>, --t 0,0.5,1, --view yaw,pitch (repeatable),
+// --update (regress: write the references instead of comparing)
+struct HeadlessOptions
+{
+	enum class Mode { None, Thumbnails, Regress, Record, UVLayout, Coverage, Overlaps, ValidateMorph, Benchmark };
+
+	Mode mode = Mode::None;
+	std::vector<std::string> models;
+	std::vector<float> interpolations;
+	std::vector<glm::vec2> views; // yaw, pitch in degrees
+	int size = 256;
+	std::string outDir = ".";
+	std::string referenceDir = "res/regression";
+	bool updateReferences = false;
+	float maxDeltaE = 2.3f;         // CIE76, about one just noticeable difference
+	float maxFailFraction = 0.001f; // of the pixels, above that the image fails
+	float maxMorphError = 1e-3f;    // validate-morph: of the mesh's bounding radius
+	size_t benchTriangles = 10000000;
+	RecordSettings record;          // path is derived from outDir, pitch from the first view
+	UVRasterSettings uvLayout;      // width and height come from size
+};
+
+// true when the arguments ask for a headless mode
+bool ParseHeadlessArgs(int argc, char** argv, HeadlessOptions& options);
+// returns the process exit code
+int RunHeadless(const HeadlessOptions& options);
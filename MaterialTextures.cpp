@@ -0,0 +1,271 @@
+#include "MaterialTextures.h"
+
+#include <GL/glew.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include "mesh.h"
+#include "Renderer.h"
+#include "GLState.h"
+#include "Utils.h"
+#include "vendor/stb_image/stb_image.h"
+
+static const int MAP_COUNT = (int)MaterialMap::Count;
+// of an array's base level; every layer has the size of the largest map, so a few large maps on
+// many materials would otherwise take gigabytes
+static const size_t ARRAY_BUDGET = (size_t)256 << 20;
+
+struct Image
+{
+	int width = 0, height = 0;
+	std::vector<unsigned char> rgba;
+};
+
+// exporters write absolute paths and backslashes, so the file name alone is tried as well
+static bool loadMap(const Mesh& mesh, const std::string& textureSet, std::string file, Image& image)
+{
+	std::replace(file.begin(), file.end(), '\\', '/');
+	size_t slash = file.find_last_of('/');
+	std::string name = slash == std::string::npos ? file : file.substr(slash + 1);
+	std::string candidates[4];
+	int count = 0;
+	if (!textureSet.empty())
+	{
+		candidates[count++] = mesh.directory + textureSet + "/" + file;
+		candidates[count++] = mesh.directory + textureSet + "/" + name;
+	}
+	candidates[count++] = mesh.directory + file;
+	candidates[count++] = mesh.directory + name;
+	for (int i = 0; i < count; i++)
+	{
+		int channels = 0;
+		unsigned char* pixels = stbi_load(candidates[i].c_str(), &image.width, &image.height, &channels, 4);
+		if (!pixels)
+			continue;
+		image.rgba.assign(pixels, pixels + (size_t)image.width * image.height * 4);
+		stbi_image_free(pixels);
+		return true;
+	}
+	return false;
+}
+
+// 2 x 2 box along the axes that are at least twice the target's
+static Image halve(const Image& source, int width, int height)
+{
+	int stepX = source.width >= width * 2 ? 2 : 1, stepY = source.height >= height * 2 ? 2 : 1;
+	Image half;
+	half.width = source.width / stepX;
+	half.height = source.height / stepY;
+	half.rgba.resize((size_t)half.width * half.height * 4);
+	for (int y = 0; y < half.height; y++)
+	{
+		for (int x = 0; x < half.width; x++)
+		{
+			const unsigned char* p00 = &source.rgba[((size_t)y * stepY * source.width + x * stepX) * 4];
+			const unsigned char* p01 = p00 + (stepX - 1) * 4;
+			const unsigned char* p10 = p00 + (size_t)(stepY - 1) * source.width * 4;
+			const unsigned char* p11 = p10 + (stepX - 1) * 4;
+			unsigned char* out = &half.rgba[((size_t)y * half.width + x) * 4];
+			for (int c = 0; c < 4; c++)
+				out[c] = (unsigned char)((p00[c] + p01[c] + p10[c] + p11[c] + 2) / 4);
+		}
+	}
+	return half;
+}
+
+// bilinear, texel centers line up; a plain copy when the sizes match. Maps that shrink to half or
+// less are box filtered down first, bilinear alone would skip texels.
+static void resample(const Image& source, int width, int height, unsigned char* target)
+{
+	if (source.width == width && source.height == height)
+	{
+		std::copy(source.rgba.begin(), source.rgba.end(), target);
+		return;
+	}
+	if (source.width >= width * 2 || source.height >= height * 2)
+	{
+		resample(halve(source, width, height), width, height, target);
+		return;
+	}
+	float scaleX = (float)source.width / width, scaleY = (float)source.height / height;
+	for (int y = 0; y < height; y++)
+	{
+		float sy = std::max(0.0f, (y + 0.5f) * scaleY - 0.5f);
+		int y0 = std::min((int)sy, source.height - 1), y1 = std::min(y0 + 1, source.height - 1);
+		float fy = sy - y0;
+		for (int x = 0; x < width; x++)
+		{
+			float sx = std::max(0.0f, (x + 0.5f) * scaleX - 0.5f);
+			int x0 = std::min((int)sx, source.width - 1), x1 = std::min(x0 + 1, source.width - 1);
+			float fx = sx - x0;
+			const unsigned char* p00 = &source.rgba[((size_t)y0 * source.width + x0) * 4];
+			const unsigned char* p01 = &source.rgba[((size_t)y0 * source.width + x1) * 4];
+			const unsigned char* p10 = &source.rgba[((size_t)y1 * source.width + x0) * 4];
+			const unsigned char* p11 = &source.rgba[((size_t)y1 * source.width + x1) * 4];
+			unsigned char* out = &target[((size_t)y * width + x) * 4];
+			for (int c = 0; c < 4; c++)
+			{
+				float top = p00[c] + (p01[c] - p00[c]) * fx;
+				float bottom = p10[c] + (p11[c] - p10[c]) * fx;
+				out[c] = (unsigned char)(top + (bottom - top) * fy + 0.5f);
+			}
+		}
+	}
+}
+
+static void createArray(unsigned int& id)
+{
+	if (id)
+		return;
+	GLCall(glGenTextures(1, &id));
+	GLState::BindTexture(0, GL_TEXTURE_2D_ARRAY, id);
+	GLCall(glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR));
+	GLCall(glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+	GLCall(glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT));
+	GLCall(glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT));
+}
+
+static void uploadArray(unsigned int id, int width, int height, unsigned int layers, const unsigned char* pixels)
+{
+	GLState::BindTexture(0, GL_TEXTURE_2D_ARRAY, id);
+	GLCall(glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, width, height, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels));
+	// the morph shrinks the mesh a lot, the layers get minified
+	GLCall(glGenerateMipmap(GL_TEXTURE_2D_ARRAY));
+	GLState::BindTexture(0, GL_TEXTURE_2D_ARRAY, 0);
+}
+
+MaterialTextures::MaterialTextures()
+	: m_ColorArray(0), m_OrmArray(0), m_ColorSize{ 0, 0 }, m_OrmSize{ 0, 0 }, m_Layers(0), m_MapsLoaded(0), m_MapsMissing(0), m_LoadMs(0.0)
+{
+}
+
+MaterialTextures::~MaterialTextures()
+{
+	GLState::ForgetTexture(m_ColorArray);
+	GLState::ForgetTexture(m_OrmArray);
+	glDeleteTextures(1, &m_ColorArray);
+	glDeleteTextures(1, &m_OrmArray);
+}
+
+bool MaterialTextures::load(const Mesh& mesh, const std::string& textureSet)
+{
+	auto start = std::chrono::steady_clock::now();
+	m_Layers = (unsigned int)std::min<size_t>(mesh.materials.size(), 256);
+	m_MapsLoaded = 0;
+	m_MapsMissing = 0;
+	if (m_Layers == 0)
+		return false;
+
+	// decoding dominates, every map on its own thread; the flip is per thread, like every loader's
+	std::vector<Image> images(m_Layers * MAP_COUNT);
+	std::vector<unsigned char> found(images.size(), 0);
+	Utils::ParallelFor((int)images.size(), [&](int i)
+	{
+		stbi_set_flip_vertically_on_load_thread(1);
+		const std::string& file = mesh.materials[i / MAP_COUNT].maps[i % MAP_COUNT];
+		if (!file.empty())
+			found[i] = loadMap(mesh, textureSet, file, images[i]) ? 1 : 0;
+	});
+	for (size_t i = 0; i < images.size(); i++)
+	{
+		if (found[i])
+			m_MapsLoaded++;
+		else if (!mesh.materials[i / MAP_COUNT].maps[i % MAP_COUNT].empty())
+		{
+			m_MapsMissing++;
+			std::cout << "MaterialTextures: " << mesh.materials[i / MAP_COUNT].maps[i % MAP_COUNT] << " not found in " << mesh.directory
+				<< (textureSet.empty() ? "" : " or " + mesh.directory + textureSet) << std::endl;
+		}
+	}
+
+	// the largest map sets the size of its array, 1 x 1 when the layers are all constants
+	int colorSize[2] = { 1, 1 }, ormSize[2] = { 1, 1 };
+	for (size_t i = 0; i < images.size(); i++)
+	{
+		if (!found[i])
+			continue;
+		int* size = i % MAP_COUNT == (int)MaterialMap::BaseColor ? colorSize : ormSize;
+		size[0] = std::max(size[0], images[i].width);
+		size[1] = std::max(size[1], images[i].height);
+	}
+	// halved until the layers fit, the aspect stays
+	for (int* size : { colorSize, ormSize })
+	{
+		while ((size_t)size[0] * size[1] * 4 * m_Layers > ARRAY_BUDGET && (size[0] > 1 || size[1] > 1))
+		{
+			size[0] = std::max(1, size[0] / 2);
+			size[1] = std::max(1, size[1] / 2);
+		}
+	}
+
+	size_t colorLayer = (size_t)colorSize[0] * colorSize[1] * 4, ormLayer = (size_t)ormSize[0] * ormSize[1] * 4;
+	std::vector<unsigned char> color(colorLayer * m_Layers), orm(ormLayer * m_Layers);
+	Utils::ParallelFor((int)m_Layers, [&](int layer)
+	{
+		const Material& material = mesh.materials[layer];
+		const Image* maps = &images[(size_t)layer * MAP_COUNT];
+		const unsigned char* has = &found[(size_t)layer * MAP_COUNT];
+
+		unsigned char* colorPixels = &color[colorLayer * layer];
+		if (has[(int)MaterialMap::BaseColor])
+			resample(maps[(int)MaterialMap::BaseColor], colorSize[0], colorSize[1], colorPixels);
+		else
+		{
+			glm::vec3 diffuse = glm::clamp(material.diffuseColor, 0.0f, 1.0f) * 255.0f;
+			for (size_t p = 0; p < colorLayer; p += 4)
+			{
+				colorPixels[p + 0] = (unsigned char)(diffuse.x + 0.5f);
+				colorPixels[p + 1] = (unsigned char)(diffuse.y + 0.5f);
+				colorPixels[p + 2] = (unsigned char)(diffuse.z + 0.5f);
+				colorPixels[p + 3] = 255;
+			}
+		}
+
+		// r, g, b from the red channel of their own maps, or from their own channel when one file
+		// feeds several of them, packed the glTF way; without a map: no occlusion, the material's
+		// roughness, not metallic
+		unsigned char* ormPixels = &orm[ormLayer * layer];
+		const unsigned char constants[3] = { 255, (unsigned char)(glm::clamp(material.roughness, 0.0f, 1.0f) * 255.0f + 0.5f), 0 };
+		const MaterialMap channels[3] = { MaterialMap::AmbientOcclusion, MaterialMap::Roughness, MaterialMap::Metallic };
+		std::vector<unsigned char> scratch;
+		for (int c = 0; c < 3; c++)
+		{
+			int map = (int)channels[c];
+			if (has[map])
+			{
+				bool packed = false;
+				for (int other = 0; other < 3; other++)
+					packed |= other != c && material.maps[(int)channels[other]] == material.maps[map];
+				scratch.resize(ormLayer);
+				resample(maps[map], ormSize[0], ormSize[1], scratch.data());
+				int source = packed ? c : 0;
+				unsigned char invert = channels[c] == MaterialMap::Roughness && material.shininessMap ? 255 : 0;
+				for (size_t p = 0; p < ormLayer; p += 4)
+					ormPixels[p + c] = scratch[p + source] ^ invert;
+			}
+			else
+			{
+				for (size_t p = 0; p < ormLayer; p += 4)
+					ormPixels[p + c] = constants[c];
+			}
+		}
+		for (size_t p = 0; p < ormLayer; p += 4)
+			ormPixels[p + 3] = 255;
+	});
+
+	createArray(m_ColorArray);
+	createArray(m_OrmArray);
+	uploadArray(m_ColorArray, colorSize[0], colorSize[1], m_Layers, color.data());
+	uploadArray(m_OrmArray, ormSize[0], ormSize[1], m_Layers, orm.data());
+	m_ColorSize[0] = colorSize[0];
+	m_ColorSize[1] = colorSize[1];
+	m_OrmSize[0] = ormSize[0];
+	m_OrmSize[1] = ormSize[1];
+
+	m_LoadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "MaterialTextures: " << m_Layers << " materials, " << m_MapsLoaded << " maps, color " << colorSize[0] << " x " << colorSize[1]
+		<< ", orm " << ormSize[0] << " x " << ormSize[1] << " in " << m_LoadMs << " ms" << std::endl;
+	return m_MapsLoaded > 0;
+}
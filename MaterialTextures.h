@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+struct Mesh;
+
+// The maps of every material of a mesh as two texture arrays with a layer per material, so a mesh
+// with many materials still draws in one call: its vertices carry their material (Mesh::material)
+// and the shader picks the layer. Base color is RGBA, ambient occlusion, roughness and metallic
+// share the ORM array in r, g and b the way glTF packs them. A material without a map gets a layer
+// filled with its constant instead. All layers of an array have one size, the largest map's, halved
+// until the array fits a fixed budget; other maps are resampled when they are loaded.
+class MaterialTextures
+{
+private:
+	unsigned int m_ColorArray, m_OrmArray;
+	int m_ColorSize[2], m_OrmSize[2];
+	unsigned int m_Layers;
+	size_t m_MapsLoaded, m_MapsMissing;
+	double m_LoadMs;
+
+public:
+	MaterialTextures();
+	~MaterialTextures();
+
+	// Looks the maps up in textureSet, a subdirectory of the mesh's directory (files like Die-OBJ
+	// ship several), then in the directory itself. Decoding runs on all cores. Returns whether any
+	// map was found; without one the mesh is better off with its plain texture.
+	bool load(const Mesh& mesh, const std::string& textureSet = "");
+	bool isLoaded() const { return m_MapsLoaded > 0; }
+
+	unsigned int getColorArray() const { return m_ColorArray; }
+	unsigned int getOrmArray() const { return m_OrmArray; }
+	unsigned int getLayerCount() const { return m_Layers; }
+	int getColorWidth() const { return m_ColorSize[0]; }
+	int getColorHeight() const { return m_ColorSize[1]; }
+	int getOrmWidth() const { return m_OrmSize[0]; }
+	int getOrmHeight() const { return m_OrmSize[1]; }
+	size_t getMapsLoaded() const { return m_MapsLoaded; }
+	size_t getMapsMissing() const { return m_MapsMissing; } // named by the file but not found
+	double getLoadMs() const { return m_LoadMs; }
+};
@@ -0,0 +1,165 @@
+#include "MeshBvh.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "mesh.h"
+#include "BvhBuilder.h"
+
+// a face's boxes at both morph end points; SAH pays for the surface area at both
+struct MorphBox
+{
+    glm::vec3 min0, max0, min1, max1;
+
+    MorphBox() : min0(INFINITY), max0(-INFINITY), min1(INFINITY), max1(-INFINITY) {}
+
+    void grow(const MorphBox& other)
+    {
+        min0 = glm::min(min0, other.min0);
+        max0 = glm::max(max0, other.max0);
+        min1 = glm::min(min1, other.min1);
+        max1 = glm::max(max1, other.max1);
+    }
+
+    float area() const
+    {
+        glm::vec3 d0 = max0 - min0, d1 = max1 - min1;
+        return d0.x * d0.y + d0.y * d0.z + d0.z * d0.x + d1.x * d1.y + d1.y * d1.z + d1.z * d1.x;
+    }
+
+    // centroid at t = 0, then at t = 1
+    float key(int k) const { return k < 3 ? (min0[k] + max0[k]) * 0.5f : (min1[k - 3] + max1[k - 3]) * 0.5f; }
+};
+
+MeshBvh::MeshBvh(const Mesh& mesh)
+    : m_Mesh(mesh), m_BuildMs(0.0)
+{
+}
+
+void MeshBvh::build()
+{
+    auto start = std::chrono::steady_clock::now();
+    const Mesh& mesh = m_Mesh;
+    BvhBuilder<MorphBox, 6, 3> builder;
+    builder.build((int)mesh.f.size(), [&](int i, MorphBox& box)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            int v = mesh.f[i].vi[k];
+            glm::vec3 p0 = mesh.morphStart(v), p1 = mesh.morphEnd(v);
+            box.min0 = glm::min(box.min0, p0);
+            box.max0 = glm::max(box.max0, p0);
+            box.min1 = glm::min(box.min1, p1);
+            box.max1 = glm::max(box.max1, p1);
+        }
+        bool finite = true;
+        for (int k = 0; k < 6; k++)
+            finite &= std::isfinite(box.key(k));
+        return finite;
+    });
+
+    m_Faces.swap(builder.items);
+    m_Nodes.resize(builder.nodes.size());
+    m_Ends.resize(builder.nodes.size() * 4);
+    for (size_t i = 0; i < builder.nodes.size(); i++)
+    {
+        const BvhBuilder<MorphBox, 6, 3>::Node& node = builder.nodes[i];
+        m_Nodes[i].first = node.first;
+        m_Nodes[i].count = node.count;
+        m_Ends[i * 4 + 0] = node.box.min0;
+        m_Ends[i * 4 + 1] = node.box.max0;
+        m_Ends[i * 4 + 2] = node.box.min1;
+        m_Ends[i * 4 + 3] = node.box.max1;
+    }
+    m_BuildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// entry distance of the ray into the node's box at t, INFINITY when it misses or starts past limit
+float MeshBvh::slabs(int node, float t, const glm::vec3& origin, const glm::vec3& inverse, float limit) const
+{
+    const glm::vec3* ends = &m_Ends[(size_t)node * 4];
+    glm::vec3 t0 = (glm::mix(ends[0], ends[2], t) - origin) * inverse;
+    glm::vec3 t1 = (glm::mix(ends[1], ends[3], t) - origin) * inverse;
+    glm::vec3 near = glm::min(t0, t1), far = glm::max(t0, t1);
+    float enter = std::max(std::max(near.x, near.y), std::max(near.z, 0.0f));
+    float exit = std::min(std::min(far.x, far.y), std::min(far.z, limit));
+    return enter <= exit ? enter : INFINITY;
+}
+
+bool MeshBvh::raycast(const glm::vec3& origin, const glm::vec3& direction, float t, MeshHit& hit) const
+{
+    hit.face = -1;
+    hit.t = t;
+    if (m_Nodes.empty())
+        return false;
+
+    // no zero components, 0 * inf would poison the slab test
+    glm::vec3 inverse;
+    for (int k = 0; k < 3; k++)
+    {
+        float d = std::abs(direction[k]) > 1e-20f ? direction[k] : 1e-20f;
+        inverse[k] = 1.0f / d;
+    }
+
+    const Mesh& mesh = m_Mesh;
+    float closest = INFINITY;
+    int stack[128]; // BvhBuilder keeps the depth under 100
+    int top = 0;
+    if (slabs(0, t, origin, inverse, closest) == INFINITY)
+        return false;
+    stack[top++] = 0;
+    while (top > 0)
+    {
+        const Node& node = m_Nodes[stack[--top]];
+        if (node.count > 0)
+        {
+            // Moller-Trumbore on the corners at t, both sides
+            for (int slot = node.first; slot < node.first + node.count; slot++)
+            {
+                const Face& face = mesh.f[m_Faces[slot]];
+                glm::vec3 p[3];
+                for (int k = 0; k < 3; k++)
+                    p[k] = glm::mix(mesh.morphStart(face.vi[k]), mesh.morphEnd(face.vi[k]), t);
+                glm::vec3 e1 = p[1] - p[0], e2 = p[2] - p[0];
+                glm::vec3 q = glm::cross(direction, e2);
+                float det = glm::dot(e1, q);
+                if (std::abs(det) < 1e-20f)
+                    continue;
+                float invDet = 1.0f / det;
+                glm::vec3 s = origin - p[0];
+                float u = glm::dot(s, q) * invDet;
+                if (u < 0.0f || u > 1.0f)
+                    continue;
+                glm::vec3 r = glm::cross(s, e1);
+                float v = glm::dot(direction, r) * invDet;
+                if (v < 0.0f || u + v > 1.0f)
+                    continue;
+                float distance = glm::dot(e2, r) * invDet;
+                if (distance > 0.0f && distance < closest)
+                {
+                    closest = distance;
+                    hit.face = m_Faces[slot];
+                    hit.distance = distance;
+                    hit.barycentric = glm::vec2(u, v);
+                }
+            }
+            continue;
+        }
+
+        // nearer child on top of the stack, children behind the closest hit are dropped
+        float a = slabs(node.first, t, origin, inverse, closest);
+        float b = slabs(node.first + 1, t, origin, inverse, closest);
+        int nearChild = node.first, farChild = node.first + 1;
+        if (b < a)
+        {
+            std::swap(a, b);
+            std::swap(nearChild, farChild);
+        }
+        if (b != INFINITY)
+            stack[top++] = farChild;
+        if (a != INFINITY)
+            stack[top++] = nearChild;
+    }
+    return hit.face >= 0;
+}
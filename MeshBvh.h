@@ -0,0 +1,49 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+
+struct Mesh;
+
+struct MeshHit
+{
+	int face = -1;
+	float distance = 0.0f;     // along the ray, in units of its direction
+	glm::vec2 barycentric;     // weights of corners 1 and 2
+	float t = 0.0f;            // morph position the ray was cast at
+};
+
+// Ray casts against the morphing mesh. The tree is built once for both morph end points: faces
+// are binned along their centroids at t = 0 and at t = 1, and SAH weighs the surface areas at
+// both ends, so it suits the 3D shape and the flattened layout alike. Vertices move on straight
+// lines, so a face's box at t lies inside the mix of its end boxes; the traversal mixes each box it
+// tests at the ray's t, nothing is refitted when the morph moves.
+class MeshBvh
+{
+public:
+	struct Node
+	{
+		int first; // count == 0: children at first and first + 1, otherwise the leaf's slots
+		int count;
+	};
+
+private:
+	const Mesh& m_Mesh;
+	std::vector<Node> m_Nodes;
+	std::vector<glm::vec3> m_Ends; // per node min and max at t = 0, then at t = 1
+	std::vector<int> m_Faces;      // face of each leaf slot
+	double m_BuildMs;
+
+	float slabs(int node, float t, const glm::vec3& origin, const glm::vec3& inverse, float limit) const;
+
+public:
+	MeshBvh(const Mesh& mesh);
+
+	void build();
+	// closest face hit by origin + s * direction, s > 0, in mesh space at morph position t
+	bool raycast(const glm::vec3& origin, const glm::vec3& direction, float t, MeshHit& hit) const;
+
+	bool isBuilt() const { return !m_Nodes.empty(); }
+	size_t getNodeCount() const { return m_Nodes.size(); }
+	double getBuildMs() const { return m_BuildMs; }
+};
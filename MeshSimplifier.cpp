@@ -0,0 +1,587 @@
+#include "MeshSimplifier.h"
+#include "meshGL.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// what a position may do, see classify()
+enum PositionKind : unsigned char
+{
+    MANIFOLD, // no seam or border through it, one wedge
+    SEAM,     // two seam edges, slides along them
+    BORDER,   // two border edges, slides along them
+    LOCKED
+};
+
+// an edge counts as a boundary this much more than the faces next to it
+static const double BOUNDARY_WEIGHT = 2.0;
+// the largest error of the first level, relative to the mesh size; it doubles with every level, as
+// the projected size the renderer picks the levels for halves
+static const double LEVEL_ERROR = 0.004;
+
+// sum of squared distances to weighted planes, the upper half of a symmetric 4 x 4 matrix
+struct Quadric
+{
+    double a2 = 0, ab = 0, ac = 0, ad = 0, b2 = 0, bc = 0, bd = 0, c2 = 0, cd = 0, d2 = 0;
+    double weight = 0;
+
+    void addPlane(const glm::vec3& n, float d, double w)
+    {
+        a2 += w * n.x * n.x; ab += w * n.x * n.y; ac += w * n.x * n.z; ad += w * n.x * d;
+        b2 += w * n.y * n.y; bc += w * n.y * n.z; bd += w * n.y * d;
+        c2 += w * n.z * n.z; cd += w * n.z * d;
+        d2 += w * d * d;
+        weight += w;
+    }
+
+    void add(const Quadric& q)
+    {
+        a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad; b2 += q.b2; bc += q.bc; bd += q.bd; c2 += q.c2; cd += q.cd; d2 += q.d2;
+        weight += q.weight;
+    }
+
+    double evaluate(const glm::vec3& p) const
+    {
+        double x = p.x, y = p.y, z = p.z;
+        double error = a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+            + b2 * y * y + 2 * bc * y * z + 2 * bd * y
+            + c2 * z * z + 2 * cd * z + d2;
+        return std::max(error, 0.0);
+    }
+};
+
+// an edge of a position p to a neighbour q as the faces around p see it
+struct EdgeInfo
+{
+    int q;
+    int faces;
+    int wedgeP, wedgeQ; // in the first face on it
+    bool seam;          // a later face disagrees on the wedges
+};
+
+struct Candidate
+{
+    double error; // distance the collapse moves the surface by, relative to the mesh size
+    int p, q;
+};
+
+static uint32_t floatBits(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+// the working state of one build: faces over wedges, wedges over positions
+struct SimplifyState
+{
+    std::vector<Face> faces;       // wedge indices
+    std::vector<unsigned char> dead;
+    std::vector<int> wedgePosition;
+    std::vector<int> wedgeVertex;  // the mesh vertex it stands for
+    std::vector<glm::vec3> position;
+    std::vector<Quadric> quadrics; // per position
+    std::vector<unsigned char> kind;
+    // faces around each position, rebuilt every pass
+    std::vector<int> faceStart, faceList;
+
+    int corner(const Face& face, int p) const
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            if (wedgePosition[face.vi[k]] == p)
+                return k;
+        }
+        return -1;
+    }
+
+    void buildAdjacency()
+    {
+        size_t positions = position.size();
+        faceStart.assign(positions + 1, 0);
+        for (size_t i = 0; i < faces.size(); i++)
+        {
+            for (int k = 0; k < 3; k++)
+                faceStart[wedgePosition[faces[i].vi[k]] + 1]++;
+        }
+        for (size_t p = 0; p < positions; p++)
+            faceStart[p + 1] += faceStart[p];
+        faceList.resize(faceStart[positions]);
+        std::vector<int> fill(faceStart.begin(), faceStart.end() - 1);
+        for (size_t i = 0; i < faces.size(); i++)
+        {
+            for (int k = 0; k < 3; k++)
+                faceList[fill[wedgePosition[faces[i].vi[k]]]++] = (int)i;
+        }
+        dead.assign(faces.size(), 0);
+    }
+
+    // the edges of p with the living faces around it, grouped by neighbour
+    void gatherEdges(int p, std::vector<EdgeInfo>& edges) const
+    {
+        edges.clear();
+        for (int i = faceStart[p]; i < faceStart[p + 1]; i++)
+        {
+            int faceIndex = faceList[i];
+            if (dead[faceIndex])
+                continue;
+            const Face& face = faces[faceIndex];
+            int k = corner(face, p);
+            for (int side = 1; side <= 2; side++)
+            {
+                int wedgeQ = face.vi[(k + side) % 3];
+                int q = wedgePosition[wedgeQ];
+                auto edge = std::find_if(edges.begin(), edges.end(), [q](const EdgeInfo& e) { return e.q == q; });
+                if (edge == edges.end())
+                    edges.push_back({ q, 1, face.vi[k], wedgeQ, false });
+                else
+                {
+                    edge->faces++;
+                    if (edge->wedgeP != face.vi[k] || edge->wedgeQ != wedgeQ)
+                        edge->seam = true;
+                }
+            }
+        }
+    }
+
+    static bool isBoundary(const EdgeInfo& edge) { return edge.faces == 1 || edge.seam; }
+
+    unsigned char classify(const std::vector<EdgeInfo>& edges) const
+    {
+        int seams = 0, borders = 0;
+        for (const EdgeInfo& edge : edges)
+        {
+            if (edge.faces > 2)
+                return LOCKED;
+            if (edge.faces == 1)
+                borders++;
+            else if (edge.seam)
+                seams++;
+        }
+        if (seams == 0 && borders == 0)
+            return MANIFOLD;
+        if (seams == 2 && borders == 0)
+            return SEAM;
+        if (borders == 2 && seams == 0)
+            return BORDER;
+        return LOCKED;
+    }
+
+    bool allowed(int p, const EdgeInfo& edge) const
+    {
+        switch (kind[p])
+        {
+        case MANIFOLD: return true;
+        case SEAM: return edge.faces == 2 && edge.seam;
+        case BORDER: return edge.faces == 1;
+        default: return false;
+        }
+    }
+
+    // checks moving p onto q; wedgeMap gets the wedge of q each wedge of p turns into
+    bool validate(int p, int q, std::vector<std::pair<int, int>>& wedgeMap, const std::vector<std::vector<glm::vec2>>& uvs,
+        std::vector<int>& neighboursP, std::vector<int>& neighboursQ) const
+    {
+        wedgeMap.clear();
+        neighboursP.clear();
+        neighboursQ.clear();
+        int edgeFaces = 0;
+        for (int i = faceStart[p]; i < faceStart[p + 1]; i++)
+        {
+            if (dead[faceList[i]])
+                continue;
+            const Face& face = faces[faceList[i]];
+            int k = corner(face, p);
+            for (int side = 1; side <= 2; side++)
+                neighboursP.push_back(wedgePosition[face.vi[(k + side) % 3]]);
+            int kq = corner(face, q);
+            if (kq < 0)
+                continue;
+            edgeFaces++;
+            int from = face.vi[k], to = face.vi[kq];
+            auto mapped = std::find_if(wedgeMap.begin(), wedgeMap.end(), [from](const std::pair<int, int>& m) { return m.first == from; });
+            if (mapped == wedgeMap.end())
+                wedgeMap.push_back({ from, to });
+            else if (mapped->second != to)
+                return false; // the uvs would tear
+        }
+        if (edgeFaces == 0)
+            return false;
+
+        // link condition: the ends share exactly the neighbours opposite the edge, else the collapse pinches
+        for (int i = faceStart[q]; i < faceStart[q + 1]; i++)
+        {
+            if (dead[faceList[i]])
+                continue;
+            const Face& face = faces[faceList[i]];
+            int k = corner(face, q);
+            for (int side = 1; side <= 2; side++)
+                neighboursQ.push_back(wedgePosition[face.vi[(k + side) % 3]]);
+        }
+        std::sort(neighboursP.begin(), neighboursP.end());
+        neighboursP.erase(std::unique(neighboursP.begin(), neighboursP.end()), neighboursP.end());
+        std::sort(neighboursQ.begin(), neighboursQ.end());
+        neighboursQ.erase(std::unique(neighboursQ.begin(), neighboursQ.end()), neighboursQ.end());
+        int shared = 0;
+        for (size_t a = 0, b = 0; a < neighboursP.size() && b < neighboursQ.size();)
+        {
+            if (neighboursP[a] < neighboursQ[b])
+                a++;
+            else if (neighboursQ[b] < neighboursP[a])
+                b++;
+            else
+            {
+                shared++;
+                a++;
+                b++;
+            }
+        }
+        if (shared != edgeFaces)
+            return false;
+
+        // the faces that stay must not flip, neither in 3D nor in the uvs
+        for (int i = faceStart[p]; i < faceStart[p + 1]; i++)
+        {
+            if (dead[faceList[i]])
+                continue;
+            const Face& face = faces[faceList[i]];
+            if (corner(face, q) >= 0)
+                continue;
+            int k = corner(face, p);
+            auto mapped = std::find_if(wedgeMap.begin(), wedgeMap.end(), [&](const std::pair<int, int>& m) { return m.first == face.vi[k]; });
+            if (mapped == wedgeMap.end())
+                return false; // a wedge of p that no face along the edge carries over
+            int b = face.vi[(k + 1) % 3], c = face.vi[(k + 2) % 3];
+            const glm::vec3& pb = position[wedgePosition[b]];
+            const glm::vec3& pc = position[wedgePosition[c]];
+            glm::vec3 before = glm::cross(pb - position[p], pc - position[p]);
+            glm::vec3 after = glm::cross(pb - position[q], pc - position[q]);
+            if (glm::dot(before, after) <= 0.0f)
+                return false;
+            for (const std::vector<glm::vec2>& uv : uvs)
+            {
+                glm::vec2 eb = uv[wedgeVertex[b]] - uv[wedgeVertex[face.vi[k]]], ec = uv[wedgeVertex[c]] - uv[wedgeVertex[face.vi[k]]];
+                glm::vec2 fb = uv[wedgeVertex[b]] - uv[wedgeVertex[mapped->second]], fc = uv[wedgeVertex[c]] - uv[wedgeVertex[mapped->second]];
+                float areaBefore = eb.x * ec.y - eb.y * ec.x;
+                float areaAfter = fb.x * fc.y - fb.y * fc.x;
+                if (areaBefore != 0.0f && areaBefore * areaAfter <= 0.0f)
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    void collapse(int p, int q, const std::vector<std::pair<int, int>>& wedgeMap)
+    {
+        for (int i = faceStart[p]; i < faceStart[p + 1]; i++)
+        {
+            int faceIndex = faceList[i];
+            if (dead[faceIndex])
+                continue;
+            Face& face = faces[faceIndex];
+            if (corner(face, q) >= 0)
+            {
+                dead[faceIndex] = 1;
+                continue;
+            }
+            int k = corner(face, p);
+            for (const std::pair<int, int>& m : wedgeMap)
+            {
+                if (m.first == face.vi[k])
+                    face.vi[k] = m.second;
+            }
+        }
+        quadrics[q].add(quadrics[p]);
+    }
+};
+
+MeshSimplifier::MeshSimplifier()
+    : m_Generation(0), m_Levels(0), m_Running(false), m_Cancel(false), m_Started(false)
+{
+}
+
+MeshSimplifier::~MeshSimplifier()
+{
+    cancel();
+}
+
+void MeshSimplifier::copy(const Mesh& mesh, int levels)
+{
+    m_Pos = mesh.pos;
+    m_UVs.clear();
+    for (int c = 0; c < mesh.uvChannelCount(); c++)
+    {
+        if (mesh.channelUVs(c).size() == mesh.vertexCount())
+            m_UVs.push_back(mesh.channelUVs(c));
+    }
+    m_Material = mesh.material.size() == mesh.vertexCount() ? mesh.material : std::vector<unsigned char>();
+    m_Faces = mesh.f;
+    m_Generation = mesh.generation;
+    m_Levels = levels;
+    m_Lods.clear();
+}
+
+void MeshSimplifier::run()
+{
+    auto start = std::chrono::steady_clock::now();
+    Report report;
+    SimplifyState state;
+
+    // weld: sorted by position bits, then the uvs of every channel and the material; a change of
+    // position starts a position, any change a wedge
+    size_t n = m_Pos.size();
+    std::vector<int> order(n);
+    for (size_t i = 0; i < n; i++)
+        order[i] = (int)i;
+    auto compare = [this](int a, int b)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            uint32_t ba = floatBits(m_Pos[a][k]), bb = floatBits(m_Pos[b][k]);
+            if (ba != bb)
+                return ba < bb;
+        }
+        for (const std::vector<glm::vec2>& uv : m_UVs)
+        {
+            for (int k = 0; k < 2; k++)
+            {
+                uint32_t ba = floatBits(uv[a][k]), bb = floatBits(uv[b][k]);
+                if (ba != bb)
+                    return ba < bb;
+            }
+        }
+        if (!m_Material.empty() && m_Material[a] != m_Material[b])
+            return m_Material[a] < m_Material[b];
+        return a < b;
+    };
+    std::sort(order.begin(), order.end(), compare);
+    std::vector<int> vertexWedge(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        int v = order[i];
+        bool samePosition = i > 0 && std::memcmp(&m_Pos[v], &m_Pos[order[i - 1]], sizeof(glm::vec3)) == 0;
+        bool sameWedge = samePosition;
+        for (size_t c = 0; c < m_UVs.size() && sameWedge; c++)
+            sameWedge = std::memcmp(&m_UVs[c][v], &m_UVs[c][order[i - 1]], sizeof(glm::vec2)) == 0;
+        if (sameWedge && !m_Material.empty())
+            sameWedge = m_Material[v] == m_Material[order[i - 1]];
+        if (!samePosition)
+            state.position.push_back(m_Pos[v]);
+        if (!sameWedge)
+        {
+            state.wedgePosition.push_back((int)state.position.size() - 1);
+            state.wedgeVertex.push_back(v);
+        }
+        vertexWedge[v] = (int)state.wedgeVertex.size() - 1;
+    }
+    report.wedges = state.wedgeVertex.size();
+    report.positions = state.position.size();
+
+    // faces over wedges, the ones without area in 3D dropped
+    state.faces.reserve(m_Faces.size());
+    for (const Face& face : m_Faces)
+    {
+        Face wedges;
+        for (int k = 0; k < 3; k++)
+            wedges.vi[k] = vertexWedge[face.vi[k]];
+        int a = state.wedgePosition[wedges.vi[0]], b = state.wedgePosition[wedges.vi[1]], c = state.wedgePosition[wedges.vi[2]];
+        if (a != b && b != c && c != a)
+            state.faces.push_back(wedges);
+    }
+
+    glm::vec3 minExtents(state.position.empty() ? glm::vec3(0.0f) : state.position[0]), maxExtents(minExtents);
+    for (const glm::vec3& p : state.position)
+    {
+        minExtents = glm::min(minExtents, p);
+        maxExtents = glm::max(maxExtents, p);
+    }
+    float meshSize = std::max(glm::length(maxExtents - minExtents), 1e-6f);
+
+    // quadrics of the faces, weighted by area, and of a plane along every boundary edge, upright on its face
+    size_t positions = state.position.size();
+    state.quadrics.assign(positions, Quadric());
+    state.kind.assign(positions, MANIFOLD);
+    state.buildAdjacency();
+    for (const Face& face : state.faces)
+    {
+        const glm::vec3& a = state.position[state.wedgePosition[face.vi[0]]];
+        glm::vec3 normal = glm::cross(state.position[state.wedgePosition[face.vi[1]]] - a, state.position[state.wedgePosition[face.vi[2]]] - a);
+        float length = glm::length(normal);
+        if (length == 0.0f)
+            continue;
+        normal /= length;
+        for (int k = 0; k < 3; k++)
+            state.quadrics[state.wedgePosition[face.vi[k]]].addPlane(normal, -glm::dot(normal, a), 0.5 * length);
+    }
+    std::vector<EdgeInfo> edges;
+    for (size_t p = 0; p < positions; p++)
+    {
+        state.gatherEdges((int)p, edges);
+        state.kind[p] = state.classify(edges);
+        report.seamPositions += state.kind[p] == SEAM;
+        report.borderPositions += state.kind[p] == BORDER;
+        report.lockedPositions += state.kind[p] == LOCKED;
+        for (const EdgeInfo& edge : edges)
+        {
+            if (!SimplifyState::isBoundary(edge))
+                continue;
+            // every face along the edge, each end adds its own half
+            for (int i = state.faceStart[p]; i < state.faceStart[p + 1]; i++)
+            {
+                const Face& face = state.faces[state.faceList[i]];
+                if (state.corner(face, edge.q) < 0)
+                    continue;
+                const glm::vec3& pp = state.position[p];
+                const glm::vec3& pq = state.position[edge.q];
+                int k = state.corner(face, (int)p);
+                int other = state.wedgePosition[face.vi[(k + 1) % 3]] == edge.q ? face.vi[(k + 2) % 3] : face.vi[(k + 1) % 3];
+                glm::vec3 faceNormal = glm::cross(pq - pp, state.position[state.wedgePosition[other]] - pp);
+                glm::vec3 normal = glm::cross(pq - pp, faceNormal);
+                float length = glm::length(normal);
+                if (length == 0.0f)
+                    continue;
+                normal /= length;
+                float edgeLength = glm::length(pq - pp);
+                state.quadrics[p].addPlane(normal, -glm::dot(normal, pp), BOUNDARY_WEIGHT * edgeLength * edgeLength);
+            }
+        }
+    }
+
+    std::vector<Candidate> candidates;
+    std::vector<unsigned char> used;
+    std::vector<std::pair<int, int>> wedgeMap;
+    std::vector<int> neighboursP, neighboursQ;
+    size_t previous = state.faces.size();
+    for (int level = 1; level <= m_Levels && !m_Cancel; level++)
+    {
+        size_t target = previous / 4;
+        double limit = LEVEL_ERROR * (1 << (level - 1));
+        double largest = 0.0;
+        while (state.faces.size() > target && !m_Cancel)
+        {
+            // the cheapest collapse of every position that may move
+            state.buildAdjacency();
+            candidates.clear();
+            for (size_t p = 0; p < positions; p++)
+            {
+                if (state.kind[p] == LOCKED || state.faceStart[p] == state.faceStart[p + 1])
+                    continue;
+                state.gatherEdges((int)p, edges);
+                Candidate best = { -1.0, (int)p, -1 };
+                for (const EdgeInfo& edge : edges)
+                {
+                    if (!state.allowed((int)p, edge))
+                        continue;
+                    Quadric sum = state.quadrics[p];
+                    sum.add(state.quadrics[edge.q]);
+                    double error = sum.weight > 0.0 ? std::sqrt(sum.evaluate(state.position[edge.q]) / sum.weight) / meshSize : 0.0;
+                    if (best.q < 0 || error < best.error)
+                        best = { error, (int)p, edge.q };
+                }
+                if (best.q >= 0 && best.error <= limit)
+                    candidates.push_back(best);
+            }
+            std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) { return a.error < b.error; });
+
+            // a collapse takes about two faces; no position moves or receives twice in a pass, so the
+            // faces around the ones still to come are what validate() sees
+            size_t goal = std::max<size_t>((state.faces.size() - target) / 2, 1);
+            used.assign(positions, 0);
+            size_t collapses = 0;
+            for (const Candidate& candidate : candidates)
+            {
+                if (collapses >= goal)
+                    break;
+                if (used[candidate.p] || used[candidate.q])
+                    continue;
+                if (!state.validate(candidate.p, candidate.q, wedgeMap, m_UVs, neighboursP, neighboursQ))
+                    continue;
+                state.collapse(candidate.p, candidate.q, wedgeMap);
+                used[candidate.p] = used[candidate.q] = 1;
+                collapses++;
+                largest = std::max(largest, candidate.error);
+            }
+            if (collapses == 0)
+                break;
+            size_t kept = 0;
+            for (size_t i = 0; i < state.faces.size(); i++)
+            {
+                if (!state.dead[i])
+                    state.faces[kept++] = state.faces[i];
+            }
+            state.faces.resize(kept);
+        }
+
+        // not worth a level if it barely simplifies, locked boundaries can leave little to take
+        if (m_Cancel || state.faces.empty() || state.faces.size() > previous * 9 / 10)
+            break;
+        std::vector<Face> lod(state.faces.size());
+        for (size_t i = 0; i < lod.size(); i++)
+        {
+            for (int k = 0; k < 3; k++)
+                lod[i].vi[k] = state.wedgeVertex[state.faces[i].vi[k]];
+        }
+        m_Lods.push_back(std::move(lod));
+        report.levelFaces.push_back(state.faces.size());
+        report.levelError.push_back((float)largest);
+        previous = state.faces.size();
+    }
+
+    // the copies are only needed while it runs
+    std::vector<glm::vec3>().swap(m_Pos);
+    std::vector<std::vector<glm::vec2>>().swap(m_UVs);
+    std::vector<unsigned char>().swap(m_Material);
+    std::vector<Face>().swap(m_Faces);
+
+    report.buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    m_Pending = report;
+    m_Running = false;
+}
+
+void MeshSimplifier::start(const Mesh& mesh, int levels)
+{
+    cancel();
+    copy(mesh, levels);
+    m_Running = true;
+    m_Started = true;
+    m_Thread = std::thread(&MeshSimplifier::run, this);
+}
+
+void MeshSimplifier::cancel()
+{
+    m_Cancel = true;
+    if (m_Thread.joinable())
+        m_Thread.join();
+    m_Cancel = false;
+    m_Started = false;
+    m_Lods.clear();
+}
+
+void MeshSimplifier::wait()
+{
+    if (m_Thread.joinable())
+        m_Thread.join();
+}
+
+bool MeshSimplifier::apply(Mesh& mesh, MeshGl& meshGl)
+{
+    if (!m_Started || m_Running)
+        return false;
+    if (m_Thread.joinable())
+        m_Thread.join();
+    m_Started = false;
+    m_Report = m_Pending;
+    // faces rebuilt since, by a load or otherwise, index other vertices
+    if (m_Lods.empty() || mesh.generation != m_Generation)
+    {
+        m_Lods.clear();
+        return false;
+    }
+    mesh.lods = std::move(m_Lods);
+    m_Lods.clear();
+    meshGl.updateLods(mesh);
+    return true;
+}
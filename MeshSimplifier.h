@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+
+struct MeshGl;
+
+// The levels of detail of a mesh by quadric error edge collapse (Garland and Heckbert). Corners
+// are welded into wedges first: a wedge is a position with one set of uvs (every channel) and one
+// material, what the importer splits into a vertex per face corner. A collapse moves every wedge
+// of one position onto a wedge of a neighbour, so each level is an index buffer over the mesh's
+// own vertices: it shares their buffer and follows every morph and edit of them.
+//
+// UV seams, island boundaries and the borders of the mesh are kept. An edge whose faces disagree on
+// the wedges at its ends is a seam, a position on one may only slide along it, and a position
+// where seams and borders meet or branch never moves. The quadrics get a plane through every such
+// edge as well, so the slide keeps the boundary's shape. A collapse that flips a face in 3D or in
+// the uvs of any channel is rejected.
+//
+// Each pass sorts the cheapest collapse of every position and takes them in order, no position
+// twice; passes repeat until a level is a quarter of the one before or what is left would move the
+// surface more than the level allows. start() runs it on a thread of its own over a copy of what it
+// reads, apply() hands the levels to the mesh once they are done.
+class MeshSimplifier
+{
+public:
+	struct Report
+	{
+		size_t wedges = 0;
+		size_t positions = 0;
+		size_t seamPositions = 0;   // slide along a seam
+		size_t borderPositions = 0; // slide along the mesh border
+		size_t lockedPositions = 0; // corners and branches of seams and borders, non-manifold
+		std::vector<size_t> levelFaces;
+		std::vector<float> levelError; // largest collapse of the level, in units of the mesh size
+		double buildMs = 0.0;
+	};
+
+private:
+	// copies of the mesh, the thread never reads the mesh itself
+	std::vector<glm::vec3> m_Pos;
+	std::vector<std::vector<glm::vec2>> m_UVs; // every channel
+	std::vector<unsigned char> m_Material;
+	std::vector<Face> m_Faces;
+	unsigned int m_Generation; // of the mesh it started from
+	int m_Levels;
+
+	std::thread m_Thread;
+	std::atomic<bool> m_Running, m_Cancel;
+	bool m_Started; // a build apply() hasn't taken yet
+	std::vector<std::vector<Face>> m_Lods;
+	Report m_Pending, m_Report;
+
+	void copy(const Mesh& mesh, int levels);
+	void run();
+
+public:
+	MeshSimplifier();
+	~MeshSimplifier();
+
+	// on a thread of its own, a running build is dropped first
+	void start(const Mesh& mesh, int levels = 4);
+	void cancel();
+	bool isRunning() const { return m_Running.load(); }
+	// blocks until a started build is done, for callers that draw right away; apply() still hands it over
+	void wait();
+	// once a started build is done: its levels become the mesh's and meshGl's, returns whether
+	// they did; call it every frame, it doesn't wait
+	bool apply(Mesh& mesh, MeshGl& meshGl);
+
+	const Report& getReport() const { return m_Report; } // of the last finished build
+};
@@ -0,0 +1,149 @@
+#include "MorphFeedback.h"
+
+#include <GL/glew.h>
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include "mesh.h"
+#include "meshGL.h"
+#include "Renderer.h"
+#include "GLState.h"
+
+MorphFeedback::MorphFeedback()
+    : m_Shader("res/shaders/morph.hlsl", { "v_Position", "v_Normal" }),
+    m_VAO(0), m_SourceVBO(0), m_VertexCount(0), m_UVChannelCount(1), m_UVChannel(0), m_Params(0.0f), m_LastInterpolation(-1.0f)
+{
+    glGenVertexArrays(1, &m_VAO);
+    glGenBuffers(1, &m_SourceVBO);
+}
+
+MorphFeedback::~MorphFeedback()
+{
+    GLState::ForgetVertexArray(m_VAO);
+    GLState::ForgetBuffer(m_SourceVBO);
+    glDeleteVertexArrays(1, &m_VAO);
+    glDeleteBuffers(1, &m_SourceVBO);
+}
+
+void MorphFeedback::setup(const Mesh& mesh)
+{
+    size_t n = mesh.pos.size();
+    m_VertexCount = (unsigned int)n;
+    m_UVChannelCount = (unsigned int)mesh.uvChannelCount();
+
+    // same block layout as Mesh::bake, missing normals read as zero and end up +z
+    size_t normalOffset = uvOffset(m_UVChannelCount);
+    GLState::BindVertexArray(m_VAO);
+    GLState::BindBuffer(GL_ARRAY_BUFFER, m_SourceVBO);
+    // dynamic: batch runs respecify it for every asset
+    GLCall(glBufferData(GL_ARRAY_BUFFER, normalOffset + n * sizeof(glm::vec3), nullptr, GL_DYNAMIC_DRAW));
+    GLCall(glBufferSubData(GL_ARRAY_BUFFER, 0, n * sizeof(glm::vec3), mesh.pos.data()));
+    for (int c = 0; c < (int)m_UVChannelCount; c++)
+    {
+        const std::vector<glm::vec2>& uv = mesh.channelUVs(c);
+        if (uv.size() == n)
+        {
+            GLCall(glBufferSubData(GL_ARRAY_BUFFER, uvOffset(c), n * sizeof(glm::vec2), uv.data()));
+        }
+    }
+    if (mesh.normal.size() == n)
+    {
+        GLCall(glBufferSubData(GL_ARRAY_BUFFER, normalOffset, n * sizeof(glm::vec3), mesh.normal.data()));
+    }
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)normalOffset);
+    GLState::BindVertexArray(0);
+
+    m_UVChannel = m_UVChannelCount;
+    selectUVChannel(mesh);
+}
+
+void MorphFeedback::selectUVChannel(const Mesh& mesh)
+{
+    if (mesh.uvChannel >= (int)m_UVChannelCount)
+        return;
+    if ((unsigned int)mesh.uvChannel != m_UVChannel)
+    {
+        m_UVChannel = (unsigned int)mesh.uvChannel;
+        GLState::BindVertexArray(m_VAO);
+        GLState::BindBuffer(GL_ARRAY_BUFFER, m_SourceVBO);
+        GLCall(glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (void*)uvOffset(m_UVChannel)));
+        GLState::BindVertexArray(0);
+    }
+    updateParams(mesh);
+}
+
+void MorphFeedback::updateVertices(const Mesh& mesh, size_t first, size_t count)
+{
+    if (first + count > m_VertexCount)
+        return;
+    GLState::BindBuffer(GL_ARRAY_BUFFER, m_SourceVBO);
+    GLCall(glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(glm::vec3), count * sizeof(glm::vec3), &mesh.pos[first]));
+    GLCall(glBufferSubData(GL_ARRAY_BUFFER, uvOffset(m_UVChannel) + first * sizeof(glm::vec2), count * sizeof(glm::vec2), &mesh.uv[first]));
+    invalidate();
+}
+
+void MorphFeedback::updateParams(const Mesh& mesh)
+{
+    MorphParams params;
+    params.bestRotation = mesh.bestRotation;
+    params.averageScaling = mesh.averageScaling;
+    params.toFlip = mesh.toFlip;
+    m_Params = params.pack();
+    invalidate();
+}
+
+bool MorphFeedback::run(float interpolation, const MeshGl& target)
+{
+    if (interpolation == m_LastInterpolation || m_VertexCount == 0 || target.getVertexCount() != m_VertexCount)
+        return false;
+    m_LastInterpolation = interpolation;
+
+    m_Shader.Bind();
+    m_Shader.SetUniformMat4f("u_DrawParams", m_Params);
+    m_Shader.SetUniform1f("u_Interpolation", interpolation);
+
+    // the target VBO can't be bound as an attribute source while it is written, the VAO here only reads m_SourceVBO
+    GLState::BindVertexArray(m_VAO);
+    target.bindMorphOutputs();
+    GLState::SetEnabled(GL_RASTERIZER_DISCARD, true);
+    GLCall(glBeginTransformFeedback(GL_POINTS));
+    GLCall(glDrawArrays(GL_POINTS, 0, m_VertexCount));
+    GLCall(glEndTransformFeedback());
+    GLState::SetEnabled(GL_RASTERIZER_DISCARD, false);
+    return true;
+}
+
+float MorphFeedback::validate(const Mesh& mesh, float interpolation, const MeshGl& target)
+{
+    size_t n = mesh.pos.size();
+    if (n != m_VertexCount || target.getVertexCount() != n)
+        return -1.0f;
+
+    invalidate();
+    run(interpolation, target);
+
+    std::vector<glm::vec3> gpuPositions(n), gpuNormals(n), cpuPositions(n), cpuNormals(n);
+    GLState::BindBuffer(GL_ARRAY_BUFFER, target.getVBO());
+    GLCall(glGetBufferSubData(GL_ARRAY_BUFFER, 0, n * sizeof(glm::vec3), gpuPositions.data()));
+    GLCall(glGetBufferSubData(GL_ARRAY_BUFFER, target.normalOffset(), n * sizeof(glm::vec3), gpuNormals.data()));
+    mesh.interpolate(interpolation, cpuPositions.data());
+
+    float positionError = 0.0f, normalError = 0.0f;
+    for (size_t i = 0; i < n; i++)
+        positionError = std::max(positionError, glm::length(gpuPositions[i] - cpuPositions[i]));
+    if (mesh.normal.size() == n)
+    {
+        mesh.interpolateNormals(interpolation, cpuNormals.data());
+        for (size_t i = 0; i < n; i++)
+            normalError = std::max(normalError, glm::length(gpuNormals[i] - cpuNormals[i]));
+    }
+
+    std::cout << "Morph validation at t = " << interpolation << ": max position error " << positionError
+        << ", max normal error " << normalError << " over " << n << " vertices" << std::endl;
+    return positionError;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <glm/glm.hpp>
+#include "Shader.h"
+
+struct Mesh;
+struct MeshGl;
+
+// Morphs a mesh on the GPU with transform feedback (GL 3.3). The rest pose lives in a buffer
+// of its own, run() writes the interpolated positions and blended normals straight into the
+// target's VBO, so the passes draw it like any other mesh and nothing is uploaded per frame.
+class MorphFeedback
+{
+private:
+	Shader m_Shader;
+	unsigned int m_VAO, m_SourceVBO;
+	unsigned int m_VertexCount;
+	unsigned int m_UVChannelCount, m_UVChannel;
+	glm::mat4 m_Params;
+	float m_LastInterpolation;
+
+	// [pos | uv of every channel | normal], like MeshGl
+	size_t uvOffset(unsigned int channel) const { return m_VertexCount * (sizeof(glm::vec3) + channel * sizeof(glm::vec2)); }
+
+public:
+	MorphFeedback();
+	~MorphFeedback();
+
+	// copies the rest pose with every uv channel, call again after the mesh changes
+	void setup(const Mesh& mesh);
+	// reads the mesh's active channel from now on: a new attribute binding and the channel's params
+	void selectUVChannel(const Mesh& mesh);
+	// after edits: positions and uvs first .. first + count - 1 of the rest pose
+	void updateVertices(const Mesh& mesh, size_t first, size_t count);
+	// after edits: bestRotation, averageScaling and toFlip
+	void updateParams(const Mesh& mesh);
+	// writes into target when t changed since the last run, returns whether it did
+	bool run(float interpolation, const MeshGl& target);
+	void invalidate() { m_LastInterpolation = -1.0f; }
+
+	// Reads the target back and compares it with Mesh::interpolate / interpolateNormals.
+	// Returns the largest position error, -1 when the sizes don't match. Stalls, debugging only.
+	float validate(const Mesh& mesh, float interpolation, const MeshGl& target);
+};
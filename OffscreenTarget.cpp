@@ -0,0 +1,82 @@
+#include "OffscreenTarget.h"
+
+#include <GL/glew.h>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "Renderer.h"
+#include "GLState.h"
+
+OffscreenTarget::OffscreenTarget(int width, int height)
+	: m_FramebufferID(0), m_ColorTexture(0), m_DepthBuffer(0), m_Width(0), m_Height(0)
+{
+	glGenFramebuffers(1, &m_FramebufferID);
+	glGenTextures(1, &m_ColorTexture);
+	glGenRenderbuffers(1, &m_DepthBuffer);
+
+	GLState::BindTexture(0, GL_TEXTURE_2D, m_ColorTexture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	resize(width, height);
+
+	GLState::BindFramebuffer(m_FramebufferID);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_ColorTexture, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_DepthBuffer);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		std::cout << "OffscreenTarget: framebuffer incomplete" << std::endl;
+	GLState::BindFramebuffer(0);
+}
+
+OffscreenTarget::~OffscreenTarget()
+{
+	GLState::ForgetFramebuffer(m_FramebufferID);
+	GLState::ForgetTexture(m_ColorTexture);
+	glDeleteFramebuffers(1, &m_FramebufferID);
+	glDeleteTextures(1, &m_ColorTexture);
+	glDeleteRenderbuffers(1, &m_DepthBuffer);
+}
+
+void OffscreenTarget::resize(int width, int height)
+{
+	if (width == m_Width && height == m_Height)
+		return;
+	m_Width = width;
+	m_Height = height;
+
+	GLState::BindTexture(0, GL_TEXTURE_2D, m_ColorTexture);
+	GLCall(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr));
+	// left on unit 0 it would be sampled by whatever draws into it next
+	GLState::BindTexture(0, GL_TEXTURE_2D, 0);
+	glBindRenderbuffer(GL_RENDERBUFFER, m_DepthBuffer);
+	GLCall(glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height));
+}
+
+void OffscreenTarget::readPixels(unsigned char* rgba) const
+{
+	GLState::BindFramebuffer(m_FramebufferID);
+	GLState::BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	GLCall(glReadPixels(0, 0, m_Width, m_Height, GL_RGBA, GL_UNSIGNED_BYTE, rgba));
+
+	// GL starts at the bottom row
+	size_t stride = (size_t)m_Width * 4;
+	std::vector<unsigned char> row(stride);
+	for (int y = 0; y < m_Height / 2; y++)
+	{
+		unsigned char* top = rgba + y * stride;
+		unsigned char* bottom = rgba + (m_Height - 1 - y) * stride;
+		memcpy(row.data(), top, stride);
+		memcpy(top, bottom, stride);
+		memcpy(bottom, row.data(), stride);
+	}
+}
+
+void OffscreenTarget::blitTo(unsigned int framebuffer, int width, int height) const
+{
+	GLState::BindFramebuffer(framebuffer);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, m_FramebufferID);
+	GLCall(glBlitFramebuffer(0, 0, m_Width, m_Height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_LINEAR));
+	// back to what the state cache thinks is bound for reading too
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+// Framebuffer with an RGBA8 color texture and a depth renderbuffer, for rendering without a window.
+class OffscreenTarget
+{
+private:
+	unsigned int m_FramebufferID;
+	unsigned int m_ColorTexture;
+	unsigned int m_DepthBuffer;
+	int m_Width, m_Height;
+
+public:
+	OffscreenTarget(int width, int height);
+	~OffscreenTarget();
+
+	// keeps the objects, only reallocates their storage
+	void resize(int width, int height);
+
+	unsigned int getID() const { return m_FramebufferID; }
+	unsigned int getColorTexture() const { return m_ColorTexture; }
+	int getWidth() const { return m_Width; }
+	int getHeight() const { return m_Height; }
+
+	// width * height * 4 bytes, top row first (the way image files want it)
+	void readPixels(unsigned char* rgba) const;
+	// scales the color buffer into the given rectangle of framebuffer, leaves framebuffer bound
+	void blitTo(unsigned int framebuffer, int width, int height) const;
+};
@@ -0,0 +1,377 @@
+#include "PngWriter.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+static const size_t WINDOW_SIZE = 32768;
+static const int HASH_BITS = 15;
+static const int MIN_MATCH = 3;
+static const int MAX_MATCH = 258;
+static const size_t IDAT_SIZE = 1 << 16;
+
+struct CrcTable
+{
+    uint32_t entries[256];
+};
+
+// a function-local static is built once even when writers on several threads open at the same time
+static const CrcTable& crcTable()
+{
+    static const CrcTable table = [] {
+        CrcTable result;
+        for (uint32_t n = 0; n < 256; n++)
+        {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+                c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            result.entries[n] = c;
+        }
+        return result;
+    }();
+    return table;
+}
+
+static uint32_t crc32(uint32_t crc, const unsigned char* data, size_t size)
+{
+    const uint32_t* table = crcTable().entries;
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static uint32_t adler32(uint32_t adler, const unsigned char* data, size_t size)
+{
+    uint32_t a = adler & 0xFFFF, b = adler >> 16;
+    while (size > 0)
+    {
+        // 5552 bytes is the most that can be summed before b overflows
+        size_t block = std::min<size_t>(size, 5552);
+        size -= block;
+        while (block--)
+        {
+            a += *data++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+static void putBigEndian(unsigned char* out, uint32_t value)
+{
+    out[0] = (unsigned char)(value >> 24);
+    out[1] = (unsigned char)(value >> 16);
+    out[2] = (unsigned char)(value >> 8);
+    out[3] = (unsigned char)value;
+}
+
+static int paeth(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    if (pa <= pb && pa <= pc)
+        return a;
+    return pb <= pc ? b : c;
+}
+
+// writes the filter byte and the residuals to out, returns their sum of absolute values
+static long filterRow(int filter, const unsigned char* row, const unsigned char* up, size_t stride, int bpp, unsigned char* out)
+{
+    long cost = 0;
+    out[0] = (unsigned char)filter;
+    for (size_t i = 0; i < stride; i++)
+    {
+        int left = i >= (size_t)bpp ? row[i - bpp] : 0;
+        int upLeft = i >= (size_t)bpp ? up[i - bpp] : 0;
+        int predicted = 0;
+        switch (filter)
+        {
+        case 1: predicted = left; break;
+        case 2: predicted = up[i]; break;
+        case 3: predicted = (left + up[i]) / 2; break;
+        case 4: predicted = paeth(left, up[i], upLeft); break;
+        }
+        unsigned char residual = (unsigned char)(row[i] - predicted);
+        out[i + 1] = residual;
+        cost += residual < 128 ? residual : 256 - residual;
+    }
+    return cost;
+}
+
+PngWriter::PngWriter()
+    : m_File(nullptr), m_Width(0), m_Height(0), m_Channels(0), m_RowsWritten(0),
+    m_WindowBase(0), m_BitBuffer(0), m_BitCount(0), m_Adler(1)
+{
+}
+
+PngWriter::~PngWriter()
+{
+    if (m_File)
+        close();
+}
+
+bool PngWriter::open(const char* path, int width, int height, int channels)
+{
+    if (m_File || width <= 0 || height <= 0 || channels < 1 || channels > 4 || channels == 2)
+        return false;
+    m_File = fopen(path, "wb");
+    if (!m_File)
+    {
+        std::cout << "PngWriter: can't open " << path << std::endl;
+        return false;
+    }
+
+    m_Width = width;
+    m_Height = height;
+    m_Channels = channels;
+    m_RowsWritten = 0;
+    m_PreviousRow.assign((size_t)width * channels, 0);
+    m_Filtered.resize((size_t)width * channels + 1);
+    m_Scratch.resize((size_t)width * channels + 1);
+    m_Window.clear();
+    m_WindowBase = 0;
+    m_Head.assign((size_t)1 << HASH_BITS, -1);
+    m_BitBuffer = 0;
+    m_BitCount = 0;
+    m_Idat.clear();
+    m_Adler = 1;
+
+    static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    fwrite(signature, 1, 8, m_File);
+
+    unsigned char header[13];
+    putBigEndian(header, width);
+    putBigEndian(header + 4, height);
+    header[8] = 8; // bit depth
+    header[9] = channels == 1 ? 0 : channels == 3 ? 2 : 6;
+    header[10] = 0; // deflate
+    header[11] = 0; // adaptive filtering
+    header[12] = 0; // no interlace
+    writeChunk("IHDR", header, sizeof(header));
+
+    // zlib header (32 KB window, fastest), then the one fixed Huffman block that stays open until close()
+    m_Idat.push_back(0x78);
+    m_Idat.push_back(0x01);
+    putBits(0, 1);
+    putBits(1, 2);
+    return true;
+}
+
+bool PngWriter::writeRows(const unsigned char* rows, int rowCount)
+{
+    if (!m_File || m_RowsWritten + rowCount > m_Height)
+        return false;
+
+    size_t stride = (size_t)m_Width * m_Channels;
+    int bpp = m_Channels;
+    for (int r = 0; r < rowCount; r++, m_RowsWritten++)
+    {
+        const unsigned char* row = rows + r * stride;
+        const unsigned char* up = m_PreviousRow.data();
+
+        // pick the filter with the smallest sum of absolute residuals, the usual heuristic
+        long bestCost = -1;
+        for (int filter = 0; filter < 5; filter++)
+        {
+            long cost = filterRow(filter, row, up, stride, bpp, m_Scratch.data());
+            if (bestCost < 0 || cost < bestCost)
+            {
+                bestCost = cost;
+                m_Filtered.swap(m_Scratch);
+            }
+        }
+        memcpy(m_PreviousRow.data(), row, stride);
+
+        m_Adler = adler32(m_Adler, m_Filtered.data(), m_Filtered.size());
+        compress(m_Filtered.data(), m_Filtered.size());
+    }
+    return !ferror(m_File);
+}
+
+bool PngWriter::close()
+{
+    if (!m_File)
+        return false;
+
+    // end of the open block, an empty final block, then the zlib checksum
+    putHuffman(0, 7);
+    putBits(1, 1);
+    putBits(1, 2);
+    putHuffman(0, 7);
+    if (m_BitCount > 0)
+        putBits(0, 8 - m_BitCount);
+    unsigned char adler[4];
+    putBigEndian(adler, m_Adler);
+    m_Idat.insert(m_Idat.end(), adler, adler + 4);
+    flushIdat();
+    writeChunk("IEND", nullptr, 0);
+
+    bool ok = m_RowsWritten == m_Height && !ferror(m_File);
+    fclose(m_File);
+    m_File = nullptr;
+    m_Window.clear();
+    m_Head.clear();
+    return ok;
+}
+
+bool PngWriter::Write(const char* path, int width, int height, int channels, const unsigned char* pixels)
+{
+    PngWriter writer;
+    if (!writer.open(path, width, height, channels))
+        return false;
+    writer.writeRows(pixels, height);
+    return writer.close();
+}
+
+static uint32_t hash3(const unsigned char* p)
+{
+    uint32_t v = p[0] | (p[1] << 8) | (p[2] << 16);
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+void PngWriter::compress(const unsigned char* data, size_t size)
+{
+    // keep 32 KB of history in front of the new bytes, drop the rest
+    if (m_Window.size() > 2 * WINDOW_SIZE)
+    {
+        size_t drop = m_Window.size() - WINDOW_SIZE;
+        m_Window.erase(m_Window.begin(), m_Window.begin() + drop);
+        m_WindowBase += drop;
+    }
+    size_t start = m_Window.size();
+    m_Window.insert(m_Window.end(), data, data + size);
+
+    // matches may run up to the end of what has arrived, the next row can't extend them
+    const unsigned char* window = m_Window.data();
+    size_t end = m_Window.size();
+    size_t i = start;
+    while (i < end)
+    {
+        int length = 0, distance = 0;
+        if (i + MIN_MATCH <= end)
+        {
+            uint32_t h = hash3(window + i);
+            int64_t candidate = m_Head[h];
+            int64_t position = (int64_t)(m_WindowBase + i);
+            m_Head[h] = position;
+            if (candidate >= (int64_t)m_WindowBase && position - candidate <= (int64_t)WINDOW_SIZE)
+            {
+                size_t c = (size_t)(candidate - m_WindowBase);
+                size_t limit = std::min<size_t>(MAX_MATCH, end - i);
+                size_t n = 0;
+                while (n < limit && window[c + n] == window[i + n])
+                    n++;
+                if (n >= (size_t)MIN_MATCH)
+                {
+                    length = (int)n;
+                    distance = (int)(position - candidate);
+                }
+            }
+        }
+
+        if (length)
+        {
+            putMatch(length, distance);
+            // index the skipped positions too, cheap and finds noticeably more repeats
+            for (size_t k = 1; k < (size_t)length && i + k + MIN_MATCH <= end; k++)
+                m_Head[hash3(window + i + k)] = (int64_t)(m_WindowBase + i + k);
+            i += length;
+        }
+        else
+        {
+            putLiteral(window[i]);
+            i++;
+        }
+    }
+    if (m_Idat.size() >= IDAT_SIZE)
+        flushIdat();
+}
+
+void PngWriter::putBits(uint32_t bits, int count)
+{
+    m_BitBuffer |= bits << m_BitCount;
+    m_BitCount += count;
+    while (m_BitCount >= 8)
+    {
+        m_Idat.push_back((unsigned char)m_BitBuffer);
+        m_BitBuffer >>= 8;
+        m_BitCount -= 8;
+    }
+}
+
+// Huffman codes go out most significant bit first, the opposite of everything else
+void PngWriter::putHuffman(uint32_t code, int length)
+{
+    uint32_t reversed = 0;
+    for (int i = 0; i < length; i++)
+        reversed |= ((code >> i) & 1) << (length - 1 - i);
+    putBits(reversed, length);
+}
+
+// fixed literal/length code, RFC 1951 3.2.6
+static void fixedCode(int symbol, uint32_t& code, int& length)
+{
+    if (symbol < 144) { code = 0x30 + symbol; length = 8; }
+    else if (symbol < 256) { code = 0x190 + symbol - 144; length = 9; }
+    else if (symbol < 280) { code = symbol - 256; length = 7; }
+    else { code = 0xC0 + symbol - 280; length = 8; }
+}
+
+void PngWriter::putLiteral(int value)
+{
+    uint32_t code;
+    int length;
+    fixedCode(value, code, length);
+    putHuffman(code, length);
+}
+
+void PngWriter::putMatch(int length, int distance)
+{
+    static const int lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    static const int lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    static const int distanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    static const int distanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+    int l = 28;
+    while (lengthBase[l] > length)
+        l--;
+    uint32_t code;
+    int codeLength;
+    fixedCode(257 + l, code, codeLength);
+    putHuffman(code, codeLength);
+    if (lengthExtra[l])
+        putBits(length - lengthBase[l], lengthExtra[l]);
+
+    int d = 29;
+    while (distanceBase[d] > distance)
+        d--;
+    putHuffman(d, 5);
+    if (distanceExtra[d])
+        putBits(distance - distanceBase[d], distanceExtra[d]);
+}
+
+void PngWriter::flushIdat()
+{
+    if (m_Idat.empty())
+        return;
+    writeChunk("IDAT", m_Idat.data(), m_Idat.size());
+    m_Idat.clear();
+}
+
+void PngWriter::writeChunk(const char* type, const unsigned char* data, size_t size)
+{
+    unsigned char header[8];
+    putBigEndian(header, (uint32_t)size);
+    memcpy(header + 4, type, 4);
+    fwrite(header, 1, 8, m_File);
+    if (size)
+        fwrite(data, 1, size, m_File);
+
+    unsigned char crc[4];
+    putBigEndian(crc, crc32(crc32(0, header + 4, 4), data, size));
+    fwrite(crc, 1, 4, m_File);
+}
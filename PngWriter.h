@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <vector>
+
+// Streaming PNG encoder: rows go in top to bottom and are compressed as they arrive,
+// so images much larger than memory can be written a band at a time. 8 bit gray, RGB or RGBA.
+// Deflate is a single fixed Huffman block with a greedy one-candidate LZ77 matcher,
+// about what zlib level 1 does, without pulling in zlib.
+class PngWriter
+{
+private:
+	FILE* m_File;
+	int m_Width, m_Height, m_Channels;
+	int m_RowsWritten;
+
+	std::vector<unsigned char> m_PreviousRow;
+	std::vector<unsigned char> m_Filtered; // best filter so far, with its filter type byte
+	std::vector<unsigned char> m_Scratch;
+
+	// LZ77 state: the last 32 KB of input plus the row being compressed
+	std::vector<unsigned char> m_Window;
+	size_t m_WindowBase; // stream position of m_Window[0]
+	std::vector<int64_t> m_Head;
+
+	// bit writer and the IDAT chunk being filled
+	uint32_t m_BitBuffer;
+	int m_BitCount;
+	std::vector<unsigned char> m_Idat;
+	uint32_t m_Adler;
+
+	void compress(const unsigned char* data, size_t size);
+	void putBits(uint32_t bits, int count);
+	void putHuffman(uint32_t code, int length);
+	void putLiteral(int value);
+	void putMatch(int length, int distance);
+	void flushIdat();
+	void writeChunk(const char* type, const unsigned char* data, size_t size);
+
+public:
+	PngWriter();
+	~PngWriter();
+
+	bool open(const char* path, int width, int height, int channels);
+	// rowCount rows of width * channels bytes each, tightly packed
+	bool writeRows(const unsigned char* rows, int rowCount);
+	// false if fewer rows than the height were written or the disk filled up
+	bool close();
+
+	// whole image in one go
+	static bool Write(const char* path, int width, int height, int channels, const unsigned char* pixels);
+};
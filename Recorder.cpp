@@ -0,0 +1,366 @@
+#include "Recorder.h"
+
+#include <GL/glew.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#include "Renderer.h"
+#include "GLState.h"
+#include "PngWriter.h"
+#include "Utils.h"
+
+Recorder::Recorder()
+    : m_Width(0), m_Height(0), m_Frame(0), m_Recording(false), m_Stop(false),
+    m_Y4m(nullptr), m_NextY4mFrame(0), m_Failed(false)
+{
+    for (int i = 0; i < RING; i++)
+    {
+        m_Pbos[i] = 0;
+        m_Fences[i] = nullptr;
+        m_SlotFrame[i] = -1;
+    }
+}
+
+Recorder::~Recorder()
+{
+    stop();
+}
+
+bool Recorder::start(const RecordSettings& settings, int width, int height)
+{
+    if (m_Recording || width <= 0 || height <= 0 || settings.frameCount <= 0)
+        return false;
+
+    m_Settings = settings;
+    m_Settings.workers = std::max(1, settings.workers);
+    m_Width = width;
+    m_Height = height;
+    m_Frame = 0;
+    m_Stop = false;
+    m_Failed = false;
+    m_Stats = Stats();
+    m_NextY4mFrame = 0;
+    m_PendingY4m.clear();
+
+    if (m_Settings.format == RecordSettings::Format::Y4m)
+    {
+        m_Y4m = fopen(m_Settings.path.c_str(), "wb");
+        if (!m_Y4m)
+        {
+            std::cout << "Recorder: cannot open " << m_Settings.path << std::endl;
+            return false;
+        }
+        fprintf(m_Y4m, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", m_Width, m_Height, m_Settings.fps);
+    }
+    else
+    {
+        Utils::MakeDirectory(m_Settings.path);
+    }
+
+    size_t size = (size_t)m_Width * m_Height * 4;
+    GLCall(glGenBuffers(RING, m_Pbos));
+    for (int i = 0; i < RING; i++)
+    {
+        GLState::BindBuffer(GL_PIXEL_PACK_BUFFER, m_Pbos[i]);
+        GLCall(glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ));
+        m_Fences[i] = nullptr;
+        m_SlotFrame[i] = -1;
+    }
+    GLState::BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    // one CPU copy per worker plus one being filled; when all are taken the writers are
+    // behind and capture() blocks instead of queueing without bound
+    m_FreeBuffers.clear();
+    for (int i = 0; i < m_Settings.workers + 1; i++)
+        m_FreeBuffers.emplace_back(size);
+
+    for (int i = 0; i < m_Settings.workers; i++)
+        m_Workers.emplace_back(&Recorder::workerLoop, this);
+
+    m_Recording = true;
+    return true;
+}
+
+void Recorder::capture(unsigned int framebuffer)
+{
+    if (!m_Recording)
+        return;
+
+    int slot = m_Frame % RING;
+    if (m_Fences[slot])
+        collect(slot);
+
+    GLState::BindFramebuffer(framebuffer);
+    GLState::BindBuffer(GL_PIXEL_PACK_BUFFER, m_Pbos[slot]);
+    GLCall(glPixelStorei(GL_PACK_ALIGNMENT, 1));
+    // returns immediately, the copy lands in the buffer whenever the GPU gets there
+    GLCall(glReadPixels(0, 0, m_Width, m_Height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr));
+    m_Fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    GLState::BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    m_SlotFrame[slot] = m_Frame;
+
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Stats.captured++;
+    }
+    m_Frame++;
+    if (m_Frame >= m_Settings.frameCount)
+        stop();
+}
+
+void Recorder::collect(int slot)
+{
+    GLsync fence = (GLsync)m_Fences[slot];
+    bool stalled = false;
+    if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+    {
+        stalled = true;
+        glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+    }
+    glDeleteSync(fence);
+    m_Fences[slot] = nullptr;
+
+    Job job;
+    job.frame = m_SlotFrame[slot];
+    {
+        std::unique_lock<std::mutex> lock(m_Mutex);
+        if (m_FreeBuffers.empty())
+            stalled = true;
+        m_BufferFree.wait(lock, [this] { return !m_FreeBuffers.empty(); });
+        job.pixels = std::move(m_FreeBuffers.back());
+        m_FreeBuffers.pop_back();
+        if (stalled)
+            m_Stats.stalls++;
+    }
+
+    GLState::BindBuffer(GL_PIXEL_PACK_BUFFER, m_Pbos[slot]);
+    const void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, job.pixels.size(), GL_MAP_READ_BIT);
+    if (mapped)
+    {
+        memcpy(job.pixels.data(), mapped, job.pixels.size());
+        GLCall(glUnmapBuffer(GL_PIXEL_PACK_BUFFER));
+    }
+    else
+    {
+        std::cout << "Recorder: mapping the readback of frame " << job.frame << " failed" << std::endl;
+        std::fill(job.pixels.begin(), job.pixels.end(), (unsigned char)0);
+    }
+    GLState::BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    m_SlotFrame[slot] = -1;
+
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Queue.push_back(std::move(job));
+    }
+    m_WorkReady.notify_one();
+}
+
+void Recorder::stop()
+{
+    if (!m_Recording)
+        return;
+
+    // the ring holds the last RING frames, hand them over oldest first
+    for (int i = 0; i < RING; i++)
+    {
+        int oldest = -1;
+        for (int slot = 0; slot < RING; slot++)
+        {
+            if (m_Fences[slot] && (oldest < 0 || m_SlotFrame[slot] < m_SlotFrame[oldest]))
+                oldest = slot;
+        }
+        if (oldest < 0)
+            break;
+        collect(oldest);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Stop = true;
+    }
+    m_WorkReady.notify_all();
+    for (std::thread& worker : m_Workers)
+        worker.join();
+    m_Workers.clear();
+    m_FreeBuffers.clear();
+
+    if (m_Y4m)
+    {
+        if (!m_PendingY4m.empty())
+        {
+            std::cout << "Recorder: " << m_PendingY4m.size() << " Y4M frames never got their predecessors" << std::endl;
+            m_Stats.failed += (int)m_PendingY4m.size();
+            m_PendingY4m.clear();
+        }
+        fclose(m_Y4m);
+        m_Y4m = nullptr;
+    }
+
+    for (int i = 0; i < RING; i++)
+        GLState::ForgetBuffer(m_Pbos[i]);
+    GLCall(glDeleteBuffers(RING, m_Pbos));
+
+    m_Recording = false;
+    std::cout << "Recorder: " << m_Stats.written << "/" << m_Stats.captured << " frames written to "
+        << m_Settings.path << ", " << m_Stats.failed << " failed, " << m_Stats.stalls << " stalls" << std::endl;
+}
+
+void Recorder::workerLoop()
+{
+    while (true)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_WorkReady.wait(lock, [this] { return m_Stop || !m_Queue.empty(); });
+            if (m_Queue.empty())
+                return;
+            job = std::move(m_Queue.front());
+            m_Queue.pop_front();
+        }
+
+        encode(job);
+
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_FreeBuffers.push_back(std::move(job.pixels));
+        }
+        m_BufferFree.notify_one();
+    }
+}
+
+void Recorder::encode(Job& job)
+{
+    int w = m_Width, h = m_Height;
+    const unsigned char* pixels = job.pixels.data();
+    size_t stride = (size_t)w * 4;
+
+    if (m_Settings.format == RecordSettings::Format::Png)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "/frame_%05d.png", job.frame);
+        std::string path = m_Settings.path + name;
+
+        // GL rows are bottom up, feed them to the writer top down
+        PngWriter writer;
+        bool ok = writer.open(path.c_str(), w, h, 4);
+        for (int y = h - 1; ok && y >= 0; y--)
+            ok = writer.writeRows(pixels + y * stride, 1);
+        ok = writer.close() && ok;
+        if (!ok && !m_Failed.exchange(true))
+            std::cout << "Recorder: writing " << path << " failed" << std::endl;
+        countWrite(ok);
+        return;
+    }
+
+    // I420: full resolution luma, chroma averaged over 2x2 blocks, BT.601 studio range
+    int cw = (w + 1) / 2, ch = (h + 1) / 2;
+    std::vector<unsigned char> yuv((size_t)w * h + 2 * (size_t)cw * ch);
+    unsigned char* yPlane = yuv.data();
+    unsigned char* uPlane = yPlane + (size_t)w * h;
+    unsigned char* vPlane = uPlane + (size_t)cw * ch;
+
+    for (int y = 0; y < h; y++)
+    {
+        const unsigned char* row = pixels + (h - 1 - y) * stride;
+        for (int x = 0; x < w; x++)
+        {
+            int r = row[x * 4], g = row[x * 4 + 1], b = row[x * 4 + 2];
+            yPlane[(size_t)y * w + x] = (unsigned char)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+        }
+    }
+    for (int cy = 0; cy < ch; cy++)
+    {
+        for (int cx = 0; cx < cw; cx++)
+        {
+            int r = 0, g = 0, b = 0, count = 0;
+            for (int dy = 0; dy < 2; dy++)
+            {
+                int y = std::min(cy * 2 + dy, h - 1);
+                const unsigned char* row = pixels + (h - 1 - y) * stride;
+                for (int dx = 0; dx < 2; dx++)
+                {
+                    int x = std::min(cx * 2 + dx, w - 1);
+                    r += row[x * 4];
+                    g += row[x * 4 + 1];
+                    b += row[x * 4 + 2];
+                    count++;
+                }
+            }
+            r /= count;
+            g /= count;
+            b /= count;
+            uPlane[(size_t)cy * cw + cx] = (unsigned char)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+            vPlane[(size_t)cy * cw + cx] = (unsigned char)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+        }
+    }
+
+    writeY4m(job.frame, std::move(yuv));
+}
+
+void Recorder::writeY4m(int frame, std::vector<unsigned char>&& yuv)
+{
+    std::lock_guard<std::mutex> lock(m_WriteMutex);
+    m_PendingY4m[frame] = std::move(yuv);
+
+    auto next = m_PendingY4m.find(m_NextY4mFrame);
+    while (next != m_PendingY4m.end())
+    {
+        const std::vector<unsigned char>& data = next->second;
+        bool ok = fputs("FRAME\n", m_Y4m) >= 0 && fwrite(data.data(), 1, data.size(), m_Y4m) == data.size();
+        if (!ok && !m_Failed.exchange(true))
+            std::cout << "Recorder: writing frame " << m_NextY4mFrame << " to " << m_Settings.path << " failed" << std::endl;
+        countWrite(ok);
+        m_PendingY4m.erase(next);
+        m_NextY4mFrame++;
+        next = m_PendingY4m.find(m_NextY4mFrame);
+    }
+}
+
+// only frames that reached the file count as written, takes m_Mutex after m_WriteMutex
+void Recorder::countWrite(bool ok)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (ok)
+        m_Stats.written++;
+    else
+        m_Stats.failed++;
+}
+
+Recorder::Stats Recorder::getStats()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    Stats stats = m_Stats;
+    stats.queued = (int)m_Queue.size();
+    return stats;
+}
+
+float Recorder::interpolationAt(int frame) const
+{
+    float u = m_Settings.frameCount > 1 ? (float)frame / (m_Settings.frameCount - 1) : 1.0f;
+    u = std::min(std::max(u, 0.0f), 1.0f);
+
+    switch (m_Settings.easing)
+    {
+    case RecordSettings::Easing::Smooth:
+        return u * u * (3.0f - 2.0f * u);
+    case RecordSettings::Easing::EaseInOut:
+        return u < 0.5f ? 4.0f * u * u * u : 1.0f - 0.5f * std::pow(2.0f - 2.0f * u, 3.0f);
+    case RecordSettings::Easing::PingPong:
+    {
+        // there and back, eased at both ends and at the turn
+        float v = 1.0f - std::fabs(2.0f * u - 1.0f);
+        return v * v * (3.0f - 2.0f * v);
+    }
+    default:
+        return u;
+    }
+}
+
+float Recorder::yawAt(int frame) const
+{
+    // over frameCount rather than frameCount - 1 so a full turn loops without a repeated frame
+    return m_Settings.orbitDegrees * frame / std::max(1, m_Settings.frameCount);
+}
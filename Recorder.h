@@ -0,0 +1,112 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct RecordSettings
+{
+	enum class Easing { Linear, Smooth, EaseInOut, PingPong };
+	enum class CameraPath { Free, Orbit };
+	enum class Format { Png, Y4m };
+
+	int frameCount = 120;
+	int fps = 30;
+	Easing easing = Easing::Smooth;
+	CameraPath camera = CameraPath::Orbit;
+	float orbitDegrees = 360.0f; // yaw covered over the whole sweep
+	float pitch = 20.0f;
+	Format format = Format::Png;
+	std::string path = "capture"; // directory for PNG frames, file for Y4M
+	int workers = 4;
+};
+
+// Records an interpolation sweep. The main thread renders frame n, capture() starts an
+// asynchronous glReadPixels into a ring of pixel pack buffers and maps the slot it is about
+// to reuse, filled RING frames ago and long finished, so the read doesn't wait on the GPU.
+// Encoding and file writes happen on a pool of worker threads.
+class Recorder
+{
+public:
+	static const int RING = 3;
+
+	struct Stats
+	{
+		int captured = 0;
+		int written = 0; // reached the file
+		int failed = 0;  // encoded but the write failed, or a Y4M frame left without its predecessors
+		int queued = 0;
+		int stalls = 0; // captures that had to wait, on the GPU or on the writers
+	};
+
+private:
+	struct Job
+	{
+		int frame;
+		std::vector<unsigned char> pixels; // RGBA, bottom row first as GL reads it
+	};
+
+	RecordSettings m_Settings;
+	int m_Width, m_Height;
+	int m_Frame;
+	bool m_Recording;
+
+	unsigned int m_Pbos[RING];
+	void* m_Fences[RING]; // GLsync, kept opaque to spare GL headers here
+	int m_SlotFrame[RING];
+
+	std::vector<std::thread> m_Workers;
+	std::mutex m_Mutex;
+	std::condition_variable m_WorkReady;
+	std::condition_variable m_BufferFree;
+	std::deque<Job> m_Queue;
+	std::vector<std::vector<unsigned char>> m_FreeBuffers;
+	bool m_Stop;
+
+	// Y4M frames must land in order, whichever worker finishes first
+	FILE* m_Y4m;
+	std::mutex m_WriteMutex;
+	std::map<int, std::vector<unsigned char>> m_PendingY4m;
+	int m_NextY4mFrame;
+
+	Stats m_Stats;
+	std::atomic<bool> m_Failed; // set by the writers
+
+	void collect(int slot);
+	void workerLoop();
+	void encode(Job& job);
+	void writeY4m(int frame, std::vector<unsigned char>&& yuv);
+	void countWrite(bool ok);
+
+public:
+	Recorder();
+	// stops a recording still running, which reads back and deletes GL buffers: stop() first
+	// when the context may be gone by then
+	~Recorder();
+
+	// width and height of the framebuffer that will be captured
+	bool start(const RecordSettings& settings, int width, int height);
+	// starts reading back the frame just rendered into framebuffer, hands the one from RING frames back
+	// to the writers and advances to the next frame
+	void capture(unsigned int framebuffer);
+	// waits for everything in flight, also called when the last frame was captured; needs the
+	// context current
+	void stop();
+
+	bool isRecording() const { return m_Recording; }
+	int getFrame() const { return m_Frame; }
+	const RecordSettings& getSettings() const { return m_Settings; }
+	Stats getStats();
+	// a frame could not be written, valid once stopped
+	bool hasFailed() const { return m_Failed; }
+
+	// t and camera yaw for a frame of the sweep
+	float interpolationAt(int frame) const;
+	float yawAt(int frame) const;
+};
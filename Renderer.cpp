@@ -1,6 +1,14 @@
 #include "Renderer.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <iostream>
+#include <mutex>
+#include <unordered_map>
+
+#include "GLState.h"
+#include "Frustum.h"
 
 void GLClearError()
 {
@@ -18,7 +26,406 @@ bool GLLogCall(const char* function, const char* file, int line)
     return true;
 }
 
+static GLCallSite* s_CallSites = nullptr;
+static unsigned int s_LastFrameCallCount = 0;
+
+GLCallSite::GLCallSite(const char* function, const char* file, int line)
+    : function(function), file(file), line(line), count(0), lastFrameCount(0), next(s_CallSites)
+{
+    s_CallSites = this;
+}
+
+GLErrorMode GLDebug::s_Mode = GLErrorMode::Off;
+int GLDebug::s_ValidateFrames = 0;
+bool GLDebug::s_DebugContext = false;
+
+// (source, type, id) -> times seen, only the first occurrence gets printed. Ids are only unique
+// within a source and type. Outside the synchronous mode the driver may call back from threads of
+// its own, so the map is locked.
+static std::unordered_map<uint64_t, unsigned int> s_SeenMessages;
+static unsigned int s_SuppressedMessages = 0;
+static std::mutex s_MessageMutex;
+
+static const char* SourceName(GLenum source)
+{
+    switch (source)
+    {
+    case GL_DEBUG_SOURCE_API: return "API";
+    case GL_DEBUG_SOURCE_WINDOW_SYSTEM: return "Window System";
+    case GL_DEBUG_SOURCE_SHADER_COMPILER: return "Shader Compiler";
+    case GL_DEBUG_SOURCE_THIRD_PARTY: return "Third Party";
+    case GL_DEBUG_SOURCE_APPLICATION: return "Application";
+    default: return "Other";
+    }
+}
+
+static const char* SeverityName(GLenum severity)
+{
+    switch (severity)
+    {
+    case GL_DEBUG_SEVERITY_HIGH: return "high";
+    case GL_DEBUG_SEVERITY_MEDIUM: return "medium";
+    case GL_DEBUG_SEVERITY_LOW: return "low";
+    default: return "notification";
+    }
+}
+
+static void GLAPIENTRY DebugCallback(GLenum source, GLenum type, GLuint id, GLenum severity,
+    GLsizei length, const GLchar* message, const void* userParam)
+{
+    // the enums of both fit in 16 bits (0x8246..0x826A)
+    uint64_t key = ((uint64_t)(source & 0xFFFF) << 48) | ((uint64_t)(type & 0xFFFF) << 32) | id;
+    std::lock_guard<std::mutex> lock(s_MessageMutex);
+    if (s_SeenMessages[key]++ > 0)
+    {
+        s_SuppressedMessages++;
+        return;
+    }
+    std::cout << "[OpenGL " << SourceName(source) << ", " << SeverityName(severity) << "] (" << id << "): " << message << std::endl;
+    if (type == GL_DEBUG_TYPE_ERROR && GLDebug::GetMode() == GLErrorMode::CallbackSync)
+        ASSERT(false);
+}
+
+bool GLDebug::HasDebugOutput()
+{
+    return GLEW_KHR_debug || GLEW_VERSION_4_3;
+}
+
+void GLDebug::Init(GLErrorMode mode)
+{
+    GLint flags = 0;
+    glGetIntegerv(GL_CONTEXT_FLAGS, &flags);
+    s_DebugContext = (flags & GL_CONTEXT_FLAG_DEBUG_BIT) != 0;
+    if (HasDebugOutput())
+    {
+        glDebugMessageCallback(DebugCallback, nullptr);
+        SetMinSeverity(GL_DEBUG_SEVERITY_LOW);
+    }
+    SetMode(mode);
+}
+
+void GLDebug::SetMode(GLErrorMode mode)
+{
+    if ((mode == GLErrorMode::Callback || mode == GLErrorMode::CallbackSync) && !(HasDebugOutput() && s_DebugContext))
+    {
+        std::cout << "GLDebug: " << (HasDebugOutput() ? "not a debug context" : "KHR_debug not available") << ", falling back to glGetError polling" << std::endl;
+        mode = GLErrorMode::Poll;
+    }
+    s_Mode = mode;
+
+    if (!HasDebugOutput())
+        return;
+    if (mode == GLErrorMode::Callback || mode == GLErrorMode::CallbackSync)
+        glEnable(GL_DEBUG_OUTPUT);
+    else
+        glDisable(GL_DEBUG_OUTPUT);
+    if (mode == GLErrorMode::CallbackSync)
+        glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+    else
+        glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+}
+
+void GLDebug::SetMinSeverity(GLenum severity)
+{
+    if (!HasDebugOutput())
+        return;
+    const GLenum severities[] = { GL_DEBUG_SEVERITY_HIGH, GL_DEBUG_SEVERITY_MEDIUM, GL_DEBUG_SEVERITY_LOW, GL_DEBUG_SEVERITY_NOTIFICATION };
+    bool enable = true;
+    for (GLenum s : severities)
+    {
+        glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, s, 0, nullptr, enable ? GL_TRUE : GL_FALSE);
+        if (s == severity)
+            enable = false;
+    }
+}
+
+void GLDebug::EnableSource(GLenum source, bool enable)
+{
+    if (HasDebugOutput())
+        glDebugMessageControl(source, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr, enable ? GL_TRUE : GL_FALSE);
+}
+
+void GLDebug::ValidateFrames(int n)
+{
+    s_ValidateFrames = n;
+}
+
+void GLDebug::EndFrame()
+{
+    unsigned int total = 0;
+    for (GLCallSite* site = s_CallSites; site; site = site->next)
+    {
+        site->lastFrameCount = site->count;
+        site->count = 0;
+        total += site->lastFrameCount;
+    }
+    s_LastFrameCallCount = total;
+
+#ifdef NDEBUG
+    // the bare GLCall of release builds never polls, whatever the frame left is caught here;
+    // bounded, a lost context keeps returning an error
+    if (s_Mode == GLErrorMode::Poll)
+    {
+        for (int i = 0; i < 16; i++)
+        {
+            GLenum error = glGetError();
+            if (error == GL_NO_ERROR)
+                break;
+            std::cout << "[OpenGL Error] (" << error << "): during the frame" << std::endl;
+        }
+    }
+#endif
+
+    if (s_ValidateFrames > 0 && --s_ValidateFrames == 0)
+        SetMode(GLErrorMode::Off);
+}
+
+GLCallSite* GLDebug::GetCallSites()
+{
+    return s_CallSites;
+}
+
+unsigned int GLDebug::GetLastFrameCallCount()
+{
+    return s_LastFrameCallCount;
+}
+
+unsigned int GLDebug::GetSuppressedMessageCount()
+{
+    std::lock_guard<std::mutex> lock(s_MessageMutex);
+    return s_SuppressedMessages;
+}
+
+// [63..48] program, [47..24] first texture, [23..0] VAO
+static uint64_t MakeSortKey(const DrawItem& item)
+{
+    uint64_t program = item.shader->GetRendererID() & 0xFFFF;
+    uint64_t texture = item.textures[0] & 0xFFFFFF;
+    uint64_t vao = item.mesh->getVAO() & 0xFFFFFF;
+    return (program << 48) | (texture << 24) | vao;
+}
+
+glm::mat4 SurfaceParams::pack() const
+{
+    glm::mat4 result;
+    result[0] = glm::vec4((float)overlay, (float)(pickedFace + 1), heatmapReference, heatmapRange);
+    result[1] = glm::vec4((float)edgeBits, edgeWidth, materials ? 1.0f : 0.0f, virtualTexture ? 1.0f : 0.0f);
+    result[2] = glm::vec4(virtualPages.x, virtualPages.y, virtualLevels, virtualLodBias);
+    result[3] = glm::vec4(virtualTiles.x, virtualTiles.y, virtualCacheSize, virtualTilePages);
+    return result;
+}
+
+glm::mat4 MorphParams::pack() const
+{
+    glm::mat4 result;
+    for (int i = 0; i < 3; i++)
+        result[i] = glm::vec4(bestRotation[i], 0.0f);
+    result[3] = glm::vec4(averageScaling, toFlip ? 1.0f : 0.0f, 0.0f, 0.0f);
+    return result;
+}
+
+DrawItem& CommandList::Draw(const Shader& shader, const MeshGl& mesh, const glm::mat4& model)
+{
+    m_Items.emplace_back();
+    DrawItem& item = m_Items.back();
+    item.shader = &shader;
+    item.mesh = &mesh;
+    item.model = model;
+    item.params = glm::mat4(0.0f);
+    item.instanceCount = 0;
+    item.instanceRadius = 0.0f;
+    item.minLod = 0;
+    item.interpolation = 0.0f;
+    item.worldBounds.center = glm::vec3(0.0f);
+    item.worldBounds.radius = -1.0f;
+    item.cull = true;
+    item.faceOrder = false;
+    item.linearMorph = true;
+    for (unsigned int i = 0; i < DrawItem::MAX_TEXTURES; i++)
+    {
+        item.textures[i] = 0;
+        item.textureTargets[i] = GL_TEXTURE_2D;
+    }
+    item.sortKey = MakeSortKey(item);
+    return item;
+}
+
+void CommandList::SetTexture(DrawItem& item, unsigned int unit, unsigned int texture, GLenum target)
+{
+    item.textures[unit] = texture;
+    item.textureTargets[unit] = target;
+    item.sortKey = MakeSortKey(item);
+}
+
+Renderer::Renderer()
+    : m_PassUBO(0), m_PassStride(0), m_PassIndex(0), m_LastFrameDraws(0), m_FrameDraws(0),
+    culling(true), clusterCulling(true), lodBias(0)
+{
+}
+
+Renderer::~Renderer()
+{
+    if (m_PassUBO)
+    {
+        GLState::ForgetBuffer(m_PassUBO);
+        glDeleteBuffers(1, &m_PassUBO);
+    }
+}
+
 void Renderer::Clear() const
 {
     GLCall(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
 }
+
+void Renderer::BeginFrame()
+{
+    m_PassIndex = 0;
+    m_LastFrameDraws = m_FrameDraws;
+    m_FrameDraws = 0;
+    m_LastPassStats.swap(m_PassStats);
+    m_PassStats.clear();
+}
+
+void Renderer::Submit(const RenderPass& pass, CommandList& list)
+{
+    CommandList* lists[] = { &list };
+    Submit(pass, lists, 1);
+}
+
+void Renderer::Submit(const RenderPass& pass, CommandList* const* lists, size_t listCount)
+{
+    if (m_PassUBO == 0)
+    {
+        int alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        m_PassStride = (sizeof(PassData) + alignment - 1) / alignment * alignment;
+        glGenBuffers(1, &m_PassUBO);
+        GLState::BindBuffer(GL_UNIFORM_BUFFER, m_PassUBO);
+        GLCall(glBufferData(GL_UNIFORM_BUFFER, MAX_PASSES * m_PassStride, nullptr, GL_DYNAMIC_DRAW));
+    }
+
+    // every pass of the frame gets its own slice, so nothing waits on the previous pass
+    unsigned int offset = (m_PassIndex++ % MAX_PASSES) * m_PassStride;
+    GLState::BindBuffer(GL_UNIFORM_BUFFER, m_PassUBO);
+    GLCall(glBufferSubData(GL_UNIFORM_BUFFER, offset, sizeof(PassData), &pass.data));
+    GLCall(glBindBufferRange(GL_UNIFORM_BUFFER, Shader::PASS_DATA_BINDING, m_PassUBO, offset, sizeof(PassData)));
+
+    GLState::BindFramebuffer(pass.framebuffer);
+    GLState::Viewport(pass.viewport[0], pass.viewport[1], pass.viewport[2], pass.viewport[3]);
+    if (pass.clearMask)
+    {
+        GLCall(glClearColor(pass.clearColor.x, pass.clearColor.y, pass.clearColor.z, pass.clearColor.w));
+        GLCall(glClear(pass.clearMask));
+    }
+    if (pass.shadowMap)
+        GLState::BindTexture(Shader::SHADOW_MAP_UNIT, GL_TEXTURE_2D, pass.shadowMap);
+
+    m_Sorted.clear();
+    for (size_t i = 0; i < listCount; i++)
+    {
+        const DrawItem* items = lists[i]->Items();
+        for (size_t j = 0; j < lists[i]->Size(); j++)
+            m_Sorted.push_back(&items[j]);
+    }
+    std::sort(m_Sorted.begin(), m_Sorted.end(), [](const DrawItem* a, const DrawItem* b) {
+        return a->sortKey < b->sortKey;
+    });
+
+    Frustum frustum(pass.data.proj * pass.data.view);
+    bool perspective = pass.data.proj[3][3] == 0.0f;
+    PassStats stats = { pass.name, 0, 0, 0, 0, 0 };
+
+    for (const DrawItem* item : m_Sorted)
+    {
+        const MeshGl& mesh = *item->mesh;
+        Frustum::Result visibility = Frustum::Result::Inside;
+        BoundingSphere bounds = item->worldBounds;
+        if (bounds.radius < 0.0f && mesh.hasBounds() && item->linearMorph)
+            bounds = transformSphere(mesh.getBounds().at(item->interpolation), item->model);
+        if (culling && item->cull && bounds.radius >= 0.0f)
+        {
+            visibility = frustum.test(bounds);
+            if (visibility == Frustum::Result::Outside)
+            {
+                stats.objectsCulled++;
+                continue;
+            }
+        }
+
+        // level from the projected size: a sphere filling the viewport height gets level 0, each halving one more, never finer than the item's minLod.
+        // The bounds of an instanced item hold every instance, it gets the level of one instance at their nearest point.
+        unsigned int lod = 0;
+        bool instanced = item->instanceCount > 0;
+        if ((!instanced || item->instanceRadius > 0.0f) && !item->faceOrder && mesh.getLodCount() > 1)
+        {
+            int level = (int)item->minLod;
+            float radius = instanced ? item->instanceRadius : bounds.radius;
+            if (radius > 0.0f && bounds.radius > 0.0f)
+            {
+                float distance = perspective ? std::max(glm::length(glm::vec3(pass.data.view * glm::vec4(bounds.center, 1.0f))) - (bounds.radius - radius), 1e-4f) : 1.0f;
+                float pixels = radius * pass.data.proj[1][1] * pass.viewport[3] / distance;
+                level = std::max(level, (int)std::floor(std::log2(pass.viewport[3] / std::max(pixels, 1.0f))) + lodBias);
+            }
+            lod = (unsigned int)std::min(std::max(level, 0), (int)mesh.getLodCount() - 1);
+        }
+
+        // only an object crossing the frustum boundary is worth testing per cluster
+        m_Ranges.clear();
+        bool useClusters = culling && clusterCulling && item->cull && !item->faceOrder && item->linearMorph && lod == 0 && item->instanceCount == 0
+            && visibility == Frustum::Result::Intersects && !mesh.getClusters().empty();
+        if (useClusters)
+        {
+            for (const MeshCluster& cluster : mesh.getClusters())
+            {
+                BoundingSphere clusterBounds = transformSphere(cluster.bounds.at(item->interpolation), item->model);
+                if (frustum.test(clusterBounds) == Frustum::Result::Outside)
+                {
+                    stats.clustersCulled++;
+                    continue;
+                }
+                stats.clustersDrawn++;
+                unsigned int first = cluster.firstFace * 3;
+                unsigned int count = cluster.faceCount * 3;
+                if (!m_Ranges.empty() && m_Ranges.back().first + m_Ranges.back().count == first)
+                    m_Ranges.back().count += count;
+                else
+                    m_Ranges.push_back({ first, count });
+            }
+            if (m_Ranges.empty())
+            {
+                stats.objectsCulled++;
+                continue;
+            }
+        }
+        stats.objectsDrawn++;
+        if (lod > 0)
+            stats.lodDraws++;
+
+        const Shader& shader = *item->shader;
+        GLState::UseProgram(shader.GetRendererID());
+        for (unsigned int unit = 0; unit < DrawItem::MAX_TEXTURES; unit++)
+        {
+            if (item->textures[unit])
+                GLState::BindTexture(unit, item->textureTargets[unit], item->textures[unit]);
+        }
+        if (shader.GetModelLocation() != -1)
+        {
+            GLCall(glUniformMatrix4fv(shader.GetModelLocation(), 1, GL_FALSE, &item->model[0][0]));
+        }
+        if (shader.GetNormalMatrixLocation() != -1)
+        {
+            glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(item->model)));
+            GLCall(glUniformMatrix3fv(shader.GetNormalMatrixLocation(), 1, GL_FALSE, &normalMatrix[0][0]));
+        }
+        if (shader.GetDrawParamsLocation() != -1)
+        {
+            GLCall(glUniformMatrix4fv(shader.GetDrawParamsLocation(), 1, GL_FALSE, &item->params[0][0]));
+        }
+        if (useClusters)
+            mesh.drawRanges(m_Ranges.data(), m_Ranges.size());
+        else
+            mesh.drawElements(item->instanceCount, lod);
+        m_FrameDraws++;
+    }
+    m_PassStats.push_back(stats);
+}
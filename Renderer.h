@@ -1,18 +1,214 @@
 #pragma once
 
 #include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
 #include "Shader.h"
+#include "meshGL.h"
 
 #define ASSERT(x) if (!(x)) __debugbreak();
-#define GLCall(x) GLClearError();\
+
+// Release builds emit the bare call. Other builds count every call site per frame
+// and only poll glGetError while GLDebug runs in Poll mode.
+#ifdef NDEBUG
+#define GLCall(x) x
+#else
+#define GLCall(x) { static GLCallSite glCallSite(#x, __FILE__, __LINE__); glCallSite.count++; }\
+    if (GLDebug::IsPolling()) GLClearError();\
     x;\
-    ASSERT(GLLogCall(#x, __FILE__, __LINE__)) //#x is the name of the function
+    if (GLDebug::IsPolling()) ASSERT(GLLogCall(#x, __FILE__, __LINE__)) //#x is the name of the function
+#endif
 
 void GLClearError();
 bool GLLogCall(const char* function, const char* file, int line);
 
+// one per GLCall expansion, chained in a list walked by GLDebug::EndFrame()
+struct GLCallSite
+{
+    const char* function;
+    const char* file;
+    int line;
+    unsigned int count;
+    unsigned int lastFrameCount;
+    GLCallSite* next;
+
+    GLCallSite(const char* function, const char* file, int line);
+};
+
+enum class GLErrorMode
+{
+    Off,
+    Poll,         // glGetError around every GLCall, serializes the driver; release builds, whose GLCall
+                  // is the bare call, check once per frame in EndFrame()
+    Callback,     // KHR_debug callback, asynchronous
+    CallbackSync  // KHR_debug callback on the calling thread, for breakpoints
+};
+
+class GLDebug
+{
+private:
+    static GLErrorMode s_Mode;
+    static int s_ValidateFrames;
+    static bool s_DebugContext;
+
+public:
+    // callback modes fall back to Poll when KHR_debug is missing or the context isn't a debug one,
+    // whose drivers may report nothing through it
+    static void Init(GLErrorMode mode);
+    static void SetMode(GLErrorMode mode);
+    static GLErrorMode GetMode() { return s_Mode; }
+    static bool IsPolling() { return s_Mode == GLErrorMode::Poll; }
+    static bool HasDebugOutput();
+    static bool IsDebugContext() { return s_DebugContext; }
+
+    // driver side filtering, severity is one of GL_DEBUG_SEVERITY_*
+    static void SetMinSeverity(GLenum severity);
+    static void EnableSource(GLenum source, bool enable);
+
+    // keep the current mode for n frames, then switch to Off
+    static void ValidateFrames(int n);
+    static int GetValidateFramesLeft() { return s_ValidateFrames; }
+
+    static void EndFrame();
+    static GLCallSite* GetCallSites();
+    static unsigned int GetLastFrameCallCount();
+    static unsigned int GetSuppressedMessageCount();
+};
+
+// std140 block "PassData" shared by every program, written once per pass
+struct PassData
+{
+    glm::mat4 view;
+    glm::mat4 proj;
+    glm::mat4 lightSpace;
+    glm::vec4 viewPos;
+};
+
+struct RenderPass
+{
+    const char* name;
+    unsigned int framebuffer;
+    int viewport[4];
+    GLbitfield clearMask;
+    glm::vec4 clearColor;
+    PassData data;
+    unsigned int shadowMap; // depth texture on Shader::SHADOW_MAP_UNIT for the whole pass, 0 = none
+};
+
+// The per-draw data travels as one mat4, u_DrawParams, a single glUniformMatrix4fv per draw. These
+// name its slots: pack() is the only mapping from the fields to the matrix, the shaders give the
+// same slots the same names with #defines next to their u_DrawParams.
+
+// basic.hlsl and vtFeedback.hlsl
+struct SurfaceParams
+{
+    enum class Overlay { None = 0, UVOverlaps = 1, Heatmap = 2 };
+
+    Overlay overlay = Overlay::None;            // [0].x, the value from u_FaceAttributes per face
+    int pickedFace = -1;                        // [0].y as face + 1, drawn highlighted
+    float heatmapReference = 0.0f;              // [0].z, the value drawn neutral
+    float heatmapRange = 0.0f;                  // [0].w, log2 of value / reference at full color
+    int edgeBits = 0;                           // [1].x: 1 wireframe, 2 seams, 4 borders
+    float edgeWidth = 0.0f;                     // [1].y, line width in pixels
+    bool materials = false;                     // [1].z, textures from the material arrays instead of u_Texture
+    bool virtualTexture = false;                // [1].w, the color from the virtual texture instead of u_Texture
+    // the virtual texture's, VirtualTexture::setDrawParams fills them
+    glm::vec2 virtualPages = glm::vec2(0.0f);   // [2].xy, pages a tile's texels span along u and v at level 0, the last one padded
+    float virtualLevels = 0.0f;                 // [2].z
+    float virtualLodBias = 0.0f;                // [2].w, in mip levels
+    glm::vec2 virtualTiles = glm::vec2(0.0f);   // [3].xy, udim tiles along u and v
+    float virtualCacheSize = 0.0f;              // [3].z, texels along a side of u_VirtualPages
+    float virtualTilePages = 0.0f;              // [3].w, pages along a side of a tile's square in the page table
+
+    glm::mat4 pack() const;
+};
+
+// morph.hlsl, gallery.hlsl and galleryDepth.hlsl: Mesh::interpolate on the GPU
+struct MorphParams
+{
+    glm::mat3 bestRotation = glm::mat3(1.0f);   // [0..2].xyz
+    float averageScaling = 1.0f;                // [3].x
+    bool toFlip = false;                        // [3].y, the uvs are mirrored
+
+    glm::mat4 pack() const;
+};
+
+struct DrawItem
+{
+    static const unsigned int MAX_TEXTURES = 8;
+
+    uint64_t sortKey;
+    const Shader* shader;
+    const MeshGl* mesh;
+    unsigned int textures[MAX_TEXTURES]; // bound to units 0..MAX_TEXTURES-1, 0 = leave the unit alone
+    GLenum textureTargets[MAX_TEXTURES];
+    glm::mat4 model;
+    glm::mat4 params;           // SurfaceParams or MorphParams packed, uploaded to u_DrawParams when the shader has it
+    unsigned int instanceCount; // 0 = not instanced
+    float instanceRadius;       // instanced: the world radius of one instance, picks the level; 0 = always level 0
+    unsigned int minLod;        // the finest level allowed, the projected size may pick a coarser one
+    float interpolation;        // picks the mesh bounds between its morph end points
+    BoundingSphere worldBounds; // radius < 0: derived from the mesh bounds and the model matrix
+    bool cull;
+    bool faceOrder; // gl_PrimitiveID has to be the face index: all of level 0 in one range, no clusters
+    bool linearMorph; // the vertices follow Mesh::interpolate, else the morph bounds of the mesh and its clusters don't hold
+};
+
+struct PassStats
+{
+    const char* name;
+    unsigned int objectsDrawn;
+    unsigned int objectsCulled;
+    unsigned int clustersDrawn;
+    unsigned int clustersCulled;
+    unsigned int lodDraws; // objects drawn with a coarser level
+};
+
+// Draws recorded for one pass. Not shared between threads: every thread fills
+// its own list and Renderer::Submit merges them.
+class CommandList
+{
+private:
+    std::vector<DrawItem> m_Items;
+
+public:
+    void Clear() { m_Items.clear(); } // keeps the capacity, steady frames don't allocate
+    DrawItem& Draw(const Shader& shader, const MeshGl& mesh, const glm::mat4& model);
+    void SetTexture(DrawItem& item, unsigned int unit, unsigned int texture, GLenum target = GL_TEXTURE_2D);
+
+    size_t Size() const { return m_Items.size(); }
+    const DrawItem* Items() const { return m_Items.data(); }
+};
+
 class Renderer
 {
+private:
+    static const unsigned int MAX_PASSES = 16;
+
+    unsigned int m_PassUBO;
+    unsigned int m_PassStride;
+    unsigned int m_PassIndex;
+    std::vector<const DrawItem*> m_Sorted;
+    std::vector<IndexRange> m_Ranges;
+    unsigned int m_LastFrameDraws;
+    unsigned int m_FrameDraws;
+    std::vector<PassStats> m_PassStats;
+    std::vector<PassStats> m_LastPassStats;
+
 public:
+    Renderer();
+    ~Renderer();
+
     void Clear() const;
-};
\ No newline at end of file
+    void BeginFrame();
+    // merges the lists, orders them by sort key (program, texture, VAO) and draws them into the pass target
+    void Submit(const RenderPass& pass, CommandList* const* lists, size_t listCount);
+    void Submit(const RenderPass& pass, CommandList& list);
+    unsigned int GetLastFrameDrawCount() const { return m_LastFrameDraws; }
+    const std::vector<PassStats>& GetLastFramePassStats() const { return m_LastPassStats; }
+
+    bool culling;
+    bool clusterCulling;
+    int lodBias; // added to the level picked from the projected size, negative favors detail
+};
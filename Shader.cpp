@@ -3,21 +3,49 @@
 #include <iostream>
 #include <fstream>
 #include <string>
-#include <sstream>
 
 #include "Renderer.h"
+#include "GLState.h"
 
 
-Shader::Shader(const std::string& filepath)
-	:m_Filepath(filepath), m_RendererID(0)
+Shader::Shader(const std::string& filepath, const std::vector<const char*>& feedbackVaryings)
+	:m_Filepath(filepath), m_RendererID(0), m_ModelLocation(-1), m_NormalMatrixLocation(-1), m_DrawParamsLocation(-1)
 {
     ShaderProgramSource source = ParseShader(filepath);
-    m_RendererID = CreateShader(source.VertexSource, source.FragmentSource);
+    m_RendererID = CreateShader(source.VertexSource, source.FragmentSource, feedbackVaryings);
+
+    // optional uniforms, looked up directly to skip the missing-uniform warning
+    m_ModelLocation = glGetUniformLocation(m_RendererID, "u_Model");
+    m_NormalMatrixLocation = glGetUniformLocation(m_RendererID, "u_NormalMatrix");
+    m_DrawParamsLocation = glGetUniformLocation(m_RendererID, "u_DrawParams");
+    unsigned int passBlock = glGetUniformBlockIndex(m_RendererID, "PassData");
+    if (passBlock != GL_INVALID_INDEX)
+        glUniformBlockBinding(m_RendererID, passBlock, PASS_DATA_BINDING);
+    // samplers on fixed units, set once for the programs that have them
+    static const struct { const char* name; unsigned int unit; } samplers[] = {
+        { "u_ShadowMap", SHADOW_MAP_UNIT },
+        { "u_FaceAttributes", FACE_ATTRIBUTE_UNIT },
+        { "u_FaceEdges", FACE_EDGE_UNIT },
+        { "u_MaterialColor", MATERIAL_COLOR_UNIT },
+        { "u_MaterialOrm", MATERIAL_ORM_UNIT },
+        { "u_PageTable", VIRTUAL_PAGE_TABLE_UNIT },
+        { "u_VirtualPages", VIRTUAL_PAGES_UNIT },
+    };
+    for (const auto& sampler : samplers)
+    {
+        int location = glGetUniformLocation(m_RendererID, sampler.name);
+        if (location != -1)
+        {
+            GLState::UseProgram(m_RendererID);
+            glUniform1i(location, sampler.unit);
+        }
+    }
     //m_RendererID = CreateShader(source.VertexSource, source.FragmentSource, source.GeometrySource);
 }
 
 Shader::~Shader()
 {
+    GLState::ForgetProgram(m_RendererID);
     GLCall(glDeleteProgram(m_RendererID));
 }
 
@@ -30,8 +58,10 @@ ShaderProgramSource Shader::ParseShader(const std::string& filepath)
         NONE = -1, VERTEX = 0, FRAGMENT = 1, GEOMETRY = 2
     };
 
+    // plain strings appended in place: shaders load outside any import, the arenas' counters stay theirs
+    ShaderProgramSource source;
+    std::string* ss[3] = { &source.VertexSource, &source.FragmentSource, &source.GeometrySource };
     std::string line;
-    std::stringstream ss[3];
     ShaderType type = ShaderType::NONE;
     while (getline(stream, line))
     {
@@ -44,13 +74,14 @@ ShaderProgramSource Shader::ParseShader(const std::string& filepath)
             else if (line.find("geometry") != std::string::npos)
                 type = ShaderType::GEOMETRY;
         }
-        else
+        else if (type != ShaderType::NONE)
         {
-            ss[(int)type] << line << '\n';
+            *ss[(int)type] += line;
+            *ss[(int)type] += '\n';
         }
     }
 
-    return { ss[0].str(), ss[1].str(), ss[2].str() };
+    return source;
 }
 
 unsigned int Shader::CompileShader(unsigned int type, const std::string& source)
@@ -77,19 +108,36 @@ unsigned int Shader::CompileShader(unsigned int type, const std::string& source)
     return id;
 }
 
-unsigned unsigned int Shader::CreateShader(const std::string& vertexShader, const std::string& fragmentShader)
+unsigned unsigned int Shader::CreateShader(const std::string& vertexShader, const std::string& fragmentShader, const std::vector<const char*>& feedbackVaryings)
 {
     unsigned int program = glCreateProgram();
     unsigned int vs = CompileShader(GL_VERTEX_SHADER, vertexShader);
-    unsigned int fs = CompileShader(GL_FRAGMENT_SHADER, fragmentShader);
+    unsigned int fs = fragmentShader.empty() ? 0 : CompileShader(GL_FRAGMENT_SHADER, fragmentShader);
 
     glAttachShader(program, vs);
-    glAttachShader(program, fs);
+    if (fs)
+        glAttachShader(program, fs);
+    // has to be set before linking
+    if (!feedbackVaryings.empty())
+        glTransformFeedbackVaryings(program, (GLsizei)feedbackVaryings.size(), feedbackVaryings.data(), GL_SEPARATE_ATTRIBS);
     glLinkProgram(program);
+
+    int linked;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (linked == GL_FALSE)
+    {
+        int length;
+        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+        char* message = (char*)alloca(length * sizeof(char));
+        glGetProgramInfoLog(program, length, &length, message);
+        std::cout << "Failed to link " << m_Filepath << "!" << std::endl;
+        std::cout << message << std::endl;
+    }
     glValidateProgram(program);
 
     glDeleteShader(vs);
-    glDeleteShader(fs);
+    if (fs)
+        glDeleteShader(fs);
 
     return program;
 }
@@ -116,12 +164,12 @@ unsigned unsigned int Shader::CreateShader(const std::string& vertexShader, cons
 
 void Shader::Bind() const
 {
-    GLCall(glUseProgram(m_RendererID));
+    GLState::UseProgram(m_RendererID);
 }
 
 void Shader::Unbind() const
 {
-    GLCall(glUseProgram(0));
+    GLState::UseProgram(0);
 }
 
 void Shader::SetUniform1i(const std::string& name, int value)
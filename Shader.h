@@ -2,6 +2,7 @@
 
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "glm/glm.hpp"
 
@@ -14,18 +15,38 @@ struct ShaderProgramSource
 
 class Shader
 {
+public:
+	static const unsigned int PASS_DATA_BINDING = 0; // uniform block "PassData", see Renderer.h
+	static const unsigned int SHADOW_MAP_UNIT = 1;   // sampler "u_ShadowMap", bound per pass by the renderer
+	static const unsigned int FACE_ATTRIBUTE_UNIT = 2; // samplerBuffer "u_FaceAttributes", see FaceAttributeBuffer
+	static const unsigned int FACE_EDGE_UNIT = 3;      // samplerBuffer "u_FaceEdges", see UVSeams
+	static const unsigned int MATERIAL_COLOR_UNIT = 4; // sampler2DArray "u_MaterialColor", see MaterialTextures
+	static const unsigned int MATERIAL_ORM_UNIT = 5;   // sampler2DArray "u_MaterialOrm"
+	static const unsigned int VIRTUAL_PAGE_TABLE_UNIT = 6; // sampler2D "u_PageTable", see VirtualTexture
+	static const unsigned int VIRTUAL_PAGES_UNIT = 7;      // sampler2D "u_VirtualPages"
+
 private:
 	unsigned int m_RendererID;
+	int m_ModelLocation;        // u_Model, resolved once for the renderer's per-draw upload
+	int m_NormalMatrixLocation; // u_NormalMatrix
+	int m_DrawParamsLocation;   // u_DrawParams
 	mutable std::unordered_map<std::string, int> m_UniformLocationCache;
 	std::string m_Filepath; // debug purpose
 
 public:
-	Shader(const std::string& filepath);
+	// feedbackVaryings: vertex outputs captured by transform feedback, one buffer each (GL_SEPARATE_ATTRIBS).
+	// A file without a fragment section is fine then, the program only runs the vertex stage.
+	Shader(const std::string& filepath, const std::vector<const char*>& feedbackVaryings = {});
 	~Shader();
 
 	void Bind() const;
 	void Unbind() const;
 
+	unsigned int GetRendererID() const { return m_RendererID; }
+	int GetModelLocation() const { return m_ModelLocation; }
+	int GetNormalMatrixLocation() const { return m_NormalMatrixLocation; }
+	int GetDrawParamsLocation() const { return m_DrawParamsLocation; }
+
 	// Set uniforms
 	void SetUniform1i(const std::string& name, int value);
 	void SetUniform1f(const std::string& name, float value);
@@ -38,7 +59,7 @@ public:
 private:
 	ShaderProgramSource ParseShader(const std::string& filepath);
 	unsigned int CompileShader(unsigned int type, const std::string& source);
-	unsigned int CreateShader(const std::string& vertexShader, const std::string& fragmentShader);
+	unsigned int CreateShader(const std::string& vertexShader, const std::string& fragmentShader, const std::vector<const char*>& feedbackVaryings);
 	unsigned int CreateShader(const std::string& vertexShader, const std::string& fragmentShader, const std::string& geometryShader);
 	int GetUniformLocation(const std::string& name) const;
 };
@@ -1,4 +1,5 @@
 #include "Texture.h"
+#include "GLState.h"
 
 #include "vendor/stb_image/stb_image.h"
 
@@ -10,11 +11,11 @@ Texture::Texture()
 Texture::Texture(const std::string& path)
 	: m_RendererID(0), m_FilePath(path), m_LocalBuffer(nullptr), m_Width(0), m_Height(0), m_BPP(0)
 {
-	stbi_set_flip_vertically_on_load(1);
+	stbi_set_flip_vertically_on_load_thread(1);
 	m_LocalBuffer = stbi_load(path.c_str(), &m_Width, &m_Height, &m_BPP, 4);
 
 	GLCall(glGenTextures(1, &m_RendererID));
-	GLCall(glBindTexture(GL_TEXTURE_2D, m_RendererID));
+	GLState::BindTexture(0, GL_TEXTURE_2D, m_RendererID);
 
 	GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
 	GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
@@ -22,24 +23,43 @@ Texture::Texture(const std::string& path)
 	GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
 
 	GLCall(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, m_Width, m_Height, 0, GL_RGBA, GL_UNSIGNED_BYTE, m_LocalBuffer));
-	GLCall(glBindTexture(GL_TEXTURE_2D, 0));
+	GLState::BindTexture(0, GL_TEXTURE_2D, 0);
 
 	if (m_LocalBuffer)
 		stbi_image_free(m_LocalBuffer);
 }
 
+void Texture::SetData(int width, int height, const unsigned char* rgba)
+{
+	if (m_RendererID == 0)
+	{
+		GLCall(glGenTextures(1, &m_RendererID));
+		GLState::BindTexture(0, GL_TEXTURE_2D, m_RendererID);
+		GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+		GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+		GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+		GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+	}
+	m_Width = width;
+	m_Height = height;
+	m_BPP = 4;
+	GLState::BindTexture(0, GL_TEXTURE_2D, m_RendererID);
+	GLCall(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba));
+	GLState::BindTexture(0, GL_TEXTURE_2D, 0);
+}
+
 Texture::~Texture()
 {
+	GLState::ForgetTexture(m_RendererID);
 	GLCall(glDeleteTextures(1, &m_RendererID));
 }
 
 void Texture::Bind(unsigned int slot) const
 {
-	GLCall(glActiveTexture(GL_TEXTURE0 + slot));
-	GLCall(glBindTexture(GL_TEXTURE_2D, m_RendererID));
+	GLState::BindTexture(slot, GL_TEXTURE_2D, m_RendererID);
 }
 
 void Texture::Unbind()
 {
-	GLCall(glBindTexture(GL_TEXTURE_2D, 0));
+	GLState::BindTexture(0, GL_TEXTURE_2D, 0);
 }
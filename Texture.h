@@ -14,10 +14,14 @@ public:
 	Texture(const std::string& path);
 	~Texture();
 
+	// (re)fills the texture from RGBA8 pixels made at runtime, the first row is t = 0
+	void SetData(int width, int height, const unsigned char* rgba);
+
 	void Bind(unsigned int slot = 0) const;
 	void Unbind();
 
 
+	inline unsigned int GetRendererID() const { return m_RendererID; };
 	inline int GetWidth() const { return m_Width; };
 	inline int GetHeight() const { return m_Height; };
 };
\ No newline at end of file
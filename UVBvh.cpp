@@ -0,0 +1,42 @@
+#include "UVBvh.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#include "mesh.h"
+
+static UVBox faceBox(const Mesh& mesh, int i)
+{
+    const Face& face = mesh.f[i];
+    const glm::vec2& a = mesh.uv[face.vi[0]];
+    const glm::vec2& b = mesh.uv[face.vi[1]];
+    const glm::vec2& c = mesh.uv[face.vi[2]];
+    UVBox box;
+    box.min = glm::min(a, glm::min(b, c));
+    box.max = glm::max(a, glm::max(b, c));
+    return box;
+}
+
+void UVBvh::build(const Mesh& mesh, int leafSize)
+{
+    auto start = std::chrono::steady_clock::now();
+    BvhBuilder<UVBox, 2> builder;
+    builder.build((int)mesh.f.size(), [&](int i, UVBox& box)
+    {
+        box = faceBox(mesh, i);
+        return std::isfinite(box.min.x) && std::isfinite(box.min.y) && std::isfinite(box.max.x) && std::isfinite(box.max.y);
+    }, leafSize);
+    nodes.swap(builder.nodes);
+    faces.swap(builder.items);
+
+    boxMin.resize(faces.size());
+    boxMax.resize(faces.size());
+    for (size_t slot = 0; slot < faces.size(); slot++)
+    {
+        UVBox box = faceBox(mesh, faces[slot]);
+        boxMin[slot] = box.min;
+        boxMax[slot] = box.max;
+    }
+    ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
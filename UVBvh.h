@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "BvhBuilder.h"
+
+struct Mesh;
+
+// box of uv triangles for BvhBuilder, half perimeters stand in for surface areas
+struct UVBox
+{
+	glm::vec2 min, max;
+
+	UVBox() : min(INFINITY), max(-INFINITY) {}
+	void grow(const UVBox& other) { min = glm::min(min, other.min); max = glm::max(max, other.max); }
+	float area() const { return (max.x - min.x) + (max.y - min.y); }
+	float key(int k) const { return (min[k] + max[k]) * 0.5f; }
+};
+
+// Bounding volume hierarchy over the uv triangles, binned SAH on the face box centroids, see
+// BvhBuilder. Faces whose uvs aren't finite are left out.
+struct UVBvh
+{
+	typedef BvhBuilder<UVBox, 2>::Node Node;
+
+	std::vector<Node> nodes; // root at 0
+	std::vector<int> faces;  // face of each leaf slot
+	std::vector<glm::vec2> boxMin, boxMax; // face boxes, in slot order
+	double ms = 0.0;
+
+	void build(const Mesh& mesh, int leafSize = 4);
+
+	// visit(face) for every face whose box touches min .. max
+	template <typename Visit>
+	void query(const glm::vec2& min, const glm::vec2& max, Visit visit) const
+	{
+		if (nodes.empty())
+			return;
+		int stack[128]; // BvhBuilder keeps the depth under 100
+		int top = 0;
+		stack[top++] = 0;
+		while (top > 0)
+		{
+			const Node& node = nodes[stack[--top]];
+			if (node.box.max.x < min.x || node.box.min.x > max.x || node.box.max.y < min.y || node.box.min.y > max.y)
+				continue;
+			if (node.count == 0)
+			{
+				stack[top++] = node.first;
+				stack[top++] = node.first + 1;
+				continue;
+			}
+			for (int slot = node.first; slot < node.first + node.count; slot++)
+			{
+				if (boxMax[slot].x < min.x || boxMin[slot].x > max.x || boxMax[slot].y < min.y || boxMin[slot].y > max.y)
+					continue;
+				visit(faces[slot]);
+			}
+		}
+	}
+};
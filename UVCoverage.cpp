@@ -0,0 +1,326 @@
+#include "UVCoverage.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+
+#include "mesh.h"
+#include "UVIslands.h"
+#include "FaceBins.h"
+#include "Utils.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+static int popcount64(uint64_t v)
+{
+#ifdef _MSC_VER
+    return (int)__popcnt64(v);
+#else
+    return __builtin_popcountll(v);
+#endif
+}
+
+// texels [x0, x1) of one row: whatever was covered before goes into the overlap mask
+static void setSpan(uint64_t* coverage, uint64_t* overlap, int x0, int x1)
+{
+    int first = x0 >> 6, last = (x1 - 1) >> 6;
+    uint64_t firstMask = ~0ull << (x0 & 63);
+    uint64_t lastMask = ~0ull >> (63 - ((x1 - 1) & 63));
+    if (first == last)
+    {
+        uint64_t mask = firstMask & lastMask;
+        overlap[first] |= coverage[first] & mask;
+        coverage[first] |= mask;
+        return;
+    }
+    overlap[first] |= coverage[first] & firstMask;
+    coverage[first] |= firstMask;
+    for (int w = first + 1; w < last; w++)
+    {
+        overlap[w] |= coverage[w];
+        coverage[w] = ~0ull;
+    }
+    overlap[last] |= coverage[last] & lastMask;
+    coverage[last] |= lastMask;
+}
+
+struct SpanEdge
+{
+    glm::vec2 top;   // smaller y, then smaller x
+    float bottomY;
+    float slope;     // dx / dy
+};
+
+// Both faces along a shared edge order its end points the same way and run the same
+// arithmetic, so they agree on every crossing to the bit. Together with half-open rows and
+// columns that makes neighbouring faces tile the texels exactly.
+static bool makeEdge(glm::vec2 a, glm::vec2 b, SpanEdge& edge)
+{
+    if (a.y > b.y || (a.y == b.y && a.x > b.x))
+        std::swap(a, b);
+    if (a.y == b.y)
+        return false;
+    edge.top = a;
+    edge.bottomY = b.y;
+    edge.slope = (b.x - a.x) / (b.y - a.y);
+    return true;
+}
+
+// returns the number of texels set in rows [y0, y1) of the band starting at bandY
+static uint64_t scanFace(const glm::vec2* p, int width, int y0, int y1, int bandY, int wordsPerRow, uint64_t* coverage, uint64_t* overlap)
+{
+    SpanEdge edges[3];
+    int edgeCount = 0;
+    for (int k = 0; k < 3; k++)
+    {
+        if (makeEdge(p[k], p[(k + 1) % 3], edges[edgeCount]))
+            edgeCount++;
+    }
+    if (edgeCount < 2)
+        return 0;
+
+    float minY = std::min(p[0].y, std::min(p[1].y, p[2].y));
+    float maxY = std::max(p[0].y, std::max(p[1].y, p[2].y));
+    int top = std::max(y0, (int)std::ceil(minY - 0.5f));
+    int bottom = std::min(y1, (int)std::ceil(maxY - 0.5f));
+
+    uint64_t texels = 0;
+    for (int y = top; y < bottom; y++)
+    {
+        float center = y + 0.5f;
+        float lo = INFINITY, hi = -INFINITY;
+        for (int k = 0; k < edgeCount; k++)
+        {
+            const SpanEdge& e = edges[k];
+            if (center < e.top.y || center >= e.bottomY)
+                continue;
+            float x = e.top.x + (center - e.top.y) * e.slope;
+            lo = std::min(lo, x);
+            hi = std::max(hi, x);
+        }
+        if (!(hi > lo))
+            continue;
+        int x0 = (int)std::max(0.0f, std::ceil(lo - 0.5f));
+        int x1 = (int)std::min((float)width, std::ceil(hi - 0.5f));
+        if (x0 >= x1)
+            continue;
+        size_t row = (size_t)(y - bandY) * wordsPerRow;
+        setSpan(coverage + row, overlap + row, x0, x1);
+        texels += x1 - x0;
+    }
+    return texels;
+}
+
+UVCoverage::UVCoverage(const Mesh& mesh, const UVIslands& islands)
+    : m_Mesh(mesh), m_Islands(islands), m_WordsPerRow(0)
+{
+}
+
+const UVCoverageReport& UVCoverage::analyze(int width, int height, bool keepMasks)
+{
+    auto start = std::chrono::steady_clock::now();
+    m_Report = UVCoverageReport();
+    m_Report.width = width;
+    m_Report.height = height;
+    m_Report.faces = m_Mesh.f.size();
+    m_Coverage.clear();
+    m_Overlap.clear();
+    m_WordsPerRow = (width + 63) / 64;
+    if (width <= 0 || height <= 0)
+        return m_Report;
+
+    // texel space, top row at v = 1 like the image file
+    const Mesh& mesh = m_Mesh;
+    auto corner = [&](int face, int k)
+    {
+        glm::vec2 uv = mesh.uv[mesh.f[face].vi[k]];
+        return glm::vec2(uv.x * width, (1.0f - uv.y) * height);
+    };
+    auto yRange = [&](int face, float& lo, float& hi)
+    {
+        glm::vec2 a = corner(face, 0), b = corner(face, 1), c = corner(face, 2);
+        lo = std::min(a.y, std::min(b.y, c.y));
+        hi = std::max(a.y, std::max(b.y, c.y));
+    };
+
+    int bandCount = (height + BAND - 1) / BAND;
+    FaceBins bands;
+    bands.build(bandCount, (float)BAND, nullptr, mesh.f.size(), yRange);
+
+    if (keepMasks)
+    {
+        m_Coverage.assign((size_t)m_WordsPerRow * height, 0);
+        m_Overlap.assign((size_t)m_WordsPerRow * height, 0);
+    }
+    // texels per entry of bands.faces, each band writes only its own entries
+    std::vector<uint32_t> spanTexels(bands.faces.size(), 0);
+    std::vector<uint64_t> bandCovered(bandCount, 0), bandOverlap(bandCount, 0);
+
+    Utils::ParallelFor(bandCount, [&](int band)
+    {
+        int bandY = band * BAND;
+        int rows = std::min(BAND, height - bandY);
+        size_t words = (size_t)rows * m_WordsPerRow;
+        std::vector<uint64_t> localCoverage, localOverlap;
+        uint64_t* coverage;
+        uint64_t* overlap;
+        if (keepMasks)
+        {
+            coverage = m_Coverage.data() + (size_t)bandY * m_WordsPerRow;
+            overlap = m_Overlap.data() + (size_t)bandY * m_WordsPerRow;
+        }
+        else
+        {
+            localCoverage.assign(words, 0);
+            localOverlap.assign(words, 0);
+            coverage = localCoverage.data();
+            overlap = localOverlap.data();
+        }
+
+        for (int i = bands.start[band]; i < bands.start[band + 1]; i++)
+        {
+            int face = bands.faces[i];
+            glm::vec2 p[3] = { corner(face, 0), corner(face, 1), corner(face, 2) };
+            spanTexels[i] = (uint32_t)scanFace(p, width, bandY, bandY + rows, bandY, m_WordsPerRow, coverage, overlap);
+        }
+
+        uint64_t covered = 0, overlapping = 0;
+        for (size_t w = 0; w < words; w++)
+        {
+            covered += popcount64(coverage[w]);
+            overlapping += popcount64(overlap[w]);
+        }
+        bandCovered[band] = covered;
+        bandOverlap[band] = overlapping;
+    });
+
+    double total = (double)width * height;
+    for (int band = 0; band < bandCount; band++)
+    {
+        m_Report.coveredTexels += bandCovered[band];
+        m_Report.overlapTexels += bandOverlap[band];
+    }
+    m_Report.coverage = (float)(m_Report.coveredTexels / total);
+    m_Report.overlap = (float)(m_Report.overlapTexels / total);
+
+    for (size_t i = 0; i < mesh.f.size(); i++)
+    {
+        for (int k = 0; k < 3; k++)
+        {
+            glm::vec2 uv = mesh.uv[mesh.f[i].vi[k]];
+            if (uv.x < 0.0f || uv.x > 1.0f || uv.y < 0.0f || uv.y > 1.0f)
+            {
+                m_Report.facesOutside++;
+                break;
+            }
+        }
+    }
+
+    // per island: bounds from the corners, covered texels from the spans
+    if (m_Islands.faceIsland.size() == mesh.f.size())
+    {
+        m_Report.islands.resize(m_Islands.count);
+        for (UVCoverageReport::Island& island : m_Report.islands)
+        {
+            island.uvMin = glm::vec2(INFINITY);
+            island.uvMax = glm::vec2(-INFINITY);
+        }
+        for (size_t i = 0; i < mesh.f.size(); i++)
+        {
+            UVCoverageReport::Island& island = m_Report.islands[m_Islands.faceIsland[i]];
+            island.faces++;
+            for (int k = 0; k < 3; k++)
+            {
+                glm::vec2 uv = mesh.uv[mesh.f[i].vi[k]];
+                island.uvMin = glm::min(island.uvMin, uv);
+                island.uvMax = glm::max(island.uvMax, uv);
+            }
+        }
+        for (size_t i = 0; i < bands.faces.size(); i++)
+            m_Report.islands[m_Islands.faceIsland[bands.faces[i]]].coveredTexels += spanTexels[i];
+        for (UVCoverageReport::Island& island : m_Report.islands)
+        {
+            // texel centers inside the rectangle, the same rule the spans use
+            glm::vec2 lo = glm::clamp(island.uvMin, 0.0f, 1.0f), hi = glm::clamp(island.uvMax, 0.0f, 1.0f);
+            int x0 = (int)std::ceil(lo.x * width - 0.5f), x1 = (int)std::ceil(hi.x * width - 0.5f);
+            int y0 = (int)std::ceil((1.0f - hi.y) * height - 0.5f), y1 = (int)std::ceil((1.0f - lo.y) * height - 0.5f);
+            island.boundsTexels = (uint64_t)std::max(0, x1 - x0) * (uint64_t)std::max(0, y1 - y0);
+            island.waste = island.boundsTexels ? std::max(0.0f, 1.0f - (float)island.coveredTexels / island.boundsTexels) : 0.0f;
+        }
+    }
+
+    m_Report.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return m_Report;
+}
+
+void UVCoverage::preview(int size, std::vector<unsigned char>& rgba) const
+{
+    rgba.assign((size_t)size * size * 4, 0);
+    int width = m_Report.width, height = m_Report.height;
+    if (m_Coverage.empty() || size <= 0)
+        return;
+
+    // 4 x 4 samples per preview pixel, fine enough to see thin overlaps
+    const int SAMPLES = 4;
+    Utils::ParallelFor(size, [&](int py)
+    {
+        for (int px = 0; px < size; px++)
+        {
+            int covered = 0, overlapping = 0;
+            for (int sy = 0; sy < SAMPLES; sy++)
+            {
+                int y = std::min(height - 1, (int)(((py * SAMPLES + sy) + 0.5f) * height / (size * SAMPLES)));
+                const uint64_t* coverageRow = m_Coverage.data() + (size_t)y * m_WordsPerRow;
+                const uint64_t* overlapRow = m_Overlap.data() + (size_t)y * m_WordsPerRow;
+                for (int sx = 0; sx < SAMPLES; sx++)
+                {
+                    int x = std::min(width - 1, (int)(((px * SAMPLES + sx) + 0.5f) * width / (size * SAMPLES)));
+                    covered += (coverageRow[x >> 6] >> (x & 63)) & 1;
+                    overlapping += (overlapRow[x >> 6] >> (x & 63)) & 1;
+                }
+            }
+            float c = (float)covered / (SAMPLES * SAMPLES), o = (float)overlapping / (SAMPLES * SAMPLES);
+            unsigned char* p = &rgba[((size_t)py * size + px) * 4];
+            p[0] = (unsigned char)(255.0f * (0.5f * (c - o) + o));
+            p[1] = (unsigned char)(255.0f * 0.5f * (c - o));
+            p[2] = (unsigned char)(255.0f * 0.5f * (c - o));
+            p[3] = 255;
+        }
+    });
+}
+
+bool UVCoverageReport::writeJson(const char* path, const std::string& model) const
+{
+    FILE* file = fopen(path, "w");
+    if (!file)
+    {
+        std::cout << "UVCoverage: can't open " << path << std::endl;
+        return false;
+    }
+    uint64_t total = (uint64_t)width * height;
+    fprintf(file, "{\n");
+    fprintf(file, "  \"model\": \"%s\",\n", Utils::JsonEscape(model).c_str());
+    fprintf(file, "  \"width\": %d,\n  \"height\": %d,\n", width, height);
+    fprintf(file, "  \"faces\": %zu,\n  \"facesOutside\": %zu,\n", faces, facesOutside);
+    fprintf(file, "  \"coveredTexels\": %llu,\n  \"overlapTexels\": %llu,\n  \"wastedTexels\": %llu,\n",
+        (unsigned long long)coveredTexels, (unsigned long long)overlapTexels, (unsigned long long)(total - coveredTexels));
+    fprintf(file, "  \"coverage\": %.6f,\n  \"overlap\": %.6f,\n", coverage, overlap);
+    fprintf(file, "  \"milliseconds\": %.3f,\n", ms);
+    fprintf(file, "  \"islands\": [");
+    for (size_t i = 0; i < islands.size(); i++)
+    {
+        const Island& island = islands[i];
+        fprintf(file, "%s\n    { \"id\": %zu, \"faces\": %d, \"uvMin\": [%.6f, %.6f], \"uvMax\": [%.6f, %.6f], "
+            "\"boundsTexels\": %llu, \"coveredTexels\": %llu, \"waste\": %.6f }",
+            i ? "," : "", i, island.faces, island.uvMin.x, island.uvMin.y, island.uvMax.x, island.uvMax.y,
+            (unsigned long long)island.boundsTexels, (unsigned long long)island.coveredTexels, island.waste);
+    }
+    fprintf(file, "%s]\n}\n", islands.empty() ? "" : "\n  ");
+    bool ok = !ferror(file);
+    fclose(file);
+    return ok;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+struct Mesh;
+struct UVIslands;
+
+struct UVCoverageReport
+{
+	struct Island
+	{
+		int faces = 0;
+		glm::vec2 uvMin, uvMax;
+		uint64_t boundsTexels = 0;  // texels of the bounding rectangle inside the square
+		uint64_t coveredTexels = 0; // texel centers inside the island's faces, overlaps within it counted twice
+		float waste = 0.0f;         // part of the bounding rectangle the island leaves empty
+	};
+
+	int width = 0, height = 0;
+	size_t faces = 0;
+	size_t facesOutside = 0;      // faces with a corner outside 0..1, their texels there are ignored
+	uint64_t coveredTexels = 0;   // covered at least once
+	uint64_t overlapTexels = 0;   // covered by more than one face
+	float coverage = 0.0f;        // fractions of the whole texture
+	float overlap = 0.0f;
+	std::vector<Island> islands;
+	double ms = 0.0;
+
+	bool writeJson(const char* path, const std::string& model) const;
+};
+
+// Texture budget analysis at the texture's real resolution. Faces are scan converted into a
+// 1 bit coverage mask and a 1 bit overlap mask (texel already covered when a face reaches
+// it). Rows are split into bands that are processed in parallel, spans are set a 64 bit word
+// at a time and the totals are popcounts of the words. Texel centers follow a half-open fill
+// rule, so faces sharing an edge never count as overlapping.
+class UVCoverage
+{
+public:
+	static const int BAND = 64;
+
+private:
+	const Mesh& m_Mesh;
+	const UVIslands& m_Islands;
+	UVCoverageReport m_Report;
+	// rows of m_WordsPerRow words, bit x % 64 of word x / 64 is texel x; top row first
+	std::vector<uint64_t> m_Coverage;
+	std::vector<uint64_t> m_Overlap;
+	int m_WordsPerRow;
+
+public:
+	UVCoverage(const Mesh& mesh, const UVIslands& islands);
+
+	// keepMasks holds on to both bitmaps for previews, 2 bits per texel
+	const UVCoverageReport& analyze(int width, int height, bool keepMasks = false);
+
+	const UVCoverageReport& getReport() const { return m_Report; }
+	const std::vector<uint64_t>& getCoverageMask() const { return m_Coverage; }
+	const std::vector<uint64_t>& getOverlapMask() const { return m_Overlap; }
+	int getWordsPerRow() const { return m_WordsPerRow; }
+
+	// size x size RGBA, box filtered: covered texels gray, overlapping ones red
+	void preview(int size, std::vector<unsigned char>& rgba) const;
+};
@@ -0,0 +1,237 @@
+#include "UVDistortion.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <emmintrin.h>
+
+#include "mesh.h"
+#include "Utils.h"
+
+static const int METRICS = (int)UVDistortion::Metric::Count;
+
+// Singular values of the 3D to uv Jacobian of four faces, lanes past count repeat the last
+// face and are not written. With e1, e2 the 3D edges and d1, d2 the uv ones:
+// sigmaMax * sigmaMin = |det(d1, d2)| / |e1 x e2| and sigmaMax^2 + sigmaMin^2 =
+// (|d1.x e2 - d2.x e1|^2 + |d1.y e2 - d2.y e1|^2) / |e1 x e2|^2, sums of squares throughout.
+static void sigmas4(const Mesh& mesh, int first, int count, float* sigmaMax, float* sigmaMin, float* area)
+{
+    alignas(16) float lanes[10][4];
+    for (int l = 0; l < 4; l++)
+    {
+        const Face& face = mesh.f[first + std::min(l, count - 1)];
+        glm::vec3 p0 = mesh.pos[face.vi[0]];
+        glm::vec3 e1 = mesh.pos[face.vi[1]] - p0, e2 = mesh.pos[face.vi[2]] - p0;
+        glm::vec2 t0 = mesh.uv[face.vi[0]];
+        glm::vec2 d1 = mesh.uv[face.vi[1]] - t0, d2 = mesh.uv[face.vi[2]] - t0;
+        float values[10] = { e1.x, e1.y, e1.z, e2.x, e2.y, e2.z, d1.x, d1.y, d2.x, d2.y };
+        for (int k = 0; k < 10; k++)
+            lanes[k][l] = values[k];
+    }
+    __m128 e1x = _mm_load_ps(lanes[0]), e1y = _mm_load_ps(lanes[1]), e1z = _mm_load_ps(lanes[2]);
+    __m128 e2x = _mm_load_ps(lanes[3]), e2y = _mm_load_ps(lanes[4]), e2z = _mm_load_ps(lanes[5]);
+    __m128 d1x = _mm_load_ps(lanes[6]), d1y = _mm_load_ps(lanes[7]);
+    __m128 d2x = _mm_load_ps(lanes[8]), d2y = _mm_load_ps(lanes[9]);
+
+    auto square = [](__m128 x, __m128 y, __m128 z) { return _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z)); };
+    auto combine = [](__m128 a, __m128 x2, __m128 b, __m128 x1) { return _mm_sub_ps(_mm_mul_ps(a, x2), _mm_mul_ps(b, x1)); };
+    __m128 cross = _mm_sqrt_ps(square(combine(e1y, e2z, e1z, e2y), combine(e1z, e2x, e1x, e2z), combine(e1x, e2y, e1y, e2x)));
+    __m128 det = combine(d1x, d2y, d1y, d2x);
+    __m128 absDet = _mm_andnot_ps(_mm_set1_ps(-0.0f), det);
+    __m128 q = _mm_add_ps(square(combine(d1x, e2x, d2x, e1x), combine(d1x, e2y, d2x, e1y), combine(d1x, e2z, d2x, e1z)),
+        square(combine(d1y, e2x, d2y, e1x), combine(d1y, e2y, d2y, e1y), combine(d1y, e2z, d2y, e1z)));
+
+    __m128 product = _mm_div_ps(absDet, cross);
+    __m128 trace = _mm_div_ps(q, _mm_mul_ps(cross, cross));
+    __m128 twice = _mm_add_ps(product, product);
+    __m128 sum = _mm_sqrt_ps(_mm_add_ps(trace, twice));
+    __m128 difference = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(trace, twice), _mm_setzero_ps()));
+    __m128 half = _mm_set1_ps(0.5f);
+    __m128 large = _mm_mul_ps(_mm_add_ps(sum, difference), half);
+    __m128 small = _mm_mul_ps(_mm_sub_ps(sum, difference), half);
+
+    // degenerate in either space, or overflowed: NaN; NaNs fail every comparison
+    __m128 valid = _mm_and_ps(_mm_and_ps(_mm_cmpgt_ps(cross, _mm_setzero_ps()), _mm_cmpgt_ps(absDet, _mm_setzero_ps())),
+        _mm_and_ps(_mm_cmplt_ps(trace, _mm_set1_ps(INFINITY)), _mm_cmpgt_ps(small, _mm_setzero_ps())));
+    __m128 nan = _mm_set1_ps(NAN);
+    alignas(16) float out[3][4];
+    _mm_store_ps(out[0], _mm_or_ps(_mm_and_ps(valid, large), _mm_andnot_ps(valid, nan)));
+    _mm_store_ps(out[1], _mm_or_ps(_mm_and_ps(valid, small), _mm_andnot_ps(valid, nan)));
+    _mm_store_ps(out[2], _mm_mul_ps(cross, half));
+    for (int l = 0; l < count; l++)
+    {
+        sigmaMax[l] = out[0][l];
+        sigmaMin[l] = out[1][l];
+        area[l] = out[2][l];
+    }
+}
+
+const char* UVDistortion::metricName(Metric metric)
+{
+    switch (metric)
+    {
+    case Metric::AreaStretch: return "Area stretch";
+    case Metric::Conformal: return "Conformal error";
+    case Metric::SigmaMax: return "Max stretch";
+    case Metric::SigmaMin: return "Min stretch";
+    case Metric::TexelDensity: return "Texel density";
+    default: return "";
+    }
+}
+
+const char* UVDistortion::attributeName(Metric metric)
+{
+    switch (metric)
+    {
+    case Metric::AreaStretch: return "uvAreaStretch";
+    case Metric::Conformal: return "uvConformal";
+    case Metric::SigmaMax: return "uvSigmaMax";
+    case Metric::SigmaMin: return "uvSigmaMin";
+    case Metric::TexelDensity: return "uvTexelDensity";
+    default: return "";
+    }
+}
+
+UVDistortion::UVDistortion(const Mesh& mesh)
+    : m_Mesh(mesh)
+{
+}
+
+float UVDistortion::value(Metric metric, int face) const
+{
+    float large = m_SigmaMax[face], small = m_SigmaMin[face];
+    float scale = m_Report.scale;
+    switch (metric)
+    {
+    case Metric::AreaStretch: return large * small / (scale * scale);
+    case Metric::Conformal: return large / small;
+    case Metric::SigmaMax: return large / scale;
+    case Metric::SigmaMin: return small / scale;
+    case Metric::TexelDensity: return std::sqrt(large * small * (float)m_Report.width * (float)m_Report.height);
+    default: return NAN;
+    }
+}
+
+const UVDistortionReport& UVDistortion::compute(int width, int height)
+{
+    auto start = std::chrono::steady_clock::now();
+    const Mesh& mesh = m_Mesh;
+    int faceCount = (int)mesh.f.size();
+    m_Report = UVDistortionReport();
+    m_Report.faces = faceCount;
+    m_Report.width = std::max(width, 1);
+    m_Report.height = std::max(height, 1);
+    m_Report.metrics.resize(METRICS);
+    m_SigmaMax.resize(faceCount);
+    m_SigmaMin.resize(faceCount);
+    std::vector<float> area(faceCount);
+
+    // pass one: singular values, and the areas for the mesh's overall scale
+    const int CHUNK = 1 << 16;
+    int chunks = (faceCount + CHUNK - 1) / CHUNK;
+    std::vector<double> chunkArea(chunks, 0.0), chunkUVArea(chunks, 0.0);
+    std::vector<size_t> chunkDegenerate(chunks, 0);
+    Utils::ParallelFor(chunks, [&](int chunk)
+    {
+        int end = std::min(faceCount, (chunk + 1) * CHUNK);
+        for (int i = chunk * CHUNK; i < end; i += 4)
+            sigmas4(mesh, i, std::min(4, end - i), &m_SigmaMax[i], &m_SigmaMin[i], &area[i]);
+        for (int i = chunk * CHUNK; i < end; i++)
+        {
+            if (std::isnan(m_SigmaMax[i]))
+            {
+                chunkDegenerate[chunk]++;
+                continue;
+            }
+            chunkArea[chunk] += area[i];
+            chunkUVArea[chunk] += (double)area[i] * m_SigmaMax[i] * m_SigmaMin[i];
+        }
+    });
+    double totalArea = 0.0, totalUVArea = 0.0;
+    for (int chunk = 0; chunk < chunks; chunk++)
+    {
+        totalArea += chunkArea[chunk];
+        totalUVArea += chunkUVArea[chunk];
+        m_Report.degenerateFaces += chunkDegenerate[chunk];
+    }
+    if (totalArea > 0.0 && totalUVArea > 0.0)
+        m_Report.scale = (float)std::sqrt(totalUVArea / totalArea);
+    float references[METRICS] = { 1.0f, 1.0f, 1.0f, 1.0f, m_Report.scale * std::sqrt((float)m_Report.width * m_Report.height) };
+
+    // pass two: stats and histograms per chunk, summed afterwards
+    struct Partial
+    {
+        float min[METRICS], max[METRICS];
+        double sum[METRICS];
+        double histogram[METRICS][UVDistortionReport::BINS];
+    };
+    std::vector<Partial> partials(chunks);
+    float binScale = UVDistortionReport::BINS * 0.5f / m_Report.range;
+    float logScale = std::log2(m_Report.scale);
+    Utils::ParallelFor(chunks, [&](int chunk)
+    {
+        Partial& partial = partials[chunk];
+        std::fill(partial.min, partial.min + METRICS, INFINITY);
+        std::fill(partial.max, partial.max + METRICS, -INFINITY);
+        std::fill(partial.sum, partial.sum + METRICS, 0.0);
+        std::fill(&partial.histogram[0][0], &partial.histogram[0][0] + METRICS * UVDistortionReport::BINS, 0.0);
+        int end = std::min(faceCount, (chunk + 1) * CHUNK);
+        for (int i = chunk * CHUNK; i < end; i++)
+        {
+            if (std::isnan(m_SigmaMax[i]))
+                continue;
+            // every metric's log2 / reference from two logs
+            float large = std::log2(m_SigmaMax[i]) - logScale, small = std::log2(m_SigmaMin[i]) - logScale;
+            float logs[METRICS] = { large + small, large - small, large, small, (large + small) * 0.5f };
+            for (int m = 0; m < METRICS; m++)
+            {
+                float v = value((Metric)m, i);
+                partial.min[m] = std::min(partial.min[m], v);
+                partial.max[m] = std::max(partial.max[m], v);
+                partial.sum[m] += (double)v * area[i];
+                float bin = (logs[m] + m_Report.range) * binScale;
+                partial.histogram[m][(int)std::min(std::max(bin, 0.0f), UVDistortionReport::BINS - 1.0f)] += area[i];
+            }
+        }
+    });
+    for (int m = 0; m < METRICS; m++)
+    {
+        UVDistortionReport::Stats& stats = m_Report.metrics[m];
+        stats.reference = references[m];
+        float lo = INFINITY, hi = -INFINITY;
+        double sum = 0.0;
+        double histogram[UVDistortionReport::BINS] = {};
+        for (const Partial& partial : partials)
+        {
+            lo = std::min(lo, partial.min[m]);
+            hi = std::max(hi, partial.max[m]);
+            sum += partial.sum[m];
+            for (int b = 0; b < UVDistortionReport::BINS; b++)
+                histogram[b] += partial.histogram[m][b];
+        }
+        if (totalArea > 0.0)
+        {
+            stats.min = lo;
+            stats.max = hi;
+            stats.mean = (float)(sum / totalArea);
+            for (int b = 0; b < UVDistortionReport::BINS; b++)
+                stats.histogram[b] = (float)(histogram[b] / totalArea);
+        }
+    }
+
+    m_Report.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return m_Report;
+}
+
+void UVDistortion::faceValues(Metric metric, std::vector<float>& values) const
+{
+    int faceCount = (int)m_SigmaMax.size();
+    values.resize(faceCount);
+    const int CHUNK = 1 << 16;
+    Utils::ParallelFor((faceCount + CHUNK - 1) / CHUNK, [&](int chunk)
+    {
+        int end = std::min(faceCount, (chunk + 1) * CHUNK);
+        for (int i = chunk * CHUNK; i < end; i++)
+            values[i] = value(metric, i);
+    });
+}
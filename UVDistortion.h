@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+struct Mesh;
+
+struct UVDistortionReport
+{
+	static const int BINS = 64;
+
+	struct Stats
+	{
+		float reference = 1.0f; // histograms and heatmaps are log2 of value / reference
+		float min = 0.0f, max = 0.0f;
+		float mean = 0.0f;      // weighted by 3D area
+		float histogram[BINS] = {}; // share of the 3D area per bin, -range .. range around the reference
+	};
+
+	size_t faces = 0;
+	size_t degenerateFaces = 0; // no area in 3D or in uv, left out of the stats
+	float range = 4.0f;         // log2 range of the histograms
+	float scale = 1.0f;         // uv units per 3D unit over the whole mesh, sqrt of the area ratio
+	int width = 0, height = 0;  // texture size of the texel densities
+	std::vector<Stats> metrics; // one per UVDistortion::Metric
+	double ms = 0.0;
+};
+
+// Per-face distortion of the uv map. J is the Jacobian of the affine map from a face in 3D
+// to its uv triangle, sigmaMax >= sigmaMin its singular values; they come from the trace and
+// determinant of J J^T, so no tangent frame is built and areas are cross products instead of
+// Heron's formula. Faces go through the kernel four at a time in SSE lanes, in chunks spread
+// over all cores. Stretch metrics are relative to the mesh's overall scale, 1 is the average.
+class UVDistortion
+{
+public:
+	enum class Metric
+	{
+		AreaStretch,  // sigmaMax * sigmaMin / scale^2, uv area per 3D area
+		Conformal,    // sigmaMax / sigmaMin, 1 keeps angles
+		SigmaMax,     // largest stretch / scale
+		SigmaMin,     // smallest stretch / scale
+		TexelDensity, // texels per 3D unit, sqrt(sigmaMax * sigmaMin * width * height)
+		Count
+	};
+
+	static const char* metricName(Metric metric);
+	static const char* attributeName(Metric metric); // face attribute of the mesh, e.g. "uvAreaStretch"
+
+private:
+	const Mesh& m_Mesh;
+	UVDistortionReport m_Report;
+	std::vector<float> m_SigmaMax, m_SigmaMin; // raw, NaN on degenerate faces
+
+	float value(Metric metric, int face) const;
+
+public:
+	UVDistortion(const Mesh& mesh);
+
+	// width and height only scale the texel densities
+	const UVDistortionReport& compute(int width, int height);
+
+	const UVDistortionReport& getReport() const { return m_Report; }
+	// one value per face, NaN where the face is degenerate
+	void faceValues(Metric metric, std::vector<float>& values) const;
+};
@@ -0,0 +1,99 @@
+#include "UVIslands.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <unordered_map>
+
+#include "mesh.h"
+
+// union-find over faces, path halving and union by size
+static int findRoot(std::vector<int>& parent, int i)
+{
+    while (parent[i] != i)
+    {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+    return i;
+}
+
+static void unite(std::vector<int>& parent, std::vector<int>& size, int a, int b)
+{
+    a = findRoot(parent, a);
+    b = findRoot(parent, b);
+    if (a == b)
+        return;
+    if (size[a] < size[b])
+        std::swap(a, b);
+    parent[b] = a;
+    size[a] += size[b];
+}
+
+static uint64_t uvKey(const glm::vec2& uv)
+{
+    // exact bits: corners of the same uv vertex are written from the same file value
+    uint32_t x, y;
+    memcpy(&x, &uv.x, sizeof(x));
+    memcpy(&y, &uv.y, sizeof(y));
+    return (uint64_t)x << 32 | y;
+}
+
+struct UVEdgeKey
+{
+    uint64_t a, b;
+
+    bool operator==(const UVEdgeKey& other) const { return a == other.a && b == other.b; }
+};
+
+struct UVEdgeHash
+{
+    size_t operator()(const UVEdgeKey& key) const
+    {
+        return std::hash<uint64_t>()(key.a * 0x9E3779B97F4A7C15ull ^ key.b);
+    }
+};
+
+void UVIslands::build(const Mesh& mesh)
+{
+    int faces = (int)mesh.f.size();
+    std::vector<int> parent(faces), size(faces, 1);
+    for (int i = 0; i < faces; i++)
+        parent[i] = i;
+
+    // first face seen on each undirected uv edge
+    std::unordered_map<UVEdgeKey, int, UVEdgeHash> edges;
+    edges.reserve((size_t)faces * 3 / 2);
+    for (int i = 0; i < faces; i++)
+    {
+        const Face& face = mesh.f[i];
+        for (int j = 0; j < 3; j++)
+        {
+            uint64_t a = uvKey(mesh.uv[face.vi[j]]);
+            uint64_t b = uvKey(mesh.uv[face.vi[(j + 1) % 3]]);
+            if (a == b)
+                continue;
+            UVEdgeKey key = { std::min(a, b), std::max(a, b) };
+            auto inserted = edges.emplace(key, i);
+            if (!inserted.second)
+                unite(parent, size, inserted.first->second, i);
+        }
+    }
+
+    faceIsland.assign(faces, -1);
+    faceCount.clear();
+    std::vector<int> rootIsland(faces, -1);
+    for (int i = 0; i < faces; i++)
+    {
+        int root = findRoot(parent, i);
+        if (rootIsland[root] < 0)
+        {
+            rootIsland[root] = (int)faceCount.size();
+            faceCount.push_back(0);
+        }
+        faceIsland[i] = rootIsland[root];
+        faceCount[faceIsland[i]]++;
+    }
+    count = (int)faceCount.size();
+}
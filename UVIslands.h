@@ -0,0 +1,17 @@
+#pragma once
+
+#include <vector>
+
+struct Mesh;
+
+// Connected pieces of the uv layout. Two faces are in the same island when they share an
+// edge with the same uv coordinates at both ends; the importer keeps one vertex per face
+// corner, so indices alone would make every face its own island.
+struct UVIslands
+{
+	std::vector<int> faceIsland; // island of each face, 0 .. count - 1, in order of first face
+	std::vector<int> faceCount;  // faces per island
+	int count = 0;
+
+	void build(const Mesh& mesh);
+};
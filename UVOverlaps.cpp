@@ -0,0 +1,195 @@
+#include "UVOverlaps.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+
+#include "mesh.h"
+#include "UVIslands.h"
+#include "Utils.h"
+
+// true when one of t's edge normals separates t from u, touching counts as separated
+static bool separatedByEdgeOf(const glm::dvec2* t, const glm::dvec2* u, double tolerance)
+{
+    for (int e = 0; e < 3; e++)
+    {
+        glm::dvec2 edge = t[(e + 1) % 3] - t[e];
+        glm::dvec2 n(-edge.y, edge.x);
+        double tMin = INFINITY, tMax = -INFINITY, uMin = INFINITY, uMax = -INFINITY;
+        for (int k = 0; k < 3; k++)
+        {
+            double a = glm::dot(n, t[k]);
+            double b = glm::dot(n, u[k]);
+            tMin = std::min(tMin, a);
+            tMax = std::max(tMax, a);
+            uMin = std::min(uMin, b);
+            uMax = std::max(uMax, b);
+        }
+        // projections are scaled by the edge length
+        if (std::min(tMax, uMax) - std::max(tMin, uMin) <= tolerance * glm::length(edge))
+            return true;
+    }
+    return false;
+}
+
+static void corners(const Mesh& mesh, int face, glm::dvec2* p)
+{
+    for (int k = 0; k < 3; k++)
+        p[k] = glm::dvec2(mesh.uv[mesh.f[face].vi[k]]);
+}
+
+UVOverlaps::UVOverlaps(const Mesh& mesh, const UVIslands& islands)
+    : m_Mesh(mesh), m_Islands(islands)
+{
+}
+
+const UVOverlapReport& UVOverlaps::detect(float tolerance)
+{
+    auto start = std::chrono::steady_clock::now();
+    const Mesh& mesh = m_Mesh;
+    int faceCount = (int)mesh.f.size();
+    m_Report = UVOverlapReport();
+    m_Report.faces = faceCount;
+
+    m_Bvh.build(mesh);
+    m_Report.bvhMs = m_Bvh.ms;
+
+    // twice the signed uv area, counter-clockwise positive
+    std::vector<double> area(faceCount);
+    const int CHUNK = 1 << 16;
+    Utils::ParallelFor((faceCount + CHUNK - 1) / CHUNK, [&](int chunk)
+    {
+        int end = std::min(faceCount, (chunk + 1) * CHUNK);
+        for (int i = chunk * CHUNK; i < end; i++)
+        {
+            glm::dvec2 p[3];
+            corners(mesh, i, p);
+            glm::dvec2 e1 = p[1] - p[0], e2 = p[2] - p[0];
+            area[i] = e1.x * e2.y - e1.y * e2.x;
+        }
+    });
+    double degenerate = (double)tolerance * tolerance;
+    auto isDegenerate = [&](int face) { return !(std::abs(area[face]) > degenerate); };
+
+    // each face looks for partners with a higher index, in leaf order so that neighboring
+    // queries walk the same nodes
+    auto queryStart = std::chrono::steady_clock::now();
+    const std::vector<int>& slots = m_Bvh.faces;
+    const int QUERY_CHUNK = 4096;
+    int chunks = ((int)slots.size() + QUERY_CHUNK - 1) / QUERY_CHUNK;
+    std::vector<std::vector<UVOverlapReport::Pair>> found(chunks);
+    Utils::ParallelFor(chunks, [&](int chunk)
+    {
+        int end = std::min((int)slots.size(), (chunk + 1) * QUERY_CHUNK);
+        for (int slot = chunk * QUERY_CHUNK; slot < end; slot++)
+        {
+            int i = slots[slot];
+            if (isDegenerate(i))
+                continue;
+            glm::dvec2 a[3];
+            corners(mesh, i, a);
+            const glm::vec2& boxMin = m_Bvh.boxMin[slot];
+            const glm::vec2& boxMax = m_Bvh.boxMax[slot];
+            m_Bvh.query(boxMin, boxMax, [&](int j)
+            {
+                if (j <= i || isDegenerate(j))
+                    return;
+                // boxes that only touch can't hold overlapping interiors, grid neighbors stop here
+                const Face& face = mesh.f[j];
+                const glm::vec2& p = mesh.uv[face.vi[0]];
+                const glm::vec2& q = mesh.uv[face.vi[1]];
+                const glm::vec2& r = mesh.uv[face.vi[2]];
+                if (std::max(p.x, std::max(q.x, r.x)) <= boxMin.x || std::min(p.x, std::min(q.x, r.x)) >= boxMax.x
+                    || std::max(p.y, std::max(q.y, r.y)) <= boxMin.y || std::min(p.y, std::min(q.y, r.y)) >= boxMax.y)
+                    return;
+                glm::dvec2 b[3];
+                corners(mesh, j, b);
+                if (!separatedByEdgeOf(a, b, tolerance) && !separatedByEdgeOf(b, a, tolerance))
+                    found[chunk].push_back({ i, j, false });
+            });
+        }
+    });
+    bool haveIslands = m_Islands.faceIsland.size() == (size_t)faceCount;
+    for (std::vector<UVOverlapReport::Pair>& pairs : found)
+    {
+        for (UVOverlapReport::Pair& pair : pairs)
+        {
+            pair.sameIsland = haveIslands && m_Islands.faceIsland[pair.a] == m_Islands.faceIsland[pair.b];
+            m_Report.sameIslandPairs += pair.sameIsland;
+            m_Report.pairs.push_back(pair);
+        }
+    }
+    std::sort(m_Report.pairs.begin(), m_Report.pairs.end(), [](const UVOverlapReport::Pair& x, const UVOverlapReport::Pair& y)
+    {
+        return x.a != y.a ? x.a < y.a : x.b < y.b;
+    });
+    m_Report.queryMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - queryStart).count();
+
+    std::vector<char> overlapping(faceCount, 0);
+    for (const UVOverlapReport::Pair& pair : m_Report.pairs)
+        overlapping[pair.a] = overlapping[pair.b] = 1;
+    for (char o : overlapping)
+        m_Report.overlappingFaces += o;
+
+    // winding of each island by area, the faces against it are flipped
+    std::vector<double> islandArea(haveIslands ? m_Islands.count : 1, 0.0);
+    for (int i = 0; i < faceCount; i++)
+        islandArea[haveIslands ? m_Islands.faceIsland[i] : 0] += area[i];
+    for (int i = 0; i < faceCount; i++)
+    {
+        if (isDegenerate(i))
+        {
+            m_Report.degenerateFaces++;
+            continue;
+        }
+        if (area[i] * islandArea[haveIslands ? m_Islands.faceIsland[i] : 0] < 0.0)
+            m_Report.flipped.push_back(i);
+    }
+
+    m_Report.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return m_Report;
+}
+
+void UVOverlaps::faceFlags(std::vector<float>& flags) const
+{
+    std::vector<int> bits(m_Mesh.f.size(), 0);
+    for (const UVOverlapReport::Pair& pair : m_Report.pairs)
+    {
+        bits[pair.a] |= OVERLAP;
+        bits[pair.b] |= OVERLAP;
+    }
+    for (int face : m_Report.flipped)
+        bits[face] |= FLIPPED;
+    flags.assign(bits.begin(), bits.end());
+}
+
+bool UVOverlapReport::writeJson(const char* path, const std::string& model, size_t maxPairs) const
+{
+    FILE* file = fopen(path, "w");
+    if (!file)
+    {
+        std::cout << "UVOverlaps: can't open " << path << std::endl;
+        return false;
+    }
+    fprintf(file, "{\n");
+    fprintf(file, "  \"model\": \"%s\",\n", Utils::JsonEscape(model).c_str());
+    fprintf(file, "  \"faces\": %zu,\n  \"overlappingFaces\": %zu,\n  \"degenerateFaces\": %zu,\n",
+        faces, overlappingFaces, degenerateFaces);
+    fprintf(file, "  \"pairCount\": %zu,\n  \"sameIslandPairs\": %zu,\n  \"flippedCount\": %zu,\n",
+        pairs.size(), sameIslandPairs, flipped.size());
+    fprintf(file, "  \"milliseconds\": %.3f,\n", ms);
+    size_t count = std::min(pairs.size(), maxPairs);
+    fprintf(file, "  \"pairs\": [");
+    for (size_t i = 0; i < count; i++)
+        fprintf(file, "%s[%d, %d]", i ? ", " : "", pairs[i].a, pairs[i].b);
+    fprintf(file, "],\n  \"flipped\": [");
+    count = std::min(flipped.size(), maxPairs);
+    for (size_t i = 0; i < count; i++)
+        fprintf(file, "%s%d", i ? ", " : "", flipped[i]);
+    fprintf(file, "]\n}\n");
+    bool ok = !ferror(file);
+    fclose(file);
+    return ok;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "UVBvh.h"
+
+struct Mesh;
+struct UVIslands;
+
+struct UVOverlapReport
+{
+	struct Pair
+	{
+		int a, b; // a < b
+		bool sameIsland;
+	};
+
+	size_t faces = 0;
+	std::vector<Pair> pairs;   // sorted by a, then b
+	std::vector<int> flipped;  // faces wound against the rest of their island
+	size_t overlappingFaces = 0;
+	size_t sameIslandPairs = 0; // folds; pairs across islands are stacked or packed too tightly
+	size_t degenerateFaces = 0; // no uv area, they never overlap
+	double bvhMs = 0.0, queryMs = 0.0, ms = 0.0;
+
+	// maxPairs caps the pair list, the counts stay exact
+	bool writeJson(const char* path, const std::string& model, size_t maxPairs = 10000) const;
+};
+
+// Overlapping and flipped uv triangles. Candidates come from a UVBvh query per face and are
+// tested with separating axes on the six edge normals; two triangles only overlap when every
+// axis shows a common interval longer than the tolerance, so neighbors touching along a
+// shared edge or at a shared vertex are never reported. A face is flipped when its signed uv
+// area has the opposite sign of its island's total, so mirrored islands are fine as a whole.
+class UVOverlaps
+{
+public:
+	// bits of faceFlags()
+	static const int OVERLAP = 1;
+	static const int FLIPPED = 2;
+
+private:
+	const Mesh& m_Mesh;
+	const UVIslands& m_Islands;
+	UVBvh m_Bvh;
+	UVOverlapReport m_Report;
+
+public:
+	UVOverlaps(const Mesh& mesh, const UVIslands& islands);
+
+	// tolerance in uv units, overlaps thinner than that are taken for touching
+	const UVOverlapReport& detect(float tolerance = 1e-6f);
+
+	const UVOverlapReport& getReport() const { return m_Report; }
+	const UVBvh& getBvh() const { return m_Bvh; }
+	// one value per face, OVERLAP | FLIPPED bits as floats for face attributes and the shader
+	void faceFlags(std::vector<float>& flags) const;
+};
@@ -0,0 +1,429 @@
+#include "UVRasterizer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <emmintrin.h>
+
+#include "mesh.h"
+#include "UVIslands.h"
+#include "PngWriter.h"
+#include "Utils.h"
+#include "FaceBins.h"
+
+// bytes in memory are R, G, B, A
+static unsigned int packColor(float r, float g, float b, float a)
+{
+    auto byte = [](float v) { return (unsigned int)(std::min(std::max(v, 0.0f), 1.0f) * 255.0f + 0.5f); };
+    return byte(r) | byte(g) << 8 | byte(b) << 16 | byte(a) << 24;
+}
+
+// golden ratio steps around the hue circle keep consecutive ids apart
+static unsigned int islandColor(int island)
+{
+    float h = std::fmod(island * 0.618034f, 1.0f) * 6.0f;
+    float s = 0.55f, v = 0.95f;
+    int sector = (int)h;
+    float f = h - sector;
+    float p = v * (1.0f - s), q = v * (1.0f - s * f), t = v * (1.0f - s * (1.0f - f));
+    switch (sector)
+    {
+    case 0: return packColor(v, t, p, 1.0f);
+    case 1: return packColor(q, v, p, 1.0f);
+    case 2: return packColor(p, v, t, 1.0f);
+    case 3: return packColor(p, q, v, 1.0f);
+    case 4: return packColor(t, p, v, 1.0f);
+    default: return packColor(v, p, q, 1.0f);
+    }
+}
+
+// -1 blue, 0 white, 1 red
+static unsigned int divergingColor(float x)
+{
+    x = std::min(std::max(x, -1.0f), 1.0f);
+    glm::vec3 end = x < 0.0f ? glm::vec3(0.23f, 0.30f, 0.75f) : glm::vec3(0.71f, 0.02f, 0.15f);
+    glm::vec3 c = glm::mix(glm::vec3(0.87f), end, std::fabs(x));
+    return packColor(c.x, c.y, c.z, 1.0f);
+}
+
+UVRasterizer::UVRasterizer(const Mesh& mesh, const UVIslands& islands)
+    : m_Mesh(mesh), m_Islands(islands)
+{
+}
+
+bool UVRasterizer::faceColors(const UVRasterSettings& settings, std::vector<unsigned int>& colors) const
+{
+    size_t faces = m_Mesh.f.size();
+    colors.assign(faces, 0);
+    switch (settings.mode)
+    {
+    case UVRasterSettings::Mode::Wireframe:
+        return true;
+    case UVRasterSettings::Mode::Islands:
+    case UVRasterSettings::Mode::IslandId:
+        if (m_Islands.faceIsland.size() != faces)
+        {
+            std::cout << "UVRasterizer: islands are not built for this mesh" << std::endl;
+            return false;
+        }
+        for (size_t i = 0; i < faces; i++)
+        {
+            int island = m_Islands.faceIsland[i];
+            // ids start at 1 so that 0 is "no face"
+            colors[i] = settings.mode == UVRasterSettings::Mode::Islands ? islandColor(island) : (unsigned int)(island + 1) | 0xFF000000u;
+        }
+        return true;
+    case UVRasterSettings::Mode::FaceAttribute:
+        break;
+    }
+
+    const std::vector<float>* values = m_Mesh.findFaceAttribute(settings.attribute);
+    if (!values || values->size() != faces)
+    {
+        std::cout << "UVRasterizer: no face attribute " << settings.attribute << std::endl;
+        return false;
+    }
+    if (settings.relativeToMean)
+    {
+        // non-positive values are faces the ratio couldn't be computed for, drawn gray
+        double sum = 0.0;
+        size_t count = 0;
+        for (float v : *values)
+        {
+            if (v > 0.0f && std::isfinite(v))
+            {
+                sum += v;
+                count++;
+            }
+        }
+        float mean = count ? (float)(sum / count) : 1.0f;
+        for (size_t i = 0; i < faces; i++)
+        {
+            float v = (*values)[i];
+            colors[i] = v > 0.0f && std::isfinite(v) ? divergingColor(std::log2(v / mean) / settings.logRange) : packColor(0.5f, 0.5f, 0.5f, 1.0f);
+        }
+    }
+    else
+    {
+        float lo = INFINITY, hi = -INFINITY;
+        for (float v : *values)
+        {
+            if (std::isfinite(v))
+            {
+                lo = std::min(lo, v);
+                hi = std::max(hi, v);
+            }
+        }
+        float scale = hi > lo ? 2.0f / (hi - lo) : 0.0f;
+        for (size_t i = 0; i < faces; i++)
+            colors[i] = divergingColor(((*values)[i] - lo) * scale - 1.0f);
+    }
+    return true;
+}
+
+// ********************* Tiles ********************* //
+
+struct TileRect
+{
+    int x0, y0, x1, y1; // pixels, x1 and y1 exclusive, x0 and x1 multiples of 4
+};
+
+// Half-space fill with edge functions E = A x + B y + C, positive inside a triangle that was
+// made counter-clockwise in image space. Pixels on an edge belong to the triangle only when
+// the edge is "owned" (A > 0 or A == 0 and B > 0), so a shared edge is filled exactly once.
+static void fillTriangle(unsigned int* band, size_t stridePixels, int bandY, const TileRect& tile, glm::vec2 p0, glm::vec2 p1, glm::vec2 p2, unsigned int color)
+{
+    float area = (p1.x - p0.x) * (p2.y - p0.y) - (p1.y - p0.y) * (p2.x - p0.x);
+    if (area == 0.0f || !std::isfinite(area))
+        return;
+    if (area < 0.0f)
+        std::swap(p1, p2);
+
+    // covered pixel centers i + 0.5 inside the bounds
+    int xmin = std::max(tile.x0, (int)std::ceil(std::min(p0.x, std::min(p1.x, p2.x)) - 0.5f));
+    int xmax = std::min(tile.x1 - 1, (int)std::floor(std::max(p0.x, std::max(p1.x, p2.x)) - 0.5f));
+    int ymin = std::max(tile.y0, (int)std::ceil(std::min(p0.y, std::min(p1.y, p2.y)) - 0.5f));
+    int ymax = std::min(tile.y1 - 1, (int)std::floor(std::max(p0.y, std::max(p1.y, p2.y)) - 0.5f));
+    if (xmin > xmax || ymin > ymax)
+        return;
+    xmin &= ~3;
+
+    // relative to p0, so large images don't eat the float precision
+    const glm::vec2 v[3] = { glm::vec2(0.0f), p1 - p0, p2 - p0 };
+    __m128 A[3], owned[3];
+    float B[3], C[3];
+    for (int k = 0; k < 3; k++)
+    {
+        glm::vec2 a = v[k], b = v[(k + 1) % 3];
+        float ea = -(b.y - a.y), eb = b.x - a.x;
+        A[k] = _mm_set1_ps(ea);
+        B[k] = eb;
+        C[k] = -(ea * a.x + eb * a.y);
+        owned[k] = _mm_castsi128_ps(_mm_set1_epi32(ea > 0.0f || (ea == 0.0f && eb > 0.0f) ? -1 : 0));
+    }
+
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 four = _mm_set1_ps(4.0f);
+    const __m128i fill = _mm_set1_epi32((int)color);
+    __m128 startX = _mm_add_ps(_mm_set1_ps(xmin + 0.5f - p0.x), _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f));
+    for (int y = ymin; y <= ymax; y++)
+    {
+        float qy = y + 0.5f - p0.y;
+        __m128 row[3];
+        for (int k = 0; k < 3; k++)
+            row[k] = _mm_set1_ps(B[k] * qy + C[k]);
+
+        unsigned int* dst = band + (size_t)(y - bandY) * stridePixels;
+        __m128 qx = startX;
+        for (int x = xmin; x <= xmax; x += 4, qx = _mm_add_ps(qx, four))
+        {
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (int k = 0; k < 3; k++)
+            {
+                __m128 e = _mm_add_ps(row[k], _mm_mul_ps(A[k], qx));
+                __m128 edge = _mm_or_ps(_mm_cmpgt_ps(e, zero), _mm_and_ps(owned[k], _mm_cmpeq_ps(e, zero)));
+                inside = _mm_and_ps(inside, edge);
+            }
+            if (_mm_movemask_ps(inside) == 0)
+                continue;
+            __m128i mask = _mm_castps_si128(inside);
+            __m128i* pixels = (__m128i*)(dst + x);
+            __m128i old = _mm_loadu_si128(pixels);
+            _mm_storeu_si128(pixels, _mm_or_si128(_mm_and_si128(mask, fill), _mm_andnot_si128(mask, old)));
+        }
+    }
+}
+
+// White line of the given half width with one pixel of falloff, alpha is coverage. Pixels
+// keep the larger alpha, so edges drawn from both of their faces look the same as once.
+static void drawSegment(unsigned int* band, size_t stridePixels, int bandY, const TileRect& tile, glm::vec2 a, glm::vec2 b, float halfWidth)
+{
+    glm::vec2 d = b - a;
+    float length2 = glm::dot(d, d);
+    if (length2 == 0.0f || !std::isfinite(length2))
+        return;
+
+    float reach = halfWidth + 0.5f;
+    int xmin = std::max(tile.x0, (int)std::floor(std::min(a.x, b.x) - reach));
+    int xmax = std::min(tile.x1 - 1, (int)std::ceil(std::max(a.x, b.x) + reach));
+    int ymin = std::max(tile.y0, (int)std::floor(std::min(a.y, b.y) - reach));
+    int ymax = std::min(tile.y1 - 1, (int)std::ceil(std::max(a.y, b.y) + reach));
+    if (xmin > xmax || ymin > ymax)
+        return;
+    xmin &= ~3;
+
+    const __m128 dx = _mm_set1_ps(d.x), dy = _mm_set1_ps(d.y);
+    const __m128 invLength2 = _mm_set1_ps(1.0f / length2);
+    const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+    const __m128 edge = _mm_set1_ps(reach), scale = _mm_set1_ps(255.0f), four = _mm_set1_ps(4.0f);
+    const __m128i white = _mm_set1_epi32(0x00FFFFFF);
+    __m128 startX = _mm_add_ps(_mm_set1_ps(xmin + 0.5f - a.x), _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f));
+    for (int y = ymin; y <= ymax; y++)
+    {
+        __m128 qy = _mm_set1_ps(y + 0.5f - a.y);
+        unsigned int* dst = band + (size_t)(y - bandY) * stridePixels;
+        __m128 qx = startX;
+        for (int x = xmin; x <= xmax; x += 4, qx = _mm_add_ps(qx, four))
+        {
+            // closest point on the segment, then the distance to it
+            __m128 t = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(qx, dx), _mm_mul_ps(qy, dy)), invLength2);
+            t = _mm_min_ps(_mm_max_ps(t, zero), one);
+            __m128 ex = _mm_sub_ps(qx, _mm_mul_ps(t, dx));
+            __m128 ey = _mm_sub_ps(qy, _mm_mul_ps(t, dy));
+            __m128 distance = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(ex, ex), _mm_mul_ps(ey, ey)));
+            __m128 coverage = _mm_min_ps(_mm_max_ps(_mm_sub_ps(edge, distance), zero), one);
+            if (_mm_movemask_ps(_mm_cmpgt_ps(coverage, zero)) == 0)
+                continue;
+
+            __m128i* pixels = (__m128i*)(dst + x);
+            __m128i old = _mm_loadu_si128(pixels);
+            __m128 oldAlpha = _mm_cvtepi32_ps(_mm_srli_epi32(old, 24));
+            __m128 alpha = _mm_max_ps(oldAlpha, _mm_mul_ps(coverage, scale));
+            __m128i alphaBits = _mm_slli_epi32(_mm_cvtps_epi32(alpha), 24);
+            __m128i covered = _mm_castps_si128(_mm_cmpgt_ps(alpha, zero));
+            _mm_storeu_si128(pixels, _mm_or_si128(alphaBits, _mm_and_si128(covered, white)));
+        }
+    }
+}
+
+// ********************* Rasterizer ********************* //
+
+bool UVRasterizer::rasterize(const UVRasterSettings& settings, const BandSink& sink)
+{
+    typedef std::chrono::steady_clock Clock;
+    auto ms = [](Clock::time_point a, Clock::time_point b) { return std::chrono::duration<double, std::milli>(b - a).count(); };
+    auto start = Clock::now();
+    m_Stats = Stats();
+
+    int width = settings.width, height = settings.height;
+    if (width <= 0 || height <= 0 || width > MAX_SIZE || height > MAX_SIZE)
+    {
+        std::cout << "UVRasterizer: size " << width << "x" << height << " is outside 1.." << MAX_SIZE << std::endl;
+        return false;
+    }
+    std::vector<unsigned int> colors;
+    if (!faceColors(settings, colors))
+        return false;
+
+    bool wireframe = settings.mode == UVRasterSettings::Mode::Wireframe;
+    float halfWidth = std::max(settings.lineWidth, 0.1f) * 0.5f;
+    float pad = wireframe ? halfWidth + 1.0f : 1.0f;
+
+    // image space: u to the right, v = 1 at the top row, the way the texture file reads
+    const Mesh& mesh = m_Mesh;
+    auto corner = [&](int face, int k)
+    {
+        glm::vec2 uv = mesh.uv[mesh.f[face].vi[k]];
+        return glm::vec2(uv.x * width, (1.0f - uv.y) * height);
+    };
+    auto xRange = [&](int face, float& lo, float& hi)
+    {
+        glm::vec2 a = corner(face, 0), b = corner(face, 1), c = corner(face, 2);
+        lo = std::min(a.x, std::min(b.x, c.x)) - pad;
+        hi = std::max(a.x, std::max(b.x, c.x)) + pad;
+    };
+    auto yRange = [&](int face, float& lo, float& hi)
+    {
+        glm::vec2 a = corner(face, 0), b = corner(face, 1), c = corner(face, 2);
+        lo = std::min(a.y, std::min(b.y, c.y)) - pad;
+        hi = std::max(a.y, std::max(b.y, c.y)) + pad;
+    };
+
+    int bandCount = (height + TILE - 1) / TILE;
+    int tileColumns = (width + TILE - 1) / TILE;
+    FaceBins bands;
+    bands.build(bandCount, (float)TILE, nullptr, mesh.f.size(), yRange);
+    m_Stats.binMs += ms(start, Clock::now());
+
+    // rows padded to whole 4 pixel groups, the SIMD loops never need a scalar tail
+    size_t stridePixels = (size_t)(width + 3) & ~(size_t)3;
+    std::vector<unsigned int> buffers[2];
+    buffers[0].resize(stridePixels * TILE);
+    buffers[1].resize(stridePixels * TILE);
+    m_Stats.bandBytes = buffers[0].size() * sizeof(unsigned int);
+
+    std::thread writer;
+    bool ok = true;
+    FaceBins tiles;
+    for (int band = 0; band < bandCount; band++)
+    {
+        int bandY = band * TILE;
+        int rows = std::min(TILE, height - bandY);
+        std::vector<unsigned int>& buffer = buffers[band & 1];
+        // the writer of band - 2 used this buffer and was joined before band - 1 was handed over
+        std::fill(buffer.begin(), buffer.end(), 0u);
+
+        auto binStart = Clock::now();
+        tiles.build(tileColumns, (float)TILE, bands.begin(band), bands.count(band), xRange);
+        m_Stats.binnedFaces += tiles.faces.size();
+        auto rasterStart = Clock::now();
+        m_Stats.binMs += ms(binStart, rasterStart);
+
+        Utils::ParallelFor(tileColumns, [&](int column)
+        {
+            TileRect rect;
+            rect.x0 = column * TILE;
+            rect.x1 = std::min(rect.x0 + TILE, (int)stridePixels);
+            rect.y0 = bandY;
+            rect.y1 = bandY + rows;
+            for (int i = tiles.start[column]; i < tiles.start[column + 1]; i++)
+            {
+                int face = tiles.faces[i];
+                glm::vec2 p[3] = { corner(face, 0), corner(face, 1), corner(face, 2) };
+                if (wireframe)
+                {
+                    for (int k = 0; k < 3; k++)
+                        drawSegment(buffer.data(), stridePixels, bandY, rect, p[k], p[(k + 1) % 3], halfWidth);
+                }
+                else
+                {
+                    fillTriangle(buffer.data(), stridePixels, bandY, rect, p[0], p[1], p[2], colors[face]);
+                }
+            }
+        });
+        m_Stats.rasterMs += ms(rasterStart, Clock::now());
+
+        if (writer.joinable())
+            writer.join();
+        if (!ok)
+            break;
+        writer = std::thread([&sink, &ok, &buffer, stridePixels, bandY, rows]()
+        {
+            ok = sink((const unsigned char*)buffer.data(), stridePixels * 4, bandY, rows);
+        });
+    }
+    if (writer.joinable())
+        writer.join();
+
+    m_Stats.totalMs = ms(start, Clock::now());
+    return ok;
+}
+
+bool UVRasterizer::exportPng(const UVRasterSettings& settings, const char* path)
+{
+    // opened with the first band, bad settings leave no empty file behind
+    PngWriter writer;
+    bool opened = false;
+    bool ok = rasterize(settings, [&](const unsigned char* rows, size_t stride, int firstRow, int rowCount)
+    {
+        if (!opened)
+        {
+            opened = writer.open(path, settings.width, settings.height, 4);
+            if (!opened)
+                return false;
+        }
+        for (int r = 0; r < rowCount; r++)
+        {
+            if (!writer.writeRows(rows + r * stride, 1))
+                return false;
+        }
+        return true;
+    });
+    if (!opened)
+        return false;
+    ok = writer.close() && ok;
+    std::cout << "UV layout " << settings.width << "x" << settings.height << " to " << path << (ok ? "" : " failed") << ": "
+        << m_Stats.totalMs << " ms (binning " << m_Stats.binMs << ", raster " << m_Stats.rasterMs << ")" << std::endl;
+    return ok;
+}
+
+UVLayoutExport::UVLayoutExport()
+    : m_Running(false), m_Ok(true)
+{
+}
+
+UVLayoutExport::~UVLayoutExport()
+{
+    if (m_Thread.joinable())
+        m_Thread.join();
+}
+
+bool UVLayoutExport::start(const Mesh& mesh, const UVIslands& islands, const UVRasterSettings& settings, const std::string& path)
+{
+    if (m_Running)
+        return false;
+    if (m_Thread.joinable())
+        m_Thread.join();
+    m_Mesh.reset(new Mesh());
+    m_Mesh->f = mesh.f;
+    m_Mesh->uv = mesh.uv;
+    m_Mesh->faceAttributes = mesh.faceAttributes;
+    m_Islands.reset(new UVIslands(islands));
+    m_Settings = settings;
+    m_Path = path;
+    m_Running = true;
+    m_Thread = std::thread([this]()
+    {
+        UVRasterizer rasterizer(*m_Mesh, *m_Islands);
+        m_Ok = rasterizer.exportPng(m_Settings, m_Path.c_str());
+        m_Stats = rasterizer.getLastStats();
+        // the copies are only needed while it runs
+        m_Mesh.reset();
+        m_Islands.reset();
+        m_Running = false;
+    });
+    return true;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct Mesh;
+struct UVIslands;
+
+struct UVRasterSettings
+{
+	enum class Mode { Wireframe, Islands, FaceAttribute, IslandId };
+
+	Mode mode = Mode::Wireframe;
+	int width = 2048;
+	int height = 2048;
+	float lineWidth = 1.0f; // pixels, wireframe only
+	std::string attribute = "uvScaling";
+	// FaceAttribute: log2 of value / mean for ratios like uvScaling, red above the mean and
+	// blue below, saturating at logRange; otherwise the data's min .. max from blue to red
+	bool relativeToMean = true;
+	float logRange = 2.0f;
+};
+
+// CPU rasterizer for the uv layout. Image space is cut into bands of TILE rows and each band
+// into TILE x TILE tiles; faces are binned per band and per tile, tiles are filled in parallel
+// with SSE edge functions, 4 pixels at a time. A finished band goes to the sink on another
+// thread while the next one is rasterized, so memory stays at two bands whatever the size.
+// Fill modes are not antialiased so that island ids come out exact; later faces win on overlaps.
+class UVRasterizer
+{
+public:
+	static const int TILE = 64;
+	static const int MAX_SIZE = 16384;
+
+	struct Stats
+	{
+		double binMs = 0.0;
+		double rasterMs = 0.0; // across all threads, band by band
+		double totalMs = 0.0;
+		size_t binnedFaces = 0; // faces counted once per tile they touch
+		size_t bandBytes = 0;
+	};
+
+	// rows are RGBA, stride bytes apart, top row first; returning false stops the run
+	typedef std::function<bool(const unsigned char* rows, size_t stride, int firstRow, int rowCount)> BandSink;
+
+private:
+	const Mesh& m_Mesh;
+	const UVIslands& m_Islands;
+	Stats m_Stats;
+
+	bool faceColors(const UVRasterSettings& settings, std::vector<unsigned int>& colors) const;
+
+public:
+	UVRasterizer(const Mesh& mesh, const UVIslands& islands);
+
+	// false for bad settings or when the sink gave up
+	bool rasterize(const UVRasterSettings& settings, const BandSink& sink);
+	bool exportPng(const UVRasterSettings& settings, const char* path);
+
+	const Stats& getLastStats() const { return m_Stats; }
+};
+
+// exportPng on a thread of its own over a copy of what the rasterizer reads (faces, uvs, face
+// attributes and islands), so the mesh can be edited while a large layout is written
+class UVLayoutExport
+{
+private:
+	std::unique_ptr<Mesh> m_Mesh;
+	std::unique_ptr<UVIslands> m_Islands;
+	UVRasterSettings m_Settings;
+	std::string m_Path;
+	std::thread m_Thread;
+	std::atomic<bool> m_Running;
+	bool m_Ok;
+	UVRasterizer::Stats m_Stats;
+
+public:
+	UVLayoutExport();
+	~UVLayoutExport(); // waits for a running export
+
+	// false while the last one still runs
+	bool start(const Mesh& mesh, const UVIslands& islands, const UVRasterSettings& settings, const std::string& path);
+	bool isRunning() const { return m_Running.load(); }
+	// of the last finished export
+	bool succeeded() const { return m_Ok; }
+	const UVRasterizer::Stats& getStats() const { return m_Stats; }
+};
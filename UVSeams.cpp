@@ -0,0 +1,231 @@
+#include "UVSeams.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+
+#include "mesh.h"
+#include "Utils.h"
+
+// flags of a half edge
+static const unsigned char MATCHED = 1;
+static const unsigned char DIFFERS = 2;
+
+// a half edge's ends, ordered by position bits so both faces of an edge see the same order
+struct EdgeEnds
+{
+    uint32_t key[6];
+    glm::vec2 uv[2];
+};
+
+static void positionBits(const glm::vec3& p, uint32_t* bits)
+{
+    for (int k = 0; k < 3; k++)
+    {
+        float v = p[k] + 0.0f; // -0 and 0 are the same point
+        memcpy(&bits[k], &v, sizeof(v));
+    }
+}
+
+// false for edges without length, they are left out
+static bool edgeEnds(const Mesh& mesh, int halfEdge, EdgeEnds& ends)
+{
+    const Face& face = mesh.f[halfEdge / 3];
+    int a = face.vi[halfEdge % 3], b = face.vi[(halfEdge % 3 + 1) % 3];
+    positionBits(mesh.pos[a], ends.key);
+    positionBits(mesh.pos[b], ends.key + 3);
+    ends.uv[0] = mesh.uv[a];
+    ends.uv[1] = mesh.uv[b];
+    int order = memcmp(ends.key, ends.key + 3, 3 * sizeof(uint32_t));
+    if (order == 0)
+        return false;
+    if (order > 0)
+    {
+        for (int k = 0; k < 3; k++)
+            std::swap(ends.key[k], ends.key[k + 3]);
+        std::swap(ends.uv[0], ends.uv[1]);
+    }
+    return true;
+}
+
+static uint64_t edgeHash(const EdgeEnds& ends)
+{
+    uint64_t h = 0x243F6A8885A308D3ull;
+    for (int k = 0; k < 6; k++)
+        h = (h ^ ends.key[k]) * 0x9E3779B97F4A7C15ull;
+    // murmur's finalizer, the table indexes with the low bits
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDull;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+// 32 bits of the uvs at the ends, in the order of the positions
+static uint32_t uvHash(const EdgeEnds& ends)
+{
+    uint32_t bits[4];
+    memcpy(bits, &ends.uv[0], sizeof(glm::vec2));
+    memcpy(bits + 2, &ends.uv[1], sizeof(glm::vec2));
+    uint64_t h = 0x13198A2E03707344ull;
+    for (int k = 0; k < 4; k++)
+        h = (h ^ bits[k]) * 0x9E3779B97F4A7C15ull;
+    return (uint32_t)(h >> 32);
+}
+
+// what a partition needs of a half edge, so matching streams through memory
+struct EdgeRecord
+{
+    uint64_t hash;
+    uint32_t uv;
+    int halfEdge;
+};
+
+static int partitionOf(uint64_t hash)
+{
+    return (int)(hash >> 56) % UVSeams::PARTITIONS;
+}
+
+UVSeams::UVSeams(const Mesh& mesh)
+    : m_Mesh(mesh)
+{
+}
+
+const UVSeamReport& UVSeams::extract()
+{
+    auto start = std::chrono::steady_clock::now();
+    const Mesh& mesh = m_Mesh;
+    int faceCount = (int)mesh.f.size();
+    int halfEdges = faceCount * 3;
+    m_Report = UVSeamReport();
+    m_Report.faces = faceCount;
+
+    // counting sort of the half edges into partitions, chunk by chunk
+    const int CHUNK = 1 << 16;
+    int chunks = (halfEdges + CHUNK - 1) / CHUNK;
+    std::vector<int> offsets((size_t)chunks * PARTITIONS, 0);
+    Utils::ParallelFor(chunks, [&](int chunk)
+    {
+        int* counts = &offsets[(size_t)chunk * PARTITIONS];
+        int end = std::min(halfEdges, (chunk + 1) * CHUNK);
+        EdgeEnds ends;
+        for (int h = chunk * CHUNK; h < end; h++)
+        {
+            if (edgeEnds(mesh, h, ends))
+                counts[partitionOf(edgeHash(ends))]++;
+        }
+    });
+    std::vector<int> partitionStart(PARTITIONS + 1, 0);
+    int total = 0;
+    for (int p = 0; p < PARTITIONS; p++)
+    {
+        partitionStart[p] = total;
+        for (int chunk = 0; chunk < chunks; chunk++)
+        {
+            int count = offsets[(size_t)chunk * PARTITIONS + p];
+            offsets[(size_t)chunk * PARTITIONS + p] = total;
+            total += count;
+        }
+    }
+    partitionStart[PARTITIONS] = total;
+    std::vector<EdgeRecord> sorted(total);
+    Utils::ParallelFor(chunks, [&](int chunk)
+    {
+        int* next = &offsets[(size_t)chunk * PARTITIONS];
+        int end = std::min(halfEdges, (chunk + 1) * CHUNK);
+        EdgeEnds ends;
+        for (int h = chunk * CHUNK; h < end; h++)
+        {
+            if (!edgeEnds(mesh, h, ends))
+                continue;
+            uint64_t hash = edgeHash(ends);
+            sorted[next[partitionOf(hash)]++] = { hash, uvHash(ends), h };
+        }
+    });
+
+    // each partition against its own table of record indices; the first half edge of an edge
+    // stands for it. Edges are told apart by their 64 bit hash, the same hash on different
+    // edges is as likely as 1 in 2^64 / edges^2 per mesh, and uvs by 32 bits of theirs
+    std::vector<unsigned char> edgeFlags(halfEdges, 0);
+    std::vector<size_t> partitionEdges(PARTITIONS, 0), partitionSeams(PARTITIONS, 0);
+    Utils::ParallelFor(PARTITIONS, [&](int p)
+    {
+        const EdgeRecord* records = sorted.data() + partitionStart[p];
+        int count = partitionStart[p + 1] - partitionStart[p];
+        size_t size = 16;
+        while (size < (size_t)count * 2)
+            size *= 2;
+        std::vector<int> table(size, -1);
+        for (int i = 0; i < count; i++)
+        {
+            const EdgeRecord& record = records[i];
+            for (size_t slot = (size_t)record.hash & (size - 1);; slot = (slot + 1) & (size - 1))
+            {
+                if (table[slot] < 0)
+                {
+                    table[slot] = i;
+                    partitionEdges[p]++;
+                    break;
+                }
+                const EdgeRecord& first = records[table[slot]];
+                if (first.hash != record.hash)
+                    continue;
+                edgeFlags[first.halfEdge] |= MATCHED;
+                edgeFlags[record.halfEdge] |= MATCHED;
+                if (first.uv != record.uv)
+                {
+                    partitionSeams[p] += (edgeFlags[first.halfEdge] & DIFFERS) == 0;
+                    edgeFlags[first.halfEdge] |= DIFFERS;
+                    edgeFlags[record.halfEdge] |= DIFFERS;
+                }
+                break;
+            }
+        }
+    });
+    for (int p = 0; p < PARTITIONS; p++)
+    {
+        m_Report.edges += partitionEdges[p];
+        m_Report.seamEdges += partitionSeams[p];
+    }
+
+    // half edges that never met a partner are borders, edges without length are neither
+    std::vector<unsigned char> corners;
+    mesh.cornerSlots(corners);
+    m_FaceBits.assign(faceCount, 0);
+    Utils::ParallelFor((faceCount + CHUNK - 1) / CHUNK, [&](int chunk)
+    {
+        int end = std::min(faceCount, (chunk + 1) * CHUNK);
+        for (int i = chunk * CHUNK; i < end; i++)
+        {
+            const Face& face = mesh.f[i];
+            unsigned char bits = 0;
+            for (int j = 0; j < 3; j++)
+            {
+                unsigned char flags = edgeFlags[i * 3 + j];
+                if (flags & DIFFERS)
+                    bits |= SEAM << j;
+                else if (!(flags & MATCHED) && mesh.pos[face.vi[j]] != mesh.pos[face.vi[(j + 1) % 3]])
+                    bits |= BORDER << j;
+                if (corners[face.vi[j]] != j)
+                    bits |= NO_CORNERS;
+            }
+            m_FaceBits[i] = bits;
+        }
+    });
+    for (int i = 0; i < faceCount; i++)
+    {
+        for (int j = 0; j < 3; j++)
+            m_Report.borderEdges += (m_FaceBits[i] & (BORDER << j)) != 0;
+        m_Report.facesWithoutCorners += (m_FaceBits[i] & NO_CORNERS) != 0;
+    }
+
+    m_Report.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return m_Report;
+}
+
+void UVSeams::faceFlags(std::vector<float>& flags) const
+{
+    flags.assign(m_FaceBits.begin(), m_FaceBits.end());
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+struct Mesh;
+
+struct UVSeamReport
+{
+	size_t faces = 0;
+	size_t edges = 0;       // distinct 3D edges
+	size_t seamEdges = 0;   // shared by faces that disagree on the uvs at its ends
+	size_t borderEdges = 0; // used by one face only
+	size_t facesWithoutCorners = 0; // faces the shader can't outline, see Mesh::cornerSlots
+	double ms = 0.0;
+};
+
+// Seams and borders of the uv layout. Edges are keyed by the exact position bits at their
+// ends, so the importer's one vertex per face corner doesn't hide shared edges. A counting
+// sort spreads the half edges over PARTITIONS by the top bits of their key hash, each as a
+// 16 byte record, then every partition is matched on its own thread in an open addressing
+// table that stays in cache; a half edge belongs to one partition only, so no locking.
+class UVSeams
+{
+public:
+	static const int PARTITIONS = 256;
+
+	// bits of faceFlags(), edge j runs from corner j to corner j + 1
+	static const int SEAM = 1;        // << j
+	static const int BORDER = 8;      // << j
+	static const int NO_CORNERS = 64; // the corner slot attribute doesn't fit this face
+
+private:
+	const Mesh& m_Mesh;
+	UVSeamReport m_Report;
+	std::vector<unsigned char> m_FaceBits;
+
+public:
+	UVSeams(const Mesh& mesh);
+
+	const UVSeamReport& extract();
+
+	const UVSeamReport& getReport() const { return m_Report; }
+	// one value per face, the bits above as floats for face attributes and the shader
+	void faceFlags(std::vector<float>& flags) const;
+};
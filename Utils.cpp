@@ -1,10 +1,82 @@
 #include "Utils.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
 float Utils::ComputeArea(glm::vec3 p1, glm::vec3 p2, glm::vec3 p3)
 {
-    float l1 = glm::length(p1 - p2);
-    float l2 = glm::length(p2 - p3);
-    float l3 = glm::length(p3 - p1);
-    float s = (l1 + l2 + l3) / 2.0f;
-    return sqrt(s * (s - l1) * (s - l2) * (s - l3));
+    // half the cross product, Heron's formula loses slivers to cancellation
+    return 0.5f * glm::length(glm::cross(p2 - p1, p3 - p1));
+}
+
+void Utils::MakeDirectory(const std::string& path)
+{
+#ifdef _WIN32
+    _mkdir(path.c_str());
+#else
+    mkdir(path.c_str(), 0755);
+#endif
+}
+
+std::string Utils::JsonEscape(const std::string& text)
+{
+    std::string escaped;
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            escaped += '\\';
+            escaped += c;
+        }
+        else if ((unsigned char)c < 0x20)
+        {
+            char code[8];
+            snprintf(code, sizeof(code), "\\u%04x", (unsigned char)c);
+            escaped += code;
+        }
+        else
+            escaped += c;
+    }
+    return escaped;
+}
+
+int Utils::ThreadCount()
+{
+    return std::max(1, (int)std::thread::hardware_concurrency());
+}
+
+void Utils::ParallelFor(int count, const std::function<void(int)>& body, int threads)
+{
+    if (threads <= 0)
+        threads = ThreadCount();
+    threads = std::min(threads, count);
+    if (threads <= 1)
+    {
+        for (int i = 0; i < count; i++)
+            body(i);
+        return;
+    }
+
+    std::atomic<int> next(0);
+    auto work = [&]()
+    {
+        for (int i = next++; i < count; i = next++)
+            body(i);
+    };
+    std::vector<std::thread> helpers;
+    helpers.reserve(threads - 1);
+    for (int i = 0; i < threads - 1; i++)
+        helpers.emplace_back(work);
+    work();
+    for (std::thread& helper : helpers)
+        helper.join();
 }
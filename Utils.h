@@ -1,9 +1,20 @@
 #pragma once
 
+#include <functional>
+#include <string>
+
 #include "glm/glm.hpp"
 
 class Utils
 {
 public:
 	static float ComputeArea(glm::vec3 p1, glm::vec3 p2, glm::vec3 p3);
+	// creates a single directory level, existing ones are fine
+	static void MakeDirectory(const std::string& path);
+	// text for the inside of a JSON string: quotes, backslashes and control characters escaped
+	static std::string JsonEscape(const std::string& text);
+	// calls body(i) for i in [0, count) on up to threads threads (0: one per core), the caller
+	// works too; items are handed out one at a time so uneven items balance themselves
+	static void ParallelFor(int count, const std::function<void(int)>& body, int threads = 0);
+	static int ThreadCount();
 };
\ No newline at end of file
@@ -0,0 +1,926 @@
+#include "VirtualTexture.h"
+
+#include <GL/glew.h>
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <unordered_set>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "Renderer.h"
+#include "GLState.h"
+#include "Utils.h"
+#include "vendor/stb_image/stb_image.h"
+
+static const size_t PAGE_BYTES = (size_t)VirtualTexture::SLOT * VirtualTexture::SLOT * 4;
+static const int PAGE_FILE_VERSION = 2;
+// pages requested, read or waiting for upload at once, PAGE_BYTES each
+static const size_t MAX_IN_FLIGHT = 128;
+
+struct PageFileHeader
+{
+    char magic[4];
+    int32_t version;
+    int32_t page, border;
+    int32_t tileSize, tilesU, tilesV, levels; // tileSize: the power of two square a tile has in the page table
+    int32_t tileWidth, tileHeight;            // its texels, the rest of the square is padding
+    uint64_t signature;   // sizes and times of the source files
+    uint64_t indexOffset; // a uint64_t file offset per page of every level, coarser levels after finer
+};
+
+// level, y and x of a page in one key
+static uint64_t PageKey(int level, int x, int y)
+{
+    return ((uint64_t)level << 48) | ((uint64_t)y << 24) | (uint64_t)x;
+}
+
+static int KeyLevel(uint64_t key) { return (int)(key >> 48); }
+static int KeyY(uint64_t key) { return (int)((key >> 24) & 0xFFFFFF); }
+static int KeyX(uint64_t key) { return (int)(key & 0xFFFFFF); }
+
+static int NextPowerOfTwo(int n)
+{
+    int p = 1;
+    while (p < n)
+        p *= 2;
+    return p;
+}
+
+static int Log2(int n)
+{
+    int l = 0;
+    while ((1 << (l + 1)) <= n)
+        l++;
+    return l;
+}
+
+static bool Seek(FILE* file, uint64_t offset)
+{
+#ifdef _WIN32
+    return _fseeki64(file, (__int64)offset, SEEK_SET) == 0;
+#else
+    return fseeko(file, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+// the file names of a UDIM set, or the path itself
+static std::vector<std::pair<std::string, int>> FindSources(const std::string& path)
+{
+    std::vector<std::pair<std::string, int>> sources;
+    int width, height, channels;
+    size_t token = path.find("<UDIM>");
+    if (token == std::string::npos)
+    {
+        if (stbi_info(path.c_str(), &width, &height, &channels))
+            sources.push_back({ path, 1001 });
+        return sources;
+    }
+    for (int udim = 1001; udim <= 1100; udim++)
+    {
+        std::string file = path.substr(0, token) + std::to_string(udim) + path.substr(token + 6);
+        if (stbi_info(file.c_str(), &width, &height, &channels))
+            sources.push_back({ file, udim });
+    }
+    return sources;
+}
+
+static uint64_t SourceSignature(const std::vector<std::pair<std::string, int>>& sources)
+{
+    // FNV-1a over the size and modification time of every file
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&hash](uint64_t value)
+    {
+        for (int i = 0; i < 8; i++)
+        {
+            hash ^= (value >> (i * 8)) & 0xFF;
+            hash *= 1099511628211ull;
+        }
+    };
+    for (const auto& source : sources)
+    {
+        struct stat info;
+        if (stat(source.first.c_str(), &info) != 0)
+            continue;
+        mix((uint64_t)source.second);
+        mix((uint64_t)info.st_size);
+        mix((uint64_t)info.st_mtime);
+    }
+    return hash;
+}
+
+// bilinear, for the tiles of a set that are not the size of its largest
+static void Resample(const unsigned char* source, int sourceWidth, int sourceHeight, int width, int height, std::vector<unsigned char>& target)
+{
+    target.resize((size_t)width * height * 4);
+    float scaleX = (float)sourceWidth / width, scaleY = (float)sourceHeight / height;
+    Utils::ParallelFor(height, [&](int y)
+    {
+        float sy = std::max(0.0f, (y + 0.5f) * scaleY - 0.5f);
+        int y0 = std::min((int)sy, sourceHeight - 1), y1 = std::min(y0 + 1, sourceHeight - 1);
+        float fy = sy - y0;
+        for (int x = 0; x < width; x++)
+        {
+            float sx = std::max(0.0f, (x + 0.5f) * scaleX - 0.5f);
+            int x0 = std::min((int)sx, sourceWidth - 1), x1 = std::min(x0 + 1, sourceWidth - 1);
+            float fx = sx - x0;
+            for (int c = 0; c < 4; c++)
+            {
+                float top = source[((size_t)y0 * sourceWidth + x0) * 4 + c] * (1.0f - fx) + source[((size_t)y0 * sourceWidth + x1) * 4 + c] * fx;
+                float bottom = source[((size_t)y1 * sourceWidth + x0) * 4 + c] * (1.0f - fx) + source[((size_t)y1 * sourceWidth + x1) * 4 + c] * fx;
+                target[((size_t)y * width + x) * 4 + c] = (unsigned char)(top + (bottom - top) * fy + 0.5f);
+            }
+        }
+    });
+}
+
+// 2x2 box filter to (width + 1) / 2 x (height + 1) / 2, an odd last row or column repeats
+static void Downsample(const unsigned char* source, int width, int height, std::vector<unsigned char>& target)
+{
+    int w = (width + 1) / 2, h = (height + 1) / 2;
+    target.resize((size_t)w * h * 4);
+    Utils::ParallelFor(h, [&](int y)
+    {
+        const unsigned char* row0 = source + (size_t)(2 * y) * width * 4;
+        const unsigned char* row1 = 2 * y + 1 < height ? row0 + (size_t)width * 4 : row0;
+        unsigned char* out = &target[(size_t)y * w * 4];
+        for (int x = 0; x < w; x++)
+        {
+            int x0 = 2 * x * 4, x1 = std::min(2 * x + 1, width - 1) * 4;
+            for (int c = 0; c < 4; c++)
+                out[x * 4 + c] = (unsigned char)((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+        }
+    });
+}
+
+VirtualTexture::VirtualTexture()
+    : m_State((int)State::Empty), m_BakeDone(0), m_BakeTotal(0), m_CancelBake(false),
+    m_TileSize(0), m_TileWidth(0), m_TileHeight(0), m_TilesU(0), m_TilesV(0), m_Signature(0), m_SlotsPerSide(0), m_WorkerCount(0),
+    m_PageTable(0), m_Pages(0), m_Frame(1), m_Bias(0.0f), m_FeedbackSlot(0), m_Stop(false), m_ReadMs(0.0), m_Reads(0)
+{
+    for (int i = 0; i < FEEDBACK_RING; i++)
+    {
+        m_FeedbackPbos[i] = 0;
+        m_FeedbackFences[i] = nullptr;
+        m_FeedbackSize[i][0] = m_FeedbackSize[i][1] = 0;
+        m_FeedbackBias[i] = 0.0f;
+    }
+}
+
+VirtualTexture::~VirtualTexture()
+{
+    close();
+}
+
+bool VirtualTexture::open(const std::string& path, int slotsPerSide, int workers)
+{
+    close();
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Error.clear();
+    }
+    m_Path = path;
+    m_SlotsPerSide = std::max(2, std::min(slotsPerSide, 255));
+    m_WorkerCount = std::max(1, workers);
+
+    std::vector<std::pair<std::string, int>> sources = FindSources(path);
+    std::vector<Tile> tiles;
+    for (const auto& source : sources)
+        tiles.push_back({ source.first, (source.second - 1001) % 10, (source.second - 1001) / 10 });
+    if (tiles.empty())
+    {
+        setError("no image at " + path);
+        m_State = (int)State::Failed;
+        return false;
+    }
+
+    std::string base = path;
+    size_t token = base.find("<UDIM>");
+    if (token != std::string::npos)
+        base.replace(token, 6, "udim");
+    m_CachePath = base + ".vtpages";
+    uint64_t signature = SourceSignature(sources);
+
+    // an existing page file of the same sources is used as it is
+    if (openPages(signature))
+    {
+        m_State = (int)State::Ready;
+        return true;
+    }
+
+    m_Signature = signature;
+    m_BakeDone = 0;
+    m_BakeTotal = (int)tiles.size() + 1;
+    m_CancelBake = false;
+    m_State = (int)State::Baking;
+    m_Baker = std::thread([this, tiles, signature]()
+    {
+        bool ok = bake(tiles, signature);
+        // update() opens the pages on the GL thread
+        m_State = (int)(ok ? State::Ready : State::Failed);
+    });
+    return true;
+}
+
+float VirtualTexture::getBakeProgress() const
+{
+    int total = m_BakeTotal.load();
+    return total > 0 ? (float)m_BakeDone.load() / total : 0.0f;
+}
+
+// Runs on the bake thread, no GL. One tile is decoded at a time: its mips are cut into pages
+// down to PAGE x PAGE, the levels where a page spans several tiles come from a composite of
+// those smallest tile mips. Borders clamp at the tile's edge, UDIM tiles don't continue into
+// their neighbours. A tile keeps its size in the power of two square of pages it gets, the
+// last pages padded with its edge; level 0 is cut from the decoded image itself, which goes
+// as soon as level 1 is made, so a tile costs a quarter more than stb_image's decode of it.
+bool VirtualTexture::bake(const std::vector<Tile>& tiles, uint64_t signature)
+{
+    int tileWidth = 1, tileHeight = 1, columns = 1, rows = 1;
+    for (const Tile& tile : tiles)
+    {
+        int width, height, channels;
+        if (stbi_info(tile.file.c_str(), &width, &height, &channels))
+        {
+            tileWidth = std::max(tileWidth, width);
+            tileHeight = std::max(tileHeight, height);
+        }
+        columns = std::max(columns, tile.column + 1);
+        rows = std::max(rows, tile.row + 1);
+    }
+    int tileSize = std::max(PAGE, NextPowerOfTwo(std::max(tileWidth, tileHeight)));
+    int tilesU = NextPowerOfTwo(columns), tilesV = NextPowerOfTwo(rows);
+    int pagesX = tilesU * tileSize / PAGE, pagesY = tilesV * tileSize / PAGE;
+    if (pagesX > 4096 || pagesY > 4096)
+    {
+        setError(std::to_string(pagesX) + " x " + std::to_string(pagesY) + " pages, the feedback pass addresses 4096");
+        return false;
+    }
+    int levels = Log2(std::min(pagesX, pagesY)) + 1;
+    int tileLevels = Log2(tileSize / PAGE) + 1; // levels whose pages lie in one tile
+
+    std::vector<size_t> levelStart(levels + 1, 0);
+    for (int m = 0; m < levels; m++)
+        levelStart[m + 1] = levelStart[m] + (size_t)(pagesX >> m) * (pagesY >> m);
+    std::vector<uint64_t> offsets(levelStart[levels], 0);
+
+    std::string partial = m_CachePath + ".part";
+    FILE* file = fopen(partial.c_str(), "wb");
+    if (!file)
+    {
+        setError("cannot write " + partial);
+        return false;
+    }
+    PageFileHeader header = {};
+    memcpy(header.magic, "UVVT", 4);
+    header.version = PAGE_FILE_VERSION;
+    header.page = PAGE;
+    header.border = BORDER;
+    header.tileSize = tileSize;
+    header.tilesU = tilesU;
+    header.tilesV = tilesV;
+    header.levels = levels;
+    header.tileWidth = tileWidth;
+    header.tileHeight = tileHeight;
+    header.signature = signature;
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    uint64_t position = sizeof(header);
+
+    // the pages of a width x height image of level m, its first page at (pageX, pageY); a last
+    // page that sticks out is padded
+    std::vector<unsigned char> row;
+    auto writePages = [&](const unsigned char* image, int width, int height, int level, int pageX, int pageY)
+    {
+        int countX = (width + PAGE - 1) / PAGE, countY = (height + PAGE - 1) / PAGE;
+        row.resize(PAGE_BYTES * countX);
+        for (int py = 0; py < countY && ok; py++)
+        {
+            Utils::ParallelFor(countX, [&](int px)
+            {
+                unsigned char* page = &row[PAGE_BYTES * px];
+                for (int y = 0; y < SLOT; y++)
+                {
+                    int sy = std::min(std::max(py * PAGE - BORDER + y, 0), height - 1);
+                    for (int x = 0; x < SLOT; x++)
+                    {
+                        int sx = std::min(std::max(px * PAGE - BORDER + x, 0), width - 1);
+                        memcpy(&page[((size_t)y * SLOT + x) * 4], &image[((size_t)sy * width + sx) * 4], 4);
+                    }
+                }
+            });
+            ok = fwrite(row.data(), PAGE_BYTES, countX, file) == (size_t)countX;
+            for (int px = 0; px < countX; px++)
+            {
+                offsets[levelStart[level] + (size_t)(pageY + py) * (pagesX >> level) + pageX + px] = position;
+                position += PAGE_BYTES;
+            }
+        }
+    };
+
+    // the smallest mip of every tile, PAGE x PAGE each; black where the set has no tile
+    int compositeWidth = tilesU * PAGE, compositeHeight = tilesV * PAGE;
+    std::vector<unsigned char> composite;
+    if (levels > tileLevels)
+        composite.assign((size_t)compositeWidth * compositeHeight * 4, 0);
+
+    // the flip is per thread here, the GL thread's loads are left alone
+    stbi_set_flip_vertically_on_load_thread(1);
+    for (const Tile& tile : tiles)
+    {
+        if (m_CancelBake || !ok)
+            break;
+        int width, height, channels;
+        unsigned char* pixels = stbi_load(tile.file.c_str(), &width, &height, &channels, 4);
+        if (!pixels)
+        {
+            setError("cannot decode " + tile.file);
+            m_BakeDone++;
+            continue;
+        }
+        // the tiles of a set share a size, the uvs of each span it
+        std::vector<unsigned char> image, smaller;
+        if (width != tileWidth || height != tileHeight)
+        {
+            Resample(pixels, width, height, tileWidth, tileHeight, image);
+            stbi_image_free(pixels);
+            pixels = nullptr;
+            width = tileWidth;
+            height = tileHeight;
+        }
+        const unsigned char* level = pixels ? pixels : image.data();
+
+        int size = tileSize;
+        for (int m = 0; m < tileLevels && ok; m++)
+        {
+            writePages(level, width, height, m, tile.column * size / PAGE, tile.row * size / PAGE);
+            if (m + 1 == tileLevels)
+                break;
+            Downsample(level, width, height, smaller);
+            if (pixels)
+            {
+                stbi_image_free(pixels);
+                pixels = nullptr;
+            }
+            image.swap(smaller);
+            level = image.data();
+            width = (width + 1) / 2;
+            height = (height + 1) / 2;
+            size /= 2;
+        }
+        if (!composite.empty() && ok)
+        {
+            // the smallest mip is at most PAGE x PAGE, padded with its edge like the pages
+            for (int y = 0; y < PAGE; y++)
+            {
+                const unsigned char* source = level + (size_t)std::min(y, height - 1) * width * 4;
+                unsigned char* target = &composite[(((size_t)tile.row * PAGE + y) * compositeWidth + (size_t)tile.column * PAGE) * 4];
+                for (int x = 0; x < PAGE; x++)
+                    memcpy(&target[x * 4], &source[std::min(x, width - 1) * 4], 4);
+            }
+        }
+        stbi_image_free(pixels);
+        m_BakeDone++;
+    }
+
+    std::vector<unsigned char> smaller;
+    int width = compositeWidth, height = compositeHeight;
+    for (int m = tileLevels; m < levels && ok && !m_CancelBake; m++)
+    {
+        Downsample(composite.data(), width, height, smaller);
+        composite.swap(smaller);
+        width /= 2;
+        height /= 2;
+        writePages(composite.data(), width, height, m, 0, 0);
+    }
+
+    header.indexOffset = position;
+    ok = ok && !m_CancelBake && fwrite(offsets.data(), sizeof(uint64_t), offsets.size(), file) == offsets.size();
+    // the header last, a file cut short by a crash has no index and gets baked again
+    ok = ok && fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = fclose(file) == 0 && ok;
+    remove(m_CachePath.c_str());
+    ok = ok && rename(partial.c_str(), m_CachePath.c_str()) == 0;
+    if (!ok)
+    {
+        remove(partial.c_str());
+        if (!m_CancelBake)
+            setError("baking " + m_CachePath + " failed");
+        return false;
+    }
+    m_BakeDone++;
+    return true;
+}
+
+// reads the page file's header and index, sets up the GL objects and the workers, makes the
+// coarsest level resident
+bool VirtualTexture::openPages(uint64_t signature)
+{
+    FILE* file = fopen(m_CachePath.c_str(), "rb");
+    if (!file)
+        return false;
+    PageFileHeader header;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, "UVVT", 4) == 0
+        && header.version == PAGE_FILE_VERSION && header.page == PAGE && header.border == BORDER
+        && header.signature == signature && header.indexOffset != 0 && header.levels > 0
+        && header.tileWidth > 0 && header.tileHeight > 0;
+    if (!ok)
+    {
+        fclose(file);
+        return false;
+    }
+
+    int pagesX = header.tilesU * header.tileSize / PAGE, pagesY = header.tilesV * header.tileSize / PAGE;
+    m_Levels.assign(header.levels, Level());
+    m_LevelStart.assign(header.levels + 1, 0);
+    for (int m = 0; m < header.levels; m++)
+    {
+        Level& level = m_Levels[m];
+        level.pagesX = pagesX >> m;
+        level.pagesY = pagesY >> m;
+        level.table.assign((size_t)level.pagesX * level.pagesY, 0);
+        level.slot.assign(level.table.size(), -1);
+        m_LevelStart[m + 1] = m_LevelStart[m] + level.table.size();
+    }
+    m_Offsets.assign(m_LevelStart.back(), 0);
+    ok = Seek(file, header.indexOffset) && fread(m_Offsets.data(), sizeof(uint64_t), m_Offsets.size(), file) == m_Offsets.size();
+    const Level& top = m_Levels.back();
+    size_t pinned = (size_t)top.pagesX * top.pagesY;
+    if (ok && pinned + 8 > (size_t)m_SlotsPerSide * m_SlotsPerSide)
+    {
+        setError("the coarsest level alone has " + std::to_string(pinned) + " pages, the cache needs more slots");
+        ok = false;
+    }
+    if (!ok)
+    {
+        fclose(file);
+        m_Levels.clear();
+        m_Offsets.clear();
+        return false;
+    }
+    m_TileSize = header.tileSize;
+    m_TileWidth = header.tileWidth;
+    m_TileHeight = header.tileHeight;
+    m_TilesU = header.tilesU;
+    m_TilesV = header.tilesV;
+    m_Signature = signature;
+
+    // nearest everywhere, the shader fetches entries of an explicit level
+    GLCall(glGenTextures(1, &m_PageTable));
+    GLState::BindTexture(0, GL_TEXTURE_2D, m_PageTable);
+    GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST));
+    GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+    GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, header.levels - 1));
+    for (int m = 0; m < header.levels; m++)
+    {
+        GLCall(glTexImage2D(GL_TEXTURE_2D, m, GL_RGBA8, m_Levels[m].pagesX, m_Levels[m].pagesY, 0, GL_RGBA, GL_UNSIGNED_BYTE, m_Levels[m].table.data()));
+    }
+
+    // no mips, the page table picks the level; the borders keep bilinear inside a page
+    int side = m_SlotsPerSide * SLOT;
+    GLCall(glGenTextures(1, &m_Pages));
+    GLState::BindTexture(0, GL_TEXTURE_2D, m_Pages);
+    GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
+    GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+    GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+    GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+    GLCall(glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, side, side, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr));
+    GLState::BindTexture(0, GL_TEXTURE_2D, 0);
+
+    m_Slots.assign((size_t)m_SlotsPerSide * m_SlotsPerSide, Slot());
+    m_Frame = 1;
+    m_Bias = 0.0f;
+    m_Stats = Stats();
+
+    std::vector<unsigned char> pixels(PAGE_BYTES);
+    int topLevel = header.levels - 1;
+    for (int y = 0; y < top.pagesY; y++)
+    {
+        for (int x = 0; x < top.pagesX; x++)
+        {
+            uint64_t offset = m_Offsets[m_LevelStart[topLevel] + (size_t)y * top.pagesX + x];
+            if (offset == 0 || !Seek(file, offset) || fread(pixels.data(), PAGE_BYTES, 1, file) != 1)
+                std::fill(pixels.begin(), pixels.end(), (unsigned char)0);
+            int slot = takeSlot();
+            GLState::BindTexture(0, GL_TEXTURE_2D, m_Pages);
+            GLCall(glTexSubImage2D(GL_TEXTURE_2D, 0, (slot % m_SlotsPerSide) * SLOT, (slot / m_SlotsPerSide) * SLOT, SLOT, SLOT, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data()));
+            m_Slots[slot].pinned = true;
+            mapPage(PageKey(topLevel, x, y), slot);
+        }
+    }
+    GLState::BindTexture(0, GL_TEXTURE_2D, 0);
+    fclose(file);
+    m_Stats.pinned = pinned;
+
+    m_Stop = false;
+    m_ReadMs = 0.0;
+    m_Reads = 0;
+    for (int i = 0; i < m_WorkerCount; i++)
+        m_Workers.emplace_back(&VirtualTexture::workerLoop, this);
+    return true;
+}
+
+void VirtualTexture::close()
+{
+    if (m_Baker.joinable())
+    {
+        m_CancelBake = true;
+        m_Baker.join();
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Stop = true;
+    }
+    m_WorkReady.notify_all();
+    for (std::thread& worker : m_Workers)
+        worker.join();
+    m_Workers.clear();
+    m_Requests.clear();
+    m_InFlight.clear();
+    m_Loaded.clear();
+
+    for (int i = 0; i < FEEDBACK_RING; i++)
+    {
+        if (m_FeedbackFences[i])
+            glDeleteSync((GLsync)m_FeedbackFences[i]);
+        m_FeedbackFences[i] = nullptr;
+        if (m_FeedbackPbos[i])
+        {
+            GLState::ForgetBuffer(m_FeedbackPbos[i]);
+            glDeleteBuffers(1, &m_FeedbackPbos[i]);
+        }
+        m_FeedbackPbos[i] = 0;
+        m_FeedbackSize[i][0] = m_FeedbackSize[i][1] = 0;
+    }
+    if (m_PageTable)
+    {
+        GLState::ForgetTexture(m_PageTable);
+        glDeleteTextures(1, &m_PageTable);
+    }
+    if (m_Pages)
+    {
+        GLState::ForgetTexture(m_Pages);
+        glDeleteTextures(1, &m_Pages);
+    }
+    m_PageTable = 0;
+    m_Pages = 0;
+    m_Levels.clear();
+    m_Offsets.clear();
+    m_Slots.clear();
+    m_State = (int)State::Empty;
+}
+
+void VirtualTexture::workerLoop()
+{
+    FILE* file = fopen(m_CachePath.c_str(), "rb");
+    if (!file)
+        setError("cannot read " + m_CachePath);
+    while (true)
+    {
+        uint64_t page;
+        {
+            std::unique_lock<std::mutex> lock(m_Mutex);
+            m_WorkReady.wait(lock, [this] { return m_Stop || !m_Requests.empty(); });
+            if (m_Stop)
+                break;
+            page = m_Requests.back();
+            m_Requests.pop_back();
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        Loaded loaded;
+        loaded.page = page;
+        loaded.pixels.resize(PAGE_BYTES);
+        const Level& level = m_Levels[KeyLevel(page)];
+        uint64_t offset = m_Offsets[m_LevelStart[KeyLevel(page)] + (size_t)KeyY(page) * level.pagesX + KeyX(page)];
+        bool ok = file && Seek(file, offset) && fread(loaded.pixels.data(), PAGE_BYTES, 1, file) == 1;
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_ReadMs += ms;
+        m_Reads++;
+        if (ok)
+            m_Loaded.push_back(std::move(loaded));
+        else
+            m_InFlight.erase(page);
+    }
+    if (file)
+        fclose(file);
+}
+
+void VirtualTexture::update(int maxUploads)
+{
+    // a finished bake gets opened here, the GL objects belong to this thread
+    State state = getState();
+    if (state != State::Baking && m_Baker.joinable())
+    {
+        m_Baker.join();
+        if (state == State::Ready && !openPages(m_Signature))
+        {
+            setError("cannot open " + m_CachePath);
+            m_State = (int)State::Failed;
+        }
+    }
+    if (!m_PageTable)
+        return;
+    m_Frame++;
+
+    // the oldest readback, only when the GPU is done with it
+    for (int i = 0; i < FEEDBACK_RING; i++)
+    {
+        int slot = (m_FeedbackSlot + i) % FEEDBACK_RING;
+        GLsync fence = (GLsync)m_FeedbackFences[slot];
+        if (!fence)
+            continue;
+        if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+            break;
+        glDeleteSync(fence);
+        m_FeedbackFences[slot] = nullptr;
+        int width = m_FeedbackSize[slot][0], height = m_FeedbackSize[slot][1];
+        size_t bytes = (size_t)width * height * 4;
+        GLState::BindBuffer(GL_PIXEL_PACK_BUFFER, m_FeedbackPbos[slot]);
+        const void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+        if (mapped)
+        {
+            m_FeedbackPixels.assign((const unsigned char*)mapped, (const unsigned char*)mapped + bytes);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        GLState::BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        if (mapped)
+            processFeedback(m_FeedbackPixels.data(), width, height, m_FeedbackBias[slot]);
+    }
+
+    std::vector<Loaded> uploads;
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        while (!m_Loaded.empty() && (int)uploads.size() < maxUploads)
+        {
+            uploads.push_back(std::move(m_Loaded.front()));
+            m_Loaded.pop_front();
+        }
+    }
+    m_Stats.uploaded = 0;
+    for (Loaded& loaded : uploads)
+    {
+        const Level& level = m_Levels[KeyLevel(loaded.page)];
+        int slot = level.slot[(size_t)KeyY(loaded.page) * level.pagesX + KeyX(loaded.page)];
+        if (slot < 0)
+            slot = takeSlot();
+        if (slot < 0)
+        {
+            m_Stats.cacheFull++;
+        }
+        else
+        {
+            // mapPage() leaves the page table's unit empty, bound again for every page
+            GLState::BindTexture(0, GL_TEXTURE_2D, m_Pages);
+            GLCall(glTexSubImage2D(GL_TEXTURE_2D, 0, (slot % m_SlotsPerSide) * SLOT, (slot / m_SlotsPerSide) * SLOT, SLOT, SLOT, GL_RGBA, GL_UNSIGNED_BYTE, loaded.pixels.data()));
+            mapPage(loaded.page, slot);
+            m_Stats.uploaded++;
+        }
+    }
+    if (!uploads.empty())
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        for (const Loaded& loaded : uploads)
+            m_InFlight.erase(loaded.page);
+    }
+}
+
+void VirtualTexture::readFeedback(unsigned int framebuffer, int width, int height)
+{
+    if (!m_PageTable || width <= 0 || height <= 0)
+        return;
+    int slot = m_FeedbackSlot;
+    // update() didn't get to it, the GPU is that far behind: drop it rather than wait
+    if (m_FeedbackFences[slot])
+    {
+        glDeleteSync((GLsync)m_FeedbackFences[slot]);
+        m_FeedbackFences[slot] = nullptr;
+    }
+    if (!m_FeedbackPbos[slot])
+    {
+        GLCall(glGenBuffers(1, &m_FeedbackPbos[slot]));
+    }
+    GLState::BindBuffer(GL_PIXEL_PACK_BUFFER, m_FeedbackPbos[slot]);
+    if (m_FeedbackSize[slot][0] != width || m_FeedbackSize[slot][1] != height)
+    {
+        GLCall(glBufferData(GL_PIXEL_PACK_BUFFER, (size_t)width * height * 4, nullptr, GL_STREAM_READ));
+        m_FeedbackSize[slot][0] = width;
+        m_FeedbackSize[slot][1] = height;
+    }
+    GLState::BindFramebuffer(framebuffer);
+    GLCall(glPixelStorei(GL_PACK_ALIGNMENT, 1));
+    GLCall(glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr));
+    m_FeedbackFences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    m_FeedbackBias[slot] = m_Bias;
+    GLState::BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    m_FeedbackSlot = (slot + 1) % FEEDBACK_RING;
+}
+
+// every page the frame samples and its ancestors are kept, the ones missing get requested,
+// coarsest first: a level that is there soon beats a sharp one that is there late
+void VirtualTexture::processFeedback(const unsigned char* rgba, int width, int height, float bias)
+{
+    std::unordered_set<uint64_t> seen;
+    std::vector<uint64_t> wanted;
+    int levels = (int)m_Levels.size();
+    size_t pixels = (size_t)width * height;
+    for (size_t i = 0; i < pixels; i++)
+    {
+        const unsigned char* p = &rgba[i * 4];
+        if (p[3] == 0)
+            continue;
+        int level = std::min(p[3] - 1, levels - 1);
+        int x = p[0] | ((p[2] & 15) << 8), y = p[1] | ((p[2] >> 4) << 8);
+        for (; level < levels; level++, x /= 2, y /= 2)
+        {
+            const Level& l = m_Levels[level];
+            if (x >= l.pagesX || y >= l.pagesY)
+                break;
+            uint64_t key = PageKey(level, x, y);
+            if (!seen.insert(key).second)
+                break;
+            size_t index = (size_t)y * l.pagesX + x;
+            if (l.slot[index] >= 0)
+                m_Slots[l.slot[index]].lastUsed = m_Frame;
+            else if (m_Offsets[m_LevelStart[level] + index] != 0)
+                wanted.push_back(key);
+        }
+    }
+    std::sort(wanted.begin(), wanted.end(), [](uint64_t a, uint64_t b) { return KeyLevel(a) < KeyLevel(b); });
+
+    size_t queued;
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        // what was not picked up yet is replaced, the view has moved on
+        for (uint64_t page : m_Requests)
+            m_InFlight.erase(page);
+        m_Requests.clear();
+        size_t budget = MAX_IN_FLIGHT > m_InFlight.size() ? MAX_IN_FLIGHT - m_InFlight.size() : 0;
+        std::vector<uint64_t> picked;
+        for (auto it = wanted.rbegin(); it != wanted.rend() && picked.size() < budget; ++it)
+        {
+            if (m_InFlight.insert(*it).second)
+                picked.push_back(*it);
+        }
+        m_Requests.assign(picked.rbegin(), picked.rend());
+        queued = m_InFlight.size();
+    }
+    m_WorkReady.notify_all();
+
+    m_Stats.requested = seen.size();
+    m_Stats.missing = wanted.size();
+    m_Stats.queued = queued;
+
+    // More pages than slots would evict what the frame itself samples and read them again
+    // every frame; a level coarser quarters them. Finer again only once that would fit with
+    // room to spare. A readback drawn before the last change says nothing about the new bias.
+    if (bias == m_Bias)
+    {
+        if (seen.size() > m_Slots.size() * 7 / 8 && m_Bias < levels - 1)
+            m_Bias += 1.0f;
+        else if (m_Bias > 0.0f && seen.size() * 4 < m_Slots.size() / 2)
+            m_Bias -= 1.0f;
+    }
+    m_Stats.lodBias = m_Bias;
+}
+
+// a free slot, else the least recently used one the last feedback didn't ask for
+int VirtualTexture::takeSlot()
+{
+    int best = -1;
+    for (int i = 0; i < (int)m_Slots.size(); i++)
+    {
+        const Slot& slot = m_Slots[i];
+        if (slot.page == UINT64_MAX)
+            return i;
+        if (slot.pinned || slot.lastUsed >= m_Frame)
+            continue;
+        if (best < 0 || slot.lastUsed < m_Slots[best].lastUsed)
+            best = i;
+    }
+    if (best >= 0)
+    {
+        unmapPage(m_Slots[best].page);
+        m_Stats.evictions++;
+    }
+    return best;
+}
+
+void VirtualTexture::mapPage(uint64_t page, int slot)
+{
+    Level& level = m_Levels[KeyLevel(page)];
+    level.slot[(size_t)KeyY(page) * level.pagesX + KeyX(page)] = slot;
+    m_Slots[slot].page = page;
+    m_Slots[slot].lastUsed = m_Frame;
+    m_Stats.resident++;
+    updateTable(KeyLevel(page), KeyX(page), KeyY(page));
+}
+
+void VirtualTexture::unmapPage(uint64_t page)
+{
+    Level& level = m_Levels[KeyLevel(page)];
+    int& slot = level.slot[(size_t)KeyY(page) * level.pagesX + KeyX(page)];
+    m_Slots[slot].page = UINT64_MAX;
+    slot = -1;
+    m_Stats.resident--;
+    updateTable(KeyLevel(page), KeyX(page), KeyY(page));
+}
+
+// An entry holds the slot of the nearest resident page at or above it, so a page going in or
+// out of the cache changes only the entries below it that reach it through pages that aren't
+// resident. Those are rewritten level by level top down, a resident page stops the descent, and
+// each level uploads the rectangle around what changed straight from its table.
+void VirtualTexture::updateTable(int level, int x, int y)
+{
+    std::vector<int> pages = { x, y }, children;
+    GLState::BindTexture(0, GL_TEXTURE_2D, m_PageTable);
+    GLCall(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+    for (int k = level; k >= 0 && !pages.empty(); k--)
+    {
+        Level& l = m_Levels[k];
+        int x0 = INT_MAX, y0 = INT_MAX, x1 = -1, y1 = -1;
+        children.clear();
+        for (size_t p = 0; p < pages.size(); p += 2)
+        {
+            int px = pages[p], py = pages[p + 1];
+            size_t index = (size_t)py * l.pagesX + px;
+            uint32_t entry = 0;
+            int slot = l.slot[index];
+            if (slot >= 0)
+                entry = (uint32_t)(slot % m_SlotsPerSide) | ((uint32_t)(slot / m_SlotsPerSide) << 8) | ((uint32_t)k << 16) | (255u << 24);
+            else if (k + 1 < (int)m_Levels.size())
+            {
+                const Level& parent = m_Levels[k + 1];
+                entry = parent.table[(size_t)(py / 2) * parent.pagesX + px / 2];
+            }
+            l.table[index] = entry;
+            x0 = std::min(x0, px);
+            y0 = std::min(y0, py);
+            x1 = std::max(x1, px);
+            y1 = std::max(y1, py);
+
+            if (k == 0)
+                continue;
+            const Level& finer = m_Levels[k - 1];
+            for (int c = 0; c < 4; c++)
+            {
+                int cx = px * 2 + (c & 1), cy = py * 2 + (c >> 1);
+                if (cx < finer.pagesX && cy < finer.pagesY && finer.slot[(size_t)cy * finer.pagesX + cx] < 0)
+                {
+                    children.push_back(cx);
+                    children.push_back(cy);
+                }
+            }
+        }
+        GLCall(glPixelStorei(GL_UNPACK_ROW_LENGTH, l.pagesX));
+        GLCall(glTexSubImage2D(GL_TEXTURE_2D, k, x0, y0, x1 - x0 + 1, y1 - y0 + 1, GL_RGBA, GL_UNSIGNED_BYTE, &l.table[(size_t)y0 * l.pagesX + x0]));
+        pages.swap(children);
+    }
+    GLCall(glPixelStorei(GL_UNPACK_ROW_LENGTH, 0));
+    GLState::BindTexture(0, GL_TEXTURE_2D, 0);
+}
+
+void VirtualTexture::setDrawParams(SurfaceParams& params, float lodBias) const
+{
+    if (m_Levels.empty())
+        return;
+    params.virtualPages = glm::vec2((float)m_TileWidth, (float)m_TileHeight) / (float)PAGE;
+    params.virtualLevels = (float)m_Levels.size();
+    params.virtualLodBias = lodBias + m_Bias;
+    params.virtualTiles = glm::vec2((float)m_TilesU, (float)m_TilesV);
+    params.virtualTilePages = (float)(m_TileSize / PAGE);
+    params.virtualCacheSize = (float)(m_SlotsPerSide * SLOT);
+}
+
+size_t VirtualTexture::getGpuBytes() const
+{
+    size_t bytes = m_Slots.size() * PAGE_BYTES;
+    for (const Level& level : m_Levels)
+        bytes += level.table.size() * 4;
+    return bytes;
+}
+
+// the first error since open() stays, later ones tend to follow from it
+void VirtualTexture::setError(const std::string& error)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if (m_Error.empty())
+        m_Error = error;
+}
+
+std::string VirtualTexture::getError()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Error;
+}
+
+VirtualTexture::Stats VirtualTexture::getStats()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    Stats stats = m_Stats;
+    stats.readMs = m_Reads ? m_ReadMs / m_Reads : 0.0;
+    return stats;
+}
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+struct SurfaceParams;
+
+// A texture too large to upload, streamed in pages. The source (one image, or a UDIM set when
+// the path holds <UDIM>) is baked once into a page file next to it: every mip level cut into
+// PAGE x PAGE pages with a BORDER of neighbouring texels, so bilinear filtering never reads
+// across pages. Each tile gets a power of two square of pages and keeps its own size in it, the
+// pages past its edge are never written. At runtime only a fixed cache of page slots lives on the GPU, addressed through
+// a page table texture with a texel per page of every level; a page that is not resident points
+// at its nearest resident ancestor. The pages of the coarsest level stay resident, so every
+// lookup finds something.
+//
+// What to load comes from a feedback pass: the mesh drawn at 1 / FEEDBACK_SCALE of the screen
+// with vtFeedback.hlsl writes the page each pixel wants, the target is read back through pixel
+// pack buffers a frame late, so nothing waits on the GPU. Worker threads read the wanted pages
+// from the page file, update() uploads a bounded number per frame into the least recently used
+// slots. Memory is the slot cache plus the page table, whatever the size of the source. When
+// the pages a frame samples don't fit the cache, the levels are biased coarser until they do.
+class VirtualTexture
+{
+public:
+	static const int PAGE = 128;
+	static const int BORDER = 4;
+	static const int SLOT = PAGE + 2 * BORDER;
+	static const int FEEDBACK_SCALE = 8;
+	static const int FEEDBACK_RING = 2;
+
+	enum class State { Empty, Baking, Ready, Failed };
+
+	struct Stats
+	{
+		size_t resident = 0;
+		size_t pinned = 0;     // coarsest level, never evicted
+		size_t requested = 0;  // distinct pages in the last feedback
+		size_t missing = 0;    // of those, not resident
+		size_t uploaded = 0;   // last update()
+		size_t queued = 0;     // waiting for a worker or for upload
+		size_t evictions = 0;  // since open()
+		size_t cacheFull = 0;  // loads dropped because every slot was needed by the frame
+		float lodBias = 0.0f;  // levels added because the cache is too small for the view
+		double readMs = 0.0;   // average worker read of a page
+	};
+
+private:
+	// page table entries and residency, per level, index y * pagesX(level) + x
+	struct Level
+	{
+		int pagesX, pagesY;
+		std::vector<uint32_t> table; // r, g: slot; b: level of the page the slot holds; a: 255 = valid
+		std::vector<int> slot;       // -1 = not resident
+	};
+
+	struct Slot
+	{
+		uint64_t page = UINT64_MAX; // key of the page it holds
+		unsigned int lastUsed = 0;  // frame
+		bool pinned = false;
+	};
+
+	struct Loaded
+	{
+		uint64_t page;
+		std::vector<unsigned char> pixels;
+	};
+
+	// a source image, UDIM 1001 + column + 10 * row
+	struct Tile
+	{
+		std::string file;
+		int column, row;
+	};
+
+	std::string m_Path, m_CachePath;
+	std::atomic<int> m_State;
+	std::atomic<int> m_BakeDone, m_BakeTotal;
+	std::atomic<bool> m_CancelBake;
+	std::thread m_Baker;
+
+	// from the page file header
+	int m_TileSize, m_TilesU, m_TilesV; // m_TileSize: the page table's square per tile
+	int m_TileWidth, m_TileHeight;      // texels of a tile, from the top left of its square
+	std::vector<Level> m_Levels;
+	std::vector<uint64_t> m_Offsets;  // in the page file, 0 = no source texels there
+	std::vector<size_t> m_LevelStart; // first page of each level in m_Offsets
+	uint64_t m_Signature;
+
+	int m_SlotsPerSide, m_WorkerCount;
+	std::vector<Slot> m_Slots;
+	unsigned int m_PageTable, m_Pages;
+	unsigned int m_Frame;
+	float m_Bias;
+
+	unsigned int m_FeedbackPbos[FEEDBACK_RING];
+	void* m_FeedbackFences[FEEDBACK_RING]; // GLsync
+	int m_FeedbackSize[FEEDBACK_RING][2];
+	float m_FeedbackBias[FEEDBACK_RING]; // the bias it was drawn with
+	int m_FeedbackSlot;
+	std::vector<unsigned char> m_FeedbackPixels;
+
+	std::vector<std::thread> m_Workers;
+	std::mutex m_Mutex;
+	std::condition_variable m_WorkReady;
+	std::vector<uint64_t> m_Requests; // coarsest last, workers take from the back
+	std::unordered_set<uint64_t> m_InFlight; // requested, read or waiting for upload
+	std::deque<Loaded> m_Loaded;
+	bool m_Stop;
+	double m_ReadMs;
+	size_t m_Reads;
+
+	Stats m_Stats;
+	std::string m_Error;
+
+	bool bake(const std::vector<Tile>& tiles, uint64_t signature);
+	bool openPages(uint64_t signature);
+	void close();
+	void workerLoop();
+	void processFeedback(const unsigned char* rgba, int width, int height, float bias);
+	int takeSlot();
+	void mapPage(uint64_t page, int slot);
+	void unmapPage(uint64_t page);
+	void updateTable(int level, int x, int y);
+	void setError(const std::string& error);
+
+public:
+	VirtualTexture();
+	~VirtualTexture();
+
+	// bakes the page file on a thread of its own when it is missing or older than the source,
+	// then starts streaming; slotsPerSide^2 pages fit in the cache
+	bool open(const std::string& path, int slotsPerSide = 16, int workers = 2);
+	State getState() const { return (State)m_State.load(); }
+	bool isReady() const { return getState() == State::Ready && m_PageTable != 0; }
+	float getBakeProgress() const;
+
+	// once per frame before drawing: finishes opening after a bake, uploads loaded pages
+	void update(int maxUploads = 32);
+	// after the feedback pass was drawn into framebuffer, width x height pixels
+	void readFeedback(unsigned int framebuffer, int width, int height);
+	// the virtual fields of the params, lodBias in mip levels on top of the cache's own
+	void setDrawParams(SurfaceParams& params, float lodBias) const;
+
+	unsigned int getPageTable() const { return m_PageTable; }
+	unsigned int getPages() const { return m_Pages; }
+	const std::string& getPath() const { return m_Path; }
+	const std::string& getCachePath() const { return m_CachePath; }
+	int getTileSize() const { return m_TileSize; }
+	int getTileWidth() const { return m_TileWidth; }
+	int getTileHeight() const { return m_TileHeight; }
+	int getTilesU() const { return m_TilesU; }
+	int getTilesV() const { return m_TilesV; }
+	int getLevelCount() const { return (int)m_Levels.size(); }
+	int getSlotCount() const { return (int)m_Slots.size(); }
+	size_t getGpuBytes() const;
+	Stats getStats();
+	// what went wrong since open(), empty when nothing did; a failed state always has one
+	std::string getError();
+};
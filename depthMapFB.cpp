@@ -2,34 +2,38 @@
 #include <gl/glew.h>
 
 #include "DepthMapFB.h"
+#include "Renderer.h"
+#include "GLState.h"
 
 
 DepthMapFB::DepthMapFB()
+	: m_Texture(nullptr)
 {
 	glGenFramebuffers(1, &m_RendererID);
 }
 
 void DepthMapFB::attachTexture(const DepthTexture& tex)
 {
-	glBindFramebuffer(GL_FRAMEBUFFER, m_RendererID);
+	m_Texture = &tex;
+	GLState::BindFramebuffer(m_RendererID);
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, tex.getID(), 0);
 	glDrawBuffer(GL_NONE);
 	glReadBuffer(GL_NONE);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);	
+	GLState::BindFramebuffer(0);	
 }
 
 void DepthMapFB::bind() const
 {
-	glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-	glBindFramebuffer(GL_FRAMEBUFFER, m_RendererID);
+	GLState::Viewport(0, 0, getWidth(), getHeight());
+	GLState::BindFramebuffer(m_RendererID);
 }
 
 void DepthMapFB::unBind() const
 {
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLState::BindFramebuffer(0);
 }
 
 void DepthMapFB::clear()
 {
-	glClear(GL_DEPTH_BUFFER_BIT);
+	GLCall(glClear(GL_DEPTH_BUFFER_BIT));
 }
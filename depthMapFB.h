@@ -2,16 +2,17 @@
 
 #include "DepthTexture.h"
 
-
-const unsigned int SHADOW_WIDTH = 1024, SHADOW_HEIGHT = 1024;
-
 class DepthMapFB
 {
 private:
 	unsigned int m_RendererID;
+	const DepthTexture* m_Texture; // viewport size follows it, also after a resize
 
 public:
 	DepthMapFB();
+	unsigned int getID() const { return m_RendererID; }
+	unsigned int getWidth() const { return m_Texture ? m_Texture->getWidth() : 0; }
+	unsigned int getHeight() const { return m_Texture ? m_Texture->getHeight() : 0; }
 	void attachTexture(const DepthTexture& tex);
 	void bind() const;
 	void unBind() const;
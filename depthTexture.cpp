@@ -2,23 +2,49 @@
 #include "vendor/stb_image/stb_image.h"
 #include <GL/glew.h>
 #include "Renderer.h"
+#include "GLState.h"
 
-const unsigned int SHADOW_WIDTH = 1024, SHADOW_HEIGHT = 1024;
+static GLenum internalFormat(DepthFormat format)
+{
+	switch (format)
+	{
+	case DepthFormat::Depth16: return GL_DEPTH_COMPONENT16;
+	case DepthFormat::Depth32F: return GL_DEPTH_COMPONENT32F;
+	default: return GL_DEPTH_COMPONENT24;
+	}
+}
 
-DepthTexture::DepthTexture()
+DepthTexture::DepthTexture(unsigned int width, unsigned int height, DepthFormat format)
+	: m_RendererID(0), m_Width(0), m_Height(0), m_Format(format)
 {
 	glGenTextures(1, &m_RendererID);
-	glBindTexture(GL_TEXTURE_2D, m_RendererID);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT,
-		SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	GLState::BindTexture(0, GL_TEXTURE_2D, m_RendererID);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	// everything outside the fitted light frustum is lit
+	float border[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, border);
+	resize(width, height, format);
+}
+
+void DepthTexture::resize(unsigned int width, unsigned int height, DepthFormat format)
+{
+	if (width == m_Width && height == m_Height && format == m_Format && m_Width > 0)
+		return;
+	m_Width = width;
+	m_Height = height;
+	m_Format = format;
+
+	GLState::BindTexture(0, GL_TEXTURE_2D, m_RendererID);
+	GLCall(glTexImage2D(GL_TEXTURE_2D, 0, internalFormat(format),
+		width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL));
 }
 
 DepthTexture::~DepthTexture()
 {
+	GLState::ForgetTexture(m_RendererID);
 	glDeleteTextures(1, &m_RendererID);
 }
 
@@ -29,8 +55,7 @@ unsigned int DepthTexture::getID() const
 
 void DepthTexture::Bind(unsigned int slot) const
 {
-	GLCall(glActiveTexture(GL_TEXTURE0 + slot));
-	GLCall(glBindTexture(GL_TEXTURE_2D, m_RendererID));
+	GLState::BindTexture(slot, GL_TEXTURE_2D, m_RendererID);
 }
 
 
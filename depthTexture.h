@@ -1,13 +1,23 @@
 #pragma once
 
+enum class DepthFormat { Depth16, Depth24, Depth32F };
+
 class DepthTexture
 {
 private:
 	unsigned int m_RendererID;
+	unsigned int m_Width, m_Height;
+	DepthFormat m_Format;
 public:
-	DepthTexture();
+	DepthTexture(unsigned int width = 1024, unsigned int height = 1024, DepthFormat format = DepthFormat::Depth24);
 	~DepthTexture();
 
+	// reallocates the storage, framebuffers keep the attachment
+	void resize(unsigned int width, unsigned int height, DepthFormat format);
+
 	unsigned int getID() const;
+	unsigned int getWidth() const { return m_Width; }
+	unsigned int getHeight() const { return m_Height; }
+	DepthFormat getFormat() const { return m_Format; }
 	void Bind(unsigned int slot = 0) const;
-};
\ No newline at end of file
+};
@@ -1,7 +1,8 @@
-#pragma once
-
 #include "directionalLight.h"
 
+#include <algorithm>
+#include <cmath>
+
 DirectionalLight::DirectionalLight(glm::vec3 dir, glm::vec3 amb, glm::vec3 diff, glm::vec3 spec):
 	direction(dir),
 	ambient(amb),
@@ -18,3 +19,31 @@ void DirectionalLight::setUniform(const Shader& shader) const
 	shader.SetUniformVec3f("u_DirLight.diffuse", diffuse);
 	shader.SetUniformVec3f("u_DirLight.specular", specular);
 }
+
+void DirectionalLight::fitShadow(const BoundingSphere& casters, const BoundingSphere& receivers, unsigned int mapSize,
+	glm::mat4& view, glm::mat4& projection, float& depthRange) const
+{
+	glm::vec3 dir = glm::normalize(direction);
+	glm::vec3 up = std::abs(dir.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+	// rotation only, the frustum position goes into the projection where it can be snapped
+	view = glm::lookAt(glm::vec3(0.0f), dir, up);
+
+	float radius = std::max(casters.radius, 1e-4f);
+	glm::vec3 center = glm::vec3(view * glm::vec4(casters.center, 1.0f));
+	float texel = 2.0f * radius / (float)mapSize;
+	center.x = std::floor(center.x / texel) * texel;
+	center.y = std::floor(center.y / texel) * texel;
+	radius += texel; // the snap moved the center by up to a texel
+
+	// view space looks down -z, so depth along the light is -z
+	float nearPlane = -center.z - radius;
+	float farPlane = -center.z + radius;
+	if (receivers.radius >= 0.0f)
+	{
+		float receiverDepth = -glm::vec3(view * glm::vec4(receivers.center, 1.0f)).z;
+		farPlane = std::max(farPlane, receiverDepth + receivers.radius);
+	}
+
+	projection = glm::ortho(center.x - radius, center.x + radius, center.y - radius, center.y + radius, nearPlane, farPlane);
+	depthRange = farPlane - nearPlane;
+}
@@ -2,6 +2,7 @@
 
 #include <glm/glm.hpp>
 #include "Shader.h"
+#include "BoundingVolume.h"
 
 class DirectionalLight
 {
@@ -14,5 +15,12 @@ class DirectionalLight
 public:
     DirectionalLight(glm::vec3 dir, glm::vec3 amb, glm::vec3 diff, glm::vec3 spec);
     void setUniform(const Shader& shader) const;
+    const glm::vec3& getDirection() const { return direction; }
+
+    // Orthographic shadow frustum around the casters, deep enough to reach the receivers.
+    // Shadows never leave the casters' footprint, so the receivers only extend the depth range.
+    // The window moves in whole texels so the edges don't shimmer while the bounds change.
+    void fitShadow(const BoundingSphere& casters, const BoundingSphere& receivers, unsigned int mapSize,
+        glm::mat4& view, glm::mat4& projection, float& depthRange) const;
 
 };
\ No newline at end of file
@@ -2,7 +2,13 @@
 #include <glm/geometric.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <GLFW/glfw3.h>
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstring>
 #include <iostream>
+#include <memory>
 #include <imgui.h>
 #include <backends/imgui_impl_glfw.h>
 #include <backends/imgui_impl_opengl3.h>
@@ -16,6 +22,30 @@
 #include "directionalLight.h"
 #include "depthMapFB.h"
 #include "depthTexture.h"
+#include "Arena.h"
+#include "Renderer.h"
+#include "GLState.h"
+#include "Gallery.h"
+#include "Frustum.h"
+#include "MorphFeedback.h"
+#include "Headless.h"
+#include "Recorder.h"
+#include "OffscreenTarget.h"
+#include "UVIslands.h"
+#include "UVRasterizer.h"
+#include "UVCoverage.h"
+#include "UVOverlaps.h"
+#include "UVDistortion.h"
+#include "UVSeams.h"
+#include "FaceAttributeBuffer.h"
+#include "MeshBvh.h"
+#include "ArapMorph.h"
+#include "ExplodedMorph.h"
+#include "MeshSimplifier.h"
+#include "EditableMesh.h"
+#include "MaterialTextures.h"
+#include "VirtualTexture.h"
+#include "Utils.h"
 
 const unsigned int SCR_WIDTH = 960;
 const unsigned int SCR_HEIGHT = 540;
@@ -36,20 +66,23 @@ void renderQuad()
         // setup plane VAO
         glGenVertexArrays(1, &quadVAO);
         glGenBuffers(1, &quadVBO);
-        glBindVertexArray(quadVAO);
-        glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+        GLState::BindVertexArray(quadVAO);
+        GLState::BindBuffer(GL_ARRAY_BUFFER, quadVBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
         glEnableVertexAttribArray(0);
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
         glEnableVertexAttribArray(1);
         glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
     }
-    glBindVertexArray(quadVAO);
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-    glBindVertexArray(0);
+    GLState::BindVertexArray(quadVAO);
+    GLCall(glDrawArrays(GL_TRIANGLE_STRIP, 0, 4));
 }
 
-int main() {
+int main(int argc, char** argv) {
+
+    HeadlessOptions headless;
+    if (ParseHeadlessArgs(argc, argv, headless))
+        return RunHeadless(headless);
 
     GLFWwindow* window;
 
@@ -65,6 +98,9 @@ int main() {
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifndef NDEBUG
+    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GLFW_TRUE);
+#endif
 
     /* Create a windowed mode window and its OpenGL context */
     window = glfwCreateWindow(960, 540, "Hello World", NULL, NULL);
@@ -84,9 +120,17 @@ int main() {
 
     std::cout << glGetString(GL_VERSION) << std::endl;
 
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA); // it defines how opengl blend alpha pixels
-    glEnable(GL_DEPTH_TEST);
+#ifdef NDEBUG
+    // release: asynchronous callback for the first frames only
+    GLDebug::Init(GLErrorMode::Callback);
+    GLDebug::ValidateFrames(120);
+#else
+    GLDebug::Init(GLErrorMode::CallbackSync);
+#endif
+
+    GLState::SetEnabled(GL_BLEND, true);
+    GLState::BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA); // it defines how opengl blend alpha pixels
+    GLState::SetEnabled(GL_DEPTH_TEST, true);
     //glEnable(GL_FRAMEBUFFER_SRGB);// gamma correction
 
     // imgui
@@ -116,7 +160,13 @@ int main() {
     //mesh.buildPlane();
     //mesh.importOBJ("res/models/cylinder/cylinder.obj");
     //mesh.exportOBJ("res/models/plane/plane.obj");
-    mesh.importOBJ("res/models/_Wheel_195_50R13x10_OBJ/wheel.obj");
+    const char* modelPath = "res/models/_Wheel_195_50R13x10_OBJ/wheel.obj";
+    mesh.importOBJ(modelPath);
+    // the levels of detail take seconds on large scans, the full mesh draws until they are done
+    MeshSimplifier simplifier;
+    simplifier.start(mesh);
+    UVIslands islands;
+    islands.build(mesh);
     Camera camera;
     Shader depthShader("res/shaders/simpleDepthShader.hlsl");
     Shader quadShader("res/shaders/quad.hlsl");
@@ -124,6 +174,12 @@ int main() {
     Shader shader("res/shaders/basic.hlsl");
     MeshGl meshGl;
     meshGl = mesh.bake();
+    MorphFeedback morph;
+    morph.setup(mesh);
+    bool gpuMorph = true;
+    ArapMorph arap(mesh);
+    ExplodedMorph exploded; // set up on first use
+    int morphMode = 0; // 0 linear, 1 as rigid as possible, 2 exploded
     float scalingFactor = 1.0 / mesh.boundingSphere.radius * 2.0f;
     meshGl.model = glm::scale(meshGl.model, glm::vec3(scalingFactor, scalingFactor, scalingFactor));
 
@@ -137,22 +193,120 @@ int main() {
     shader.Bind();
     dirLight.setUniform(shader); // TODO: refactor
     shader.SetUniform1f("material.shininess", 32.0f);
-    shader.SetUniformVec3f("u_ViewPos", camera.GetPos());
-    shader.SetUniformMat4f("u_Proj", proj);
 
     Texture texture("res/models/_Wheel_195_50R13x10_OBJ/diffuse.png");
     Texture floorTexture("res/models/plane/Prototype_Grid_Gray_08-512x512.png");
     shader.SetUniform1i("u_Texture", 0); // slot of the texture
 
+    // the file's own materials, one texture layer each; the plain texture stays for files without maps
+    MaterialTextures materials;
+    char textureSet[64] = "";
+    materials.load(mesh, textureSet);
+    bool useMaterials = true;
+
+    // the color of the mesh streamed in pages, for sources too large to upload; opened from the UI,
+    // the first open bakes the page file
+    VirtualTexture virtualTexture;
+    char virtualPath[256] = "res/models/_Wheel_195_50R13x10_OBJ/diffuse.png";
+    const int virtualCacheSizes[] = { 8, 16, 24, 32 };
+    int virtualCacheIndex = 1;
+    int virtualUploads = 32;
+    bool useVirtualTexture = true;
+    Shader feedbackShader("res/shaders/vtFeedback.hlsl");
+    OffscreenTarget feedbackTarget(SCR_WIDTH / VirtualTexture::FEEDBACK_SCALE, SCR_HEIGHT / VirtualTexture::FEEDBACK_SCALE);
+    CommandList feedbackList;
+
+    Shader galleryShader("res/shaders/gallery.hlsl");
+    Shader galleryDepthShader("res/shaders/galleryDepth.hlsl");
+    galleryShader.Bind();
+    dirLight.setUniform(galleryShader);
+    Gallery gallery;
+    bool galleryMode = false;
+    char galleryPath[256] = "res/models/_Wheel_195_50R13x10_OBJ/wheel.obj";
+
     DepthMapFB depthFB;
     DepthTexture depthMap;
     depthFB.attachTexture(depthMap);
+    const unsigned int shadowSizes[] = { 256, 512, 1024, 2048, 4096 };
+    int shadowSizeIndex = 2;
+    int shadowFormatIndex = (int)DepthFormat::Depth24;
+    int pcfRadius = 1;
+    bool shadows = true;
 
     float textureColorMode = 0.5;
     float textureGridMode = 0.5;
     float interpolation = 0.0;
     float interpolationSpeed = 1.0;
-    
+    float uploadedInterpolation = -1.0;
+    bool showDepthMap = false;
+
+    Renderer renderer;
+    CommandList shadowList;
+    CommandList sceneList;
+
+    // interpolation sweeps rendered at a fixed resolution and written out frame by frame
+    Recorder recorder;
+    RecordSettings recordSettings;
+    char recordPath[256] = "capture";
+    const int recordSizes[][2] = { { 960, 540 }, { 1280, 720 }, { 1920, 1080 } };
+    int recordSizeIndex = 1;
+    std::unique_ptr<OffscreenTarget> recordTarget;
+
+    UVRasterSettings uvLayout;
+    const int uvLayoutSizes[] = { 1024, 2048, 4096, 8192, 16384 };
+    int uvLayoutSizeIndex = 1;
+    char uvLayoutPath[256] = "uv_layout.png";
+    UVLayoutExport uvLayoutExport;
+
+    // texture budget: how much of the texture the layout uses, at the texture's own size
+    UVCoverage coverage(mesh, islands);
+    int coverageSize[2] = { 4096, 4096 };
+    if (texture.GetWidth() > 0)
+    {
+        coverageSize[0] = texture.GetWidth();
+        coverageSize[1] = texture.GetHeight();
+    }
+    Texture coveragePreview;
+    std::vector<int> wastefulIslands;
+    char coverageReportPath[256] = "uv_coverage.json";
+
+    // overlapping and flipped uv faces, highlighted on the mesh through a per-face buffer
+    UVOverlaps overlaps(mesh, islands);
+    FaceAttributeBuffer faceFlags;
+    bool showOverlaps = true;
+    char overlapReportPath[256] = "uv_overlaps.json";
+
+    // per-face distortion of the uv map as a heatmap on the mesh, takes over from the overlap highlight
+    UVDistortion distortion(mesh);
+    FaceAttributeBuffer distortionValues;
+    int distortionMetric = 0;
+    bool showDistortion = true;
+    float distortionRange = 2.0f;
+
+    // uv seams, borders and the wireframe drawn by the mesh's own shader, no second pass
+    UVSeams seams(mesh);
+    FaceAttributeBuffer seamFlags;
+    bool showWireframe = false, showSeams = true, showBorders = true;
+    float edgeWidth = 1.5f;
+
+    // right click picks a face of the morphing mesh, the tree is built on the first pick
+    MeshBvh meshBvh(mesh);
+    MeshHit picked;
+    double pickMs = 0.0;
+
+    // edits of the picked face keep the linear morph's analysis current, see EditableMesh; what
+    // is built from the mesh once (the tree, the other morphs) is redone when next used
+    EditableMesh editable(mesh);
+    bool bvhStale = false, arapStale = false, explodedStale = false;
+
+    // while the camera or t moves, the mesh draws at the finest level within the preview budget,
+    // in full once both rested for a moment
+    bool previewLods = true;
+    int previewFaces = 250000;
+    glm::mat4 lastView(0.0f);
+    float lastInterpolation = -1.0f;
+    float lastMotion = -1.0f;
+
 
     float deltaTime = 0.0f;
     float lastFrame = 0.0f; // Time of last frame
@@ -163,8 +317,8 @@ int main() {
     // ********************* Renderer Loop ********************* //
     while (!glfwWindowShouldClose(window))
     {
-        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        MemoryStats::BeginFrame();
+        renderer.BeginFrame();
 
         float currentFrame = glfwGetTime();
         deltaTime = currentFrame - lastFrame;
@@ -172,57 +326,273 @@ int main() {
 
         camera.ProcessKeyboardInput(deltaTime, window);
         view = camera.GetView();
+        glm::vec3 viewPos = camera.GetPos();
+        glm::mat4 sceneProj = proj;
+
+        // the recorder drives t (and maybe the camera) for the frame it is about to capture
+        bool recording = recorder.isRecording();
+        if (recording)
+            interpolation = recorder.interpolationAt(recorder.getFrame());
 
         shader.Bind();
-        shader.SetUniformMat4f("u_View", view);
         shader.SetUniform1f("u_TextureColorMode", textureColorMode);
         shader.SetUniform1f("u_TextureGridMode", textureGridMode);
-        shader.SetUniformVec3f("u_ViewPos", camera.GetPos());
-
-        // shadows
-        float near_plane = 1.0f, far_plane = 7.5f;
-        glm::mat4 lightProjection = glm::ortho(-10.0f, 10.0f, -10.0f, 10.0f, near_plane, far_plane);
-        glm::mat4 lightView = glm::lookAt(glm::vec3(-2.0f, 4.0f, -1.0f),
-            glm::vec3(0.0f, 0.0f, 0.0f),
-            glm::vec3(0.0f, 1.0f, 0.0f));
+        galleryShader.Bind();
+        galleryShader.SetUniform1f("u_TextureGridMode", textureGridMode);
+
+        // main mesh, morphed once per change of t before any pass reads it
+        if (morphMode == 1)
+        {
+            if (interpolation != uploadedInterpolation)
+            {
+                bool withNormals = mesh.normal.size() == mesh.vertexCount();
+                ArenaVector<glm::vec3> positions(mesh.vertexCount(), glm::vec3(0.0f), ArenaAllocator<glm::vec3>(Arena::Frame()));
+                ArenaVector<glm::vec3> normals(withNormals ? mesh.vertexCount() : 0, glm::vec3(0.0f), ArenaAllocator<glm::vec3>(Arena::Frame()));
+                arap.interpolate(interpolation, positions.data(), withNormals ? normals.data() : nullptr);
+                meshGl.updatePositions(positions.data(), positions.size());
+                if (withNormals)
+                    meshGl.updateNormals(normals.data(), normals.size());
+                uploadedInterpolation = interpolation;
+            }
+        }
+        else if (morphMode == 2)
+        {
+            exploded.run(interpolation);
+        }
+        else if (gpuMorph)
+        {
+            morph.run(interpolation, meshGl);
+        }
+        else if (interpolation != uploadedInterpolation)
+        {
+            ArenaVector<glm::vec3> interpolated(mesh.vertexCount(), glm::vec3(0.0f), ArenaAllocator<glm::vec3>(Arena::Frame()));
+            mesh.interpolate(interpolation, interpolated.data());
+            meshGl.updatePositions(interpolated.data(), interpolated.size());
+            if (mesh.normal.size() == mesh.vertexCount())
+            {
+                mesh.interpolateNormals(interpolation, interpolated.data());
+                meshGl.updateNormals(interpolated.data(), interpolated.size());
+            }
+            uploadedInterpolation = interpolation;
+        }
+
+        simplifier.apply(mesh, meshGl);
+        bool moving = view != lastView || interpolation != lastInterpolation;
+        lastView = view;
+        lastInterpolation = interpolation;
+        if (moving)
+            lastMotion = currentFrame;
+        unsigned int previewLod = 0;
+        if (previewLods && !recording && currentFrame - lastMotion < 0.25f)
+        {
+            while (previewLod + 1 < meshGl.getLodCount() && meshGl.getLodIndexCount(previewLod) / 3 > (unsigned int)previewFaces)
+                previewLod++;
+        }
+
+        // without feedback nothing gets loaded, this only finishes a bake then
+        virtualTexture.update(virtualUploads);
+        // the material maps take precedence
+        bool virtualTextured = useVirtualTexture && virtualTexture.isReady() && !galleryMode && !showDepthMap
+            && !(useMaterials && materials.isLoaded());
+
+        // shadows, fitted to what is drawn this frame
+        depthMap.resize(shadowSizes[shadowSizeIndex], shadowSizes[shadowSizeIndex], (DepthFormat)shadowFormatIndex);
+        if (galleryMode)
+            gallery.update(interpolation);
+        // the exploded mode draws a mesh of its own, with the main mesh's transform
+        const MeshGl& drawnMesh = morphMode == 2 ? exploded.getTarget() : meshGl;
+        BoundingSphere meshBounds = morphMode == 1 ? transformSphere(arap.getBounds(), meshGl.model) : transformSphere(drawnMesh.getBounds().at(interpolation), meshGl.model);
+        BoundingSphere casters = galleryMode ? gallery.getBounds() : meshBounds;
+        BoundingSphere receivers = transformSphere(plane.boundingSphere, planeGl.model);
+        if (casters.radius < 0.0f)
+            casters = receivers;
+        if (recording)
+        {
+            float aspect = (float)recordTarget->getWidth() / recordTarget->getHeight();
+            sceneProj = glm::perspective(glm::radians(45.0f), aspect, 0.1f, 500.0f);
+            if (recordSettings.camera == RecordSettings::CameraPath::Orbit)
+                view = Camera::Orbit(casters, recorder.yawAt(recorder.getFrame()), recordSettings.pitch, glm::radians(45.0f), viewPos);
+        }
+        glm::mat4 lightView, lightProjection;
+        float lightDepthRange;
+        dirLight.fitShadow(casters, receivers, depthMap.getWidth(), lightView, lightProjection, lightDepthRange);
         glm::mat4 lightSpaceMatrix = lightProjection * lightView;
-        depthShader.Bind();
-        depthShader.SetUniformMat4f("lightSpaceMatrix", lightSpaceMatrix);
-        depthFB.bind();
-        depthFB.clear();
-
-        //render scene TODO: refactoring
-
-
-        // main mesh
-        //texture.Bind();
-        Mesh meshInterpolated = mesh.interpolate(interpolation);
-        meshGl.updateGeometry(meshInterpolated);
-        depthShader.Bind();
-        depthShader.SetUniformMat4f("u_Model", meshGl.model);
-        //shader.SetUniformMat3f("u_NormalMatrix", glm::mat3(transpose(inverse(meshGl.model))));
-        meshGl.draw(depthShader);
-
-        // Draw plane
-        //floorTexture.Bind();
-        depthShader.Bind();
-        depthShader.SetUniformMat4f("u_Model", planeGl.model);
-        //shader.SetUniformMat3f("u_NormalMatrix", glm::mat3(transpose(inverse(planeGl.model))));
-        planeGl.draw(depthShader);
-
-        depthFB.unBind();
-        // reset viewport
-        glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        
+
+        // a texel and a half of world space bias, in depth units of the fitted frustum
+        float shadowBias = 1.5f * (2.0f * casters.radius / depthMap.getWidth()) / lightDepthRange;
+        for (Shader* s : { &shader, &galleryShader })
+        {
+            s->Bind();
+            s->SetUniform1f("u_ShadowStrength", shadows ? 1.0f : 0.0f);
+            s->SetUniform1f("u_ShadowBias", shadowBias);
+            s->SetUniform1i("u_PcfRadius", pcfRadius);
+        }
+
+        RenderPass shadowPass = {
+            "shadow", depthFB.getID(), { 0, 0, (int)depthFB.getWidth(), (int)depthFB.getHeight() },
+            GL_DEPTH_BUFFER_BIT, glm::vec4(0.0f),
+            { lightView, lightProjection, lightSpaceMatrix, glm::vec4(0.0f) }
+        };
+        shadowList.Clear();
+        if (galleryMode)
+        {
+            gallery.record(shadowList, galleryDepthShader);
+        }
+        else
+        {
+            DrawItem& meshItem = shadowList.Draw(depthShader, drawnMesh, meshGl.model);
+            meshItem.interpolation = interpolation;
+            meshItem.minLod = previewLod;
+            if (morphMode == 1)
+            {
+                meshItem.linearMorph = false;
+                meshItem.worldBounds = meshBounds;
+            }
+        }
+        // the plane's morph bounds are for its flattened state, it is drawn at rest
+        DrawItem& shadowPlaneItem = shadowList.Draw(depthShader, planeGl, planeGl.model);
+        shadowPlaneItem.worldBounds = receivers;
+        renderer.Submit(shadowPass, shadowList);
+
+        RenderPass scenePass = {
+            "scene", 0, { 0, 0, (int)SCR_WIDTH, (int)SCR_HEIGHT },
+            GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f),
+            { view, sceneProj, lightSpaceMatrix, glm::vec4(viewPos, 1.0f) },
+            depthMap.getID()
+        };
+        if (recording)
+        {
+            scenePass.framebuffer = recordTarget->getID();
+            scenePass.viewport[2] = recordTarget->getWidth();
+            scenePass.viewport[3] = recordTarget->getHeight();
+        }
+        sceneList.Clear();
+        if (!showDepthMap)
+        {
+            if (galleryMode)
+            {
+                gallery.record(sceneList, galleryShader);
+            }
+            else
+            {
+                DrawItem& meshItem = sceneList.Draw(shader, drawnMesh, meshGl.model);
+                meshItem.interpolation = interpolation;
+                meshItem.minLod = previewLod;
+                if (morphMode == 1)
+                {
+                    meshItem.linearMorph = false;
+                    meshItem.worldBounds = meshBounds;
+                }
+                sceneList.SetTexture(meshItem, 0, texture.GetRendererID());
+                SurfaceParams surface;
+                if (useMaterials && materials.isLoaded())
+                {
+                    surface.materials = true;
+                    sceneList.SetTexture(meshItem, Shader::MATERIAL_COLOR_UNIT, materials.getColorArray(), GL_TEXTURE_2D_ARRAY);
+                    sceneList.SetTexture(meshItem, Shader::MATERIAL_ORM_UNIT, materials.getOrmArray(), GL_TEXTURE_2D_ARRAY);
+                }
+                else if (virtualTextured)
+                {
+                    surface.virtualTexture = true;
+                    virtualTexture.setDrawParams(surface, 0.0f);
+                    sceneList.SetTexture(meshItem, Shader::VIRTUAL_PAGE_TABLE_UNIT, virtualTexture.getPageTable());
+                    sceneList.SetTexture(meshItem, Shader::VIRTUAL_PAGES_UNIT, virtualTexture.getPages());
+                }
+                if (showDistortion && distortionValues.getCount() == mesh.f.size())
+                {
+                    meshItem.faceOrder = true;
+                    surface.overlay = SurfaceParams::Overlay::Heatmap;
+                    surface.heatmapReference = distortion.getReport().metrics[distortionMetric].reference;
+                    surface.heatmapRange = distortionRange;
+                    sceneList.SetTexture(meshItem, Shader::FACE_ATTRIBUTE_UNIT, distortionValues.getTexture(), GL_TEXTURE_BUFFER);
+                }
+                else if (showOverlaps && faceFlags.getCount() == mesh.f.size())
+                {
+                    meshItem.faceOrder = true;
+                    surface.overlay = SurfaceParams::Overlay::UVOverlaps;
+                    sceneList.SetTexture(meshItem, Shader::FACE_ATTRIBUTE_UNIT, faceFlags.getTexture(), GL_TEXTURE_BUFFER);
+                }
+                if (picked.face >= 0)
+                {
+                    meshItem.faceOrder = true;
+                    surface.pickedFace = picked.face;
+                }
+                int edgeBits = (showWireframe ? 1 : 0) | (showSeams ? 2 : 0) | (showBorders ? 4 : 0);
+                if (edgeBits && seamFlags.getCount() == mesh.f.size())
+                {
+                    meshItem.faceOrder = true;
+                    surface.edgeBits = edgeBits;
+                    surface.edgeWidth = edgeWidth;
+                    sceneList.SetTexture(meshItem, Shader::FACE_EDGE_UNIT, seamFlags.getTexture(), GL_TEXTURE_BUFFER);
+                }
+                meshItem.params = surface.pack();
+            }
+            DrawItem& planeItem = sceneList.Draw(shader, planeGl, planeGl.model);
+            planeItem.worldBounds = receivers;
+            sceneList.SetTexture(planeItem, 0, floorTexture.GetRendererID());
+        }
+        renderer.Submit(scenePass, sceneList);
+
+        // the pages the mesh samples, at a fraction of the resolution, read back next frame
+        if (virtualTextured)
+        {
+            RenderPass feedbackPass = scenePass;
+            feedbackPass.name = "vt feedback";
+            feedbackPass.framebuffer = feedbackTarget.getID();
+            feedbackPass.viewport[2] = feedbackTarget.getWidth();
+            feedbackPass.viewport[3] = feedbackTarget.getHeight();
+            feedbackPass.clearColor = glm::vec4(0.0f);
+            feedbackPass.shadowMap = 0;
+            feedbackList.Clear();
+            DrawItem& feedbackItem = feedbackList.Draw(feedbackShader, drawnMesh, meshGl.model);
+            feedbackItem.interpolation = interpolation;
+            feedbackItem.minLod = previewLod;
+            if (morphMode == 1)
+            {
+                feedbackItem.linearMorph = false;
+                feedbackItem.worldBounds = meshBounds;
+            }
+            float scale = (float)scenePass.viewport[3] / feedbackTarget.getHeight();
+            SurfaceParams feedback;
+            virtualTexture.setDrawParams(feedback, -std::log2(scale));
+            feedbackItem.params = feedback.pack();
+            renderer.Submit(feedbackPass, feedbackList);
+            virtualTexture.readFeedback(feedbackTarget.getID(), feedbackTarget.getWidth(), feedbackTarget.getHeight());
+        }
+
         // debug shadow
-        quadShader.Bind();
-        quadShader.SetUniform1f("near_plane", near_plane);
-        quadShader.SetUniform1f("far_plane", far_plane);
-        quadShader.SetUniform1i("depthMap", 0);
-        depthMap.Bind(0);
-        renderQuad();
+        if (showDepthMap)
+        {
+            quadShader.Bind();
+            quadShader.SetUniform1i("depthMap", 0);
+            depthMap.Bind(0);
+            renderQuad();
+        }
+
+        if (recording)
+        {
+            // the readback only gets queued here, the preview blit doesn't wait for it
+            recorder.capture(recordTarget->getID());
+            recordTarget->blitTo(0, SCR_WIDTH, SCR_HEIGHT);
+        }
 
+        // against the frame just drawn; ImGui's mouse state is the one of its last NewFrame
+        ImGuiIO& io = ImGui::GetIO();
+        // the tree follows the linear morph only
+        if (!galleryMode && !recording && morphMode == 0 && ImGui::IsMouseClicked(ImGuiMouseButton_Right) && !io.WantCaptureMouse)
+        {
+            if (!meshBvh.isBuilt() || bvhStale)
+                meshBvh.build();
+            bvhStale = false;
+            glm::vec2 ndc(2.0f * io.MousePos.x / io.DisplaySize.x - 1.0f, 1.0f - 2.0f * io.MousePos.y / io.DisplaySize.y);
+            glm::mat4 toMesh = glm::inverse(sceneProj * view * meshGl.model);
+            glm::vec4 nearPoint = toMesh * glm::vec4(ndc.x, ndc.y, -1.0f, 1.0f);
+            glm::vec4 farPoint = toMesh * glm::vec4(ndc.x, ndc.y, 1.0f, 1.0f);
+            glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+            auto pickStart = std::chrono::steady_clock::now();
+            meshBvh.raycast(origin, glm::vec3(farPoint) / farPoint.w - origin, interpolation, picked);
+            pickMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - pickStart).count();
+        }
 
         float speed = interpolationSpeed * deltaTime;
         if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
@@ -240,14 +610,561 @@ int main() {
         ImGui::SliderFloat("Texture Color", &textureColorMode, 0, 1.0f);
         ImGui::SliderFloat("Texture Grid", &textureGridMode, 0, 1.0f);
         ImGui::SliderFloat("Interpolation", &interpolation, 0.0f, 1.0f);
+        ImGui::Checkbox("Show shadow map", &showDepthMap);
+        const char* morphNames[] = { "Linear", "As rigid as possible", "Exploded" };
+        if (ImGui::Combo("Morph", &morphMode, morphNames, IM_ARRAYSIZE(morphNames)))
+        {
+            if (morphMode == 1 && (!arap.isBuilt() || arapStale))
+            {
+                arap.build();
+                arapStale = false;
+            }
+            if (morphMode == 1 && !arap.isBuilt())
+                morphMode = 0;
+            if (morphMode == 2 && (!exploded.isSetUp() || explodedStale))
+            {
+                exploded.setup(mesh);
+                explodedStale = false;
+            }
+            morph.invalidate();
+            exploded.invalidate();
+            uploadedInterpolation = -1.0f;
+        }
+        if (mesh.uvChannelCount() > 1)
+        {
+            // every channel is in the buffers already, switching rebinds attribute 1
+            int channel = mesh.uvChannel;
+            const char* channelNames[] = { "0", "1", "2", "3", "4", "5", "6", "7" };
+            if (ImGui::Combo("UV channel", &channel, channelNames, std::min(mesh.uvChannelCount(), (int)IM_ARRAYSIZE(channelNames))))
+            {
+                mesh.selectUVChannel(channel);
+                meshGl.selectUVChannel(channel);
+                meshGl.updateBounds(mesh);
+                morph.selectUVChannel(mesh);
+                uploadedInterpolation = -1.0f;
+                islands.build(mesh);
+                distortionValues.upload(nullptr, 0);
+                seamFlags.upload(nullptr, 0);
+                if (editable.isBegun())
+                    editable.begin();
+                bvhStale = arapStale = explodedStale = true;
+                if (morphMode == 1)
+                {
+                    arap.build();
+                    arapStale = false;
+                }
+                if (morphMode == 2)
+                {
+                    exploded.setup(mesh);
+                    explodedStale = false;
+                }
+                exploded.invalidate();
+            }
+        }
+        if (morphMode == 1)
+        {
+            ImGui::Text("%zu welded vertices in %zu systems, factored in %.1f ms", arap.getWeldedCount(), arap.getBatchCount(), arap.getBuildMs());
+            ImGui::Text("Solve %.2f ms", arap.getSolveMs());
+        }
+        else if (morphMode == 2)
+        {
+            ImGui::Text("%zu faces, set up in %.1f ms", exploded.getFaceCount(), exploded.getBuildMs());
+            ImGui::SameLine();
+            if (ImGui::Button("Validate against CPU"))
+                exploded.validate(interpolation);
+        }
+        else if (ImGui::Checkbox("GPU morph (transform feedback)", &gpuMorph))
+        {
+            // the other path has to rewrite the buffer on its next turn
+            morph.invalidate();
+            uploadedInterpolation = -1.0f;
+        }
+        if (morphMode == 0 && gpuMorph)
+        {
+            ImGui::SameLine();
+            if (ImGui::Button("Validate against CPU"))
+                morph.validate(mesh, interpolation, meshGl);
+        }
         ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+        if (ImGui::CollapsingHeader("Gallery"))
+        {
+            ImGui::Checkbox("Gallery mode", &galleryMode);
+            ImGui::InputText("Model", galleryPath, sizeof(galleryPath));
+            ImGui::SameLine();
+            if (ImGui::Button("Add"))
+                gallery.addModel(galleryPath);
+            for (size_t i = 0; i < gallery.getEntryCount(); i++)
+                ImGui::BulletText("%s", gallery.getPath(i).c_str());
+            int galleryModeIndex = (int)gallery.mode;
+            bool layoutChanged = ImGui::RadioButton("Models", &galleryModeIndex, (int)Gallery::Mode::Models);
+            ImGui::SameLine();
+            layoutChanged |= ImGui::RadioButton("Interpolation states", &galleryModeIndex, (int)Gallery::Mode::States);
+            gallery.mode = (Gallery::Mode)galleryModeIndex;
+            layoutChanged |= ImGui::SliderInt("States", &gallery.stateCount, 1, 400);
+            layoutChanged |= ImGui::SliderInt("States of model", &gallery.stateEntry, 0, std::max(0, (int)gallery.getEntryCount() - 1));
+            layoutChanged |= ImGui::SliderFloat("Spacing", &gallery.spacing, 1.0f, 20.0f);
+            if (layoutChanged)
+                gallery.setDirty();
+            ImGui::Text("%zu instances", gallery.getInstanceCount());
+        }
+        if (ImGui::CollapsingHeader("OpenGL"))
+        {
+            const char* modes[] = { "Off", "Poll glGetError", "Debug callback", "Debug callback (sync)" };
+            int mode = (int)GLDebug::GetMode();
+            if (ImGui::Combo("Error checks", &mode, modes, IM_ARRAYSIZE(modes)))
+                GLDebug::SetMode((GLErrorMode)mode);
+            if (ImGui::Button("Validate 60 frames"))
+            {
+                // Poll where the debug output can't be trusted, release builds then check once per frame
+                GLDebug::SetMode(GLDebug::HasDebugOutput() && GLDebug::IsDebugContext() ? GLErrorMode::Callback : GLErrorMode::Poll);
+                GLDebug::ValidateFrames(60);
+            }
+            if (GLDebug::GetValidateFramesLeft() > 0)
+            {
+                ImGui::SameLine();
+                ImGui::Text("%d left", GLDebug::GetValidateFramesLeft());
+            }
+            const GLState::Stats& stateStats = GLState::GetLastFrameStats();
+            ImGui::Text("Draw calls: %u", renderer.GetLastFrameDrawCount());
+            ImGui::Text("State changes: %u issued, %u redundant filtered", stateStats.issued, stateStats.filtered);
+            ImGui::Text("Suppressed duplicate messages: %u", GLDebug::GetSuppressedMessageCount());
+#ifndef NDEBUG
+            ImGui::Text("GLCall calls last frame: %u", GLDebug::GetLastFrameCallCount());
+            for (GLCallSite* site = GLDebug::GetCallSites(); site; site = site->next)
+            {
+                if (site->lastFrameCount > 0)
+                    ImGui::Text("%5u  %s:%d  %s", site->lastFrameCount, site->file, site->line, site->function);
+            }
+#endif
+        }
+        if (ImGui::CollapsingHeader("Shadows"))
+        {
+            const char* sizeNames[] = { "256", "512", "1024", "2048", "4096" };
+            const char* formatNames[] = { "16 bit", "24 bit", "32 bit float" };
+            ImGui::Checkbox("Enabled", &shadows);
+            ImGui::Combo("Resolution", &shadowSizeIndex, sizeNames, IM_ARRAYSIZE(sizeNames));
+            ImGui::Combo("Depth format", &shadowFormatIndex, formatNames, IM_ARRAYSIZE(formatNames));
+            ImGui::SliderInt("PCF radius", &pcfRadius, 0, 3);
+            ImGui::Text("Light frustum: %.2f wide, %.2f deep", 2.0f * casters.radius, lightDepthRange);
+        }
+        if (ImGui::CollapsingHeader("Culling"))
+        {
+            ImGui::Checkbox("Frustum culling", &renderer.culling);
+            ImGui::Checkbox("Cluster culling", &renderer.clusterCulling);
+            ImGui::SliderInt("LOD bias", &renderer.lodBias, -4, 4);
+            ImGui::Text("LODs: %u, clusters: %u", meshGl.getLodCount(), (unsigned int)meshGl.getClusters().size());
+            ImGui::Checkbox("Coarser levels while moving", &previewLods);
+            ImGui::SliderInt("Preview faces", &previewFaces, 10000, 1000000);
+            if (simplifier.isRunning())
+                ImGui::Text("Simplifying...");
+            else
+            {
+                const MeshSimplifier::Report& report = simplifier.getReport();
+                ImGui::Text("%zu positions, %zu on seams, %zu on borders, %zu locked, %.0f ms",
+                    report.positions, report.seamPositions, report.borderPositions, report.lockedPositions, report.buildMs);
+                for (size_t level = 0; level < report.levelFaces.size(); level++)
+                    ImGui::Text("Level %zu: %zu faces, error %.2f%%", level + 1, report.levelFaces[level], 100.0f * report.levelError[level]);
+            }
+            ImGui::Text("Preview level: %u", previewLod);
+            for (const PassStats& stats : renderer.GetLastFramePassStats())
+            {
+                ImGui::Text("%-8s objects %u drawn / %u culled, clusters %u drawn / %u culled, %u coarse",
+                    stats.name, stats.objectsDrawn, stats.objectsCulled, stats.clustersDrawn, stats.clustersCulled, stats.lodDraws);
+            }
+        }
+        if (ImGui::CollapsingHeader("Recorder"))
+        {
+            if (!recorder.isRecording())
+            {
+                const char* easingNames[] = { "Linear", "Smoothstep", "Cubic ease in/out", "Ping-pong" };
+                const char* cameraNames[] = { "Free camera", "Orbit" };
+                const char* formatNames[] = { "PNG sequence", "Y4M video" };
+                const char* sizeNames[] = { "960x540", "1280x720", "1920x1080" };
+                ImGui::SliderInt("Frames", &recordSettings.frameCount, 2, 1000);
+                ImGui::SliderInt("FPS", &recordSettings.fps, 1, 120);
+                int easing = (int)recordSettings.easing;
+                if (ImGui::Combo("Easing", &easing, easingNames, IM_ARRAYSIZE(easingNames)))
+                    recordSettings.easing = (RecordSettings::Easing)easing;
+                int cameraPath = (int)recordSettings.camera;
+                if (ImGui::Combo("Camera", &cameraPath, cameraNames, IM_ARRAYSIZE(cameraNames)))
+                    recordSettings.camera = (RecordSettings::CameraPath)cameraPath;
+                if (recordSettings.camera == RecordSettings::CameraPath::Orbit)
+                {
+                    ImGui::SliderFloat("Orbit degrees", &recordSettings.orbitDegrees, 0.0f, 720.0f);
+                    ImGui::SliderFloat("Pitch", &recordSettings.pitch, -80.0f, 80.0f);
+                }
+                int format = (int)recordSettings.format;
+                if (ImGui::Combo("Format", &format, formatNames, IM_ARRAYSIZE(formatNames)))
+                {
+                    recordSettings.format = (RecordSettings::Format)format;
+                    // a directory for frames, a file for video
+                    if (recordSettings.format == RecordSettings::Format::Y4m && strcmp(recordPath, "capture") == 0)
+                        strcpy(recordPath, "capture.y4m");
+                    else if (recordSettings.format == RecordSettings::Format::Png && strcmp(recordPath, "capture.y4m") == 0)
+                        strcpy(recordPath, "capture");
+                }
+                ImGui::Combo("Resolution", &recordSizeIndex, sizeNames, IM_ARRAYSIZE(sizeNames));
+                ImGui::InputText("Output", recordPath, sizeof(recordPath));
+                ImGui::SliderInt("Writer threads", &recordSettings.workers, 1, 16);
+                if (ImGui::Button("Record"))
+                {
+                    int width = recordSizes[recordSizeIndex][0], height = recordSizes[recordSizeIndex][1];
+                    if (!recordTarget)
+                        recordTarget.reset(new OffscreenTarget(width, height));
+                    recordTarget->resize(width, height);
+                    recordSettings.path = recordPath;
+                    recorder.start(recordSettings, width, height);
+                }
+            }
+            else
+            {
+                const RecordSettings& active = recorder.getSettings();
+                char progress[32];
+                snprintf(progress, sizeof(progress), "%d/%d", recorder.getFrame(), active.frameCount);
+                ImGui::ProgressBar((float)recorder.getFrame() / active.frameCount, ImVec2(-1.0f, 0.0f), progress);
+                if (ImGui::Button("Stop"))
+                    recorder.stop();
+            }
+            Recorder::Stats recordStats = recorder.getStats();
+            ImGui::Text("Captured %d, written %d, failed %d, queued %d, stalls %d",
+                recordStats.captured, recordStats.written, recordStats.failed, recordStats.queued, recordStats.stalls);
+        }
+        if (ImGui::CollapsingHeader("UV layout export"))
+        {
+            const char* modeNames[] = { "Wireframe", "Islands", "Face attribute", "Island id" };
+            const char* sizeNames[] = { "1024", "2048", "4096", "8192", "16384" };
+            int layoutMode = (int)uvLayout.mode;
+            if (ImGui::Combo("Mode", &layoutMode, modeNames, IM_ARRAYSIZE(modeNames)))
+                uvLayout.mode = (UVRasterSettings::Mode)layoutMode;
+            ImGui::Combo("Size", &uvLayoutSizeIndex, sizeNames, IM_ARRAYSIZE(sizeNames));
+            if (uvLayout.mode == UVRasterSettings::Mode::Wireframe)
+                ImGui::SliderFloat("Line width", &uvLayout.lineWidth, 0.5f, 8.0f);
+            if (uvLayout.mode == UVRasterSettings::Mode::FaceAttribute)
+            {
+                for (const auto& attribute : mesh.faceAttributes)
+                {
+                    if (ImGui::RadioButton(attribute.first.c_str(), uvLayout.attribute == attribute.first))
+                        uvLayout.attribute = attribute.first;
+                }
+                ImGui::Checkbox("Relative to mean (log2)", &uvLayout.relativeToMean);
+                if (uvLayout.relativeToMean)
+                    ImGui::SliderFloat("Saturates at", &uvLayout.logRange, 0.25f, 4.0f);
+            }
+            ImGui::InputText("File", uvLayoutPath, sizeof(uvLayoutPath));
+            if (uvLayoutExport.isRunning())
+                ImGui::Text("Exporting...");
+            else if (ImGui::Button("Export"))
+            {
+                uvLayout.width = uvLayoutSizes[uvLayoutSizeIndex];
+                uvLayout.height = uvLayoutSizes[uvLayoutSizeIndex];
+                uvLayoutExport.start(mesh, islands, uvLayout, uvLayoutPath);
+            }
+            ImGui::Text("%d islands", islands.count);
+            if (!uvLayoutExport.isRunning() && !uvLayoutExport.succeeded())
+                ImGui::Text("Last export failed");
+            else if (!uvLayoutExport.isRunning() && uvLayoutExport.getStats().totalMs > 0.0)
+            {
+                const UVRasterizer::Stats& stats = uvLayoutExport.getStats();
+                ImGui::Text("Last export %.0f ms: binning %.1f, raster %.1f, %.1f MB per band",
+                    stats.totalMs, stats.binMs, stats.rasterMs, stats.bandBytes / (1024.0 * 1024.0));
+            }
+        }
+        if (ImGui::CollapsingHeader("UV coverage"))
+        {
+            ImGui::InputInt2("Texture size", coverageSize);
+            if (ImGui::Button("Analyze"))
+            {
+                coverageSize[0] = std::min(std::max(coverageSize[0], 1), 32768);
+                coverageSize[1] = std::min(std::max(coverageSize[1], 1), 32768);
+                const UVCoverageReport& report = coverage.analyze(coverageSize[0], coverageSize[1], true);
+                std::vector<unsigned char> pixels;
+                coverage.preview(512, pixels);
+                coveragePreview.SetData(512, 512, pixels.data());
+
+                // islands by wasted texels, the first ones to repack
+                wastefulIslands.resize(report.islands.size());
+                for (size_t i = 0; i < wastefulIslands.size(); i++)
+                    wastefulIslands[i] = (int)i;
+                auto wasted = [&report](int i) { return (int64_t)report.islands[i].boundsTexels - (int64_t)report.islands[i].coveredTexels; };
+                std::sort(wastefulIslands.begin(), wastefulIslands.end(), [&](int a, int b) { return wasted(a) > wasted(b); });
+                wastefulIslands.resize(std::min<size_t>(wastefulIslands.size(), 8));
+            }
+            const UVCoverageReport& report = coverage.getReport();
+            if (report.width > 0)
+            {
+                ImGui::Text("%dx%d in %.0f ms: %.2f%% covered, %.2f%% overlapping, %.2f%% unused",
+                    report.width, report.height, report.ms, report.coverage * 100.0f, report.overlap * 100.0f, (1.0f - report.coverage) * 100.0f);
+                ImGui::Text("%zu faces, %zu with uvs outside 0..1, %zu islands", report.faces, report.facesOutside, report.islands.size());
+                ImGui::Image((ImTextureID)(intptr_t)coveragePreview.GetRendererID(), ImVec2(256.0f, 256.0f));
+                for (int i : wastefulIslands)
+                {
+                    const UVCoverageReport::Island& island = report.islands[i];
+                    ImGui::BulletText("island %d: %d faces, %.1f%% of its bounds empty", i, island.faces, island.waste * 100.0f);
+                }
+                ImGui::InputText("Report", coverageReportPath, sizeof(coverageReportPath));
+                ImGui::SameLine();
+                if (ImGui::Button("Write JSON"))
+                    report.writeJson(coverageReportPath, modelPath);
+            }
+        }
+        if (ImGui::CollapsingHeader("UV overlaps"))
+        {
+            if (ImGui::Button("Detect"))
+            {
+                overlaps.detect();
+                std::vector<float>& flags = mesh.faceAttribute("uvOverlap");
+                overlaps.faceFlags(flags);
+                faceFlags.upload(flags.data(), flags.size());
+            }
+            const UVOverlapReport& report = overlaps.getReport();
+            if (report.faces > 0)
+            {
+                ImGui::SameLine();
+                ImGui::Checkbox("Highlight (red overlapping, blue flipped)", &showOverlaps);
+                ImGui::Text("%zu faces in %.1f ms: bvh %.1f ms (%zu nodes), queries %.1f ms",
+                    report.faces, report.ms, report.bvhMs, overlaps.getBvh().nodes.size(), report.queryMs);
+                ImGui::Text("%zu overlapping pairs, %zu within an island, %zu faces involved",
+                    report.pairs.size(), report.sameIslandPairs, report.overlappingFaces);
+                ImGui::Text("%zu flipped faces, %zu without uv area", report.flipped.size(), report.degenerateFaces);
+                for (size_t i = 0; i < std::min<size_t>(report.pairs.size(), 8); i++)
+                {
+                    const UVOverlapReport::Pair& pair = report.pairs[i];
+                    ImGui::BulletText("faces %d and %d%s", pair.a, pair.b, pair.sameIsland ? ", same island" : "");
+                }
+                ImGui::InputText("Report##overlaps", overlapReportPath, sizeof(overlapReportPath));
+                ImGui::SameLine();
+                if (ImGui::Button("Write JSON##overlaps"))
+                    report.writeJson(overlapReportPath, modelPath);
+            }
+        }
+        if (ImGui::CollapsingHeader("UV distortion"))
+        {
+            const char* metricNames[(int)UVDistortion::Metric::Count];
+            for (int m = 0; m < (int)UVDistortion::Metric::Count; m++)
+                metricNames[m] = UVDistortion::metricName((UVDistortion::Metric)m);
+            bool upload = false;
+            if (ImGui::Button("Compute"))
+            {
+                distortion.compute(texture.GetWidth(), texture.GetHeight());
+                upload = true;
+            }
+            const UVDistortionReport& report = distortion.getReport();
+            if (report.faces > 0)
+            {
+                ImGui::SameLine();
+                ImGui::Checkbox("Heatmap", &showDistortion);
+                upload |= ImGui::Combo("Metric", &distortionMetric, metricNames, (int)UVDistortion::Metric::Count);
+                ImGui::SliderFloat("Saturates at (log2)", &distortionRange, 0.25f, 4.0f);
+                if (upload)
+                {
+                    // the values also go into the mesh, so the uv layout export can show them
+                    std::vector<float>& values = mesh.faceAttribute(UVDistortion::attributeName((UVDistortion::Metric)distortionMetric));
+                    distortion.faceValues((UVDistortion::Metric)distortionMetric, values);
+                    distortionValues.upload(values.data(), values.size());
+                }
+                const UVDistortionReport::Stats& stats = report.metrics[distortionMetric];
+                ImGui::Text("%zu faces in %.1f ms, %zu degenerate, %.4g uv units per 3D unit",
+                    report.faces, report.ms, report.degenerateFaces, report.scale);
+                ImGui::Text("min %.4g, max %.4g, area weighted mean %.4g, reference %.4g", stats.min, stats.max, stats.mean, stats.reference);
+                ImGui::PlotHistogram("##distortion", stats.histogram, UVDistortionReport::BINS, 0, nullptr, 0.0f, FLT_MAX, ImVec2(0.0f, 80.0f));
+                ImGui::Text("share of the 3D area, log2 of value / reference from %.0f to %.0f", -report.range, report.range);
+            }
+        }
+        if (ImGui::CollapsingHeader("Seams and wireframe"))
+        {
+            if (ImGui::Button("Extract seams"))
+            {
+                seams.extract();
+                std::vector<float>& flags = mesh.faceAttribute("uvSeams");
+                seams.faceFlags(flags);
+                seamFlags.upload(flags.data(), flags.size());
+            }
+            const UVSeamReport& report = seams.getReport();
+            if (report.faces > 0)
+            {
+                ImGui::Checkbox("Wireframe", &showWireframe);
+                ImGui::SameLine();
+                ImGui::Checkbox("Seams (pink)", &showSeams);
+                ImGui::SameLine();
+                ImGui::Checkbox("Borders (cyan)", &showBorders);
+                ImGui::SliderFloat("Line width", &edgeWidth, 0.5f, 4.0f);
+                ImGui::Text("%zu edges in %.1f ms: %zu on seams, %zu on borders",
+                    report.edges, report.ms, report.seamEdges, report.borderEdges);
+                if (report.facesWithoutCorners > 0)
+                    ImGui::Text("%zu faces share corners with others and can't be outlined", report.facesWithoutCorners);
+            }
+        }
+        if (ImGui::CollapsingHeader("Face picking"))
+        {
+            ImGui::Text("Right click the mesh to pick a face");
+            if (meshBvh.isBuilt())
+            {
+                ImGui::Text("BVH: %zu nodes, built in %.0f ms, last pick %.3f ms",
+                    meshBvh.getNodeCount(), meshBvh.getBuildMs(), pickMs);
+            }
+            if (picked.face >= 0)
+            {
+                const Face& face = mesh.f[picked.face];
+                glm::vec2 uv[3];
+                glm::vec3 now[3];
+                for (int k = 0; k < 3; k++)
+                {
+                    uv[k] = mesh.uv[face.vi[k]];
+                    now[k] = glm::mix(mesh.morphStart(face.vi[k]), mesh.morphEnd(face.vi[k]), picked.t);
+                }
+                int island = islands.faceIsland.size() == mesh.f.size() ? islands.faceIsland[picked.face] : -1;
+                const std::vector<float>* scaling = mesh.findFaceAttribute("uvScaling");
+                ImGui::Text("Face %d, island %d (%d faces)", picked.face, island, island >= 0 ? islands.faceCount[island] : 0);
+                if (scaling && scaling->size() == mesh.f.size())
+                    ImGui::Text("uvScaling %.4f, mesh average %.4f", (*scaling)[picked.face], mesh.averageScaling);
+                ImGui::Text("Area %.4g in 3D, %.4g in uv, %.4g at t = %.2f",
+                    Utils::ComputeArea(mesh.pos[face.vi[0]], mesh.pos[face.vi[1]], mesh.pos[face.vi[2]]),
+                    Utils::ComputeArea(glm::vec3(uv[0], 0.0f), glm::vec3(uv[1], 0.0f), glm::vec3(uv[2], 0.0f)),
+                    Utils::ComputeArea(now[0], now[1], now[2]), picked.t);
+
+                // the face in the texture, ringed since most faces are smaller than a pixel here
+                const float size = 256.0f;
+                ImVec2 origin = ImGui::GetCursorScreenPos();
+                ImGui::Image((ImTextureID)(intptr_t)texture.GetRendererID(), ImVec2(size, size), ImVec2(0.0f, 1.0f), ImVec2(1.0f, 0.0f));
+                ImVec2 corners[3];
+                for (int k = 0; k < 3; k++)
+                    corners[k] = ImVec2(origin.x + uv[k].x * size, origin.y + (1.0f - uv[k].y) * size);
+                ImDrawList* drawList = ImGui::GetWindowDrawList();
+                drawList->AddTriangleFilled(corners[0], corners[1], corners[2], IM_COL32(255, 204, 0, 160));
+                drawList->AddTriangle(corners[0], corners[1], corners[2], IM_COL32(255, 204, 0, 255), 1.5f);
+                ImVec2 center((corners[0].x + corners[1].x + corners[2].x) / 3.0f, (corners[0].y + corners[1].y + corners[2].y) / 3.0f);
+                drawList->AddCircle(center, 8.0f, IM_COL32(255, 204, 0, 255), 0, 2.0f);
+                if (ImGui::Button("Clear pick"))
+                    picked.face = -1;
+            }
+        }
+        if (morphMode == 0 && ImGui::CollapsingHeader("Editing"))
+        {
+            if (picked.face < 0)
+                ImGui::Text("Pick a face to move its corners");
+            else
+            {
+                // the offsets move the face's corners together, in the mesh's own units and in uv; the
+                // neighbours sharing a corner move with it
+                const Face& face = mesh.f[picked.face];
+                glm::vec3 move(0.0f);
+                glm::vec2 moveUV(0.0f);
+                bool moved = ImGui::DragFloat3("Move corners", &move.x, mesh.boundingSphere.radius * 0.001f);
+                bool movedUV = ImGui::DragFloat2("Move uvs", &moveUV.x, 0.0005f);
+                if (moved || movedUV)
+                {
+                    for (int k = 0; k < 3; k++)
+                    {
+                        int v = face.vi[k];
+                        if (moved)
+                            editable.setPosition(v, mesh.pos[v] + move);
+                        if (movedUV)
+                            editable.setUV(v, mesh.uv[v] + moveUV);
+                    }
+                    editable.commit(&meshGl, &morph);
+                    // the feedback morph redoes only what commit() invalidated; the CPU one has no
+                    // partial path, a new best rotation moves every vertex
+                    if (!gpuMorph)
+                        uploadedInterpolation = -1.0f;
+                    bvhStale = arapStale = explodedStale = true;
+                }
+            }
+            if (editable.isBegun())
+            {
+                ImGui::Text("Last commit: %zu vertices, %zu faces, %zu buffer ranges in %.3f ms",
+                    editable.getLastVertexCount(), editable.getLastFaceCount(), editable.getLastRunCount(), editable.getLastMs());
+                ImGui::Text("Full analysis %.1f ms, best rotation det %.3f, average scaling %.4f%s",
+                    editable.getBeginMs(), glm::determinant(mesh.bestRotation), mesh.averageScaling, mesh.toFlip ? ", flipped" : "");
+            }
+            // the bounds only grow while editing
+            if (ImGui::Button("Refit bounds"))
+            {
+                editable.begin();
+                meshGl.updateBounds(mesh);
+                morph.updateParams(mesh);
+                uploadedInterpolation = -1.0f;
+                bvhStale = true;
+            }
+        }
+        if (ImGui::CollapsingHeader("Materials"))
+        {
+            ImGui::Text("%zu materials, %zu maps loaded, %zu missing, in %.0f ms", mesh.materials.size(), materials.getMapsLoaded(),
+                materials.getMapsMissing(), materials.getLoadMs());
+            if (materials.isLoaded())
+            {
+                ImGui::Text("Color %d x %d, ORM %d x %d, %u layers each, one draw", materials.getColorWidth(), materials.getColorHeight(),
+                    materials.getOrmWidth(), materials.getOrmHeight(), materials.getLayerCount());
+                ImGui::Checkbox("Use material maps", &useMaterials);
+            }
+            for (size_t i = 0; i < mesh.materials.size(); i++)
+            {
+                const Material& material = mesh.materials[i];
+                const std::string& color = material.maps[(int)MaterialMap::BaseColor];
+                ImGui::BulletText("%s: %s", material.name.c_str(), color.empty() ? "no base color map" : color.c_str());
+            }
+            // a subdirectory of the model's with another set of the same files
+            ImGui::InputText("Texture set", textureSet, sizeof(textureSet));
+            ImGui::SameLine();
+            if (ImGui::Button("Reload"))
+                materials.load(mesh, textureSet);
+        }
+        if (ImGui::CollapsingHeader("Virtual texture"))
+        {
+            // <UDIM> in the path stands for 1001, 1002, ... of a tile set
+            ImGui::InputText("Source", virtualPath, sizeof(virtualPath));
+            const char* cacheSizes[] = { "8 x 8 pages", "16 x 16 pages", "24 x 24 pages", "32 x 32 pages" };
+            ImGui::Combo("Cache", &virtualCacheIndex, cacheSizes, IM_ARRAYSIZE(cacheSizes));
+            if (ImGui::Button("Open"))
+                virtualTexture.open(virtualPath, virtualCacheSizes[virtualCacheIndex]);
+            VirtualTexture::State state = virtualTexture.getState();
+            if (state == VirtualTexture::State::Baking)
+            {
+                ImGui::SameLine();
+                ImGui::ProgressBar(virtualTexture.getBakeProgress(), ImVec2(-1.0f, 0.0f), "baking pages");
+            }
+            std::string virtualError = virtualTexture.getError();
+            if (!virtualError.empty())
+                ImGui::Text("%s%s", state == VirtualTexture::State::Failed ? "failed: " : "", virtualError.c_str());
+            if (virtualTexture.isReady())
+            {
+                VirtualTexture::Stats stats = virtualTexture.getStats();
+                ImGui::Checkbox("Use virtual texture", &useVirtualTexture);
+                if (useMaterials && materials.isLoaded())
+                    ImGui::Text("The material maps take precedence, turn them off to see it");
+                ImGui::SliderInt("Uploads per frame", &virtualUploads, 1, 128);
+                ImGui::Text("%d x %d tiles of %d x %d, %d levels, %.1f MB on the GPU", virtualTexture.getTilesU(), virtualTexture.getTilesV(),
+                    virtualTexture.getTileWidth(), virtualTexture.getTileHeight(), virtualTexture.getLevelCount(), virtualTexture.getGpuBytes() / (1024.0f * 1024.0f));
+                ImGui::Text("Resident %zu / %d (%zu pinned), %zu evicted", stats.resident, virtualTexture.getSlotCount(), stats.pinned, stats.evictions);
+                ImGui::Text("Frame uses %zu pages, %zu missing, %zu in flight, %zu uploaded", stats.requested, stats.missing, stats.queued, stats.uploaded);
+                ImGui::Text("%.2f ms per page read, %zu loads dropped on a full cache", stats.readMs, stats.cacheFull);
+                if (stats.lodBias > 0.0f)
+                    ImGui::Text("The view needs more pages than the cache holds, %.0f levels coarser", stats.lodBias);
+            }
+        }
+        if (ImGui::CollapsingHeader("Allocations"))
+        {
+            const AllocationStats& frameHeap = MemoryStats::LastFrameHeap();
+            const AllocationStats& frameArena = MemoryStats::LastFrameArena();
+            const AllocationStats& importHeap = MemoryStats::LastImportHeap();
+            const AllocationStats& importArena = MemoryStats::LastImportArena();
+            ImGui::Text("Frame heap:   %zu allocs, %.1f KB", frameHeap.count, frameHeap.bytes / 1024.0f);
+            ImGui::Text("Frame arena:  %zu allocs, %.1f KB", frameArena.count, frameArena.bytes / 1024.0f);
+            ImGui::Text("Import heap:  %zu allocs, %.1f KB", importHeap.count, importHeap.bytes / 1024.0f);
+            ImGui::Text("Import arena: %zu allocs, %.1f KB", importArena.count, importArena.bytes / 1024.0f);
+        }
         ImGui::End();
         
         ImGui::Render();
         ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+        // the ImGui backend binds behind our back
+        GLState::Invalidate();
 
+        GLDebug::EndFrame();
+        GLState::EndFrame();
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
+    // a recording still running reads back and deletes GL buffers, while the context is still there
+    recorder.stop();
 	return 0;
 }
\ No newline at end of file
@@ -2,140 +2,258 @@
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 #include "meshGL.h"
+#include "GLState.h"
 
+#include <atomic>
+#include <utility>
+#include <Eigen/Dense>
+
+
+static Eigen::Matrix3d glmToEigen(const glm::mat3& glmMatrix) {
+    Eigen::Matrix3d eigenMatrix;
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            eigenMatrix(i, j) = glmMatrix[i][j];
+        }
+    }
+    return eigenMatrix;
+}
+
+static glm::mat3 eigenToGlm(const Eigen::Matrix3d& eigenMatrix) {
+    glm::mat3 glmMatrix;
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            glmMatrix[i][j] = eigenMatrix(i, j);
+        }
+    }
+    return glmMatrix;
+}
+
+glm::mat3 Mesh::rotationFromCovariance(const glm::mat3& covariance)
+{
+    // SVD
+    // fixed size matrices, the solve doesn't touch the heap
+    Eigen::Matrix3d A = glmToEigen(covariance);
+    Eigen::JacobiSVD<Eigen::Matrix3d> svd(A, Eigen::ComputeFullU | Eigen::ComputeFullV);
+
+    Eigen::Matrix3d R = svd.matrixU() * svd.matrixV().transpose();
+
+    if (R.determinant() < 0) {
+        R *= -1;
+    }
+    return eigenToGlm(R);
+}
+
+Vertex Mesh::vertex(int i) const
+{
+    Vertex result;
+    result.pos = pos[i];
+    result.uv = uv[i];
+    result.normal = normal[i];
+    return result;
+}
+
+std::vector<float>& Mesh::faceAttribute(const std::string& name)
+{
+    std::vector<float>& stream = faceAttributes[name];
+    stream.resize(f.size(), 0.0f);
+    return stream;
+}
+
+const std::vector<float>* Mesh::findFaceAttribute(const std::string& name) const
+{
+    auto it = faceAttributes.find(name);
+    if (it == faceAttributes.end())
+        return nullptr;
+    return &it->second;
+}
+
+// the same call parks the active channel and brings a parked one in
+static void swapUVChannel(Mesh& mesh, UVChannel& channel)
+{
+    std::swap(mesh.uv, channel.uv);
+    std::swap(mesh.faceAttribute("uvScaling"), channel.uvScaling);
+    std::swap(mesh.centroid2D, channel.centroid2D);
+    std::swap(mesh.averageScaling, channel.averageScaling);
+    std::swap(mesh.bestRotation, channel.bestRotation);
+    std::swap(mesh.toFlip, channel.toFlip);
+    std::swap(mesh.morphBounds, channel.morphBounds);
+    channel.clusterBounds.resize(mesh.clusters.size());
+    for (size_t i = 0; i < mesh.clusters.size(); i++)
+        std::swap(mesh.clusters[i].bounds, channel.clusterBounds[i]);
+}
+
+void Mesh::selectUVChannel(int channel)
+{
+    if (channel == uvChannel || channel < 0 || channel >= (int)uvChannels.size())
+        return;
+    swapUVChannel(*this, uvChannels[uvChannel]);
+    swapUVChannel(*this, uvChannels[channel]);
+    uvChannel = channel;
+}
+
+// writes only the morphed positions, uvs, normals and faces never change with t
+glm::vec3 Mesh::morphEnd(int i) const
+{
+    float u = toFlip ? 1.0f - uv[i].x : uv[i].x;
+    return glm::vec3(u, uv[i].y, 0.0f) * averageScaling;
+}
+
+void Mesh::interpolate(float t, glm::vec3* result) const
+{
+    for (int i = 0; i < pos.size(); i++)
+    {
+        result[i] = glm::mix(morphStart(i), morphEnd(i), t);
+    }
+}
+
+void Mesh::interpolateNormals(float t, glm::vec3* result) const
+{
+    for (int i = 0; i < normal.size(); i++)
+    {
+        glm::vec3 blended = glm::mix(normal[i] * bestRotation, glm::vec3(0.0f, 0.0f, 1.0f), t);
+        float length = glm::length(blended);
+        // opposite normals cancel out half way, any unit vector will do there
+        result[i] = length > 1e-6f ? blended / length : glm::vec3(0.0f, 0.0f, 1.0f);
+    }
+}
 
 Mesh Mesh::interpolate(float t) const
 {
     Mesh result;
 
     result.f = f;
-    
-    result.v.resize(v.size());
-    
-    for (int i = 0; i < v.size(); i++)
+    result.generation = generation;
+    result.uv = uv;
+    result.normal = normal;
+    result.pos.resize(pos.size());
+    interpolate(t, result.pos.data());
+    interpolateNormals(t, result.normal.data());
+
+    return result;
+}
+
+void Mesh::cornerSlots(std::vector<unsigned char>& slots) const
+{
+    slots.assign(pos.size(), 3);
+    for (const Face& face : f)
     {
-        glm::vec3 targetUV(this->v[i].uv, 0.0);
-        if (toFlip)
+        for (int k = 0; k < 3; k++)
         {
-            targetUV.x = -targetUV.x + 1.0f;
+            if (slots[face.vi[k]] == 3)
+                slots[face.vi[k]] = (unsigned char)k;
         }
-
-        int faceIndex = i / 3;
-        //float uvScaling = f[faceIndex].uvScaling;
-        result.v[i].pos = glm::mix(
-            this->v[i].pos * bestRotation, 
-            targetUV * averageScaling,
-            t
-        );
-        result.v[i].uv = this->v[i].uv;
-        result.v[i].normal = this->v[i].normal;
     }
-
-    return result;
 }
 
 MeshGl Mesh::bake()
 {
     MeshGl result;
+    size_t n = pos.size();
 
     glGenVertexArrays(1, &result.VAO);
     glGenBuffers(1, &result.VBO);
     glGenBuffers(1, &result.EBO);
 
-    glBindVertexArray(result.VAO);
-
-    glBindBuffer(GL_ARRAY_BUFFER, result.VBO);
-    glBufferData(GL_ARRAY_BUFFER, v.size() * sizeof(Vertex), &v[0], GL_DYNAMIC_DRAW);
-
-    std::vector<int> indexes;
-    for (int i = 0; i < f.size(); i++)
+    GLState::BindVertexArray(result.VAO);
+
+    // one buffer, one block per stream: [pos | uv of every channel | normal | corner slot | material]
+    int channels = uvChannelCount();
+    result.vertexCount = n;
+    result.uvChannelCount = channels;
+    result.uvChannel = uvChannel;
+    size_t uvOffset = result.uvOffset(uvChannel);
+    size_t normalOffset = result.normalOffset();
+    size_t cornerOffset = normalOffset + n * sizeof(glm::vec3);
+    size_t materialOffset = cornerOffset + n;
+    bool hasMaterials = material.size() == n;
+    std::vector<unsigned char> corners;
+    cornerSlots(corners);
+    GLState::BindBuffer(GL_ARRAY_BUFFER, result.VBO);
+    glBufferData(GL_ARRAY_BUFFER, materialOffset + (hasMaterials ? n : 0), nullptr, GL_DYNAMIC_DRAW);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, n * sizeof(glm::vec3), pos.data());
+    for (int c = 0; c < channels; c++)
     {
-        int i0 = f[i].vi[0];
-        int i1 = f[i].vi[1];
-        int i2 = f[i].vi[2];
-        indexes.push_back(i0);
-        indexes.push_back(i1);
-        indexes.push_back(i2);
+        const std::vector<glm::vec2>& channelUV = channelUVs(c);
+        if (channelUV.size() == n)
+            glBufferSubData(GL_ARRAY_BUFFER, result.uvOffset(c), n * sizeof(glm::vec2), channelUV.data());
     }
+    if (normal.size() == n)
+        glBufferSubData(GL_ARRAY_BUFFER, normalOffset, n * sizeof(glm::vec3), normal.data());
+    glBufferSubData(GL_ARRAY_BUFFER, cornerOffset, n, corners.data());
+    if (hasMaterials)
+        glBufferSubData(GL_ARRAY_BUFFER, materialOffset, n, material.data());
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, result.EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexes.size() * sizeof(int), &indexes[0], GL_STATIC_DRAW);
-    result.indexCount = f.size() * 3;
+    result.clusters = clusters;
+    result.bounds = morphBounds;
+    result.boundsValid = hasMorphBounds;
 
     // vertex Positions
     glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
     // vertex texture coords
     glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, uv));
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (void*)uvOffset);
     // normals
     glEnableVertexAttribArray(2);
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)normalOffset);
+    // corner slots, read as floats
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 1, GL_UNSIGNED_BYTE, GL_FALSE, 1, (void*)cornerOffset);
+    // material, the texture layer; without it the attribute reads 0, the first layer
+    if (hasMaterials)
+    {
+        glEnableVertexAttribArray(9);
+        glVertexAttribPointer(9, 1, GL_UNSIGNED_BYTE, GL_FALSE, 1, (void*)materialOffset);
+    }
+    // indices of the full mesh and its coarser levels
+    result.updateLods(*this);
 
-    glBindVertexArray(0);
+    GLState::BindVertexArray(0);
 
     return result;
 }
 
 #define PI 3.14159265358979323846
 
+unsigned int Mesh::nextGeneration()
+{
+    static std::atomic<unsigned int> s_Generation(0);
+    return ++s_Generation;
+}
+
 void Mesh::buildCylinder()
 {
-    v.clear();
+    generation = nextGeneration();
+    pos.clear();
+    uv.clear();
+    normal.clear();
     int n = 10;
     float radius = 1.0f;
     float height = 2.0f;
 
     float segmentAngle = 2.0f * PI / n;
 
-    for (int i = 0; i < n; i++)
+    // the extra 2 segments duplicate the first vertices for texture wrapping
+    pos.reserve((n + 2) * 2);
+    uv.reserve((n + 2) * 2);
+    normal.reserve((n + 2) * 2);
+    for (int i = 0; i < n + 2; i++)
     {
-        float angle = i * segmentAngle;
+        int segment = i < n ? i : i - n;
+        float angle = segment * segmentAngle;
         float x = radius * cos(angle);
         float z = radius * sin(angle);
 
-        Vertex vertex;
-
         // Top vertices 
-        vertex.pos[0] = x;
-        vertex.pos[1] = height / 2;
-        vertex.pos[2] = z;
-        vertex.uv[0] = ((float)i / n);
-        vertex.uv[1] = 1.0f;
-        v.push_back(vertex);
+        pos.push_back(glm::vec3(x, height / 2, z));
+        uv.push_back(glm::vec2((float)segment / n, 1.0f));
+        normal.push_back(glm::vec3(x, 0.0f, z) / radius);
 
         // Bottom vertices
-        vertex.pos[0] = x;
-        vertex.pos[1] = -height / 2;
-        vertex.pos[2] = z;
-        vertex.uv[0] = ((float)i / n);
-        vertex.uv[1] = 0.0f;
-        v.push_back(vertex);
-    }
-    // Duplicate first and last vertices for texture wrapping
-    for (int i = 0; i < 2; ++i)
-    {
-        float angle = i * segmentAngle;
-        float x = radius * cos(angle);
-        float z = radius * sin(angle);
-
-        Vertex vertex;
-
-        // Top vertices 
-        vertex.pos[0] = x;
-        vertex.pos[1] = height / 2;
-        vertex.pos[2] = z;
-        vertex.uv[0] = ((float)i / n);
-        vertex.uv[1] = 1.0f;
-        v.push_back(vertex);
-
-        // Bottom vertices
-        vertex.pos[0] = x;
-        vertex.pos[1] = -height / 2;
-        vertex.pos[2] = z;
-        vertex.uv[0] = ((float)i / n);
-        vertex.uv[1] = 0.0f;
-        v.push_back(vertex);
+        pos.push_back(glm::vec3(x, -height / 2, z));
+        uv.push_back(glm::vec2((float)segment / n, 0.0f));
+        normal.push_back(glm::vec3(x, 0.0f, z) / radius);
     }
 
     for (int i = 0; i < n * 2; i += 2) {
@@ -156,6 +274,7 @@ void Mesh::buildCylinder()
 
 void Mesh::buildPlane()
 {
+    generation = nextGeneration();
     float vertices[] = {
         -10.0, -0.5, -10.0, 0.0,1.0,
         -10.0, -0.5, 10.0,  0.0,0.0,
@@ -164,25 +283,14 @@ void Mesh::buildPlane()
         10.0, -0.5,-10.0,   1.0, 1.0,
         -10.0, -0.5, -10.0, 0.0, 1.0
     };
-    float uvs[] = {
-        0.0,1.0,
-        0.0,0.0,
-        1.0, 0.0,
-        1.0, 0.0,
-        1.0, 1.0,
-        0.0, 1.0
-    };
-    v.clear();
-    Vertex vertex;
+    pos.clear();
+    uv.clear();
+    normal.clear();
     for (int i = 0; i < sizeof(vertices) / sizeof(float); i+=5)
     {
-        vertex.pos.x = vertices[i];
-        vertex.pos.y = vertices[i + 1];
-        vertex.pos.z = vertices[i + 2];
-        vertex.uv.x =  vertices[i + 3];
-        vertex.uv.y =  vertices[i + 4];
-
-        v.push_back(vertex);
+        pos.push_back(glm::vec3(vertices[i], vertices[i + 1], vertices[i + 2]));
+        uv.push_back(glm::vec2(vertices[i + 3], vertices[i + 4]));
+        normal.push_back(glm::vec3(0.0f, 1.0f, 0.0f));
     }
         Face face;
         face.vi[0] = 1;
@@ -197,41 +305,8 @@ void Mesh::buildPlane()
 
 void Mesh::updateBB()
 {
-    glm::vec3 minExtents = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max() };
-    glm::vec3 maxExtents = { -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max() };
-
-    for (int i = 0; i < f.size(); i++)
-    {
-        Face face = f[i];
-        for (int j = 0; j < 3; j++)
-        {
-            Vertex vertex = v[face.vi[j]];
-            minExtents.x = std::min(minExtents.x, vertex.pos.x);
-            minExtents.y = std::min(minExtents.y, vertex.pos.y);
-            minExtents.z = std::min(minExtents.z, vertex.pos.z);
-            maxExtents.x = std::max(maxExtents.x, vertex.pos.x);
-            maxExtents.y = std::max(maxExtents.y, vertex.pos.y);
-            maxExtents.z = std::max(maxExtents.z, vertex.pos.z);
-        }
-    }
-    boundingSphere.center = {
-        (minExtents.x + maxExtents.x) / 2,
-        (minExtents.y + maxExtents.y) / 2,
-        (minExtents.z + maxExtents.z) / 2
-    };
-
-    float maxRadiusSquared = 0.0f;
-    for (int i = 0; i < f.size(); i++)
-    {
-        Face face = f[i];
-        for (int j = 0; j < 3; j++)
-        {
-            Vertex vertex = v[face.vi[j]];
-            float distanceSquared = pow(vertex.pos.x - boundingSphere.center.x, 2) + pow(vertex.pos.y - boundingSphere.center.y, 2) + pow(vertex.pos.z - boundingSphere.center.z, 2);
-            maxRadiusSquared = std::max(maxRadiusSquared, distanceSquared);
-        }
-    }
-
-    boundingSphere.radius = sqrt(maxRadiusSquared);
+    aabb = computeAABB(pos.data(), pos.size());
+    boundingSphere = computeBoundingSphere(pos.data(), pos.size());
+    obb = computeOBB(pos.data(), pos.size());
 }
 
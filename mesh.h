@@ -8,9 +8,12 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <vector>
 #include <string>
+#include <unordered_map>
+#include "BoundingVolume.h"
 
 struct MeshGl;
 
+// assembled copy of one vertex, the mesh stores each attribute in its own stream
 struct Vertex
 {
 	glm::vec3 pos;
@@ -21,34 +24,133 @@ struct Vertex
 struct Face
 {
 	int vi[3];
-	float uvScaling;
-	glm::vec3 centroid3D;
-	glm::vec3 centroid2D;
 };
 
-struct BoundingSphere
+// f is uploaded as is by bake(), so a face must stay three packed indices
+static_assert(sizeof(Face) == 3 * sizeof(int), "Face must stay tightly packed");
+
+// spheres around the morph end points (t = 0 and t = 1), mixing them gives a
+// sphere that contains the mesh at any t in between
+struct MorphBounds
+{
+	BoundingSphere start;
+	BoundingSphere end;
+
+	BoundingSphere at(float t) const;
+};
+
+// run of consecutive faces culled as a unit
+struct MeshCluster
+{
+	int firstFace;
+	int faceCount;
+	MorphBounds bounds;
+};
+
+// maps a material can have, see MaterialTextures
+enum class MaterialMap
+{
+	BaseColor,
+	AmbientOcclusion,
+	Roughness,
+	Metallic,
+	Count
+};
+
+// what the importer found for one material; maps are paths as the file wrote them, relative to
+// Mesh::directory, and empty when the material has none
+struct Material
+{
+	std::string name;
+	glm::vec3 diffuseColor = glm::vec3(0.8f);
+	float roughness = 0.5f; // from the shininess when there is no roughness map
+	std::string maps[(int)MaterialMap::Count];
+	bool shininessMap = false; // the roughness map holds shininess, 1 - roughness
+};
+
+// one uv layout and what the import analysis found for it, see Mesh::selectUVChannel
+struct UVChannel
 {
-	glm::vec3 center;
-	float radius;
+	std::vector<glm::vec2> uv;
+	std::vector<float> uvScaling; // per face
+	glm::vec3 centroid2D = glm::vec3(0.0f);
+	float averageScaling = 1.0f;
+	glm::mat3 bestRotation = glm::mat3(1.0f);
+	bool toFlip = false;
+	MorphBounds morphBounds;
+	std::vector<MorphBounds> clusterBounds;
 };
 
 struct Mesh
 {
-	std::vector<Vertex> v;
+	// vertex streams (structure of arrays)
+	std::vector<glm::vec3> pos;
+	std::vector<glm::vec2> uv;
+	std::vector<glm::vec3> normal;
+	// packed index array
 	std::vector<Face> f;
+	unsigned int generation = 0; // a new one from nextGeneration() whenever f is rebuilt
+	// optional per-face streams (e.g. "uvScaling"), allocated on first request
+	std::unordered_map<std::string, std::vector<float>> faceAttributes;
+
 	glm::vec3 centroid3D;
 	glm::vec3 centroid2D;
 	float averageScaling;
 	glm::mat3 bestRotation;
 	BoundingSphere boundingSphere;
+	AABB aabb;
+	OBB obb;
 	bool toFlip = false;
 
+	// built at import by buildClusters, see mesh_lod.cpp
+	MorphBounds morphBounds;
+	bool hasMorphBounds = false;
+	std::vector<MeshCluster> clusters;
+	std::vector<std::vector<Face>> lods; // coarser levels, indices into the same vertex streams; MeshSimplifier builds them after import
+
+	// Every uv channel of the file. The active one lives in the fields above (uv, centroid2D,
+	// averageScaling, bestRotation, toFlip, "uvScaling" and the morph bounds) so the rest of the
+	// code never looks here; its own slot holds whatever was swapped out. Empty when the mesh
+	// has a single channel.
+	std::vector<UVChannel> uvChannels;
+	int uvChannel = 0;
+
+	// materials of the file, and per vertex the one its face uses (the importer never shares a
+	// vertex between materials); empty when the file has none
+	std::vector<Material> materials;
+	std::vector<unsigned char> material;
+	std::string directory; // of the imported file, with a trailing separator
+
+	size_t vertexCount() const { return pos.size(); }
+	int uvChannelCount() const { return uvChannels.empty() ? 1 : (int)uvChannels.size(); }
+	// the channel's uvs, whether it is the active one or not
+	const std::vector<glm::vec2>& channelUVs(int channel) const { return channel == uvChannel ? uv : uvChannels[channel].uv; }
+	// swaps the channel's streams and analysis into the active fields, O(clusters)
+	void selectUVChannel(int channel);
+	Vertex vertex(int i) const;
+	// slot 0..2 of each vertex in the first face using it, 3 if none; with one vertex per face
+	// corner every face finds its own slots, which gives the shaders barycentrics, see UVSeams
+	void cornerSlots(std::vector<unsigned char>& slots) const;
+	std::vector<float>& faceAttribute(const std::string& name);
+	const std::vector<float>* findFaceAttribute(const std::string& name) const;
+
 	bool importOBJ(const char* fileName);
 	void exportOBJ(std::string fileName);
+	void interpolate(float t, glm::vec3* result) const;
+	// vertex i at t = 0 and t = 1, interpolate() mixes the two linearly
+	glm::vec3 morphStart(int i) const { return pos[i] * bestRotation; }
+	glm::vec3 morphEnd(int i) const;
+	void interpolateNormals(float t, glm::vec3* result) const; // towards +z, the flattened layout's normal
 	Mesh interpolate(float t) const;
 	MeshGl bake();
 	void buildCylinder();
 	void buildPlane();
 	void updateBB();
 	void updateToFlipBool();
+	// rotation of the best fit between the 3D corners and the uvs, from their cross-covariance
+	// (mean of outerProduct(pos - centroid3D, uv - centroid2D) over the face corners)
+	static glm::mat3 rotationFromCovariance(const glm::mat3& covariance);
+	// never 0 and never the same twice, so work started on one set of faces can tell it is stale
+	static unsigned int nextGeneration();
+	void buildClusters(int facesPerCluster = 128);
 };
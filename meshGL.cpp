@@ -1,5 +1,9 @@
 #include "meshGL.h"
 #include "mesh.h"
+#include "Renderer.h"
+#include "GLState.h"
+
+#include <algorithm>
 
 MeshGl::~MeshGl()
 {
@@ -9,27 +13,173 @@ MeshGl::~MeshGl()
 }
 
 MeshGl::MeshGl():
-    model(glm::mat4(1.0f))
+    VAO(0), VBO(0), EBO(0), indexCount(0), vertexCount(0), instanceVBO(0), instanceCapacity(0), boundsValid(false),
+    uvChannelCount(1), uvChannel(0), model(glm::mat4(1.0f))
 {
 }
 
 void MeshGl::draw(const Shader& shader) const
 {
     shader.Bind();
-    glBindVertexArray(VAO);
-    glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
-    glBindVertexArray(0);
+    drawElements();
+}
+
+void MeshGl::drawElements(unsigned int instanceCount, unsigned int lod) const
+{
+    unsigned int first = 0;
+    unsigned int count = indexCount;
+    if (lod > 0 && lod < lods.size())
+    {
+        first = lods[lod].first;
+        count = lods[lod].count;
+    }
+    const void* offset = (const void*)(first * sizeof(unsigned int));
+
+    GLState::BindVertexArray(VAO);
+    if (instanceCount > 0)
+    {
+        GLCall(glDrawElementsInstanced(GL_TRIANGLES, count, GL_UNSIGNED_INT, offset, instanceCount));
+    }
+    else
+    {
+        GLCall(glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, offset));
+    }
+}
+
+// one call for any number of ranges
+void MeshGl::drawRanges(const IndexRange* ranges, size_t count) const
+{
+    const size_t BATCH = 256;
+    GLsizei counts[BATCH];
+    const void* offsets[BATCH];
+
+    GLState::BindVertexArray(VAO);
+    for (size_t first = 0; first < count; first += BATCH)
+    {
+        size_t n = std::min(BATCH, count - first);
+        for (size_t i = 0; i < n; i++)
+        {
+            counts[i] = ranges[first + i].count;
+            offsets[i] = (const void*)(ranges[first + i].first * sizeof(unsigned int));
+        }
+        GLCall(glMultiDrawElements(GL_TRIANGLES, counts, GL_UNSIGNED_INT, offsets, (GLsizei)n));
+    }
+}
+
+// the instance buffer and its attributes are created on first use
+void MeshGl::updateInstances(const InstanceData* instances, size_t count)
+{
+    if (instanceVBO == 0)
+    {
+        glGenBuffers(1, &instanceVBO);
+        GLState::BindVertexArray(VAO);
+        GLState::BindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        for (int i = 0; i < 4; i++)
+        {
+            glEnableVertexAttribArray(4 + i);
+            glVertexAttribPointer(4 + i, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(sizeof(glm::vec4) * i));
+            glVertexAttribDivisor(4 + i, 1);
+        }
+        glEnableVertexAttribArray(8);
+        glVertexAttribPointer(8, 1, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)offsetof(InstanceData, interpolation));
+        glVertexAttribDivisor(8, 1);
+    }
+
+    GLState::BindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+    if (count > instanceCapacity)
+    {
+        instanceCapacity = count;
+        GLCall(glBufferData(GL_ARRAY_BUFFER, count * sizeof(InstanceData), instances, GL_DYNAMIC_DRAW));
+    }
+    else
+    {
+        GLCall(glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(InstanceData), instances));
+    }
 }
 
 void MeshGl::updateGeometry(const Mesh& mesh)
 {
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferSubData(GL_ARRAY_BUFFER, 0, mesh.v.size() * sizeof(Vertex), &mesh.v[0]);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    updatePositions(mesh.pos.data(), mesh.pos.size());
+}
+
+// positions are the first block of the VBO, uvs and normals are left untouched
+void MeshGl::updatePositions(const glm::vec3* positions, size_t count)
+{
+    GLState::BindBuffer(GL_ARRAY_BUFFER, VBO);
+    GLCall(glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(glm::vec3), positions));
+}
+
+void MeshGl::updateNormals(const glm::vec3* normals, size_t count)
+{
+    GLState::BindBuffer(GL_ARRAY_BUFFER, VBO);
+    GLCall(glBufferSubData(GL_ARRAY_BUFFER, normalOffset(), count * sizeof(glm::vec3), normals));
+}
+
+void MeshGl::updateUVs(const glm::vec2* uvs, size_t first, size_t count)
+{
+    GLState::BindBuffer(GL_ARRAY_BUFFER, VBO);
+    GLCall(glBufferSubData(GL_ARRAY_BUFFER, uvOffset(uvChannel) + first * sizeof(glm::vec2), count * sizeof(glm::vec2), uvs));
+}
+
+void MeshGl::selectUVChannel(unsigned int channel)
+{
+    if (channel >= uvChannelCount)
+        return;
+    uvChannel = channel;
+    GLState::BindVertexArray(VAO);
+    GLState::BindBuffer(GL_ARRAY_BUFFER, VBO);
+    GLCall(glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (void*)uvOffset(channel)));
+    GLState::BindVertexArray(0);
+}
+
+void MeshGl::updateBounds(const Mesh& mesh)
+{
+    clusters = mesh.clusters;
+    bounds = mesh.morphBounds;
+    boundsValid = mesh.hasMorphBounds;
+}
+
+// the element buffer is part of the VAO's state, it is bound with it
+void MeshGl::updateLods(const Mesh& mesh)
+{
+    // full mesh first, then the coarser levels
+    size_t faceTotal = mesh.f.size();
+    for (const std::vector<Face>& lod : mesh.lods)
+        faceTotal += lod.size();
+    GLState::BindVertexArray(VAO);
+    GLState::BindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    GLCall(glBufferData(GL_ELEMENT_ARRAY_BUFFER, faceTotal * sizeof(Face), nullptr, GL_STATIC_DRAW));
+    GLCall(glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, mesh.f.size() * sizeof(Face), mesh.f.data()));
+    lods.clear();
+    lods.push_back({ 0, (unsigned int)mesh.f.size() * 3 });
+    for (const std::vector<Face>& lod : mesh.lods)
+    {
+        IndexRange range = { lods.back().first + lods.back().count, (unsigned int)lod.size() * 3 };
+        GLCall(glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, range.first * sizeof(int), lod.size() * sizeof(Face), lod.data()));
+        lods.push_back(range);
+    }
+    indexCount = mesh.f.size() * 3;
+    GLState::BindVertexArray(0);
+}
+
+void MeshGl::bindMorphOutputs() const
+{
+    // glBindBufferRange also moves the generic binding, this keeps GLState's copy in line
+    GLState::BindBuffer(GL_TRANSFORM_FEEDBACK_BUFFER, VBO);
+    GLCall(glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 0, VBO, 0, vertexCount * sizeof(glm::vec3)));
+    GLCall(glBindBufferRange(GL_TRANSFORM_FEEDBACK_BUFFER, 1, VBO, normalOffset(), vertexCount * sizeof(glm::vec3)));
 }
 
 void MeshGl::deleteBuffers()
 {
+    GLState::ForgetVertexArray(VAO);
+    GLState::ForgetBuffer(VBO);
+    GLState::ForgetBuffer(EBO);
+    if (instanceVBO)
+    {
+        GLState::ForgetBuffer(instanceVBO);
+        glDeleteBuffers(1, &instanceVBO);
+    }
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
     glDeleteBuffers(1, &EBO);
@@ -1,8 +1,24 @@
 #pragma once
 #include "Shader.h"
 #include "GL/glew.h"
+#include "mesh.h"
 
-struct Mesh;
+#include <vector>
+
+// per-instance vertex data, attribute locations 4-7 (model columns) and 8 (t); 9 is the
+// per-vertex material, see Mesh::bake
+struct InstanceData
+{
+	glm::mat4 model;
+	float interpolation;
+};
+
+// range of the element buffer, in indices
+struct IndexRange
+{
+	unsigned int first;
+	unsigned int count;
+};
 
 struct MeshGl
 {
@@ -10,13 +26,52 @@ struct MeshGl
 private:
 	unsigned int VAO, VBO, EBO;
 	unsigned int indexCount;
+	unsigned int vertexCount;
+	unsigned int instanceVBO;
+	unsigned int instanceCapacity;
+	std::vector<IndexRange> lods; // [0] is the full mesh, the rest follow it in the same element buffer
+	std::vector<MeshCluster> clusters;
+	MorphBounds bounds;
+	bool boundsValid;
+	unsigned int uvChannelCount;
+	unsigned int uvChannel; // the block attribute 1 reads
+
 public:
 	glm::mat4 model;
 
+	// [pos | uv of every channel | normal | corner slot | material], see Mesh::bake
+	size_t uvOffset(unsigned int channel) const { return vertexCount * (sizeof(glm::vec3) + channel * sizeof(glm::vec2)); }
+	size_t normalOffset() const { return uvOffset(uvChannelCount); }
+
 public:
 	MeshGl();
 	void draw(const Shader& shader) const;
+	void drawElements(unsigned int instanceCount = 0, unsigned int lod = 0) const; // with whatever program is bound
+	void drawRanges(const IndexRange* ranges, size_t count) const;
+	void updateInstances(const InstanceData* instances, size_t count);
+	unsigned int getVAO() const { return VAO; }
+	unsigned int getVBO() const { return VBO; }
+	unsigned int getLodCount() const { return (unsigned int)lods.size(); }
+	unsigned int getLodIndexCount(unsigned int lod) const { return lods[lod].count; }
+	const std::vector<MeshCluster>& getClusters() const { return clusters; }
+	bool hasBounds() const { return boundsValid; }
+	const MorphBounds& getBounds() const { return bounds; }
 	void updateGeometry(const Mesh& mesh);
+	void updatePositions(const glm::vec3* positions, size_t count);
+	void updateNormals(const glm::vec3* normals, size_t count);
+	// points attribute 1 at another channel's block, nothing is uploaded
+	void selectUVChannel(unsigned int channel);
+	unsigned int getUVChannel() const { return uvChannel; }
+	unsigned int getUVChannelCount() const { return uvChannelCount; }
+	// uvs first .. first + count - 1 of the active channel's block, the rest stays
+	void updateUVs(const glm::vec2* uvs, size_t first, size_t count);
+	// morph and cluster bounds copied from the mesh again, e.g. after EditableMesh::commit
+	void updateBounds(const Mesh& mesh);
+	// the element buffer again, the full mesh and then mesh.lods; e.g. once MeshSimplifier is done
+	void updateLods(const Mesh& mesh);
+	// position and normal blocks as transform feedback outputs 0 and 1, see MorphFeedback
+	void bindMorphOutputs() const;
+	unsigned int getVertexCount() const { return vertexCount; }
 	void deleteBuffers();
 
 	~MeshGl();
@@ -1,56 +1,75 @@
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
+#include <algorithm>
+#include <cmath>
+#include <initializer_list>
 #include <iostream>
-#include <Eigen/Dense>
 #include "mesh.h"
 #include "Utils.h"
+#include "Arena.h"
 
 static void convert(aiMesh* mesh, Mesh& output)
 {
+    size_t first = output.pos.size();
+    size_t count = first + mesh->mNumVertices;
+    output.pos.resize(count);
+    output.normal.resize(count, glm::vec3(0.0f, 0.0f, 0.0f));
+
     // walk through each of the mesh's vertices
     for (unsigned int i = 0; i < mesh->mNumVertices; i++)
     {
-        Vertex vertex;
-
-        vertex.pos.x = mesh->mVertices[i].x;
-        vertex.pos.y = mesh->mVertices[i].y;
-        vertex.pos.z = mesh->mVertices[i].z;
+        output.pos[first + i] = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
+    }
 
-        // texture coordinates
-        if (mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
+    // texture coordinates, every channel; the first one is active, the others are parked
+    // (meshes of one file may have different counts, channels missing in some are zero there)
+    unsigned int channels = std::max(1u, mesh->GetNumUVChannels());
+    if (channels > 1)
+        output.uvChannels.resize(std::max<size_t>(output.uvChannels.size(), channels));
+    for (unsigned int c = 0; c < (unsigned int)output.uvChannelCount(); c++)
+    {
+        std::vector<glm::vec2>& uv = c == 0 ? output.uv : output.uvChannels[c].uv;
+        uv.resize(count, glm::vec2(0.0f, 0.0f));
+        if (c >= channels || !mesh->mTextureCoords[c]) // does the mesh contain texture coordinates?
+            continue;
+        bool outOfRange = false;
+        for (unsigned int i = 0; i < mesh->mNumVertices; i++)
         {
-            vertex.uv.x = mesh->mTextureCoords[0][i].x;
-            vertex.uv.y = mesh->mTextureCoords[0][i].y;
-            if (vertex.uv.x > 1.0 || vertex.uv.y > 1.0)
-            {
-                std::cout << "warning, uv > 1.0" << std::endl;
-            }
+            glm::vec2 value(mesh->mTextureCoords[c][i].x, mesh->mTextureCoords[c][i].y);
+            outOfRange |= value.x > 1.0 || value.y > 1.0;
+            uv[first + i] = value;
         }
-        else vertex.uv = glm::vec2(0.0f, 0.0f);
-
-        // normals
-        if (mesh->HasNormals())
+        if (outOfRange)
         {
-            glm::vec3 vector;
-            vector.x = mesh->mNormals[i].x;
-            vector.y = mesh->mNormals[i].y;
-            vector.z = mesh->mNormals[i].z;
-            vertex.normal = vector;
+            std::cout << "warning, uv > 1.0 in channel " << c << std::endl;
         }
+    }
+
+    // the material of every vertex, the layer the shader samples
+    if (mesh->mMaterialIndex > 255)
+        std::cout << "warning, material " << mesh->mMaterialIndex << " past the 256 texture layers, drawn with material 255" << std::endl;
+    output.material.resize(count, (unsigned char)std::min(mesh->mMaterialIndex, 255u));
 
-        output.v.push_back(vertex);
+    // normals
+    if (mesh->HasNormals())
+    {
+        for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+        {
+            output.normal[first + i] = glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
+        }
     }
 
+    output.f.reserve(output.f.size() + mesh->mNumFaces);
     for (unsigned int i = 0; i < mesh->mNumFaces; i++)
     {
-        aiFace face = mesh->mFaces[i];
+        const aiFace& face = mesh->mFaces[i];
         
         if (face.mNumIndices == 3) {
             Face meshFace;
-            meshFace.vi[0] = face.mIndices[0];
-            meshFace.vi[1] = face.mIndices[1];
-            meshFace.vi[2] = face.mIndices[2];
+            meshFace.vi[0] = (int)first + face.mIndices[0];
+            meshFace.vi[1] = (int)first + face.mIndices[1];
+            meshFace.vi[2] = (int)first + face.mIndices[2];
 
             output.f.push_back(meshFace);
         }
@@ -60,37 +79,36 @@ static void convert(aiMesh* mesh, Mesh& output)
     }
 }
 
-static void computeUVScaling(aiMesh* meshAi, Mesh& mesh)
+static void computeUVScaling(const Mesh& mesh, const std::vector<glm::vec2>& uv, UVChannel& channel)
 {
+    std::vector<float>& uvScaling = channel.uvScaling;
     float scalingSum = 0.0;
-    for (unsigned int i = 0; i < meshAi->mNumFaces; i++)
+    for (int i = 0; i < mesh.f.size(); i++)
     {
-        aiFace face = meshAi->mFaces[i];
-        if (face.mNumIndices == 3) {
-            //scaling UV
-            glm::vec3 v1 = mesh.v[face.mIndices[0]].pos;
-            glm::vec3 v2 = mesh.v[face.mIndices[1]].pos;
-            glm::vec3 v3 = mesh.v[face.mIndices[2]].pos;
+        const Face& face = mesh.f[i];
+        //scaling UV
+        glm::vec3 v1 = mesh.pos[face.vi[0]];
+        glm::vec3 v2 = mesh.pos[face.vi[1]];
+        glm::vec3 v3 = mesh.pos[face.vi[2]];
 
-            float areaMesh = Utils::ComputeArea(v1, v2, v3);
+        float areaMesh = Utils::ComputeArea(v1, v2, v3);
 
-            v1 = glm::vec3(mesh.v[face.mIndices[0]].uv, 0.0f);
-            v2 = glm::vec3(mesh.v[face.mIndices[1]].uv, 0.0f);
-            v3 = glm::vec3(mesh.v[face.mIndices[2]].uv, 0.0f);
+        v1 = glm::vec3(uv[face.vi[0]], 0.0f);
+        v2 = glm::vec3(uv[face.vi[1]], 0.0f);
+        v3 = glm::vec3(uv[face.vi[2]], 0.0f);
 
-            float areaUV = Utils::ComputeArea(v1, v2, v3);
-            if (areaUV > 0)
-            {
-                float ratio = sqrt(areaMesh / areaUV);
-                mesh.f[i].uvScaling = ratio;
-                scalingSum += ratio;
-            }
+        float areaUV = Utils::ComputeArea(v1, v2, v3);
+        if (areaUV > 0)
+        {
+            float ratio = sqrt(areaMesh / areaUV);
+            uvScaling[i] = ratio;
+            scalingSum += ratio;
         }
     }
     if (scalingSum != 0)
-        mesh.averageScaling = scalingSum / meshAi->mNumFaces;
+        channel.averageScaling = scalingSum / mesh.f.size();
     else
-        mesh.averageScaling = 1.0;
+        channel.averageScaling = 1.0;
 }
 
 static void setupCentroids(Mesh& mesh)
@@ -100,10 +118,10 @@ static void setupCentroids(Mesh& mesh)
     float areaSum = 0.0;
     for (int i = 0; i < mesh.f.size(); i++)
     {
-        Face face = mesh.f[i];
-        glm::vec3 a = mesh.v[face.vi[0]].pos;
-        glm::vec3 b = mesh.v[face.vi[1]].pos;
-        glm::vec3 c = mesh.v[face.vi[2]].pos;
+        const Face& face = mesh.f[i];
+        glm::vec3 a = mesh.pos[face.vi[0]];
+        glm::vec3 b = mesh.pos[face.vi[1]];
+        glm::vec3 c = mesh.pos[face.vi[2]];
 
         glm::vec3 center = (a + b + c) / 3.0f;
         float area = 0.5 * length(cross(b - a, c - a));
@@ -112,16 +130,19 @@ static void setupCentroids(Mesh& mesh)
         areaSum += area;
     }
     mesh.centroid3D = centroid / areaSum;
+}
 
+static void setupUVCentroid(const Mesh& mesh, const std::vector<glm::vec2>& uv, UVChannel& channel)
+{
     //2D
-    centroid = glm::vec3(0.0);
-    areaSum = 0.0;
+    glm::vec3 centroid = glm::vec3(0.0);
+    float areaSum = 0.0;
     for (int i = 0; i < mesh.f.size(); i++)
     {
-        Face face = mesh.f[i];
-        glm::vec3 a = glm::vec3(mesh.v[face.vi[0]].uv, 0.0);
-        glm::vec3 b = glm::vec3(mesh.v[face.vi[1]].uv, 0.0);
-        glm::vec3 c = glm::vec3(mesh.v[face.vi[2]].uv, 0.0);
+        const Face& face = mesh.f[i];
+        glm::vec3 a = glm::vec3(uv[face.vi[0]], 0.0);
+        glm::vec3 b = glm::vec3(uv[face.vi[1]], 0.0);
+        glm::vec3 c = glm::vec3(uv[face.vi[2]], 0.0);
 
         glm::vec3 center = (a + b + c) / 3.0f;
         float area = 0.5 * length(cross(b - a, c - a));
@@ -131,85 +152,90 @@ static void setupCentroids(Mesh& mesh)
     }
     if (areaSum > 0)
     {
-        mesh.centroid2D = centroid / areaSum;
+        channel.centroid2D = centroid / areaSum;
     }
     else
     {
-        mesh.centroid2D = glm::vec3(0.0, 0.0, 0.0);
-    }
-}
-
-static Eigen::MatrixXd glmToEigen(const glm::mat3& glmMatrix) {
-    Eigen::MatrixXd eigenMatrix(3, 3);
-    for (int i = 0; i < 3; ++i) {
-        for (int j = 0; j < 3; ++j) {
-            eigenMatrix(i, j) = glmMatrix[i][j];
-        }
+        channel.centroid2D = glm::vec3(0.0, 0.0, 0.0);
     }
-    return eigenMatrix;
 }
 
-static glm::mat3 eigenToGlm(const Eigen::MatrixXd& eigenMatrix) {
-    glm::mat3 glmMatrix;
-    for (int i = 0; i < 3; ++i) {
-        for (int j = 0; j < 3; ++j) {
-            glmMatrix[i][j] = eigenMatrix(i, j);
-        }
-    }
-    return glmMatrix;
-}
-
-static glm::mat3 computeInitRotation(Mesh& mesh)
+static glm::mat3 computeInitRotation(const Mesh& mesh, const std::vector<glm::vec2>& uv, const UVChannel& channel)
 {
     glm::mat3 result = glm::mat3();
     for (int i = 0; i < mesh.f.size(); i++)
     {
-        Face face = mesh.f[i];
-        glm::vec3 vi = glm::vec3(0.0);
-        glm::vec3 wi = glm::vec3(0.0);
-
-        vi = mesh.v[face.vi[0]].pos - mesh.centroid3D;
-        wi = glm::vec3(mesh.v[face.vi[0]].uv, 0.0) - mesh.centroid2D;
-        glm::mat3 outer = glm::outerProduct(vi, wi);
-        result += outer;
-        vi = mesh.v[face.vi[1]].pos - mesh.centroid3D;
-        wi = glm::vec3(mesh.v[face.vi[1]].uv, 0.0) - mesh.centroid2D;
-        outer = glm::outerProduct(vi, wi);
-        result += outer;
-        vi = mesh.v[face.vi[2]].pos - mesh.centroid3D;
-        wi = glm::vec3(mesh.v[face.vi[2]].uv, 0.0) - mesh.centroid2D;
-        outer = glm::outerProduct(vi, wi);
-        result += outer;
+        const Face& face = mesh.f[i];
+        for (int j = 0; j < 3; j++)
+        {
+            glm::vec3 vi = mesh.pos[face.vi[j]] - mesh.centroid3D;
+            glm::vec3 wi = glm::vec3(uv[face.vi[j]], 0.0) - channel.centroid2D;
+            result += glm::outerProduct(vi, wi);
+        }
     }
     result = result / static_cast<float>(mesh.f.size() * 3);
+    return Mesh::rotationFromCovariance(result);
+}
 
-    // SVD
-    Eigen::MatrixXd A = glmToEigen(result);
-    Eigen::JacobiSVD<Eigen::MatrixXd> svd(A, Eigen::ComputeFullU | Eigen::ComputeFullV);
-
-    Eigen::Matrix3d R = svd.matrixU() * svd.matrixV().transpose();
+static bool windingFlips(const Mesh& mesh, const std::vector<glm::vec2>& uv)
+{
+    glm::vec3 crossSum(0.0);
+    for (int i = 0; i < mesh.f.size(); i++)
+    {
+        const Face& face = mesh.f[i];
 
-    if (R.determinant() < 0) {
-        R *= -1;
+        glm::vec2 vi(uv[face.vi[1]] - uv[face.vi[0]]);
+        glm::vec2 wi(uv[face.vi[2]] - uv[face.vi[0]]);
+        crossSum += glm::cross(glm::vec3(vi, 0.0), glm::vec3(wi, 0.0));
     }
-    result = eigenToGlm(R);
+    return crossSum.z < 0.0;
+}
 
-    return result;
+// every channel on its own thread, they only read the shared streams; the results are moved in
+// afterwards, channel 0 into the mesh's fields as the active one
+static void analyzeUVChannels(Mesh& mesh)
+{
+    int channels = mesh.uvChannelCount();
+    std::vector<UVChannel> results(channels);
+    for (UVChannel& result : results)
+        result.uvScaling.assign(mesh.f.size(), 0.0f);
+    Utils::ParallelFor(channels, [&](int c)
+    {
+        const std::vector<glm::vec2>& uv = mesh.channelUVs(c);
+        computeUVScaling(mesh, uv, results[c]);
+        setupUVCentroid(mesh, uv, results[c]);
+        results[c].bestRotation = computeInitRotation(mesh, uv, results[c]);
+        results[c].toFlip = windingFlips(mesh, uv);
+    });
+
+    for (int c = 0; c < channels; c++)
+    {
+        UVChannel& result = results[c];
+        if (c == mesh.uvChannel)
+        {
+            mesh.faceAttribute("uvScaling").swap(result.uvScaling);
+            mesh.centroid2D = result.centroid2D;
+            mesh.averageScaling = result.averageScaling;
+            mesh.bestRotation = result.bestRotation;
+            mesh.toFlip |= result.toFlip;
+            continue;
+        }
+        UVChannel& parked = mesh.uvChannels[c];
+        parked.uvScaling.swap(result.uvScaling);
+        parked.centroid2D = result.centroid2D;
+        parked.averageScaling = result.averageScaling;
+        parked.bestRotation = result.bestRotation;
+        parked.toFlip = result.toFlip;
+    }
 }
 
 static void processNode(aiNode* node, const aiScene* scene, Mesh& mesh)
 {
-    // process each mesh located at the current node
+    // every mesh of the node goes into the one mesh, the materials tell them apart
     for (unsigned int i = 0; i < node->mNumMeshes; i++)
     {
         aiMesh* aim = scene->mMeshes[node->mMeshes[i]];
         convert(aim, mesh);
-        computeUVScaling(aim, mesh);
-        setupCentroids(mesh);
-        mesh.bestRotation = computeInitRotation(mesh);
-        mesh.updateBB();
-        mesh.updateToFlipBool();
-        break;
     }
     // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
     for (unsigned int i = 0; i < node->mNumChildren; i++)
@@ -218,19 +244,59 @@ static void processNode(aiNode* node, const aiScene* scene, Mesh& mesh)
     }
 }
 
-void Mesh::updateToFlipBool()
+// the first texture of the first type that has one, exporters disagree on where a map goes;
+// found gets that type
+static std::string findMap(const aiMaterial* material, std::initializer_list<aiTextureType> types, aiTextureType* found = nullptr)
 {
-    glm::vec3 crossSum(0.0);
-    for (int i = 0; i < f.size(); i++)
+    for (aiTextureType type : types)
     {
-        Face face = f[i];
-        
-        glm::vec2 vi(v[face.vi[1]].uv - v[face.vi[0]].uv);
-        glm::vec2 wi(v[face.vi[2]].uv - v[face.vi[0]].uv);
-        crossSum += glm::cross(glm::vec3(vi, 0.0), glm::vec3(wi, 0.0));
+        aiString path;
+        if (material->GetTextureCount(type) > 0 && material->GetTexture(type, 0, &path) == AI_SUCCESS)
+        {
+            // "*n" points at a texture embedded in the file, not supported
+            if (path.length > 0 && path.C_Str()[0] != '*')
+            {
+                if (found)
+                    *found = type;
+                return path.C_Str();
+            }
+        }
+    }
+    return std::string();
+}
+
+static void convertMaterials(const aiScene* scene, Mesh& mesh)
+{
+    mesh.materials.resize(scene->mNumMaterials);
+    for (unsigned int i = 0; i < scene->mNumMaterials; i++)
+    {
+        const aiMaterial* source = scene->mMaterials[i];
+        Material& material = mesh.materials[i];
+        aiString name;
+        if (source->Get(AI_MATKEY_NAME, name) == AI_SUCCESS)
+            material.name = name.C_Str();
+        aiColor3D diffuse;
+        if (source->Get(AI_MATKEY_COLOR_DIFFUSE, diffuse) == AI_SUCCESS)
+            material.diffuseColor = glm::vec3(diffuse.r, diffuse.g, diffuse.b);
+        // the usual Blinn-Phong exponent to roughness conversion
+        float shininess = 0.0f;
+        if (source->Get(AI_MATKEY_SHININESS, shininess) == AI_SUCCESS && shininess >= 0.0f)
+            material.roughness = sqrt(2.0f / (shininess + 2.0f));
+
+        // OBJ has no roughness or metallic keys, they come as map_Ns and refl; map_Ns is a shininess
+        // map, high where the surface is smooth, so it is read inverted
+        aiTextureType roughnessType = aiTextureType_NONE;
+        material.maps[(int)MaterialMap::BaseColor] = findMap(source, { aiTextureType_BASE_COLOR, aiTextureType_DIFFUSE });
+        material.maps[(int)MaterialMap::AmbientOcclusion] = findMap(source, { aiTextureType_AMBIENT_OCCLUSION, aiTextureType_LIGHTMAP, aiTextureType_AMBIENT });
+        material.maps[(int)MaterialMap::Roughness] = findMap(source, { aiTextureType_DIFFUSE_ROUGHNESS, aiTextureType_SHININESS }, &roughnessType);
+        material.shininessMap = roughnessType == aiTextureType_SHININESS;
+        material.maps[(int)MaterialMap::Metallic] = findMap(source, { aiTextureType_METALNESS, aiTextureType_REFLECTION });
     }
+}
 
-    if (crossSum.z < 0.0)
+void Mesh::updateToFlipBool()
+{
+    if (windingFlips(*this, uv))
     {
         toFlip = true;
     }
@@ -238,18 +304,45 @@ void Mesh::updateToFlipBool()
 
 bool Mesh::importOBJ(const char* fileName)
 {
+    MemoryStats::BeginImport();
     Assimp::Importer importer;
     const aiScene* scene = importer.ReadFile(fileName, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_GenNormals);
 
     if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
     {
         std::cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << std::endl;
+        MemoryStats::EndImport();
         return false;
     }
 
+    std::string path(fileName);
+    size_t slash = path.find_last_of("/\\");
+    directory = slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
     processNode(scene->mRootNode, scene, *this);
-    std::cout << "Vertices: " << v.size() << std::endl;
+    generation = nextGeneration();
+    convertMaterials(scene, *this);
+    if (f.empty())
+    {
+        std::cout << "ERROR::ASSIMP:: no faces in " << fileName << std::endl;
+        MemoryStats::EndImport();
+        return false;
+    }
+    setupCentroids(*this);
+    analyzeUVChannels(*this);
+    updateBB();
+    buildClusters();
+    // morph bounds of the other channels, built with each of them active in turn
+    for (int c = 1; c < uvChannelCount(); c++)
+    {
+        selectUVChannel(c);
+        buildClusters();
+    }
+    selectUVChannel(0);
+    std::cout << "Vertices: " << pos.size() << ", uv channels: " << uvChannelCount() << ", materials: " << materials.size() << std::endl;
     std::cout << "Indexes: " << f.size() * 3 << std::endl;
+    MemoryStats::EndImport();
+    std::cout << "Import allocations: heap " << MemoryStats::LastImportHeap().count << " (" << MemoryStats::LastImportHeap().bytes / 1024 << " KB)"
+        << ", arena " << MemoryStats::LastImportArena().count << " (" << MemoryStats::LastImportArena().bytes / 1024 << " KB)" << std::endl;
     return true;
 }
 
@@ -6,14 +6,14 @@ void Mesh::exportOBJ(std::string fileName)
 {
 	std::ofstream file(fileName);
 
-	for (int i = 0; i < v.size(); ++i)
+	for (int i = 0; i < pos.size(); ++i)
 	{
-		file << "v " << v[i].pos.x << " " << v[i].pos.y << " " << v[i].pos.z << std::endl;
+		file << "v " << pos[i].x << " " << pos[i].y << " " << pos[i].z << std::endl;
 	}
 
-	for (int i = 0; i < v.size(); ++i)
+	for (int i = 0; i < uv.size(); ++i)
 	{
-		file << "vt " << v[i].uv.x << " " << v[i].uv.y << std::endl;
+		file << "vt " << uv[i].x << " " << uv[i].y << std::endl;
 	}
 
 	for (int i = 0; i < f.size(); ++i)
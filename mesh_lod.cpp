@@ -0,0 +1,49 @@
+#include "mesh.h"
+#include "Arena.h"
+
+#include <algorithm>
+
+BoundingSphere MorphBounds::at(float t) const
+{
+    // |mix(a, b) - mix(ca, cb)| <= mix(|a - ca|, |b - cb|), so the mixed sphere stays conservative
+    BoundingSphere result;
+    result.center = glm::mix(start.center, end.center, t);
+    result.radius = glm::mix(start.radius, end.radius, t);
+    return result;
+}
+
+static BoundingSphere facesSphere(const glm::vec3* p, const Face* faces, int faceCount)
+{
+    return computeBoundingSphere(p, faces[0].vi, (size_t)faceCount * 3);
+}
+
+// Consecutive faces are usually close together in the files we load, so fixed size
+// runs of the index buffer make reasonable clusters and keep drawing them a single range.
+void Mesh::buildClusters(int facesPerCluster)
+{
+    clusters.clear();
+    hasMorphBounds = false;
+    if (f.empty())
+        return;
+
+    ArenaAllocator<glm::vec3> alloc(Arena::Import());
+    ArenaVector<glm::vec3> start(pos.size(), glm::vec3(0.0f), alloc);
+    ArenaVector<glm::vec3> end(pos.size(), glm::vec3(0.0f), alloc);
+    interpolate(0.0f, start.data());
+    interpolate(1.0f, end.data());
+
+    morphBounds.start = facesSphere(start.data(), f.data(), (int)f.size());
+    morphBounds.end = facesSphere(end.data(), f.data(), (int)f.size());
+    hasMorphBounds = true;
+
+    clusters.reserve((f.size() + facesPerCluster - 1) / facesPerCluster);
+    for (int first = 0; first < (int)f.size(); first += facesPerCluster)
+    {
+        MeshCluster cluster;
+        cluster.firstFace = first;
+        cluster.faceCount = std::min(facesPerCluster, (int)f.size() - first);
+        cluster.bounds.start = facesSphere(start.data(), &f[first], cluster.faceCount);
+        cluster.bounds.end = facesSphere(end.data(), &f[first], cluster.faceCount);
+        clusters.push_back(cluster);
+    }
+}
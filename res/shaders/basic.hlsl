@@ -4,21 +4,35 @@
 layout(location = 0) in vec3 pos;
 layout(location = 1) in vec2 uv;
 layout(location = 2) in vec3 a_Normal;
+layout(location = 3) in float a_Corner; // slot of the vertex in its face, see Mesh::cornerSlots
+layout(location = 9) in float a_Material; // texture layer of the material arrays, see Mesh::bake
+
+layout(std140) uniform PassData
+{
+    mat4 u_View;
+    mat4 u_Proj;
+    mat4 u_LightSpace;
+    vec4 u_ViewPos;
+};
 
 uniform mat4 u_Model;
-uniform mat4 u_View;
-uniform mat4 u_Proj;
 uniform mat3 u_NormalMatrix;
 
 out vec2 texCoords;
 out vec3 normal;
 out vec3 fragPos;
+out vec4 fragPosLightSpace;
+out vec3 barycentric;
+flat out float v_Material;
 
 void main()
 {
    texCoords = uv;
+   v_Material = a_Material;
+   barycentric = vec3(equal(vec3(a_Corner), vec3(0.0, 1.0, 2.0)));
    normal = u_NormalMatrix * a_Normal;
-   fragPos = pos;
+   fragPos = vec3(u_Model * vec4(pos, 1.0));
+   fragPosLightSpace = u_LightSpace * vec4(fragPos, 1.0);
 
    mat4 mvp = u_Proj * u_View * u_Model;
    gl_Position = mvp * vec4(pos, 1.0);
@@ -40,31 +54,84 @@ struct DirLight {
     vec3 specular;
 };
 
+layout(std140) uniform PassData
+{
+    mat4 u_View;
+    mat4 u_Proj;
+    mat4 u_LightSpace;
+    vec4 u_ViewPos;
+};
+
 out vec4 color;
 
 in vec2 texCoords;
 in vec3 normal;
 in vec3 fragPos;
+in vec4 fragPosLightSpace;
+in vec3 barycentric;
+flat in float v_Material;
 
 uniform sampler2D u_Texture;
+uniform sampler2DArray u_MaterialColor; // a layer per material, see MaterialTextures
+uniform sampler2DArray u_MaterialOrm;   // ambient occlusion, roughness, metallic
+uniform sampler2D u_PageTable;          // a texel per page of every level, see VirtualTexture
+uniform sampler2D u_VirtualPages;       // the resident pages, PAGE texels and a BORDER on each side
 uniform float u_TextureGridMode;
 uniform float u_TextureColorMode;
 uniform DirLight u_DirLight;
-uniform vec3 u_ViewPos;
 uniform Material material;
+uniform sampler2D u_ShadowMap;
+uniform int u_PcfRadius;        // 0 = a single tap
+uniform float u_ShadowBias;     // depth units, main.cpp derives it from the texel size
+uniform float u_ShadowStrength; // 0 turns shadows off
+uniform samplerBuffer u_FaceAttributes; // one value per face, indexed by gl_PrimitiveID
+uniform mat4 u_DrawParams;              // SurfaceParams, Renderer.h, the same names for the same slots
+#define FACE_OVERLAY u_DrawParams[0].x      // 0 = off, 1 = uv overlap flags, 2 = heatmap
+#define PICKED_FACE u_DrawParams[0].y       // face + 1, 0 = none
+#define HEATMAP_REFERENCE u_DrawParams[0].z
+#define HEATMAP_RANGE u_DrawParams[0].w     // log2
+#define EDGE_BITS u_DrawParams[1].x         // 1 wireframe, 2 seams, 4 borders
+#define EDGE_WIDTH u_DrawParams[1].y        // pixels
+#define USE_MATERIALS u_DrawParams[1].z     // textures from the material arrays instead of u_Texture
+#define USE_VIRTUAL u_DrawParams[1].w       // the color from the virtual texture instead of u_Texture
+#define VIRTUAL_PAGES u_DrawParams[2].xy    // a tile's texels along u and v at level 0, in pages
+#define VIRTUAL_LEVELS u_DrawParams[2].z
+#define VIRTUAL_LOD_BIAS u_DrawParams[2].w
+#define VIRTUAL_TILES u_DrawParams[3].xy    // udim tiles along u and v
+#define VIRTUAL_CACHE_SIZE u_DrawParams[3].z // of u_VirtualPages
+#define VIRTUAL_TILE_PAGES u_DrawParams[3].w // a side of a tile's square in the page table
+uniform samplerBuffer u_FaceEdges;      // UVSeams::faceFlags, indexed by gl_PrimitiveID
 
 const vec4 plainColor = vec4(1.0);
+const float VT_PAGE = 128.0;  // VirtualTexture::PAGE
+const float VT_BORDER = 4.0;  // VirtualTexture::BORDER
 
 // function prototypes
 vec4 calcGridColor(vec2 p, vec4 defaultColor);
-vec3 calcDirLight(DirLight light, vec3 normal, vec3 viewDir, vec4 materialDiffuse);
+vec4 calcFaceOverlay(vec4 defaultColor);
+vec4 calcEdgeOverlay(vec4 defaultColor);
+vec3 calcDirLight(DirLight light, vec3 normal, vec3 viewDir, vec4 materialDiffuse, vec3 orm);
+vec4 sampleVirtual(vec2 uv);
+float calcShadow(vec4 lightSpacePos, vec3 normal, vec3 lightDir);
 
 
 void main()
 {
     vec3 norm = normalize(normal);
-    vec3 viewDir = normalize(u_ViewPos - fragPos);
-    vec4 colTexture = texture(u_Texture, texCoords).rgba;
+    vec3 viewDir = normalize(u_ViewPos.xyz - fragPos);
+    // ambient occlusion, roughness, metallic; without material maps it is plain Blinn-Phong
+    vec3 orm = vec3(1.0, 0.0, 0.0);
+    vec4 colTexture;
+    if (USE_MATERIALS > 0.5)
+    {
+        vec3 layerCoords = vec3(texCoords, floor(v_Material + 0.5));
+        colTexture = texture(u_MaterialColor, layerCoords);
+        orm = texture(u_MaterialOrm, layerCoords).rgb;
+    }
+    else if (USE_VIRTUAL > 0.5)
+        colTexture = sampleVirtual(texCoords);
+    else
+        colTexture = texture(u_Texture, texCoords).rgba;
     colTexture = mix(plainColor, colTexture, u_TextureColorMode);
     vec4 gridTexture = calcGridColor(texCoords, colTexture);
 
@@ -73,7 +140,13 @@ void main()
         gridTexture,
         u_TextureGridMode
     );
-    vec4 dirLight = vec4(calcDirLight(u_DirLight, norm, viewDir, diffuse), 1.0);
+    if (FACE_OVERLAY > 0.5)
+        diffuse = calcFaceOverlay(diffuse);
+    if (int(PICKED_FACE + 0.5) - 1 == gl_PrimitiveID)
+        diffuse = vec4(1.0, 0.8, 0.0, 1.0);
+    if (EDGE_BITS > 0.5)
+        diffuse = calcEdgeOverlay(diffuse);
+    vec4 dirLight = vec4(calcDirLight(u_DirLight, norm, viewDir, diffuse, orm), 1.0);
     color = dirLight;
 };
 
@@ -86,19 +159,128 @@ vec4 calcGridColor(vec2 p, vec4 defaultColor)
     return defaultColor;
 }
 
-vec3 calcDirLight(DirLight light, vec3 normal, vec3 viewDir, vec4 materialDiffuse)
+// mode 1: UVOverlaps::faceFlags bits, 1 overlapping in uv space (red), 2 flipped (blue)
+// mode 2: UVDistortion values, the same diverging colors as the uv layout export
+vec4 calcFaceOverlay(vec4 defaultColor)
+{
+    float value = texelFetch(u_FaceAttributes, gl_PrimitiveID).r;
+    if (FACE_OVERLAY > 1.5)
+    {
+        // log2 of value / reference, blue below, red above, gray where there is no value
+        if (!(value > 0.0))
+            return vec4(0.5, 0.5, 0.5, 1.0);
+        float x = clamp(log2(value / HEATMAP_REFERENCE) / HEATMAP_RANGE, -1.0, 1.0);
+        vec3 end = x < 0.0 ? vec3(0.23, 0.30, 0.75) : vec3(0.71, 0.02, 0.15);
+        return vec4(mix(vec3(0.87), end, abs(x)), 1.0);
+    }
+    int flags = int(value + 0.5);
+    if (flags == 0)
+        return defaultColor;
+    vec4 highlight = vec4((flags & 1) != 0 ? 1.0 : 0.0, 0.0, (flags & 2) != 0 ? 1.0 : 0.0, 1.0);
+    return mix(defaultColor, highlight, 0.75);
+}
+
+// lines from the barycentrics in the same draw, no second pass; edge j runs from corner j
+// to corner j + 1, so it lies where the barycentric of corner j + 2 is 0
+vec4 calcEdgeOverlay(vec4 defaultColor)
+{
+    vec3 pixels = barycentric / max(fwidth(barycentric), vec3(1e-6));
+    int mode = int(EDGE_BITS + 0.5);
+    int flags = int(texelFetch(u_FaceEdges, gl_PrimitiveID).r + 0.5);
+    if ((flags & 64) != 0)
+        return defaultColor;
+    vec4 result = defaultColor;
+    for (int j = 0; j < 3; j++)
+    {
+        bool seam = (mode & 2) != 0 && (flags & (1 << j)) != 0;
+        bool border = (mode & 4) != 0 && (flags & (8 << j)) != 0;
+        if (!seam && !border && (mode & 1) == 0)
+            continue;
+        float halfWidth = EDGE_WIDTH * (seam || border ? 1.0 : 0.5);
+        float coverage = 1.0 - smoothstep(halfWidth - 0.5, halfWidth + 0.5, pixels[(j + 2) % 3]);
+        vec4 lineColor = seam ? vec4(1.0, 0.2, 0.6, 1.0) : border ? vec4(0.1, 0.9, 0.9, 1.0) : vec4(0.05, 0.05, 0.05, 1.0);
+        result = mix(result, lineColor, coverage);
+    }
+    return result;
+}
+
+// in level 0 pages: udim row r is v in [r, r + 1), baked at increasing page y like the flipped
+// rows of an image, its texels from the corner of its square; a single image wraps like
+// u_Texture's GL_REPEAT.
+// Kept in step with vtFeedback.hlsl
+vec2 virtualCoords(vec2 uv)
+{
+    if (VIRTUAL_TILES.x * VIRTUAL_TILES.y < 1.5)
+        uv = fract(uv);
+    vec2 tile = floor(uv);
+    return tile * VIRTUAL_TILE_PAGES + (uv - tile) * VIRTUAL_PAGES;
+}
+
+// from the uvs before the wrap, so the level doesn't jump where fract() does
+int virtualLevel(vec2 uv)
+{
+    vec2 texel = uv * VIRTUAL_PAGES * VT_PAGE;
+    vec2 dx = dFdx(texel), dy = dFdy(texel);
+    float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8)) + VIRTUAL_LOD_BIAS;
+    return int(clamp(floor(lod), 0.0, VIRTUAL_LEVELS - 1.0));
+}
+
+// the page table entry of the wanted page names the slot of it or of its nearest resident
+// ancestor, and that page's level; the fragment's place in that page picks the texel
+vec4 sampleVirtual(vec2 uv)
+{
+    vec2 virt = virtualCoords(uv);
+    int level = virtualLevel(uv);
+    if (any(lessThan(virt, vec2(0.0))) || any(greaterThanEqual(virt, VIRTUAL_TILES * VIRTUAL_TILE_PAGES)))
+        return plainColor;
+    ivec2 pages = ivec2(VIRTUAL_TILES * VIRTUAL_TILE_PAGES) >> level;
+    ivec2 page = min(ivec2(virt / exp2(float(level))), pages - 1);
+    vec4 entry = texelFetch(u_PageTable, page, level) * 255.0;
+    if (entry.a < 0.5)
+        return plainColor;
+    vec2 inPage = fract(virt / exp2(floor(entry.b + 0.5)));
+    vec2 texel = floor(entry.rg + 0.5) * (VT_PAGE + 2.0 * VT_BORDER) + VT_BORDER + inPage * VT_PAGE;
+    return textureLod(u_VirtualPages, texel / VIRTUAL_CACHE_SIZE, 0.0);
+}
+
+vec3 calcDirLight(DirLight light, vec3 normal, vec3 viewDir, vec4 materialDiffuse, vec3 orm)
 {
     vec3 lightDir = normalize(-light.direction);
     // diffuse shading
     float diff = max(dot(normal, lightDir), 0.0);
     // specular shading
     vec3 halfwayDir = normalize(lightDir + viewDir);
-    float spec = pow(max(dot(normal, halfwayDir), 0.0), material.shininess);
+    // rough surfaces spread a weaker highlight, metals tint it with their color
+    float spec = pow(max(dot(normal, halfwayDir), 0.0), max(material.shininess * (1.0 - orm.g), 1.0));
     // combine results
-    vec3 ambient = light.ambient * vec3(materialDiffuse);
+    vec3 ambient = light.ambient * vec3(materialDiffuse) * orm.r;
     vec3 diffuse = light.diffuse * diff * vec3(materialDiffuse);
-    vec3 specular = light.specular * spec;
+    vec3 specular = light.specular * spec * (1.0 - orm.g) * mix(vec3(1.0), vec3(materialDiffuse), orm.b);
+    float shadow = calcShadow(fragPosLightSpace, normal, lightDir);
 
-    return (ambient + diffuse + specular);
+    return (ambient + (1.0 - shadow) * (diffuse + specular));
     //return vec4(1.0,1.0,1.0,1.0);
-}
\ No newline at end of file
+}
+
+// fraction of the light blocked, (2r+1)^2 taps of the shadow map around the fragment
+float calcShadow(vec4 lightSpacePos, vec3 normal, vec3 lightDir)
+{
+    vec3 p = lightSpacePos.xyz / lightSpacePos.w * 0.5 + 0.5;
+    if (u_ShadowStrength <= 0.0 || p.z > 1.0)
+        return 0.0;
+
+    // grazing light needs more bias, slopes cover more depth per texel
+    float bias = u_ShadowBias * (1.0 + 4.0 * (1.0 - max(dot(normal, lightDir), 0.0)));
+    vec2 texel = 1.0 / vec2(textureSize(u_ShadowMap, 0));
+    float shadow = 0.0;
+    for (int x = -u_PcfRadius; x <= u_PcfRadius; x++)
+    {
+        for (int y = -u_PcfRadius; y <= u_PcfRadius; y++)
+        {
+            float depth = texture(u_ShadowMap, p.xy + vec2(x, y) * texel).r;
+            shadow += p.z - bias > depth ? 1.0 : 0.0;
+        }
+    }
+    float taps = float((2 * u_PcfRadius + 1) * (2 * u_PcfRadius + 1));
+    return shadow / taps * u_ShadowStrength;
+}
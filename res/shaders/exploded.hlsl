@@ -0,0 +1,40 @@
+#shader vertex
+#version 330 core
+
+// Transform feedback only, like morph.hlsl: one point per face corner, corner k of face i is
+// vertex 3 * i + k. See ExplodedMorph for the frames.
+layout(location = 0) in vec3 a_Start;  // at t = 0
+layout(location = 1) in vec3 a_End;    // at t = 1
+layout(location = 2) in vec3 a_Normal; // unit, at t = 0
+
+uniform samplerBuffer u_FaceAttributes; // per face: rotation; centroid at t = 0, size ratio; centroid at t = 1
+uniform float u_Interpolation;
+
+out vec3 v_Position;
+out vec3 v_Normal;
+
+vec3 rotate(vec4 q, vec3 v)
+{
+    vec3 t = 2.0 * cross(q.xyz, v);
+    return v + q.w * t + cross(q.xyz, t);
+}
+
+void main()
+{
+    int face = gl_VertexID / 3;
+    vec4 rotation = texelFetch(u_FaceAttributes, face * 3);
+    vec4 start = texelFetch(u_FaceAttributes, face * 3 + 1);
+    vec3 end = texelFetch(u_FaceAttributes, face * 3 + 2).xyz;
+    float t = u_Interpolation;
+
+    // slerp from identity: the same axis, a share of the angle
+    float halfAngle = acos(clamp(rotation.w, -1.0, 1.0));
+    float s = sin(halfAngle);
+    vec4 q = s < 1e-6 ? normalize(vec4(rotation.xyz * t, 1.0)) : vec4(rotation.xyz * (sin(t * halfAngle) / s), cos(t * halfAngle));
+
+    // the uv shape turned back into the face's 3D frame and size, mixed with the 3D shape
+    vec3 endShape = rotate(vec4(-rotation.xyz, rotation.w), a_End - end) / start.w;
+    vec3 shape = mix(a_Start - start.xyz, endShape, t) * mix(1.0, start.w, t);
+    v_Position = mix(start.xyz, end, t) + rotate(q, shape);
+    v_Normal = rotate(q, a_Normal);
+};
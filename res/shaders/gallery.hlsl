@@ -0,0 +1,121 @@
+#shader vertex
+#version 330 core
+
+layout(location = 0) in vec3 pos;
+layout(location = 1) in vec2 uv;
+layout(location = 2) in vec3 a_Normal;
+layout(location = 4) in mat4 a_InstanceModel;
+layout(location = 8) in float a_InstanceT;
+
+layout(std140) uniform PassData
+{
+    mat4 u_View;
+    mat4 u_Proj;
+    mat4 u_LightSpace;
+    vec4 u_ViewPos;
+};
+
+uniform mat4 u_DrawParams; // MorphParams, Renderer.h: best rotation, average uv scaling, 1 when the uvs are mirrored
+#define MORPH_ROTATION mat3(u_DrawParams)
+#define MORPH_SCALING u_DrawParams[3].x
+#define MORPH_FLIP u_DrawParams[3].y
+
+out vec2 texCoords;
+out vec3 normal;
+out vec3 fragPos;
+out vec4 fragPosLightSpace;
+
+void main()
+{
+    mat3 bestRotation = MORPH_ROTATION;
+    float u = MORPH_FLIP > 0.5 ? 1.0 - uv.x : uv.x;
+    vec3 target = vec3(u, uv.y, 0.0) * MORPH_SCALING;
+    vec3 morphed = mix(pos * bestRotation, target, a_InstanceT);
+    vec3 morphedNormal = mix(a_Normal * bestRotation, vec3(0.0, 0.0, 1.0), a_InstanceT);
+
+    texCoords = uv;
+    normal = mat3(a_InstanceModel) * morphedNormal;
+    fragPos = vec3(a_InstanceModel * vec4(morphed, 1.0));
+    fragPosLightSpace = u_LightSpace * vec4(fragPos, 1.0);
+    gl_Position = u_Proj * u_View * vec4(fragPos, 1.0);
+};
+
+
+#shader fragment
+#version 330 core
+
+struct DirLight {
+    vec3 direction;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+layout(std140) uniform PassData
+{
+    mat4 u_View;
+    mat4 u_Proj;
+    mat4 u_LightSpace;
+    vec4 u_ViewPos;
+};
+
+out vec4 color;
+
+in vec2 texCoords;
+in vec3 normal;
+in vec3 fragPos;
+in vec4 fragPosLightSpace;
+
+uniform DirLight u_DirLight;
+uniform float u_TextureGridMode;
+uniform sampler2D u_ShadowMap;
+uniform int u_PcfRadius;        // 0 = a single tap
+uniform float u_ShadowBias;     // depth units, main.cpp derives it from the texel size
+uniform float u_ShadowStrength; // 0 turns shadows off
+
+// fraction of the light blocked, (2r+1)^2 taps of the shadow map around the fragment
+float calcShadow(vec4 lightSpacePos, vec3 normal, vec3 lightDir)
+{
+    vec3 p = lightSpacePos.xyz / lightSpacePos.w * 0.5 + 0.5;
+    if (u_ShadowStrength <= 0.0 || p.z > 1.0)
+        return 0.0;
+
+    // grazing light needs more bias, slopes cover more depth per texel
+    float bias = u_ShadowBias * (1.0 + 4.0 * (1.0 - max(dot(normal, lightDir), 0.0)));
+    vec2 texel = 1.0 / vec2(textureSize(u_ShadowMap, 0));
+    float shadow = 0.0;
+    for (int x = -u_PcfRadius; x <= u_PcfRadius; x++)
+    {
+        for (int y = -u_PcfRadius; y <= u_PcfRadius; y++)
+        {
+            float depth = texture(u_ShadowMap, p.xy + vec2(x, y) * texel).r;
+            shadow += p.z - bias > depth ? 1.0 : 0.0;
+        }
+    }
+    float taps = float((2 * u_PcfRadius + 1) * (2 * u_PcfRadius + 1));
+    return shadow / taps * u_ShadowStrength;
+}
+
+vec4 calcGridColor(vec2 p, vec4 defaultColor)
+{
+    const float nCells = 30;
+    vec2 q = fract(p * nCells);
+    if (q.x < 0.1) return vec4(0.8, 0.0, 0.0, 1.0);
+    if (q.y < 0.1) return vec4(0.0, 0.5, 0.0, 1.0);
+    return defaultColor;
+}
+
+void main()
+{
+    vec3 norm = normalize(normal);
+    // the flattened state faces both ways
+    if (!gl_FrontFacing) norm = -norm;
+    vec3 lightDir = normalize(-u_DirLight.direction);
+    vec4 diffuseColor = mix(vec4(1.0), calcGridColor(texCoords, vec4(1.0)), u_TextureGridMode);
+
+    float diff = max(dot(norm, lightDir), 0.0);
+    float shadow = calcShadow(fragPosLightSpace, norm, lightDir);
+    vec3 result = u_DirLight.ambient * vec3(diffuseColor) + (1.0 - shadow) * u_DirLight.diffuse * diff * vec3(diffuseColor);
+    color = vec4(result, 1.0);
+};
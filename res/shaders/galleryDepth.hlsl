@@ -0,0 +1,35 @@
+#shader vertex
+#version 330 core
+layout(location = 0) in vec3 aPos;
+layout(location = 1) in vec2 aUV;
+layout(location = 4) in mat4 a_InstanceModel;
+layout(location = 8) in float a_InstanceT;
+
+layout(std140) uniform PassData
+{
+    mat4 u_View;
+    mat4 u_Proj;
+    mat4 u_LightSpace;
+    vec4 u_ViewPos;
+};
+
+uniform mat4 u_DrawParams; // MorphParams, Renderer.h: best rotation, average uv scaling, 1 when the uvs are mirrored
+#define MORPH_ROTATION mat3(u_DrawParams)
+#define MORPH_SCALING u_DrawParams[3].x
+#define MORPH_FLIP u_DrawParams[3].y
+
+void main()
+{
+    float u = MORPH_FLIP > 0.5 ? 1.0 - aUV.x : aUV.x;
+    vec3 target = vec3(u, aUV.y, 0.0) * MORPH_SCALING;
+    vec3 morphed = mix(aPos * MORPH_ROTATION, target, a_InstanceT);
+    gl_Position = u_Proj * u_View * a_InstanceModel * vec4(morphed, 1.0);
+}
+
+
+#shader fragment
+#version 330 core
+
+void main()
+{
+}
@@ -0,0 +1,29 @@
+#shader vertex
+#version 330 core
+
+// Transform feedback only: one point per vertex, the outputs land in the mesh's
+// position and normal blocks and every pass reads them as plain attributes.
+layout(location = 0) in vec3 pos;
+layout(location = 1) in vec2 uv;
+layout(location = 2) in vec3 a_Normal;
+
+uniform mat4 u_DrawParams; // MorphParams, Renderer.h: best rotation, average uv scaling, 1 when the uvs are mirrored
+#define MORPH_ROTATION mat3(u_DrawParams)
+#define MORPH_SCALING u_DrawParams[3].x
+#define MORPH_FLIP u_DrawParams[3].y
+uniform float u_Interpolation;
+
+out vec3 v_Position;
+out vec3 v_Normal;
+
+void main()
+{
+    mat3 bestRotation = MORPH_ROTATION;
+    float u = MORPH_FLIP > 0.5 ? 1.0 - uv.x : uv.x;
+    vec3 target = vec3(u, uv.y, 0.0) * MORPH_SCALING;
+    v_Position = mix(pos * bestRotation, target, u_Interpolation);
+
+    vec3 blended = mix(a_Normal * bestRotation, vec3(0.0, 0.0, 1.0), u_Interpolation);
+    float len = length(blended);
+    v_Normal = len > 1e-6 ? blended / len : vec3(0.0, 0.0, 1.0);
+};
@@ -32,6 +32,6 @@ float LinearizeDepth(float depth)
 void main()
 {
     float depthValue = texture(depthMap, TexCoords).r;
-    FragColor = vec4(vec3(LinearizeDepth(depthValue) / far_plane), 1.0); // perspective
-    //FragColor = vec4(vec3(depthValue), 1.0); // orthographic
+    //FragColor = vec4(vec3(LinearizeDepth(depthValue) / far_plane), 1.0); // perspective
+    FragColor = vec4(vec3(depthValue), 1.0); // orthographic, the light is directional
 }
\ No newline at end of file
@@ -2,12 +2,19 @@
 #version 330 core
 layout(location = 0) in vec3 aPos;
 
-uniform mat4 lightSpaceMatrix;
+layout(std140) uniform PassData
+{
+    mat4 u_View;
+    mat4 u_Proj;
+    mat4 u_LightSpace;
+    vec4 u_ViewPos;
+};
+
 uniform mat4 u_Model;
 
 void main()
 {
-    gl_Position = lightSpaceMatrix * u_Model * vec4(aPos, 1.0);
+    gl_Position = u_Proj * u_View * u_Model * vec4(aPos, 1.0);
 }
 
 
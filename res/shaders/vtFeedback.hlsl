@@ -0,0 +1,71 @@
+#shader vertex
+#version 330 core
+layout(location = 0) in vec3 pos;
+layout(location = 1) in vec2 uv;
+
+layout(std140) uniform PassData
+{
+    mat4 u_View;
+    mat4 u_Proj;
+    mat4 u_LightSpace;
+    vec4 u_ViewPos;
+};
+
+uniform mat4 u_Model;
+
+out vec2 texCoords;
+
+void main()
+{
+    texCoords = uv;
+    gl_Position = u_Proj * u_View * u_Model * vec4(pos, 1.0);
+}
+
+
+#shader fragment
+#version 330 core
+
+// The page of the virtual texture each pixel samples, see VirtualTexture. Drawn into a small
+// target; VIRTUAL_LOD_BIAS makes up for its size, the level is the one of the full screen.
+// r, g: low bytes of the page's x and y, b: their high nibbles, a: level + 1, 0 = nothing
+
+out vec4 color;
+
+in vec2 texCoords;
+
+uniform mat4 u_DrawParams; // SurfaceParams, Renderer.h; only the virtual texture's slots, named as in basic.hlsl
+#define VIRTUAL_PAGES u_DrawParams[2].xy
+#define VIRTUAL_LEVELS u_DrawParams[2].z
+#define VIRTUAL_LOD_BIAS u_DrawParams[2].w
+#define VIRTUAL_TILES u_DrawParams[3].xy
+#define VIRTUAL_TILE_PAGES u_DrawParams[3].w
+
+const float VT_PAGE = 128.0;
+
+// the same as in basic.hlsl
+vec2 virtualCoords(vec2 uv)
+{
+    if (VIRTUAL_TILES.x * VIRTUAL_TILES.y < 1.5)
+        uv = fract(uv);
+    vec2 tile = floor(uv);
+    return tile * VIRTUAL_TILE_PAGES + (uv - tile) * VIRTUAL_PAGES;
+}
+
+// from the uvs before the wrap, so the level doesn't jump where fract() does
+int virtualLevel(vec2 uv)
+{
+    vec2 texel = uv * VIRTUAL_PAGES * VT_PAGE;
+    vec2 dx = dFdx(texel), dy = dFdy(texel);
+    float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8)) + VIRTUAL_LOD_BIAS;
+    return int(clamp(floor(lod), 0.0, VIRTUAL_LEVELS - 1.0));
+}
+
+void main()
+{
+    vec2 virt = virtualCoords(texCoords);
+    int level = virtualLevel(texCoords);
+    if (any(lessThan(virt, vec2(0.0))) || any(greaterThanEqual(virt, VIRTUAL_TILES * VIRTUAL_TILE_PAGES)))
+        discard;
+    ivec2 page = ivec2(virt / exp2(float(level)));
+    color = vec4(page & 255, (page.x >> 8) | ((page.y >> 8) << 4), level + 1) / 255.0;
+}